@@ -0,0 +1,452 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+// IR decoder replay benchmark.
+// Replay RMT symbol captures through the decoder and codeset lookup, then
+// report accept/reject counts and decoding throughput. Streaming decoder is
+// fed by chunks as received by RMT, and checked against complete decoding.
+// First frames after wake up are replayed with their leading pulse
+// truncated by the wake up latency. Frames are cut where RMT reception ends,
+// on the first level longer than the idle threshold.
+
+#include "command.h"
+#include "ir_decoder.h"
+#include "ir_decoder_codeset.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_LINE_SIZE         256u
+#define BENCH_SYMBOLS_NB_MAX    128u
+#define BENCH_PASS_NB           21u
+#define BENCH_PASS_DURATION_NS  25000000ull
+#define BENCH_CHUNK_SYMBOLS     24u     // RMT half block of ESP32-C3.
+
+// Wake up latencies replayed (reception started late in leading pulse).
+static const uint32_t bench_wake_latencies_us[] = {
+    250u, 500u, 1000u, 2000u, 4000u
+};
+#define BENCH_WAKE_LATENCY_NB \
+    (sizeof(bench_wake_latencies_us) / sizeof(bench_wake_latencies_us[0]))
+
+// Frame kind, as labelled in capture file.
+typedef enum
+{
+    BENCH_KIND_NORMAL = 0,
+    BENCH_KIND_REPEAT,
+    BENCH_KIND_TRUNCATED,
+    BENCH_KIND_NOISE,
+    BENCH_KIND_FOREIGN,
+    BENCH_KIND_NB_MAX
+} bench_kind_t;
+
+// Replay counters.
+typedef struct
+{
+    uint32_t frames;
+    uint32_t accepted;
+    uint32_t rejected;
+    uint32_t commands;
+    uint32_t cut;               // Frames ended early by idle threshold.
+    uint32_t streamed;
+    uint32_t mismatches;
+} bench_stats_t;
+
+// Captured frame.
+typedef struct
+{
+    bench_kind_t kind;
+    uint8_t codeset;
+    bool cut;
+    size_t num_symbols;
+    rmt_symbol_word_t *symbols;
+} bench_frame_t;
+
+// Capture file.
+typedef struct
+{
+    const char *path;
+    size_t frames_nb;
+    bench_frame_t *frames;
+    bench_stats_t stats[BENCH_KIND_NB_MAX];
+    uint32_t wake_frames;       // Normal frames replayed after wake up.
+    uint32_t wake_decoded[BENCH_WAKE_LATENCY_NB];
+} bench_capture_t;
+
+static const char *bench_kind_str[] = {
+    [BENCH_KIND_NORMAL]    = "normal",
+    [BENCH_KIND_REPEAT]    = "repeat",
+    [BENCH_KIND_TRUNCATED] = "truncated",
+    [BENCH_KIND_NOISE]     = "noise",
+    [BENCH_KIND_FOREIGN]   = "foreign",
+};
+
+static uint64_t bench_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static int bench_double_compare(const void *a, const void *b)
+{
+    const double x = *(const double *) a;
+    const double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static bool bench_kind_parse(const char *str, bench_kind_t * const kind)
+{
+    for (size_t i = 0; i < BENCH_KIND_NB_MAX; i++)
+    {
+        size_t len = strlen(bench_kind_str[i]);
+        if ((strncmp(str, bench_kind_str[i], len) == 0)
+            && ((str[len] == '\0') || (str[len] == ' ') || (str[len] == '\n')))
+        {
+            *kind = (bench_kind_t) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Append a new empty frame to capture.
+static bench_frame_t *bench_frame_add(
+    bench_capture_t * const capture, bench_kind_t kind, uint8_t codeset)
+{
+    bench_frame_t *frames = realloc(
+        capture->frames, (capture->frames_nb + 1u) * sizeof(bench_frame_t));
+    if (!frames)
+        return NULL;
+    capture->frames = frames;
+    bench_frame_t * const frame = &frames[capture->frames_nb++];
+    frame->kind = kind;
+    frame->codeset = codeset;
+    frame->cut = false;
+    frame->num_symbols = 0u;
+    frame->symbols = calloc(BENCH_SYMBOLS_NB_MAX, sizeof(rmt_symbol_word_t));
+    return frame->symbols ? frame : NULL;
+}
+
+// Load capture file.
+// Return true on success, false on error.
+static bool bench_capture_load(bench_capture_t * const capture)
+{
+    FILE *file = fopen(capture->path, "r");
+    if (!file)
+    {
+        perror(capture->path);
+        return false;
+    }
+    char line[BENCH_LINE_SIZE];
+    unsigned int line_nb = 0u;
+    int codeset = -1;
+    bench_frame_t *frame = NULL;
+    bool success = true;
+    while (success && fgets(line, sizeof(line), file))
+    {
+        unsigned int level0, duration0, level1, duration1;
+        bench_kind_t kind;
+        line_nb++;
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+        const char *str = line + strspn(line, " \t\r\n");
+        if (*str == '\0')
+            continue;
+        if (sscanf(str, "codeset %d", &codeset) == 1)
+            success = ir_decoder_codeset_get((uint8_t) codeset) != NULL;
+        else if (strncmp(str, "frame ", 6u) == 0)
+        {
+            success = (codeset >= 0) && bench_kind_parse(str + 6, &kind);
+            if (success)
+            {
+                frame = bench_frame_add(capture, kind, (uint8_t) codeset);
+                success = frame != NULL;
+            }
+        }
+        else if (sscanf(str, "{%u, %u} {%u, %u}",
+                    &level0, &duration0, &level1, &duration1) == 4)
+        {
+            success = frame && (frame->num_symbols < BENCH_SYMBOLS_NB_MAX);
+            if (success)
+            {
+                rmt_symbol_word_t * const symbol =
+                    &frame->symbols[frame->num_symbols++];
+                symbol->level0 = level0;
+                symbol->duration0 = duration0;
+                symbol->level1 = level1;
+                symbol->duration1 = duration1;
+            }
+        }
+        else
+            success = false;
+    }
+    if (!success)
+        fprintf(stderr, "%s:%u: invalid capture line\n", capture->path, line_nb);
+    fclose(file);
+    return success;
+}
+
+// Cut frame as received by RMT: reception ends on the first level longer
+// than the idle threshold, whichever the level, with a null duration.
+static void bench_frame_cut(bench_frame_t * const frame)
+{
+    const uint32_t threshold_us = IR_DECODER_THRESHOLD_MAX_NS / 1000u;
+    for (size_t i = 0; i < frame->num_symbols; i++)
+    {
+        rmt_symbol_word_t * const symbol = &frame->symbols[i];
+        if (symbol->duration0 > threshold_us)
+        {
+            symbol->duration0 = 0u;
+            symbol->duration1 = 0u;
+        }
+        else if (symbol->duration1 > threshold_us)
+            symbol->duration1 = 0u;
+        else
+            continue;
+        frame->cut = (i + 1u) < frame->num_symbols;
+        frame->num_symbols = i + 1u;
+        return;
+    }
+}
+
+static void bench_capture_free(bench_capture_t * const capture)
+{
+    for (size_t i = 0; i < capture->frames_nb; i++)
+        free(capture->frames[i].symbols);
+    free(capture->frames);
+}
+
+// Decode one frame and lookup its command.
+static void bench_decode(
+    const bench_frame_t * const frame, bench_stats_t * const stats)
+{
+    const rmt_rx_done_event_data_t event = {
+        .received_symbols = frame->symbols,
+        .num_symbols = frame->num_symbols
+    };
+    ir_frame_t ir_frame;
+    command_t command;
+    stats->frames++;
+    if (ir_decoder_format(&event, &ir_frame))
+    {
+        stats->accepted++;
+        if (((ir_frame.flags & IR_FRAME_FLAG_REPEAT) == 0u)
+            && ir_decoder_codeset_lookup(&ir_frame, &command))
+            stats->commands++;
+    }
+    else
+        stats->rejected++;
+}
+
+// Decode one frame by chunks with streaming decoder, and check result
+// against complete frame decoding.
+static void bench_stream(
+    const bench_frame_t * const frame, bench_stats_t * const stats)
+{
+    const rmt_rx_done_event_data_t event = {
+        .received_symbols = frame->symbols,
+        .num_symbols = frame->num_symbols
+    };
+    ir_decoder_stream_t stream;
+    ir_frame_t stream_frame;
+    ir_frame_t ir_frame;
+    ir_decoder_stream_init(&stream);
+    for (size_t i = 0; i < frame->num_symbols; i += BENCH_CHUNK_SYMBOLS)
+    {
+        const size_t num_symbols = (frame->num_symbols - i < BENCH_CHUNK_SYMBOLS)
+            ? frame->num_symbols - i : BENCH_CHUNK_SYMBOLS;
+        if (ir_decoder_stream_feed(
+                &stream, &frame->symbols[i], num_symbols, &stream_frame))
+            break;
+    }
+    if (stream.state != IR_DECODER_STREAM_DECODED)
+        return;
+    stats->streamed++;
+    if (!ir_decoder_format(&event, &ir_frame)
+        || (stream_frame.protocol != ir_frame.protocol)
+        || (stream_frame.flags != ir_frame.flags)
+        || (stream_frame.address != ir_frame.address)
+        || (stream_frame.command != ir_frame.command))
+        stats->mismatches++;
+}
+
+// Decode normal frame as first frame after wake up, for each latency: its
+// leading pulse is truncated then restored, and result is checked against
+// complete frame decoding.
+static void bench_wake(
+    const bench_frame_t * const frame, bench_capture_t * const capture)
+{
+    ir_frame_t ir_frame;
+    ir_frame_t wake_frame;
+    rmt_symbol_word_t symbols[BENCH_SYMBOLS_NB_MAX];
+    rmt_rx_done_event_data_t event = {
+        .received_symbols = frame->symbols,
+        .num_symbols = frame->num_symbols
+    };
+    if ((frame->kind != BENCH_KIND_NORMAL)
+        || !ir_decoder_format(&event, &ir_frame))
+        return;
+    capture->wake_frames++;
+    event.received_symbols = symbols;
+    for (size_t i = 0; i < BENCH_WAKE_LATENCY_NB; i++)
+    {
+        // Leading pulse entirely missed, frame starts with a space.
+        const uint32_t latency_us = bench_wake_latencies_us[i];
+        if (frame->symbols[0].duration0 <= latency_us)
+            continue;
+        memcpy(symbols, frame->symbols,
+            frame->num_symbols * sizeof(rmt_symbol_word_t));
+        symbols[0].duration0 -= latency_us;
+        ir_decoder_leader_restore(&symbols[0]);
+        if (ir_decoder_format(&event, &wake_frame)
+            && (wake_frame.protocol == ir_frame.protocol)
+            && (wake_frame.address == ir_frame.address)
+            && (wake_frame.command == ir_frame.command))
+            capture->wake_decoded[i]++;
+    }
+}
+
+static void bench_stats_print(
+    const char *name, const char *kind, const bench_stats_t * const stats)
+{
+    printf("%-24s %-10s %8u %8u %8u %8u %8u %8u %8u\n", name, kind,
+        stats->frames, stats->accepted, stats->rejected, stats->commands,
+        stats->cut, stats->streamed, stats->mismatches);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <capture file>...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const size_t captures_nb = (size_t) argc - 1u;
+    bench_capture_t *captures = calloc(captures_nb, sizeof(bench_capture_t));
+    if (!captures)
+        return EXIT_FAILURE;
+    size_t frames_nb = 0u;
+    uint32_t codesets = 0u;
+    for (size_t i = 0; i < captures_nb; i++)
+    {
+        captures[i].path = argv[i + 1];
+        if (!bench_capture_load(&captures[i]))
+            return EXIT_FAILURE;
+        frames_nb += captures[i].frames_nb;
+        for (size_t j = 0; j < captures[i].frames_nb; j++)
+        {
+            bench_frame_cut(&captures[i].frames[j]);
+            codesets |= 1u << captures[i].frames[j].codeset;
+        }
+    }
+    // Enable codesets of all remotes captured.
+    if (!ir_decoder_codeset_init(codesets))
+    {
+        fprintf(stderr, "codesets lookup table failed\n");
+        return EXIT_FAILURE;
+    }
+    if (frames_nb == 0u)
+    {
+        fprintf(stderr, "no frame to replay\n");
+        return EXIT_FAILURE;
+    }
+    // Single replay to report decoding result.
+    bench_stats_t total = { 0 };
+    uint32_t normal_cut = 0u;
+    printf("%-24s %-10s %8s %8s %8s %8s %8s %8s %8s\n",
+        "capture", "kind", "frames", "accepted", "rejected", "commands",
+        "cut", "streamed", "mismatch");
+    for (size_t i = 0; i < captures_nb; i++)
+    {
+        const char *name = strrchr(captures[i].path, '/');
+        name = name ? name + 1 : captures[i].path;
+        for (size_t j = 0; j < captures[i].frames_nb; j++)
+        {
+            const bench_frame_t * const frame = &captures[i].frames[j];
+            captures[i].stats[frame->kind].cut += frame->cut;
+            if (frame->kind == BENCH_KIND_NORMAL)
+                normal_cut += frame->cut;
+            bench_decode(frame, &captures[i].stats[frame->kind]);
+            bench_stream(frame, &captures[i].stats[frame->kind]);
+            bench_wake(frame, &captures[i]);
+        }
+        for (size_t k = 0; k < BENCH_KIND_NB_MAX; k++)
+        {
+            const bench_stats_t * const stats = &captures[i].stats[k];
+            if (stats->frames == 0u)
+                continue;
+            bench_stats_print(name, bench_kind_str[k], stats);
+            total.frames += stats->frames;
+            total.accepted += stats->accepted;
+            total.rejected += stats->rejected;
+            total.commands += stats->commands;
+            total.cut += stats->cut;
+            total.streamed += stats->streamed;
+            total.mismatches += stats->mismatches;
+        }
+    }
+    bench_stats_print("total", "", &total);
+    if (total.mismatches > 0u)
+    {
+        fprintf(stderr, "streaming decoder mismatches\n");
+        return EXIT_FAILURE;
+    }
+    if (normal_cut > 0u)
+    {
+        fprintf(stderr, "normal frames cut by idle threshold\n");
+        return EXIT_FAILURE;
+    }
+    // First frame decoded after wake up (%), by wake up latency.
+    printf("\n%-24s %8s", "wake latency (us)", "frames");
+    for (size_t k = 0; k < BENCH_WAKE_LATENCY_NB; k++)
+        printf(" %8u", (unsigned int) bench_wake_latencies_us[k]);
+    printf("\n");
+    for (size_t i = 0; i < captures_nb; i++)
+    {
+        const char *name = strrchr(captures[i].path, '/');
+        name = name ? name + 1 : captures[i].path;
+        printf("%-24s %8u", name, captures[i].wake_frames);
+        for (size_t k = 0; k < BENCH_WAKE_LATENCY_NB; k++)
+            printf(" %7.1f%%", (captures[i].wake_frames > 0u)
+                ? 100.0 * captures[i].wake_decoded[k]
+                    / captures[i].wake_frames : 0.0);
+        printf("\n");
+    }
+    // Replay all captures by passes of fixed duration, median pass is
+    // reported to filter out scheduling noise of the host.
+    double pass_ns[BENCH_PASS_NB];
+    uint64_t replayed = 0u;
+    for (size_t pass = 0; pass < BENCH_PASS_NB; pass++)
+    {
+        bench_stats_t replay = { 0 };
+        uint64_t elapsed = 0u;
+        const uint64_t start = bench_time_ns();
+        while (elapsed < BENCH_PASS_DURATION_NS)
+        {
+            for (size_t i = 0; i < captures_nb; i++)
+                for (size_t j = 0; j < captures[i].frames_nb; j++)
+                    bench_decode(&captures[i].frames[j], &replay);
+            elapsed = bench_time_ns() - start;
+        }
+        pass_ns[pass] = (double) elapsed / (double) replay.frames;
+        replayed += replay.frames;
+    }
+    qsort(pass_ns, BENCH_PASS_NB, sizeof(double), bench_double_compare);
+    const double ns_per_frame = pass_ns[BENCH_PASS_NB / 2u];
+    printf("\nreplayed %llu frames in %u passes\n",
+        (unsigned long long) replayed, BENCH_PASS_NB);
+    printf("decodes/s: %.0f\n", 1e9 / ns_per_frame);
+    printf("ns/frame:  %.1f (min %.1f, max %.1f)\n",
+        ns_per_frame, pass_ns[0], pass_ns[BENCH_PASS_NB - 1u]);
+    for (size_t i = 0; i < captures_nb; i++)
+        bench_capture_free(&captures[i]);
+    free(captures);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,217 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+// IR codeset database benchmark.
+// Open a database image built by host/tools/codeset_compile.py, check that
+// every record is found and unknown keys are not, then report the lookup
+// time of the database (binary search) next to the one of the built-in
+// codesets table (perfect hash). Last, append learned records to a copy of
+// the image, as the firmware does, and check they are found after reopening.
+
+#include "ir_decoder_codeset.h"
+#include "ir_decoder_database.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_PASS_NB           21u
+#define BENCH_LOOKUP_NB         1000000u
+
+static volatile uint32_t bench_sink;
+
+static uint64_t bench_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static int bench_double_compare(const void *a, const void *b)
+{
+    const double x = *(const double *) a;
+    const double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// Load image from file.
+// Return image on success, NULL on error.
+static uint8_t *bench_load(const char *path, size_t * const size)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    const long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *image = (length > 0) ? malloc((size_t) length) : NULL;
+    if (image && (fread(image, 1u, (size_t) length, file) != (size_t) length))
+    {
+        free(image);
+        image = NULL;
+    }
+    fclose(file);
+    *size = (size_t) length;
+    return image;
+}
+
+// Get key looked up at index, known records and keys next to them.
+static uint32_t bench_key(
+    const ir_decoder_database_t * const database, uint32_t index)
+{
+    const ir_decoder_database_record_t * const record =
+        &database->records[(index >> 1u) % database->records_nb];
+    return record->key + (index & 1u);
+}
+
+// Check records are found, and unknown keys are not.
+// Return true on success, false on error.
+static bool bench_check(const ir_decoder_database_t * const database)
+{
+    uint32_t hits = 0u;
+    uint32_t misses = 0u;
+    for (size_t i = 0; i < database->records_nb; i++)
+    {
+        const ir_decoder_database_record_t * const record =
+            &database->records[i];
+        if (ir_decoder_database_find(database, record->key) == record)
+            hits++;
+        const uint32_t unknown = record->key + 1u;
+        if (((i + 1u) < database->records_nb)
+            && (database->records[i + 1u].key == unknown))
+            continue;
+        if (!ir_decoder_database_find(database, unknown))
+            misses++;
+        else
+            printf("Unknown key found key=0x%08x\n", unknown);
+    }
+    if (ir_decoder_database_find(database, 0u)
+        && (database->records[0].key != 0u))
+        printf("Unknown key found key=0x00000000\n");
+    printf("Records found %u/%zu, unknown keys rejected %u\n",
+        hits, database->records_nb, misses);
+    return hits == database->records_nb;
+}
+
+// Time lookups of the database, and of the built-in codesets table.
+static void bench_lookup(const ir_decoder_database_t * const database)
+{
+    double database_ns[BENCH_PASS_NB];
+    double table_ns[BENCH_PASS_NB];
+    for (uint32_t pass = 0; pass < BENCH_PASS_NB; pass++)
+    {
+        uint32_t found = 0u;
+        uint64_t start = bench_time_ns();
+        for (uint32_t i = 0; i < BENCH_LOOKUP_NB; i++)
+            found += ir_decoder_database_find(database, bench_key(database, i))
+                != NULL;
+        database_ns[pass] =
+            (double) (bench_time_ns() - start) / BENCH_LOOKUP_NB;
+        start = bench_time_ns();
+        for (uint32_t i = 0; i < BENCH_LOOKUP_NB; i++)
+        {
+            const uint32_t key = bench_key(database, i);
+            const ir_frame_t frame = {
+                .protocol = (uint8_t) (key >> 24u),
+                .address = (uint16_t) (key >> 8u),
+                .command = (uint8_t) key,
+            };
+            command_t command;
+            found += ir_decoder_codeset_lookup(&frame, &command);
+        }
+        table_ns[pass] = (double) (bench_time_ns() - start) / BENCH_LOOKUP_NB;
+        bench_sink += found;
+    }
+    qsort(database_ns, BENCH_PASS_NB, sizeof(double), &bench_double_compare);
+    qsort(table_ns, BENCH_PASS_NB, sizeof(double), &bench_double_compare);
+    printf("Lookup database %.1f ns, built-in table %.1f ns (median)\n",
+        database_ns[BENCH_PASS_NB / 2u], table_ns[BENCH_PASS_NB / 2u]);
+}
+
+// Learn keys in a copy of the image: new key, then key overriding a record.
+// Return true on success, false on error.
+static bool bench_learn(const uint8_t *image, size_t size)
+{
+    uint8_t *copy = malloc(size);
+    if (!copy)
+        return false;
+    memcpy(copy, image, size);
+    ir_decoder_database_t database;
+    ir_decoder_database_open(&database, copy, size);
+    const size_t journal_nb = database.journal_nb;
+    const uint32_t keys[] = {
+        IR_DECODER_DATABASE_KEY(IR_PROTOCOL_NB_MAX - 1u, 0xFFFEu, 0xFEu),
+        (database.records_nb > 0u)
+            ? database.records[0].key : IR_DECODER_DATABASE_KEY(0u, 0u, 0u),
+    };
+    bool learned = true;
+    for (uint32_t i = 0; learned && (i < 2u); i++)
+    {
+        const size_t offset = ir_decoder_database_journal_offset(&database);
+        const ir_decoder_database_record_t record = {
+            .key = keys[i],
+            .remote = IR_DECODER_DATABASE_REMOTE_LEARNED,
+            .command = (uint8_t) (COMMAND_NB_MAX - 1u - i),
+            .reserved = 0xFFu,
+        };
+        learned = offset != 0u;
+        if (learned)
+        {
+            memcpy(&copy[offset], &record, sizeof(record));
+            ir_decoder_database_journal_add(&database);
+        }
+    }
+    // Learned records are found again after reopening.
+    for (uint32_t i = 0; learned && (i < 2u); i++)
+    {
+        ir_decoder_database_open(&database, copy, size);
+        const ir_decoder_database_record_t * const record =
+            ir_decoder_database_find(&database, keys[i]);
+        learned = (database.journal_nb == (journal_nb + 2u)) && record
+            && (record->remote == IR_DECODER_DATABASE_REMOTE_LEARNED)
+            && (record->command == (COMMAND_NB_MAX - 1u - i));
+    }
+    printf("Learned keys %s, journal %zu/%zu\n", learned ? "found" : "lost",
+        database.journal_nb, database.journal_max);
+    free(copy);
+    return learned;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <database image>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    size_t size = 0u;
+    uint8_t *image = bench_load(argv[1], &size);
+    if (!image)
+    {
+        fprintf(stderr, "%s: read failed\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    ir_decoder_database_t database;
+    if (!ir_decoder_database_open(&database, image, size))
+    {
+        fprintf(stderr, "%s: not a codeset database\n", argv[1]);
+        free(image);
+        return EXIT_FAILURE;
+    }
+    // Built-in table with all codesets enabled.
+    ir_decoder_codeset_init(UINT32_MAX >> (32u - ir_decoder_codeset_nb));
+    printf("Database %zu bytes, records %zu, learned %zu/%zu\n",
+        size, database.records_nb, database.journal_nb, database.journal_max);
+    printf("Highest protocol %s\n", ir_decoder_protocol_str(
+        ir_decoder_database_protocol_max(&database)));
+    bool success = bench_check(&database);
+    if (database.records_nb > 0u)
+        bench_lookup(&database);
+    success = bench_learn(image, size) && success;
+    free(image);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,345 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+// UPnP sink benchmark.
+// Build SOAP requests of all actions and report bytes and time per request,
+// then send actions to a renderer (see host/tools/renderer_stub.py) and
+// report time per action round trip, with a connection per request, on a
+// persistent connection, and pipelined. Then, compare actions sent per press
+// with renderer state read from renderer, and cached from events. Last, when
+// several renderers are given, compare time per action sent to each renderer
+// in turn with the one of the group (all renderers at once).
+
+#include "upnp_gena.h"
+#include "upnp_http.h"
+#include "upnp_sink.h"
+#include "upnp_soap.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_PASS_NB           21u
+#define BENCH_PASS_DURATION_NS  25000000ull
+#define BENCH_ROUND_TRIP_NB     100u
+#define BENCH_PRESS_NB           20u
+#define BENCH_PRESS_PERIOD_US  20000u
+#define BENCH_PRESS_POLL_NB      10u
+#define BENCH_SUBSCRIBE_MS     2000u
+#define BENCH_GROUP_NB           20u
+#define BENCH_TIMEOUT_MS       2000u   // As executor action deadline.
+
+static volatile char bench_sink;
+
+static uint64_t bench_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static int bench_double_compare(const void *a, const void *b)
+{
+    const double x = *(const double *) a;
+    const double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// Build requests of all actions by passes of fixed duration, median pass is
+// reported to filter out scheduling noise of the host.
+static void bench_build(void)
+{
+    double pass_ns[BENCH_PASS_NB];
+    uint64_t bytes = 0u;
+    uint64_t built = 0u;
+    uint32_t value = 0u;
+    for (size_t pass = 0; pass < BENCH_PASS_NB; pass++)
+    {
+        uint64_t requests = 0u;
+        uint64_t elapsed = 0u;
+        const uint64_t start = bench_time_ns();
+        while (elapsed < BENCH_PASS_DURATION_NS)
+        {
+            for (size_t action = 0; action < UPNP_SOAP_NB_MAX; action++)
+            {
+                upnp_soap_fields_t fields;
+                upnp_http_request_t request;
+                upnp_soap_request(0u, (upnp_soap_action_t) action, 0u,
+                    value++ % 101u, &fields, &request);
+                // Keep request read, so building is not optimised out.
+                bench_sink = fields.instance[0]
+                    + request.parts[request.parts_nb - 1u].data[0];
+                bytes += request.length;
+                requests++;
+            }
+            elapsed = bench_time_ns() - start;
+        }
+        pass_ns[pass] = (double) elapsed / (double) requests;
+        built += requests;
+    }
+    qsort(pass_ns, BENCH_PASS_NB, sizeof(double), bench_double_compare);
+    printf("%-18s %8s\n", "action", "bytes");
+    for (size_t action = 0; action < UPNP_SOAP_NB_MAX; action++)
+    {
+        upnp_soap_fields_t fields;
+        upnp_http_request_t request;
+        upnp_soap_request(0u, (upnp_soap_action_t) action, 0u, 0u, &fields,
+            &request);
+        printf("%-18s %8zu\n",
+            upnp_soap_action_str((upnp_soap_action_t) action),
+            request.length);
+    }
+    printf("\nbuilt %llu requests in %u passes (%llu bytes)\n",
+        (unsigned long long) built, BENCH_PASS_NB, (unsigned long long) bytes);
+    printf("ns/request: %.1f (min %.1f, max %.1f)\n",
+        pass_ns[BENCH_PASS_NB / 2u], pass_ns[0], pass_ns[BENCH_PASS_NB - 1u]);
+}
+
+// Send actions to renderer, each one is a network round trip, with a new
+// connection per action or on a persistent connection.
+// Return time per action in us.
+static double bench_round_trip(bool keep_alive)
+{
+    static const upnp_soap_action_t actions[] = {
+        UPNP_SOAP_PLAY, UPNP_SOAP_SET_VOLUME, UPNP_SOAP_NEXT,
+        UPNP_SOAP_SET_MUTE, UPNP_SOAP_PREVIOUS, UPNP_SOAP_PAUSE,
+    };
+    const size_t actions_nb = sizeof(actions) / sizeof(actions[0]);
+    upnp_http_close_all();
+    const uint64_t start = bench_time_ns();
+    for (size_t i = 0; i < BENCH_ROUND_TRIP_NB; i++)
+    {
+        upnp_sink_send(actions[i % actions_nb], (uint32_t) i % 101u);
+        if (!keep_alive)
+            upnp_http_close_all();
+    }
+    const uint64_t elapsed = bench_time_ns() - start;
+    return (double) elapsed / 1000.0 / (double) BENCH_ROUND_TRIP_NB;
+}
+
+// Process batches of folded actions, pipelined on persistent connection.
+// Return time per action in us.
+static double bench_pipeline(void)
+{
+    const command_action_t action = {
+        .volume = 1, .skip = 1, .play_pause = true, .mute = true
+    };
+    command_action_t actions[UPNP_GROUP_MEMBER_NB] = { action };
+    const uint32_t timeouts_ms[UPNP_GROUP_MEMBER_NB] = { BENCH_TIMEOUT_MS };
+    upnp_http_close_all();
+    // Volume is read once, before timing.
+    upnp_sink_process(actions, timeouts_ms);
+    const uint64_t start = bench_time_ns();
+    for (size_t i = 0; i < (BENCH_ROUND_TRIP_NB / 4u); i++)
+    {
+        actions[0] = action;
+        upnp_sink_process(actions, timeouts_ms);
+    }
+    const uint64_t elapsed = bench_time_ns() - start;
+    return (double) elapsed / 1000.0 / (double) BENCH_ROUND_TRIP_NB;
+}
+
+// Compare round trips of each connection mode.
+// Return true on success, false if an action failed.
+static bool bench_connections(void)
+{
+    upnp_sink_stats_t stats;
+    upnp_http_stats_t http_stats;
+    const double close_us = bench_round_trip(false);
+    const double keep_alive_us = bench_round_trip(true);
+    const double pipeline_us = bench_pipeline();
+    upnp_sink_stats_get(&stats);
+    upnp_http_stats_get(&http_stats);
+    printf("\nsent %u actions (%u failed, %u bytes)\n",
+        stats.actions, stats.failures, stats.bytes);
+    printf("connections: %u opened, %u reused, %u reconnected\n",
+        http_stats.connects, http_stats.reuses, http_stats.reconnects);
+    printf("%-18s %10s\n", "mode", "us/action");
+    printf("%-18s %10.1f\n", "connect-per-req", close_us);
+    printf("%-18s %10.1f\n", "keep-alive", keep_alive_us);
+    printf("%-18s %10.1f\n", "pipelined", pipeline_us);
+    return stats.failures == 0u;
+}
+
+// Process presses needing renderer state (play/pause and volume), only
+// press processing is timed. Response latency percentiles are taken from
+// trace, presses are traced from start of their processing.
+// Return true on success, false if an action failed.
+static bool bench_presses(const char *mode)
+{
+    const command_action_t action = { .volume = 1, .play_pause = true };
+    const uint32_t timeouts_ms[UPNP_GROUP_MEMBER_NB] = { BENCH_TIMEOUT_MS };
+    upnp_sink_stats_t before;
+    upnp_sink_stats_t after;
+    trace_summary_t response;
+    uint64_t elapsed = 0u;
+    bool success = true;
+    trace_reset();
+    upnp_sink_stats_get(&before);
+    for (size_t i = 0; i < BENCH_PRESS_NB; i++)
+    {
+        // Events of previous press are received meanwhile, polled as by
+        // the command task between presses.
+        for (size_t j = 0; j < BENCH_PRESS_POLL_NB; j++)
+        {
+            usleep(BENCH_PRESS_PERIOD_US / BENCH_PRESS_POLL_NB);
+            upnp_sink_poll();
+        }
+        command_action_t actions[UPNP_GROUP_MEMBER_NB] = { action };
+        const uint64_t start = bench_time_ns();
+        actions[0].origin = trace_stamp();
+        success = (upnp_sink_process(actions, timeouts_ms) == 0u) && success;
+        elapsed += bench_time_ns() - start;
+    }
+    upnp_sink_stats_get(&after);
+    trace_summary_get(TRACE_STAGE_RESPONSE, &response);
+    printf("%-18s %10.1f %10.2f %10.2f %8u %8u %8u\n", mode,
+        (double) elapsed / 1000.0 / (double) BENCH_PRESS_NB,
+        (double) (after.actions - before.actions) / (double) BENCH_PRESS_NB,
+        (double) (after.queries - before.queries) / (double) BENCH_PRESS_NB,
+        response.p50_us, response.p95_us, response.p99_us);
+    return success;
+}
+
+// Compare presses with state queried, then with state cached from events.
+// Return true on success, false on error.
+static bool bench_events(const upnp_group_t * const group)
+{
+    upnp_group_t no_events = *group;
+    upnp_gena_stats_t stats;
+    no_events.members[0].av_transport_event_path[0] = '\0';
+    no_events.members[0].rendering_control_event_path[0] = '\0';
+    printf("\n%-18s %10s %10s %10s %8s %8s %8s\n", "state", "us/press",
+        "actions", "queries", "p50", "p95", "p99");
+    if (!upnp_sink_init(&no_events) || !bench_presses("queried"))
+        return false;
+    // Subscriptions are done by polling, then initial events fill cache.
+    uint32_t value;
+    const uint64_t start = bench_time_ns();
+    if (!upnp_sink_init(group))
+        return false;
+    while (!upnp_gena_subscribed()
+        || !upnp_gena_value_get(0u, UPNP_GENA_TRANSPORT_STATE, &value)
+        || !upnp_gena_value_get(0u, UPNP_GENA_VOLUME, &value))
+    {
+        if ((bench_time_ns() - start) > (BENCH_SUBSCRIBE_MS * 1000000ull))
+        {
+            fprintf(stderr, "renderer events not received\n");
+            return false;
+        }
+        // Sockets are ready, or a subscription is due, as in executor.
+        upnp_sink_wait(-1, BENCH_SUBSCRIBE_MS);
+        upnp_sink_poll();
+    }
+    const uint64_t subscribed = bench_time_ns();
+    if (!bench_presses("events"))
+        return false;
+    upnp_gena_stats_get(&stats);
+    printf("subscribed in %.1f ms: %u subscribes, %u renewals, %u events, "
+        "%u failures\n", (double) (subscribed - start) / 1000000.0,
+        stats.subscribes, stats.renewals, stats.events, stats.failures);
+    return true;
+}
+
+// Send actions to all group renderers.
+// Return time per action in us, with mean latency of each renderer.
+static double bench_dispatch(size_t members_nb, double * const latencies_us)
+{
+    upnp_sink_stats_t stats;
+    for (size_t i = 0; i < members_nb; i++)
+        latencies_us[i] = 0.0;
+    const uint64_t start = bench_time_ns();
+    for (size_t i = 0; i < BENCH_GROUP_NB; i++)
+    {
+        upnp_sink_send(UPNP_SOAP_SET_VOLUME, (uint32_t) i % 101u);
+        upnp_sink_stats_get(&stats);
+        for (size_t j = 0; j < members_nb; j++)
+            latencies_us[j] +=
+                (double) stats.member_latencies_us[j] / BENCH_GROUP_NB;
+    }
+    const uint64_t elapsed = bench_time_ns() - start;
+    return (double) elapsed / 1000.0 / (double) BENCH_GROUP_NB;
+}
+
+// Compare actions sent to each group renderer in turn, with actions sent to
+// the group at once.
+// Return true on success, false on error.
+static bool bench_group(const upnp_group_t * const group)
+{
+    upnp_group_t single = { .nb = 1u };
+    double latencies_us[UPNP_GROUP_MEMBER_NB];
+    double sequential_us = 0.0;
+    printf("\n%-18s %10s\n", "renderer", "us/action");
+    for (size_t i = 0; i < group->nb; i++)
+    {
+        single.members[0] = group->members[i];
+        if (!upnp_sink_init(&single))
+            return false;
+        const double member_us = bench_dispatch(1u, latencies_us);
+        char name[32];
+        snprintf(name, sizeof(name), "%s:%u", single.members[0].host,
+            (unsigned int) single.members[0].port);
+        printf("%-18s %10.1f\n", name, member_us);
+        sequential_us += member_us;
+    }
+    if (!upnp_sink_init(group))
+        return false;
+    const double group_us = bench_dispatch(group->nb, latencies_us);
+    printf("%-18s %10.1f\n", "in turn", sequential_us);
+    printf("%-18s %10.1f (", "group", group_us);
+    for (size_t i = 0; i < group->nb; i++)
+        printf("%s%.1f", (i > 0u) ? ", " : "", latencies_us[i]);
+    printf(")\n");
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    upnp_group_t group = { .nb = 1u };
+    const upnp_renderer_t renderer = {
+        .host = "127.0.0.1",
+        .port = 1400u,
+        .av_transport_path = "/MediaRenderer/AVTransport/Control",
+        .rendering_control_path = "/MediaRenderer/RenderingControl/Control",
+        .av_transport_event_path = "/MediaRenderer/AVTransport/Event",
+        .rendering_control_event_path = "/MediaRenderer/RenderingControl/Event"
+    };
+    if ((argc == 2) || (argc > (int) (2u + UPNP_GROUP_MEMBER_NB)))
+    {
+        fprintf(stderr, "usage: %s [<renderer address> <port>...]\n",
+            argv[0]);
+        return EXIT_FAILURE;
+    }
+    // Group renderers have the same address, on different ports.
+    if (argc > 2)
+        group.nb = (uint32_t) argc - 2u;
+    for (size_t i = 0; i < group.nb; i++)
+    {
+        group.members[i] = renderer;
+        if (argc > 2)
+        {
+            snprintf(group.members[i].host, sizeof(group.members[i].host),
+                "%s", argv[1]);
+            group.members[i].port = (uint16_t) atoi(argv[2u + i]);
+        }
+    }
+    const upnp_group_t first = { .members = { group.members[0] }, .nb = 1u };
+    if (!upnp_sink_init(&first))
+    {
+        fprintf(stderr, "renderer configuration invalid\n");
+        return EXIT_FAILURE;
+    }
+    bench_build();
+    // Round trips only when a renderer is given, the first one.
+    if ((argc > 2) && (!bench_connections() || !bench_events(&first)))
+        return EXIT_FAILURE;
+    if ((group.nb > 1u) && !bench_group(&group))
+        return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,149 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+// UPnP discovery benchmark.
+// Compare time to first action of a cold start (SSDP search, description
+// fetch, then action) with the one of a warm start (renderer from cache,
+// action sent at once), then report renderer advertisements.
+
+#include "upnp_description.h"
+#include "upnp_http.h"
+#include "upnp_sink.h"
+#include "upnp_ssdp.h"
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_SEARCH_TIMEOUT_MS     5000u
+#define BENCH_RUN_NB                   5u
+
+static const char * const bench_kind_str[] = {
+    [UPNP_SSDP_RESPONSE] = "response",
+    [UPNP_SSDP_ALIVE] = "alive",
+    [UPNP_SSDP_BYEBYE] = "byebye",
+};
+
+static uint64_t bench_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000ull
+        + (uint64_t) ts.tv_nsec / 1000ull;
+}
+
+// Get renderer configuration from its description, as cached by firmware.
+static void bench_renderer(
+    upnp_renderer_t * const renderer,
+    const upnp_ssdp_message_t * const message,
+    const upnp_description_t * const description)
+{
+    memset(renderer, 0, sizeof(upnp_renderer_t));
+    inet_ntop(AF_INET, &message->location.sin_addr, renderer->host,
+        sizeof(renderer->host));
+    renderer->port = ntohs(message->location.sin_port);
+    const upnp_description_service_t * const av_transport =
+        &description->service_urls[UPNP_SERVICE_AV_TRANSPORT];
+    const upnp_description_service_t * const rendering_control =
+        &description->service_urls[UPNP_SERVICE_RENDERING_CONTROL];
+    strcpy(renderer->av_transport_path, av_transport->control_url);
+    strcpy(renderer->rendering_control_path, rendering_control->control_url);
+    strcpy(renderer->av_transport_event_path, av_transport->event_url);
+    strcpy(renderer->rendering_control_event_path,
+        rendering_control->event_url);
+}
+
+// Cold start: search renderer, fetch its description, then send action.
+// Return true on success, false on error.
+static bool bench_cold(upnp_group_t * const group)
+{
+    static upnp_description_t description;
+    upnp_ssdp_message_t message;
+    upnp_http_close_all();
+    const uint64_t start = bench_time_us();
+    if (!upnp_ssdp_search())
+        return false;
+    do
+    {
+        if (!upnp_ssdp_receive(&message, BENCH_SEARCH_TIMEOUT_MS, -1))
+            return false;
+    } while (message.kind != UPNP_SSDP_RESPONSE);
+    const uint64_t found = bench_time_us();
+    if (!upnp_description_fetch(&description, &message.location,
+            message.path))
+        return false;
+    group->nb = 1u;
+    bench_renderer(&group->members[0], &message, &description);
+    const uint64_t described = bench_time_us();
+    if (!upnp_sink_init(group)
+        || !upnp_sink_send(UPNP_SOAP_GET_VOLUME, 0u))
+        return false;
+    const uint64_t end = bench_time_us();
+    printf("cold  %8.1f ms (search %.1f ms, description %.1f ms, "
+        "action %.1f ms) udn=%s\n",
+        (double) (end - start) / 1000.0, (double) (found - start) / 1000.0,
+        (double) (described - found) / 1000.0,
+        (double) (end - described) / 1000.0, message.udn);
+    return true;
+}
+
+// Warm start: renderer from cache, action sent at once.
+// Return true on success, false on error.
+static bool bench_warm(const upnp_group_t * const group)
+{
+    upnp_http_close_all();
+    const uint64_t start = bench_time_us();
+    if (!upnp_sink_init(group)
+        || !upnp_sink_send(UPNP_SOAP_GET_VOLUME, 0u))
+        return false;
+    printf("warm  %8.1f ms\n", (double) (bench_time_us() - start) / 1000.0);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    upnp_group_t group;
+    upnp_ssdp_message_t message;
+    const uint32_t listen_ms = (argc > 1)
+        ? (uint32_t) strtoul(argv[1], NULL, 10) : 0u;
+    if (!upnp_ssdp_init())
+    {
+        fprintf(stderr, "cannot open SSDP socket\n");
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < BENCH_RUN_NB; i++)
+    {
+        if (!bench_cold(&group) || !bench_warm(&group))
+        {
+            fprintf(stderr, "no renderer found\n");
+            upnp_ssdp_deinit();
+            return EXIT_FAILURE;
+        }
+    }
+    // Advertisements, and late search responses.
+    const uint64_t start = bench_time_us();
+    uint64_t elapsed_ms = 0u;
+    while (elapsed_ms < listen_ms)
+    {
+        if (!upnp_ssdp_receive(
+            &message, listen_ms - (uint32_t) elapsed_ms, -1))
+            break;
+        char host[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &message.location.sin_addr, host, sizeof(host));
+        printf("%-8s %s", bench_kind_str[message.kind], message.udn);
+        if (message.kind != UPNP_SSDP_BYEBYE)
+            printf(" location=%s:%u%s", host,
+                (unsigned int) ntohs(message.location.sin_port),
+                message.path);
+        printf("\n");
+        elapsed_ms = (bench_time_us() - start) / 1000u;
+    }
+    upnp_ssdp_deinit();
+    upnp_http_close_all();
+    return EXIT_SUCCESS;
+}
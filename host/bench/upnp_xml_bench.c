@@ -0,0 +1,217 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+// UPnP XML parser benchmark.
+// Parse a corpus of renderer device descriptions and SOAP responses, fed by
+// chunks of the HTTP connection buffer size, then report extracted values,
+// parser memory (fixed, whatever the document size) and parse throughput.
+
+#include "upnp_description.h"
+#include "upnp_xml.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_CHUNK_SIZE        512u    // HTTP connection buffer size.
+#define BENCH_PASS_NB           21u
+#define BENCH_PASS_DURATION_NS  25000000ull
+#define BENCH_VALUE_SIZE        64u
+
+// SOAP response values, as extracted by UPnP sink.
+static const char * const bench_soap_paths[] = {
+    "GetPositionInfoResponse/Track",
+    "GetVolumeResponse/CurrentVolume",
+    "GetTransportInfoResponse/CurrentTransportState",
+    "UPnPError/errorCode",
+};
+#define BENCH_SOAP_PATH_NB  (sizeof(bench_soap_paths) / sizeof(char *))
+
+// Corpus document.
+typedef struct
+{
+    const char *path;
+    bool description;           // Device description, else SOAP response.
+    char *data;
+    size_t length;
+} bench_document_t;
+
+// SOAP response values found.
+typedef struct
+{
+    char values[BENCH_SOAP_PATH_NB][BENCH_VALUE_SIZE];
+} bench_soap_t;
+
+static volatile uint32_t bench_sink;
+
+static uint64_t bench_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static int bench_double_compare(const void *a, const void *b)
+{
+    const double x = *(const double *) a;
+    const double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// Load document from file, kind is given by file name prefix.
+// Return true on success, false on error.
+static bool bench_load(bench_document_t * const document, const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return false;
+    fseek(file, 0, SEEK_END);
+    const long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    document->path = path;
+    const char *name = strrchr(path, '/');
+    document->description =
+        strncmp(name ? name + 1 : path, "description", 11u) == 0;
+    document->data = malloc((size_t) length);
+    document->length = (size_t) length;
+    const bool success = document->data
+        && (fread(document->data, 1u, document->length, file)
+            == document->length);
+    fclose(file);
+    return success;
+}
+
+static void bench_soap_element(void *context, size_t path, const char *text)
+{
+    bench_soap_t * const soap = (bench_soap_t *) context;
+    snprintf(soap->values[path], BENCH_VALUE_SIZE, "%s", text);
+}
+
+// Parse document by chunks.
+// Return true on success, false if document is malformed or incomplete.
+static bool bench_parse(
+    const bench_document_t * const document,
+    upnp_description_t * const description, bench_soap_t * const soap)
+{
+    upnp_xml_parser_t parser;
+    upnp_xml_parser_t * const xml =
+        document->description ? &description->parser : &parser;
+    if (document->description)
+        upnp_description_init(description, "/description.xml");
+    else
+    {
+        memset(soap, 0, sizeof(bench_soap_t));
+        upnp_xml_init(&parser, bench_soap_paths, BENCH_SOAP_PATH_NB,
+            &bench_soap_element, soap);
+    }
+    for (size_t offset = 0u; offset < document->length;
+        offset += BENCH_CHUNK_SIZE)
+    {
+        const size_t remaining = document->length - offset;
+        if (!upnp_xml_feed(xml, &document->data[offset],
+                (remaining < BENCH_CHUNK_SIZE) ? remaining : BENCH_CHUNK_SIZE))
+            return false;
+    }
+    return upnp_xml_complete(xml)
+        && (!document->description || upnp_description_complete(description));
+}
+
+// Parse document by passes of fixed duration, median pass is reported to
+// filter out scheduling noise of the host.
+// Return parse throughput in MB/s.
+static double bench_throughput(const bench_document_t * const document)
+{
+    static upnp_description_t description;
+    bench_soap_t soap;
+    double pass_mbs[BENCH_PASS_NB];
+    for (size_t pass = 0; pass < BENCH_PASS_NB; pass++)
+    {
+        uint64_t bytes = 0u;
+        uint64_t elapsed = 0u;
+        const uint64_t start = bench_time_ns();
+        while (elapsed < BENCH_PASS_DURATION_NS)
+        {
+            bench_sink += bench_parse(document, &description, &soap);
+            bytes += document->length;
+            elapsed = bench_time_ns() - start;
+        }
+        pass_mbs[pass] = (double) bytes * 1000.0 / (double) elapsed;
+    }
+    qsort(pass_mbs, BENCH_PASS_NB, sizeof(double), bench_double_compare);
+    return pass_mbs[BENCH_PASS_NB / 2u];
+}
+
+// Print values extracted from document.
+static void bench_report(
+    const bench_document_t * const document,
+    const upnp_description_t * const description,
+    const bench_soap_t * const soap)
+{
+    if (document->description)
+    {
+        printf("  name='%s' udn=%s\n", description->name, description->udn);
+        for (size_t i = 0; i < UPNP_SERVICE_NB_MAX; i++)
+        {
+            const upnp_description_service_t * const service =
+                &description->service_urls[i];
+            printf("  %-16s control=%s event=%s\n",
+                (i == UPNP_SERVICE_AV_TRANSPORT)
+                    ? "AVTransport" : "RenderingControl",
+                service->control_url, service->event_url);
+        }
+        return;
+    }
+    for (size_t i = 0; i < BENCH_SOAP_PATH_NB; i++)
+    {
+        if (soap->values[i][0] != '\0')
+            printf("  %s=%s\n", bench_soap_paths[i], soap->values[i]);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    static upnp_description_t description;
+    bench_soap_t soap;
+    size_t bytes = 0u;
+    size_t largest = 0u;
+    uint32_t failures = 0u;
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <corpus file>...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    printf("%-36s %8s %8s %8s %s\n",
+        "document", "bytes", "state", "MB/s", "result");
+    for (int i = 1; i < argc; i++)
+    {
+        bench_document_t document;
+        if (!bench_load(&document, argv[i]))
+        {
+            fprintf(stderr, "cannot load %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        const bool success = bench_parse(&document, &description, &soap);
+        const size_t state = document.description
+            ? sizeof(upnp_description_t) : sizeof(upnp_xml_parser_t);
+        const char *name = strrchr(document.path, '/');
+        printf("%-36s %8zu %8zu %8.1f %s\n", name ? name + 1 : document.path,
+            document.length, state, bench_throughput(&document),
+            success ? "ok" : "FAILED");
+        bench_report(&document, &description, &soap);
+        failures += !success;
+        bytes += document.length;
+        if (document.length > largest)
+            largest = document.length;
+        free(document.data);
+    }
+    printf("\nparsed %d documents (%zu bytes, largest %zu bytes), "
+        "%u failed\n", argc - 1, bytes, largest, failures);
+    printf("peak memory: %zu bytes (description state %zu, chunk %u)\n",
+        sizeof(upnp_description_t) + BENCH_CHUNK_SIZE,
+        sizeof(upnp_description_t), BENCH_CHUNK_SIZE);
+    return (failures == 0u) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
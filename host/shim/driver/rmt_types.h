@@ -0,0 +1,38 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+// Host shim of ESP-IDF RMT types used by IR decoder.
+
+#ifndef HOST_SHIM_DRIVER_RMT_TYPES_H_
+#define HOST_SHIM_DRIVER_RMT_TYPES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// RMT symbol, same layout as hardware memory word.
+typedef union
+{
+    struct
+    {
+        uint16_t duration0 : 15;
+        uint16_t level0 : 1;
+        uint16_t duration1 : 15;
+        uint16_t level1 : 1;
+    };
+    uint32_t val;
+} rmt_symbol_word_t;
+
+// RMT reception done event data.
+typedef struct
+{
+    rmt_symbol_word_t *received_symbols;
+    size_t num_symbols;
+    struct
+    {
+        uint32_t is_last : 1;
+    } flags;
+} rmt_rx_done_event_data_t;
+
+#endif  // HOST_SHIM_DRIVER_RMT_TYPES_H_
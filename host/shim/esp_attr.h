@@ -0,0 +1,15 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+// Host shim of ESP-IDF memory placement attributes, no placement on host.
+
+#ifndef HOST_SHIM_ESP_ATTR_H_
+#define HOST_SHIM_ESP_ATTR_H_
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define FORCE_INLINE_ATTR static inline __attribute__((always_inline))
+
+#endif  // HOST_SHIM_ESP_ATTR_H_
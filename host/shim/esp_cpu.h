@@ -0,0 +1,24 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+// Host shim of ESP-IDF CPU utilities, cycles are nanoseconds on host.
+
+#ifndef HOST_SHIM_ESP_CPU_H_
+#define HOST_SHIM_ESP_CPU_H_
+
+#include <stdint.h>
+#include <time.h>
+
+typedef uint32_t esp_cpu_cycle_count_t;
+
+static inline esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (esp_cpu_cycle_count_t)
+        ((uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec);
+}
+
+#endif  // HOST_SHIM_ESP_CPU_H_
@@ -0,0 +1,42 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+// Host shim of ESP-IDF logger.
+// Output is disabled by default to keep benchmark free of formatting cost,
+// set HOST_LOG_LEVEL (1: error ... 5: verbose) to enable it.
+
+#ifndef HOST_SHIM_ESP_LOG_H_
+#define HOST_SHIM_ESP_LOG_H_
+
+#include <stdio.h>
+
+#ifndef HOST_LOG_LEVEL
+#define HOST_LOG_LEVEL 0
+#endif
+
+typedef enum
+{
+    ESP_LOG_NONE = 0,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+#define HOST_LOG(level, letter, tag, format, ...) \
+    do \
+    { \
+        if (HOST_LOG_LEVEL >= (level)) \
+            printf(letter " (%s) " format "\n", tag, ##__VA_ARGS__); \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG(1, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG(2, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_LOG(3, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) HOST_LOG(4, "D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) HOST_LOG(5, "V", tag, format, ##__VA_ARGS__)
+
+#endif  // HOST_SHIM_ESP_LOG_H_
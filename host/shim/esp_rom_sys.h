@@ -0,0 +1,18 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+// Host shim of ESP-IDF ROM system functions, see esp_cpu.h shim for cycles.
+
+#ifndef HOST_SHIM_ESP_ROM_SYS_H_
+#define HOST_SHIM_ESP_ROM_SYS_H_
+
+#include <stdint.h>
+
+static inline uint32_t esp_rom_get_cpu_ticks_per_us(void)
+{
+    return 1000u;
+}
+
+#endif  // HOST_SHIM_ESP_ROM_SYS_H_
@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+# MIT License
+# Copyright (c) 2024 William Vallet
+"""Decode deferred binary log records of the firmware console output.
+
+Records are emitted by the binlog drain task as '#BL' lines: level, time,
+tag and format addresses, then raw arguments (hexadecimal). Tag, format and
+string arguments are read from the firmware ELF, so the text is formatted
+here as the ESP-IDF logger would have done. Other lines are copied as they
+are.
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+LINE_PREFIX = "#BL"
+LEVELS = {1: "E", 2: "W", 3: "I", 4: "D", 5: "V"}
+
+SHF_ALLOC = 0x2
+SHT_NOBITS = 8
+
+# printf conversion: flags, width, precision, length and specifier.
+CONVERSION = re.compile(
+    r"%([-+ #0]*)(\d*)(?:\.(\d+))?(hh|h|ll|l|z|j|t)?([diouxXcsp%])")
+
+
+class Elf:
+    """Read-only view of the allocated sections of an ELF file."""
+
+    def __init__(self, path):
+        with open(path, "rb") as elf:
+            self.data = elf.read()
+        if self.data[:4] != b"\x7fELF":
+            raise ValueError("{}: not an ELF file".format(path))
+        wide = self.data[4] == 2
+        endian = "<" if self.data[5] == 1 else ">"
+        if wide:
+            header = struct.unpack_from(endian + "QQQIHHHHHH", self.data, 24)
+            shoff, shentsize, shnum = header[2], header[7], header[8]
+            section = endian + "IIQQQQIIQQ"
+        else:
+            header = struct.unpack_from(endian + "IIIIHHHHHH", self.data, 24)
+            shoff, shentsize, shnum = header[2], header[7], header[8]
+            section = endian + "IIIIIIIIII"
+        # Allocated sections with content: address, offset and size.
+        self.sections = []
+        for i in range(shnum):
+            fields = struct.unpack_from(
+                section, self.data, shoff + i * shentsize)
+            kind, flags, address, offset, size = fields[1:6]
+            if (flags & SHF_ALLOC) and kind != SHT_NOBITS and address:
+                self.sections.append((address, offset, size))
+
+    def string(self, address):
+        """Get string at address, None if not in a section."""
+        for start, offset, size in self.sections:
+            if start <= address < start + size:
+                begin = offset + address - start
+                end = self.data.find(b"\0", begin, offset + size)
+                if end < 0:
+                    end = offset + size
+                return self.data[begin:end].decode("utf-8", "replace")
+        return None
+
+
+def format_record(elf, text, args):
+    """Format text with raw 32 bits arguments, as printf does."""
+    args = list(args)
+
+    def convert(match):
+        flags, width, precision, _, specifier = match.groups()
+        if specifier == "%":
+            return "%"
+        if not args:
+            return match.group(0)
+        value = args.pop(0)
+        spec = "%" + flags + width
+        if precision is not None:
+            spec += "." + precision
+        if specifier in "di":
+            return (spec + "d") % (value - (1 << 32)
+                                   if value & 0x80000000 else value)
+        if specifier == "c":
+            return (spec + "c") % chr(value & 0xFF)
+        if specifier == "s":
+            string = elf.string(value)
+            return (spec + "s") % (string if string is not None
+                                   else "<0x{:08x}>".format(value))
+        if specifier == "p":
+            return (spec + "s") % "0x{:x}".format(value)
+        return (spec + specifier.replace("u", "d")) % value
+
+    return CONVERSION.sub(convert, text)
+
+
+def decode_line(elf, line):
+    """Decode record line, other lines are returned as they are."""
+    if not line.startswith(LINE_PREFIX + " "):
+        return line
+    try:
+        fields = [int(field, 16) for field in line.split()[1:]]
+        level, time_ms, tag, text = fields[:4]
+    except ValueError:
+        return line
+    tag = elf.string(tag)
+    text = elf.string(text)
+    if text is None:
+        return line
+    return "{} ({}) {}: {}\n".format(
+        LEVELS.get(level, "?"), time_ms, tag or "?",
+        format_record(elf, text, fields[4:]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("elf", help="firmware ELF file, as flashed")
+    parser.add_argument("log", nargs="?", type=argparse.FileType("r"),
+                        default=sys.stdin,
+                        help="console output (standard input by default)")
+    args = parser.parse_args()
+    elf = Elf(args.elf)
+    for line in args.log:
+        sys.stdout.write(decode_line(elf, line))
+        sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
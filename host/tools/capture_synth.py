@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+# MIT License
+# Copyright (c) 2024 William Vallet
+"""Synthesise RMT symbol captures for the IR decoder replay benchmark.
+
+Captures use the same symbol layout as the IR decoder verbose log, so a real
+recording can be pasted in place of a synthesised one. Timings follow the
+protocol nominal values with the jitter of a typical IR receiver (marks
+slightly stretched, spaces slightly shortened).
+"""
+
+import argparse
+import random
+import sys
+
+# Remote description: name, codeset ID, protocol, address, codes.
+REMOTES = [
+    ("NEC E553", 0, "nec", 0xFF00, [0x0D, 0x1C, 0x18, 0x04, 0x0C, 0x10]),
+    ("Samsung BN59-01175N", 1, "nec_1", 0x0707,
+        [0x47, 0x45, 0x48, 0x0F, 0x07, 0x0B]),
+    ("Sony TV", 2, "sirc", 0x01, [0x1A, 0x11, 0x10, 0x14, 0x12, 0x13]),
+    ("Philips TV", 3, "rc5", 0x00, [0x35, 0x21, 0x20, 0x0D, 0x10, 0x11]),
+    ("Philips TV", 4, "rc6", 0x00, [0x2C, 0x21, 0x20, 0x0D, 0x10, 0x11]),
+]
+
+# Pulse distance protocol timings in microseconds: leader, repeat, bit mark,
+# zero and one spaces.
+TIMINGS = {
+    "nec": ((9000, 4500), (9000, 2250), 562, 562, 1675),
+    "nec_1": ((4500, 4500), (2250, 2250), 562, 562, 1675),
+}
+
+# Receiver levels.
+MARK = 0
+SPACE = 1
+
+
+class Capture:
+    def __init__(self, rng, jitter):
+        self.rng = rng
+        self.jitter = jitter
+        self.frames = []
+
+    def mark(self, duration):
+        return duration + self.rng.randint(0, self.jitter)
+
+    def space(self, duration):
+        return max(1, duration - self.rng.randint(0, self.jitter))
+
+    def add(self, kind, comment, symbols):
+        self.frames.append((kind, comment, symbols))
+
+    def pulse_distance(self, protocol, address, command):
+        leader, _, mark, zero, one = TIMINGS[protocol]
+        data = address | (command << 16) | ((~command & 0xFF) << 24)
+        symbols = [(self.mark(leader[0]), self.space(leader[1]))]
+        for i in range(32):
+            bit = (data >> i) & 1
+            symbols.append((self.mark(mark), self.space(one if bit else zero)))
+        symbols.append((self.mark(mark), 0))
+        return symbols
+
+    def repeat(self, protocol):
+        _, repeat, mark, _, _ = TIMINGS[protocol]
+        return [(self.mark(repeat[0]), self.space(repeat[1])),
+                (self.mark(mark), 0)]
+
+    def segments(self, segments):
+        """Build symbols from (level, duration) segments starting by a mark,
+        the last space is merged with end of frame idle."""
+        merged = []
+        for level, duration in segments:
+            if merged and merged[-1][0] == level:
+                merged[-1][1] += duration
+            else:
+                merged.append([level, duration])
+        if merged[-1][0] == SPACE:
+            merged.pop()
+        durations = [self.mark(d) if level == MARK else self.space(d)
+                     for level, d in merged] + [0]
+        return list(zip(durations[0::2], durations[1::2]))
+
+    def sirc(self, address, command, bits=12):
+        data = command | (address << 7)
+        symbols = [(self.mark(2400), self.space(600))]
+        for i in range(bits):
+            bit = (data >> i) & 1
+            symbols.append((self.mark(1200 if bit else 600), self.space(600)))
+        symbols[-1] = (symbols[-1][0], 0)
+        return symbols
+
+    def rc5(self, address, command, toggle):
+        bits = [1, 0 if command & 0x40 else 1, toggle]
+        bits += [(address >> i) & 1 for i in range(4, -1, -1)]
+        bits += [(command >> i) & 1 for i in range(5, -1, -1)]
+        halves = []
+        for bit in bits:
+            halves += [(SPACE, 889), (MARK, 889)] if bit else \
+                [(MARK, 889), (SPACE, 889)]
+        # First half of the start bit is merged with idle.
+        return self.segments(halves[1:])
+
+    def rc6(self, address, command, toggle):
+        segments = [(MARK, 2666), (SPACE, 889), (MARK, 444), (SPACE, 444)]
+        segments += [(SPACE, 444), (MARK, 444)] * 3
+        segments += [(MARK, 889), (SPACE, 889)] if toggle else \
+            [(SPACE, 889), (MARK, 889)]
+        data = (address << 8) | command
+        for i in range(15, -1, -1):
+            segments += [(MARK, 444), (SPACE, 444)] if (data >> i) & 1 else \
+                [(SPACE, 444), (MARK, 444)]
+        return self.segments(segments)
+
+    def noise(self):
+        count = self.rng.randint(1, 40)
+        symbols = [(self.rng.randint(20, 3000), self.rng.randint(20, 3000))
+                   for _ in range(count)]
+        return symbols[:-1] + [(symbols[-1][0], 0)]
+
+    def write(self, out, title, codeset):
+        out.write("# Capture: {}\n".format(title))
+        out.write("# One frame per 'frame <kind>' header, followed by its RMT\n")
+        out.write("# symbols '{level0, duration0} {level1, duration1}' in us.\n")
+        out.write("codeset {}\n".format(codeset))
+        for kind, comment, symbols in self.frames:
+            out.write("\nframe {}".format(kind))
+            out.write("  # {}\n".format(comment) if comment else "\n")
+            for duration0, duration1 in symbols:
+                out.write("{{{}, {:5d}}} {{{}, {:5d}}}\n".format(
+                    MARK, duration0, SPACE, duration1))
+
+
+def synthesise(remote, rng, jitter, count):
+    name, codeset, protocol, address, codes = remote
+    capture = Capture(rng, jitter)
+    toggle = 0
+
+    def frame(code, address=address):
+        if protocol == "sirc":
+            return capture.sirc(address, code)
+        if protocol == "rc5":
+            return capture.rc5(address, code, toggle)
+        if protocol == "rc6":
+            return capture.rc6(address, code, toggle)
+        return capture.pulse_distance(protocol, address, code)
+
+    for _ in range(count):
+        for code in codes:
+            toggle ^= 1
+            capture.add("normal", "command=0x{:02X}".format(code), frame(code))
+            # Held key: repeat code, or same frame sent again.
+            for _ in range(2):
+                if protocol in TIMINGS:
+                    capture.add("repeat", None, capture.repeat(protocol))
+                else:
+                    capture.add("repeat", "command=0x{:02X}".format(code),
+                                frame(code))
+    for code in codes:
+        symbols = frame(code)
+        cut = rng.randint(2, len(symbols) - 2)
+        capture.add("truncated", "command=0x{:02X} cut={}".format(code, cut),
+                    symbols[:cut - 1] + [(symbols[cut - 1][0], 0)])
+    for _ in range(len(codes)):
+        capture.add("noise", None, capture.noise())
+    # Valid frames from another remote of the same protocol.
+    foreign = address ^ (0x0101 if protocol == "nec_1" else 0x0002)
+    for code in codes:
+        capture.add("foreign", "address=0x{:04X} command=0x{:02X}".format(
+            foreign, code), frame(code, foreign))
+    title = "{} (codeset {}, {} address=0x{:04X})".format(
+        name, codeset, protocol.upper(), address)
+    return capture, title
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--output", default=".",
+                        help="output directory for capture files")
+    parser.add_argument("--seed", type=int, default=2024)
+    parser.add_argument("--jitter", type=int, default=60,
+                        help="maximum receiver jitter in us")
+    parser.add_argument("--count", type=int, default=4,
+                        help="press count for each command")
+    args = parser.parse_args()
+    for remote in REMOTES:
+        rng = random.Random(args.seed + remote[1])
+        capture, title = synthesise(remote, rng, args.jitter, args.count)
+        path = "{}/codeset_{}.txt".format(args.output, remote[1])
+        with open(path, "w") as out:
+            capture.write(out, title, remote[1])
+        sys.stdout.write("{}: {} frames\n".format(path, len(capture.frames)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+# MIT License
+# Copyright (c) 2024 William Vallet
+"""Compile a codeset list into the codeset database image of the firmware.
+
+Each line of the list describes a remote: protocol, address, then the codes
+of Play/Pause, Previous, Next, Mute, Volume up and Volume down ('-' for a key
+missing). Text after '#' is a comment. Remote ID is the line order of the
+remotes in the list.
+
+The image is flashed in the 'codesets' partition, where the firmware reads
+it in place: header, records sorted by key (binary search), then erased
+space where the keys learned on the board are appended.
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+# Same values as ir_protocol_t.
+PROTOCOLS = {
+    "nec": 0,
+    "nec_1": 1,
+    "samsung32": 2,
+    "sirc": 3,
+    "rc5": 4,
+    "rc6": 5,
+}
+# Same order as command_t.
+COMMANDS = ["Play/Pause", "Previous", "Next", "Mute", "Volume Up",
+            "Volume Down"]
+
+MAGIC = 0x42445249
+VERSION = 1
+HEADER = struct.Struct("<IHHII")
+RECORD = struct.Struct("<IHBB")
+PARTITION_SIZE = 0x10000
+JOURNAL_MIN = 64
+
+
+def parse_number(text, maximum, what):
+    value = int(text, 0)
+    if not 0 <= value <= maximum:
+        raise ValueError("{} out of range: {}".format(what, text))
+    return value
+
+
+def parse(lines):
+    """Parse codeset list, return records by key: (remote, command)."""
+    records = {}
+    remote = 0
+    for number, line in enumerate(lines, 1):
+        fields = line.split("#", 1)[0].split()
+        if not fields:
+            continue
+        try:
+            if len(fields) != 2 + len(COMMANDS):
+                raise ValueError("expected protocol, address and {} codes"
+                                 .format(len(COMMANDS)))
+            protocol = PROTOCOLS.get(fields[0].lower())
+            if protocol is None:
+                raise ValueError("unknown protocol: " + fields[0])
+            address = parse_number(fields[1], 0xFFFF, "address")
+            for command, code in enumerate(fields[2:]):
+                if code == "-":
+                    continue
+                key = ((protocol << 24) | (address << 8)
+                       | parse_number(code, 0xFF, "code"))
+                previous = records.get(key)
+                if previous is not None and previous[1] != command:
+                    raise ValueError(
+                        "code {} already {} of remote {}".format(
+                            code, COMMANDS[previous[1]], previous[0]))
+                if previous is None:
+                    records[key] = (remote, command)
+        except ValueError as error:
+            raise ValueError("line {}: {}".format(number, error))
+        remote += 1
+    return records, remote
+
+
+def build(records, size):
+    """Build database image, padded with erased flash."""
+    body = b"".join(RECORD.pack(key, remote, command, 0xFF)
+                    for key, (remote, command) in sorted(records.items()))
+    header = HEADER.pack(MAGIC, VERSION, RECORD.size, len(records),
+                         zlib.crc32(body))
+    image = header + body
+    if len(image) + JOURNAL_MIN * RECORD.size > size:
+        raise ValueError("{} records do not fit in {} bytes".format(
+            len(records), size))
+    return image + b"\xff" * (size - len(image))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("codesets", type=argparse.FileType("r"),
+                        help="codeset list")
+    parser.add_argument("image", help="database image written")
+    parser.add_argument("--size", type=lambda text: int(text, 0),
+                        default=PARTITION_SIZE,
+                        help="partition size (default 0x%(default)x)")
+    args = parser.parse_args()
+    try:
+        records, remotes = parse(args.codesets)
+        image = build(records, args.size)
+    except ValueError as error:
+        sys.exit("{}: {}".format(args.codesets.name, error))
+    with open(args.image, "wb") as output:
+        output.write(image)
+    journal = (args.size - HEADER.size) // RECORD.size - len(records)
+    print("{}: {} remotes, {} records, {} keys can be learned".format(
+        args.image, remotes, len(records), journal))
+
+
+if __name__ == "__main__":
+    main()
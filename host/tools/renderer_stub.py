@@ -0,0 +1,441 @@
+#!/usr/bin/env python3
+# MIT License
+# Copyright (c) 2024 William Vallet
+"""Stand-in UPnP renderer for the UPnP sink host benchmark.
+
+Serves the AVTransport and RenderingControl control URLs of the firmware
+default renderer configuration, tracks transport, track, mute and volume
+state, and answers each SOAP action with its SOAP response. The device
+description is served at /description.xml.
+
+Events of both services are served at their event URLs: subscribers get the
+initial event, then a LastChange event after each state change.
+
+With --ssdp, the renderer is also discoverable: it answers SSDP searches of
+MediaRenderer devices, and advertises itself on the multicast group.
+"""
+
+import argparse
+import queue
+import random
+import re
+import signal
+import socket
+import struct
+import sys
+import threading
+import time
+import urllib.request
+import uuid
+from xml.sax.saxutils import escape
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+AV_TRANSPORT_PATH = "/MediaRenderer/AVTransport/Control"
+RENDERING_CONTROL_PATH = "/MediaRenderer/RenderingControl/Control"
+SERVICES = {
+    AV_TRANSPORT_PATH: "urn:schemas-upnp-org:service:AVTransport:1",
+    RENDERING_CONTROL_PATH: "urn:schemas-upnp-org:service:RenderingControl:1",
+}
+
+RESPONSE = (
+    '<?xml version="1.0" encoding="utf-8"?>'
+    '<s:Envelope xmlns:s="http://schemas.xmlsoap.org/soap/envelope/" '
+    's:encodingStyle="http://schemas.xmlsoap.org/soap/encoding/">'
+    '<s:Body><u:{action}Response xmlns:u="{service}">{args}'
+    '</u:{action}Response></s:Body></s:Envelope>'
+)
+EVENT_PATHS = {
+    path.rsplit("/", 1)[0] + "/Event": path for path in SERVICES
+}
+# Event property is an escaped LastChange document, as sent by renderers.
+EVENT = (
+    '<?xml version="1.0"?>'
+    '<e:propertyset xmlns:e="urn:schemas-upnp-org:event-1-0">'
+    "<e:property><LastChange>{}</LastChange></e:property></e:propertyset>"
+)
+LAST_CHANGE = {
+    AV_TRANSPORT_PATH: (
+        '<Event xmlns="urn:schemas-upnp-org:metadata-1-0/AVT/">'
+        '<InstanceID val="0"><TransportState val="{state}"/>'
+        '<CurrentTrack val="{track}"/></InstanceID></Event>'),
+    RENDERING_CONTROL_PATH: (
+        '<Event xmlns="urn:schemas-upnp-org:metadata-1-0/RCS/">'
+        '<InstanceID val="0"><Volume channel="LF" val="{volume}"/>'
+        '<Volume channel="Master" val="{volume}"/>'
+        '<Mute channel="Master" val="{mute}"/></InstanceID></Event>'),
+}
+EVENT_TIMEOUT_S = 300
+# Chunk size of response bodies sent in chunks.
+CHUNK_SIZE = 100
+SSDP_ADDRESS = "239.255.255.250"
+SSDP_PORT = 1900
+UDN = "uuid:5f0a3e62-0c1d-4b8e-9a47-2d6c8e1f3b90"
+DEVICE_TYPE = "urn:schemas-upnp-org:device:MediaRenderer:1"
+
+DESCRIPTION_PATH = "/description.xml"
+DESCRIPTION = (
+    '<?xml version="1.0" encoding="utf-8"?>'
+    '<root xmlns="urn:schemas-upnp-org:device-1-0">'
+    "<specVersion><major>1</major><minor>0</minor></specVersion>"
+    "<device>"
+    "<deviceType>urn:schemas-upnp-org:device:MediaRenderer:1</deviceType>"
+    "<friendlyName>Renderer stub</friendlyName>"
+    "<UDN>" + UDN + "</UDN>"
+    "<serviceList>{services}</serviceList>"
+    "</device></root>"
+)
+DESCRIPTION_SERVICE = (
+    "<service><serviceType>{service}</serviceType>"
+    "<controlURL>{path}</controlURL>"
+    "<eventSubURL>{event}</eventSubURL></service>"
+)
+
+# Track metadata is an escaped DIDL-Lite document, as sent by renderers.
+POSITION_INFO = (
+    "<Track>{track}</Track><TrackDuration>0:03:41</TrackDuration>"
+    "<TrackMetaData>&lt;DIDL-Lite xmlns=&quot;urn:schemas-upnp-org:"
+    "metadata-1-0/DIDL-Lite/&quot;&gt;&lt;item id=&quot;{track}&quot; "
+    "parentID=&quot;0&quot; restricted=&quot;1&quot;&gt;&lt;dc:title&gt;"
+    "Track {track}&lt;/dc:title&gt;&lt;upnp:class&gt;object.item.audioItem."
+    "musicTrack&lt;/upnp:class&gt;&lt;/item&gt;&lt;/DIDL-Lite&gt;"
+    "</TrackMetaData><TrackURI>http://192.168.1.2:8200/{track}.flac"
+    "</TrackURI><RelTime>0:01:12</RelTime><AbsTime>NOT_IMPLEMENTED</AbsTime>"
+    "<RelCount>2147483647</RelCount><AbsCount>2147483647</AbsCount>"
+)
+TRANSPORT_INFO = (
+    "<CurrentTransportState>{state}</CurrentTransportState>"
+    "<CurrentTransportStatus>OK</CurrentTransportStatus>"
+    "<CurrentSpeed>1</CurrentSpeed>"
+)
+
+
+class Renderer:
+    def __init__(self):
+        self.state = "STOPPED"
+        self.track = 1
+        self.mute = 0
+        self.volume = 20
+        self.actions = 0
+
+    def argument(self, body, name):
+        match = re.search(r"<{0}>([^<]*)</{0}>".format(name), body)
+        return match.group(1) if match else None
+
+    def process(self, action, body):
+        """Apply action, return response arguments or None if invalid."""
+        self.actions += 1
+        if action == "Play":
+            self.state = "PLAYING"
+        elif action == "Pause":
+            self.state = "PAUSED_PLAYBACK"
+        elif action == "Next":
+            self.track += 1
+        elif action == "Previous":
+            self.track = max(1, self.track - 1)
+        elif action == "Seek":
+            if self.argument(body, "Unit") != "TRACK_NR":
+                return None
+            self.track = int(self.argument(body, "Target"))
+        elif action == "GetPositionInfo":
+            return POSITION_INFO.format(track=self.track)
+        elif action == "GetTransportInfo":
+            return TRANSPORT_INFO.format(state=self.state)
+        elif action == "SetMute":
+            self.mute = int(self.argument(body, "DesiredMute"))
+        elif action == "SetVolume":
+            self.volume = int(self.argument(body, "DesiredVolume"))
+        elif action == "GetVolume":
+            return "<CurrentVolume>{}</CurrentVolume>".format(self.volume)
+        else:
+            return None
+        return ""
+
+
+class Events(threading.Thread):
+    """Event subscriptions, events are sent in order by a single sender."""
+
+    def __init__(self, renderer, verbose):
+        super().__init__(daemon=True)
+        self.renderer = renderer
+        self.verbose = verbose
+        self.lock = threading.Lock()
+        self.subscriptions = {}
+        self.pending = queue.Queue()
+
+    def subscribe(self, path, callback):
+        sid = "uuid:{}".format(uuid.uuid4())
+        with self.lock:
+            self.subscriptions[sid] = {
+                "path": path, "callback": callback, "seq": 0}
+        return sid
+
+    def renew(self, sid):
+        with self.lock:
+            return sid in self.subscriptions
+
+    def unsubscribe(self, sid):
+        with self.lock:
+            return self.subscriptions.pop(sid, None) is not None
+
+    def notify(self, sid=None, path=None):
+        """Queue event of one subscription, or of all subscriptions of a
+        service control path."""
+        with self.lock:
+            sids = [sid] if sid else [
+                key for key, value in self.subscriptions.items()
+                if value["path"] == path]
+        for key in sids:
+            self.pending.put(key)
+
+    def send(self, sid):
+        with self.lock:
+            subscription = self.subscriptions.get(sid)
+            if not subscription:
+                return
+            seq = subscription["seq"]
+            subscription["seq"] = (seq + 1) if seq < 0xffffffff else 1
+        renderer = self.renderer
+        last_change = LAST_CHANGE[subscription["path"]].format(
+            state=renderer.state, track=renderer.track,
+            volume=renderer.volume, mute=renderer.mute)
+        body = EVENT.format(escape(last_change)).encode("utf-8")
+        request = urllib.request.Request(
+            subscription["callback"], data=body, method="NOTIFY", headers={
+                "Content-Type": 'text/xml; charset="utf-8"',
+                "NT": "upnp:event", "NTS": "upnp:propchange",
+                "SID": sid, "SEQ": str(seq)})
+        try:
+            with urllib.request.urlopen(request, timeout=2) as response:
+                status = response.status
+        except Exception as error:
+            status = getattr(error, "code", error)
+        if self.verbose:
+            sys.stderr.write("event {} seq={} status={}\n".format(
+                sid, seq, status))
+
+    def run(self):
+        while True:
+            self.send(self.pending.get())
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    # Responses are sent at once and without delay, as most renderers do.
+    wbufsize = -1
+    disable_nagle_algorithm = True
+    renderer = Renderer()
+    events = None
+    delay = 0.0
+    chunked = False
+    verbose = False
+
+    def send_body(self, body):
+        """End header and send body, in chunks if asked so."""
+        if not self.chunked:
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+            return
+        self.send_header("Transfer-Encoding", "chunked")
+        self.end_headers()
+        data = b""
+        for i in range(0, len(body), CHUNK_SIZE):
+            chunk = body[i:i + CHUNK_SIZE]
+            data += b"%x\r\n%s\r\n" % (len(chunk), chunk)
+        self.wfile.write(data + b"0\r\n\r\n")
+
+    def do_GET(self):
+        if self.path != DESCRIPTION_PATH:
+            self.send_error(404, "Not found")
+            return
+        services = "".join(
+            DESCRIPTION_SERVICE.format(service=service, path=path,
+                                       event=path.rsplit("/", 1)[0] + "/Event")
+            for path, service in SERVICES.items())
+        response = DESCRIPTION.format(services=services).encode("utf-8")
+        self.send_response(200)
+        self.send_header("Content-Type", 'text/xml; charset="utf-8"')
+        self.send_body(response)
+
+    def do_SUBSCRIBE(self):
+        path = EVENT_PATHS.get(self.path)
+        sid = self.headers.get("SID")
+        callback = re.match(r"<(http://[^>]+)>",
+                            self.headers.get("CALLBACK", ""))
+        if not path:
+            self.send_error(404, "Not found")
+            return
+        if sid:
+            if not self.events.renew(sid):
+                self.send_error(412, "Precondition Failed")
+                return
+        elif callback and (self.headers.get("NT") == "upnp:event"):
+            sid = self.events.subscribe(path, callback.group(1))
+        else:
+            self.send_error(412, "Precondition Failed")
+            return
+        self.send_response(200)
+        self.send_header("SID", sid)
+        self.send_header("TIMEOUT", "Second-{}".format(EVENT_TIMEOUT_S))
+        self.send_header("Content-Length", "0")
+        self.end_headers()
+        # Initial event is sent once subscription is accepted.
+        if not self.headers.get("SID"):
+            self.events.notify(sid=sid)
+
+    def do_UNSUBSCRIBE(self):
+        if not self.events.unsubscribe(self.headers.get("SID")):
+            self.send_error(412, "Precondition Failed")
+            return
+        self.send_response(200)
+        self.send_header("Content-Length", "0")
+        self.end_headers()
+
+    def do_POST(self):
+        service = SERVICES.get(self.path)
+        length = int(self.headers.get("Content-Length", 0))
+        body = self.rfile.read(length).decode("utf-8", "replace")
+        soap_action = self.headers.get("SOAPACTION", "").strip('"')
+        service_type, _, action = soap_action.partition("#")
+        args = None
+        if service and (service_type == service):
+            args = self.renderer.process(action, body)
+        if (args == "") and not action.startswith("Get"):
+            self.events.notify(path=self.path)
+        if self.delay:
+            time.sleep(self.delay)
+        if args is None:
+            self.send_error(500, "Invalid action")
+            return
+        response = RESPONSE.format(
+            action=action, service=service, args=args).encode("utf-8")
+        self.send_response(200)
+        self.send_header("Content-Type", 'text/xml; charset="utf-8"')
+        self.send_body(response)
+
+    def log_message(self, format, *args):
+        if self.verbose:
+            sys.stderr.write("{} {} volume={} mute={} track={}\n".format(
+                self.address_string(), format % args, self.renderer.volume,
+                self.renderer.mute, self.renderer.track))
+
+
+class Ssdp(threading.Thread):
+    """SSDP responder and advertiser of the renderer."""
+
+    def __init__(self, address, port, notify_s, verbose):
+        super().__init__(daemon=True)
+        self.location = "http://{}:{}{}".format(address, port, DESCRIPTION_PATH)
+        self.notify_s = notify_s
+        self.verbose = verbose
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, 2)
+        self.sock.bind(("", SSDP_PORT))
+        self.sock.setsockopt(
+            socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP,
+            struct.pack("4s4s", socket.inet_aton(SSDP_ADDRESS),
+                        socket.inet_aton("0.0.0.0")))
+
+    def log(self, message):
+        if self.verbose:
+            sys.stderr.write("ssdp {}\n".format(message))
+
+    def notify(self, nts):
+        message = (
+            "NOTIFY * HTTP/1.1\r\n"
+            "HOST: {}:{}\r\n"
+            "CACHE-CONTROL: max-age=1800\r\n"
+            "LOCATION: {}\r\n"
+            "NT: {}\r\n"
+            "NTS: {}\r\n"
+            "SERVER: Linux/5 UPnP/1.0 renderer-stub/1.0\r\n"
+            "USN: {}::{}\r\n"
+            "\r\n").format(SSDP_ADDRESS, SSDP_PORT, self.location,
+                           DEVICE_TYPE, nts, UDN, DEVICE_TYPE)
+        self.sock.sendto(message.encode("ascii"), (SSDP_ADDRESS, SSDP_PORT))
+        self.log(nts)
+
+    def respond(self, request, source):
+        headers = dict(
+            (name.strip().upper(), value.strip())
+            for name, _, value in (
+                line.partition(":") for line in request.split("\r\n")[1:]))
+        if headers.get("ST") not in ("ssdp:all", "upnp:rootdevice",
+                                     DEVICE_TYPE, UDN):
+            return
+        # Response is delayed randomly up to MX, as devices do.
+        time.sleep(random.uniform(0, min(int(headers.get("MX", "1")), 5)))
+        response = (
+            "HTTP/1.1 200 OK\r\n"
+            "CACHE-CONTROL: max-age=1800\r\n"
+            "EXT:\r\n"
+            "LOCATION: {}\r\n"
+            "SERVER: Linux/5 UPnP/1.0 renderer-stub/1.0\r\n"
+            "ST: {}\r\n"
+            "USN: {}::{}\r\n"
+            "\r\n").format(self.location, DEVICE_TYPE, UDN, DEVICE_TYPE)
+        self.sock.sendto(response.encode("ascii"), source)
+        self.log("response to {}:{}".format(*source))
+
+    def run(self):
+        self.notify("ssdp:alive")
+        next_notify = time.monotonic() + self.notify_s
+        while True:
+            self.sock.settimeout(max(0.0, next_notify - time.monotonic()))
+            try:
+                data, source = self.sock.recvfrom(1024)
+            except socket.timeout:
+                self.notify("ssdp:alive")
+                next_notify = time.monotonic() + self.notify_s
+                continue
+            request = data.decode("ascii", "replace")
+            if request.startswith("M-SEARCH * HTTP/1.1"):
+                threading.Thread(target=self.respond, args=(request, source),
+                                 daemon=True).start()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--address", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=1400)
+    parser.add_argument("--delay-ms", type=int, default=0,
+                        help="response delay, to emulate a slow renderer")
+    parser.add_argument("--idle-timeout-ms", type=int, default=0,
+                        help="close connections idle for this long")
+    parser.add_argument("--ssdp", action="store_true",
+                        help="answer SSDP searches and advertise renderer")
+    parser.add_argument("--notify-s", type=int, default=30,
+                        help="advertisement period of renderer")
+    parser.add_argument("--chunked", action="store_true",
+                        help="send response bodies in chunks")
+    parser.add_argument("--verbose", action="store_true")
+    args = parser.parse_args()
+    Handler.delay = args.delay_ms / 1000.0
+    Handler.chunked = args.chunked
+    Handler.verbose = args.verbose
+    if args.idle_timeout_ms:
+        Handler.timeout = args.idle_timeout_ms / 1000.0
+    Handler.events = Events(Handler.renderer, args.verbose)
+    Handler.events.start()
+    server = ThreadingHTTPServer((args.address, args.port), Handler)
+    ssdp = None
+    if args.ssdp:
+        ssdp = Ssdp(args.address, args.port, args.notify_s, args.verbose)
+        ssdp.start()
+    # Renderer leaves as well when terminated.
+    signal.signal(signal.SIGTERM, lambda *_: sys.exit(0))
+    sys.stdout.write("renderer listening on {}:{}\n".format(
+        args.address, args.port))
+    sys.stdout.flush()
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if ssdp:
+            ssdp.notify("ssdp:byebye")
+
+
+if __name__ == "__main__":
+    main()
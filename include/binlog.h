@@ -0,0 +1,55 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#ifndef BINLOG_H_
+#define BINLOG_H_
+
+#include "esp_log.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BINLOG_ARGS_NB_MAX      5u
+
+// Deferred binary logger statistics.
+typedef struct
+{
+    uint32_t records;           // Records written.
+    uint32_t drops;             // Records dropped, ring full.
+} binlog_stats_t;
+
+// Log record without formatting, emitted later by drain task. Tag and
+// format are only referenced: they must be string literals, and so must be
+// string arguments (%s). Arguments are 32 bits.
+// Note: not from ISR.
+#define BINLOG(level, tag, format, ...) \
+    do \
+    { \
+        if (binlog_level_get() >= (level)) \
+        { \
+            const uint32_t binlog_args[] = { 0u, ##__VA_ARGS__ }; \
+            binlog_write((level), (tag), (format), &binlog_args[1], \
+                (sizeof(binlog_args) / sizeof(binlog_args[0])) - 1u); \
+        } \
+    } while (0)
+#define BINLOG_D(tag, format, ...) \
+    BINLOG(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define BINLOG_V(tag, format, ...) \
+    BINLOG(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+// Initialise deferred binary logger and its drain task.
+extern void binlog_init(void);
+// Set level of records written (info by default, BINLOG_LEVEL build flag).
+extern void binlog_level_set(esp_log_level_t level);
+// Get level of records written.
+extern esp_log_level_t binlog_level_get(void);
+// Write record in ring, without waiting. Use BINLOG macros instead.
+// Return true on success, false if ring is full.
+extern bool binlog_write(
+    esp_log_level_t level, const char *tag, const char *format,
+    const uint32_t *args, uint32_t args_nb);
+// Get deferred binary logger statistics.
+extern void binlog_stats_get(binlog_stats_t * const stats);
+
+#endif  // BINLOG_H_
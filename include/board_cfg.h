@@ -13,6 +13,7 @@
 
 #define BOARD_LED_FREQUENCY      60
 #define BOARD_LED_DUTY_CYCLE     90
+#define BOARD_LED_DUTY_CYCLE_DIM 10
 #define BOARD_LED_CHANNEL_WIFI    0
 #define BOARD_LED_CHANNEL_BT      1
 #define BOARD_LED_CHANNEL_SOFT    2
@@ -0,0 +1,29 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#ifndef BOOT_H_
+#define BOOT_H_
+
+#include <stdint.h>
+
+// Boot milestones, timed from boot.
+typedef enum
+{
+    BOOT_IR_READY = 0,          // IR decoder receiving.
+    BOOT_LINK_UP,               // Wi-Fi connected, with IP address.
+    BOOT_FIRST_ACTION,          // First action answered by a renderer.
+    BOOT_NB_MAX
+} boot_milestone_t;
+
+// Mark milestone reached now, only its first time is kept (and logged).
+// Note: not from ISR.
+extern void boot_mark(boot_milestone_t milestone);
+// Get time of milestone from boot, in ms.
+// Return time, 0 if milestone is not reached yet.
+extern uint32_t boot_time_get(boot_milestone_t milestone);
+// Dump boot milestones times on console.
+extern void boot_dump(void);
+
+#endif  // BOOT_H_
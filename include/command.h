@@ -6,6 +6,7 @@
 #ifndef COMMAND_H_
 #define COMMAND_H_
 
+#include <stdint.h>
 #include <stdbool.h>
 
 // Control commands supported.
@@ -20,10 +21,46 @@ typedef enum
     COMMAND_NB_MAX
 } command_t;
 
+// Control actions, folded from a batch of commands.
+typedef struct
+{
+    int32_t volume;             // Relative volume steps.
+    int32_t skip;               // Relative tracks (negative for previous).
+    bool play_pause;            // Toggle play/pause (odd number of presses).
+    bool mute;                  // Toggle mute (odd number of presses).
+    uint32_t origin;            // Trace stamp of oldest command folded.
+} command_action_t;
+
+// Command processing statistics.
+typedef struct
+{
+    uint32_t commands;          // Commands received.
+    uint32_t batches;           // Batches of queued commands processed.
+    uint32_t merged;            // Commands merged in another action.
+    uint32_t held;              // Commands held while link was down.
+    uint32_t expired;           // Commands dropped, older than deadline.
+    uint32_t overflows;         // Commands dropped, ring full.
+    uint32_t high_water;        // Most commands waiting in a ring.
+} command_stats_t;
+
 // Initialise command process.
 extern void command_init(void);
-// Push command for processing task.
-// Return true on success, false on error.
-extern bool command_push(command_t cmd);
+// Get command processing statistics.
+extern void command_stats_get(command_stats_t * const stats);
+// Get command name.
+extern const char *command_str(command_t cmd);
+// Set IP link state, commands are held while it is down, and replayed when
+// it comes up (unless too old). Link is down on initialisation.
+extern void command_link_set(bool up);
+// Push command for processing task, without waiting.
+// Origin is the trace stamp of its IR frame, 0 if not traced.
+// Note: single producer, only called from IR decoder task.
+// Return true on success, false if commands are not processed fast enough.
+extern bool command_push(command_t cmd, uint32_t origin);
+// Push command for processing task from ISR, without waiting.
+// Task wakeup is set if a context switch is requested.
+// Return true on success, false if commands are not processed fast enough.
+extern bool command_push_from_isr(
+    command_t cmd, uint32_t origin, bool * const task_wakeup);
 
 #endif  // COMMAND_H_
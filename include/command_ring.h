@@ -0,0 +1,47 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#ifndef COMMAND_RING_H_
+#define COMMAND_RING_H_
+
+#include "command.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define COMMAND_RING_NB         16u     // Power of 2.
+
+// Command ring entry.
+typedef struct
+{
+    uint32_t time_ms;           // Capture time.
+    uint32_t origin;            // Trace stamp of IR frame.
+    command_t command;
+} command_entry_t;
+
+// Command ring, lock-free with single producer and single consumer.
+// Indexes run freely, producer owns head and consumer owns tail.
+typedef struct
+{
+    atomic_uint_least32_t head; // Next entry written by producer.
+    atomic_uint_least32_t tail; // Next entry read by consumer.
+    uint32_t high_water;        // Most entries used (producer side).
+    uint32_t overflows;         // Entries dropped, ring full (producer side).
+    command_entry_t entries[COMMAND_RING_NB];
+} command_ring_t;
+
+// Initialise empty ring.
+extern void command_ring_init(command_ring_t * const ring);
+// Push entry in ring, never waits (producer side).
+// Note: can be called from ISR.
+// Return true on success, false if ring is full.
+extern bool command_ring_push(
+    command_ring_t * const ring, const command_entry_t * const entry);
+// Pop oldest entry from ring (consumer side).
+// Return true on success, false if ring is empty.
+extern bool command_ring_pop(
+    command_ring_t * const ring, command_entry_t * const entry);
+
+#endif  // COMMAND_RING_H_
@@ -7,16 +7,132 @@
 #define IR_DECODER_H_
 
 #include "driver/rmt_types.h"
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
+// IR protocols supported.
+typedef enum
+{
+    IR_PROTOCOL_NEC = 0,        // NEC protocol.
+    IR_PROTOCOL_NEC_1,          // NEC protocol with first pulse shorter.
+    IR_PROTOCOL_SAMSUNG32,      // NEC_1 frame with address byte repeated.
+    IR_PROTOCOL_SIRC,           // Sony SIRC (12, 15 or 20 bits).
+    IR_PROTOCOL_RC5,            // Philips RC5 (and RC5X).
+    IR_PROTOCOL_RC6,            // Philips RC6 mode 0.
+    IR_PROTOCOL_NB_MAX
+} ir_protocol_t;
+
+// End of frame: RMT reception ends once IR line has no edge for this long,
+// whichever its level, so it is above the longest pulse (NEC leading pulse,
+// 9ms) and space, with margin.
+#define IR_DECODER_THRESHOLD_MAX_NS     12000000u
+
+// Frame flags.
+#define IR_FRAME_FLAG_REPEAT    (1u << 0)   // Repeat code, no payload.
+#define IR_FRAME_FLAG_TOGGLE    (1u << 1)   // Toggle bit set (RC5/RC6).
+
+// Decoded IR frame.
+typedef struct
+{
+    uint8_t protocol;           // Protocol (ir_protocol_t).
+    uint8_t flags;              // Frame flags (IR_FRAME_FLAG_*).
+    uint8_t command;            // Command code.
+    uint8_t bits;               // Payload length in bits.
+    uint16_t address;           // Address (device) code.
+} ir_frame_t;
+
+// IR decoder statistics.
+typedef struct
+{
+    uint32_t frames;            // Frames received.
+    uint32_t overruns;          // Frames dropped, no free buffer.
+    uint32_t fast_frames;       // Frames handled in RMT callback.
+    uint32_t callback_cycles;   // CPU cycles of last RMT callback.
+    uint32_t callback_cycles_max;   // CPU cycles of longest RMT callback.
+    uint32_t wakeups;           // Receptions started again by IR line.
+    uint32_t wake_frames;       // First frames decoded after wake up.
+    uint32_t asleep_ms;         // Time with reception stopped.
+} ir_decoder_stats_t;
+
+// Streaming decoder state.
+typedef enum
+{
+    IR_DECODER_STREAM_LEADER = 0,   // Waiting leading code.
+    IR_DECODER_STREAM_DATA,         // Decoding data bits.
+    IR_DECODER_STREAM_DECODED,      // Frame decoded.
+    IR_DECODER_STREAM_FALLBACK      // Frame to decode once complete.
+} ir_decoder_stream_state_t;
+
+// Streaming decoder, consumes symbols as they are received.
+typedef struct
+{
+    uint8_t state;              // Decoding state (ir_decoder_stream_state_t).
+    uint8_t protocol;           // Protocol from leading code.
+    uint8_t bits;               // Data bits decoded.
+    uint32_t data;              // Data bits, LSB first.
+} ir_decoder_stream_t;
+
+// Frame decoder, symbols start with the leading code of the frame.
+// Return true if decoding was successful, else false.
+typedef bool (*ir_decoder_format_t)(
+    const rmt_symbol_word_t * const symbols, size_t num_symbols,
+    ir_frame_t * const frame);
+
+// Remote activity handler, called from IR decoder task on first frame
+// decoded, then about once a second while frames are decoded.
+typedef void (*ir_decoder_activity_handler_t)(void);
+
 // Initialise IR decoder (RMT driver and parsing task).
-extern void ir_decoder_init(uint8_t gpio_num, uint8_t codeset);
-// Event parser for NEC protocol.
-// Enable variant for shorter pulse on beginning for the frame.
+// Codesets is the bit mask of enabled codeset IDs.
+extern void ir_decoder_init(uint8_t gpio_num, uint32_t codesets,
+    ir_decoder_activity_handler_t activity_handler);
+// Get IR decoder reception statistics.
+extern void ir_decoder_stats_get(ir_decoder_stats_t * const stats);
+// Log sleep residency of IR reception, and wake ups.
+extern void ir_decoder_power_dump(void);
+// Event parser, detect protocol from leading code and decode the frame.
 // Return true if parsing was successful, else false.
+extern bool ir_decoder_format(
+    const rmt_rx_done_event_data_t * const event, ir_frame_t * const frame);
+// Reset streaming decoder for a new frame.
+extern void ir_decoder_stream_init(ir_decoder_stream_t * const stream);
+// Feed streaming decoder with next received symbols of the frame.
+// Only NEC family frames (and repeat codes) are decoded before the end of
+// frame, any other frame ends in fallback state and has to be decoded once
+// complete.
+// Note: can be called from ISR.
+// Return true if frame has been decoded by these symbols, else false.
+extern bool ir_decoder_stream_feed(
+    ir_decoder_stream_t * const stream, const rmt_symbol_word_t *symbols,
+    size_t num_symbols, ir_frame_t * const frame);
+// Restore leading pulse of NEC family frame, truncated when reception
+// started during the pulse (first frame after wake up). Pulse is stretched
+// to the nominal duration of the protocol told by its length, so truncation
+// must stay shorter than 4.3ms. Other symbols are left unchanged.
+// Note: can be called from ISR.
+extern void ir_decoder_leader_restore(rmt_symbol_word_t * const symbol);
+// Get protocol name.
+extern const char *ir_decoder_protocol_str(uint8_t protocol);
+// Frame decoder for NEC protocol (9ms leading pulse).
 extern bool ir_decoder_format_nec(
-    const rmt_rx_done_event_data_t * const event, uint16_t * const address,
-    uint8_t * const command, bool variant);
+    const rmt_symbol_word_t * const symbols, size_t num_symbols,
+    ir_frame_t * const frame);
+// Frame decoder for NEC_1 and Samsung32 protocols (4.5ms leading pulse).
+extern bool ir_decoder_format_nec_1(
+    const rmt_symbol_word_t * const symbols, size_t num_symbols,
+    ir_frame_t * const frame);
+// Frame decoder for Sony SIRC protocol.
+extern bool ir_decoder_format_sirc(
+    const rmt_symbol_word_t * const symbols, size_t num_symbols,
+    ir_frame_t * const frame);
+// Frame decoder for Philips RC5 protocol.
+extern bool ir_decoder_format_rc5(
+    const rmt_symbol_word_t * const symbols, size_t num_symbols,
+    ir_frame_t * const frame);
+// Frame decoder for Philips RC6 protocol.
+extern bool ir_decoder_format_rc6(
+    const rmt_symbol_word_t * const symbols, size_t num_symbols,
+    ir_frame_t * const frame);
 
 #endif  // IR_DECODER_H_
@@ -0,0 +1,38 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#ifndef IR_DECODER_CODESET_H_
+#define IR_DECODER_CODESET_H_
+
+#include "command.h"
+#include "ir_decoder.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// IR decoder codeset configuration.
+typedef struct
+{
+    uint8_t protocol;               // Protocol (ir_protocol_t).
+    uint16_t address;               // Remote address.
+    uint8_t codeset[COMMAND_NB_MAX];
+} ir_decoder_codeset_t;
+
+// Number of codesets available.
+extern const size_t ir_decoder_codeset_nb;
+
+// Get codeset configuration from its ID.
+// Return codeset on success, NULL if ID is unknown.
+extern const ir_decoder_codeset_t *ir_decoder_codeset_get(uint8_t codeset);
+// Build lookup table of enabled codesets (bit mask of codeset IDs).
+// Return true on success, false if codesets are conflicting.
+extern bool ir_decoder_codeset_init(uint32_t codesets);
+// Lookup command key of decoded frame in enabled codesets.
+// Note: can be called from ISR.
+// Return true if command is found, else false.
+extern bool ir_decoder_codeset_lookup(
+    const ir_frame_t * const frame, command_t * const cmd);
+
+#endif  // IR_DECODER_CODESET_H_
@@ -0,0 +1,74 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#ifndef IR_DECODER_DATABASE_H_
+#define IR_DECODER_DATABASE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Codeset database image, built by host/tools/codeset_compile.py: header,
+// records sorted by key, then journal of learned records in erased space
+// (little endian).
+#define IR_DECODER_DATABASE_MAGIC           0x42445249u     // "IRDB".
+#define IR_DECODER_DATABASE_VERSION         1u
+// Record key: protocol, address and IR command.
+#define IR_DECODER_DATABASE_KEY(protocol, address, command) \
+    (((uint32_t) (protocol) << 24u) | ((uint32_t) (address) << 8u) \
+        | (uint32_t) (command))
+#define IR_DECODER_DATABASE_KEY_FREE        0xFFFFFFFFu     // Erased record.
+#define IR_DECODER_DATABASE_REMOTE_LEARNED  0xFFFFu
+
+// Codeset database image header.
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;       // Size of a record.
+    uint32_t records_nb;        // Sorted records following header.
+    uint32_t crc;               // CRC-32 of sorted records.
+} ir_decoder_database_header_t;
+
+// Codeset database record.
+typedef struct
+{
+    uint32_t key;
+    uint16_t remote;            // Remote ID, in codeset list.
+    uint8_t command;            // Command (command_t).
+    uint8_t reserved;
+} ir_decoder_database_record_t;
+
+// Codeset database, read in place from its image.
+typedef struct
+{
+    const ir_decoder_database_record_t *records;
+    size_t records_nb;
+    const ir_decoder_database_record_t *journal;
+    size_t journal_nb;          // Records learned.
+    size_t journal_max;         // Records fitting in image after sorted ones.
+} ir_decoder_database_t;
+
+// Open codeset database image, which is not copied.
+// Return true on success, false if image is not valid.
+extern bool ir_decoder_database_open(ir_decoder_database_t * const database,
+    const void *image, size_t size);
+// Find record of key, learned records override sorted ones.
+// Return record on success, NULL if key is unknown.
+extern const ir_decoder_database_record_t *ir_decoder_database_find(
+    const ir_decoder_database_t * const database, uint32_t key);
+// Get highest protocol of records, learned ones included.
+// Return protocol (ir_protocol_t), 0 if database is empty.
+extern uint8_t ir_decoder_database_protocol_max(
+    const ir_decoder_database_t * const database);
+// Get image offset of next record learned.
+// Return offset on success, 0 if journal is full.
+extern size_t ir_decoder_database_journal_offset(
+    const ir_decoder_database_t * const database);
+// Account record written at journal offset.
+extern void ir_decoder_database_journal_add(
+    ir_decoder_database_t * const database);
+
+#endif  // IR_DECODER_DATABASE_H_
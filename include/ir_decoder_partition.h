@@ -0,0 +1,34 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#ifndef IR_DECODER_PARTITION_H_
+#define IR_DECODER_PARTITION_H_
+
+#include "command.h"
+#include "ir_decoder.h"
+#include <stdbool.h>
+
+// Map codeset database of flash partition, an erased partition is
+// initialised empty (learned records only).
+// Return true on success, false if partition is missing or not valid.
+extern bool ir_decoder_partition_init(void);
+// Lookup command key of decoded frame in codeset database.
+// Note: not from ISR, database is read from flash.
+// Return true if command is found, else false.
+extern bool ir_decoder_partition_lookup(
+    const ir_frame_t * const frame, command_t * const cmd);
+// Get highest protocol of codeset database records, learned ones included.
+// Note: only called from IR decoder task.
+// Return protocol (ir_protocol_t), 0 if database is not mapped.
+extern uint8_t ir_decoder_partition_protocol_max(void);
+// Start learning mode: next unknown frames are recorded as keys of each
+// command in turn.
+extern void ir_decoder_partition_learn_start(void);
+// Record unknown frame as key of command learned, if learning.
+// Note: only called from IR decoder task.
+// Return true if frame is learned, else false.
+extern bool ir_decoder_partition_learn(const ir_frame_t * const frame);
+
+#endif  // IR_DECODER_PARTITION_H_
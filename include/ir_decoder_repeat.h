@@ -0,0 +1,53 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#ifndef IR_DECODER_REPEAT_H_
+#define IR_DECODER_REPEAT_H_
+
+#include "command.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+// Auto-repeat policy of held key.
+typedef struct
+{
+    uint32_t timeout_ms;        // Key released if no frame during timeout.
+    uint32_t delay_ms;          // Delay before first repeat.
+    uint32_t interval_ms;       // First interval between repeats.
+    uint32_t interval_min_ms;   // Shortest interval between repeats.
+    uint32_t acceleration_ms;   // Interval decrease at each repeat.
+} ir_decoder_repeat_policy_t;
+
+// Held key tracker.
+typedef struct
+{
+    const ir_decoder_repeat_policy_t *policy;
+    bool held;                  // Key is held.
+    command_t command;          // Command of held key.
+    uint32_t last_ms;           // Time of last frame of held key.
+    uint32_t next_ms;           // Time of next repeat.
+    uint32_t interval_ms;       // Current interval between repeats.
+} ir_decoder_repeat_t;
+
+// Initialise held key tracker with its auto-repeat policy.
+extern void ir_decoder_repeat_init(
+    ir_decoder_repeat_t * const repeat,
+    const ir_decoder_repeat_policy_t * const policy);
+// Track key press of decoded command. Retransmission is set if frame is the
+// same as the previous one, for protocols sending the full frame while key is
+// held (it is then handled as held key, unless key was released).
+// Note: can be called from ISR.
+// Return true if command has to be pushed, else false.
+extern bool ir_decoder_repeat_press(
+    ir_decoder_repeat_t * const repeat, command_t command,
+    bool retransmission, uint32_t now_ms);
+// Track repeat code of held key, and get command to repeat.
+// Note: can be called from ISR.
+// Return true if command has to be pushed, else false.
+extern bool ir_decoder_repeat_hold(
+    ir_decoder_repeat_t * const repeat, uint32_t now_ms,
+    command_t * const command);
+
+#endif  // IR_DECODER_REPEAT_H_
@@ -6,11 +6,35 @@
 #ifndef LED_H_
 #define LED_H_
 
+#include <stdint.h>
+
+// LEDs of board.
+typedef enum
+{
+    LED_WIFI = 0,
+    LED_BT,
+    LED_SOFT,
+    LED_NB_MAX
+} led_t;
+
+// LED patterns, run by hardware fades.
+typedef enum
+{
+    LED_PATTERN_OFF = 0,
+    LED_PATTERN_ON,
+    LED_PATTERN_DIM,
+    LED_PATTERN_BREATHE,        // Fade in and out, 3s period.
+    LED_PATTERN_BLINK,          // On and off, 500ms period.
+    LED_PATTERN_HEARTBEAT,      // Double flash, 1.2s period.
+    LED_PATTERN_NB_MAX
+} led_pattern_t;
+
 // WiFi LED state.
 typedef enum
 {
     WIFI_NOT_CONNECTED = 0,
-    WIFI_CONNECTED
+    WIFI_CONNECTED,
+    WIFI_CONNECTED_SLEEP        // Connected, in modem sleep (dimmed).
 } led_wifi_t;
 
 // Bluetooth LED state.
@@ -27,8 +51,15 @@ typedef enum
     SOFT_ON
 } led_soft_t;
 
-// Initialise all LEDs.
+// Initialise all LEDs, and their pattern task.
 extern void led_init(void);
+// Set pattern of LED, repeated count times (0 for ever), then LED stays at
+// its last level.
+// Note: not from ISR.
+extern void led_pattern_set(led_t led, led_pattern_t pattern, uint32_t count);
+// Flash LED shortly (acknowledgement), then its pattern starts again.
+// Note: not from ISR.
+extern void led_flash(led_t led);
 // Control WiFi LED state.
 extern void led_wifi_set(led_wifi_t value);
 // Control bluetooth LED state.
@@ -0,0 +1,30 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#ifndef POWER_H_
+#define POWER_H_
+
+// Power locks, CPU runs at full speed and light sleep is prevented while
+// one of them is held.
+typedef enum
+{
+    POWER_LOCK_IR = 0,          // IR frame being received or decoded.
+    POWER_LOCK_NETWORK,         // Network action in flight.
+    POWER_LOCK_NB_MAX
+} power_lock_t;
+
+// Initialise power management: automatic light sleep, and CPU frequency
+// scaled down while idle (power locks only, if disabled in configuration).
+extern void power_init(void);
+// Acquire power lock, it is counted so each acquisition has its release.
+// Note: can be called from ISR.
+extern void power_acquire(power_lock_t lock);
+// Release power lock.
+// Note: can be called from ISR.
+extern void power_release(power_lock_t lock);
+// Dump time spent in each power mode, and power locks.
+extern void power_dump(void);
+
+#endif  // POWER_H_
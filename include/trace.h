@@ -0,0 +1,59 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+
+// Pipeline stages traced, from IR frame reception to renderer response.
+typedef enum
+{
+    TRACE_STAGE_RMT = 0,        // RMT callback done.
+    TRACE_STAGE_WAKEUP,         // IR decoder task woken up with frame.
+    TRACE_STAGE_DECODE,         // Frame decoded.
+    TRACE_STAGE_PUSH,           // Command pushed.
+    TRACE_STAGE_POP,            // Command popped by command task.
+    TRACE_STAGE_SENT,           // Action dispatched to renderer.
+    TRACE_STAGE_RESPONSE,       // Renderer response received.
+    TRACE_STAGE_WAKE,           // First frame decoded after wake up, from
+                                // IR line edge (origin) which woke it up.
+    TRACE_STAGE_NB_MAX
+} trace_stage_t;
+
+// Latency summary of a stage, from origin of events.
+typedef struct
+{
+    uint32_t events;            // Events recorded.
+    uint32_t p50_us;            // Median latency.
+    uint32_t p95_us;            // 95th percentile latency.
+    uint32_t p99_us;            // 99th percentile latency.
+} trace_summary_t;
+
+// Get time stamp (CPU cycles, or us with power management), origin of the
+// events of an IR frame.
+// Stamp is never 0, which stands for no origin (events not traced).
+// Note: can be called from ISR.
+extern uint32_t trace_stamp(void);
+// Get oldest of two origins, 0 (no origin) is ignored.
+extern uint32_t trace_oldest(uint32_t origin, uint32_t other);
+// Convert duration to stamp units.
+extern uint32_t trace_stamp_us(uint32_t duration_us);
+// Record event of stage now, latency is accounted from origin.
+// Note: can be called from ISR.
+extern void trace_event(trace_stage_t stage, uint32_t origin);
+// Record event of stage which occurred at stamp.
+// Note: can be called from ISR.
+extern void trace_event_at(
+    trace_stage_t stage, uint32_t origin, uint32_t stamp);
+// Get latency summary of stage.
+extern void trace_summary_get(
+    trace_stage_t stage, trace_summary_t * const summary);
+// Dump stage latencies and last events on console.
+extern void trace_dump(void);
+// Clear latency histograms and events.
+extern void trace_reset(void);
+
+#endif  // TRACE_H_
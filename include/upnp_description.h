@@ -0,0 +1,67 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#ifndef UPNP_DESCRIPTION_H_
+#define UPNP_DESCRIPTION_H_
+
+#include "upnp_soap.h"
+#include "upnp_xml.h"
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define UPNP_DESCRIPTION_URL_SIZE       UPNP_RENDERER_PATH_SIZE
+#define UPNP_DESCRIPTION_NAME_SIZE      64u
+
+// Renderer services used.
+typedef enum
+{
+    UPNP_SERVICE_AV_TRANSPORT = 0,
+    UPNP_SERVICE_RENDERING_CONTROL,
+    UPNP_SERVICE_NB_MAX
+} upnp_service_t;
+
+// Service URLs (paths on renderer).
+typedef struct
+{
+    char control_url[UPNP_DESCRIPTION_URL_SIZE];
+    char event_url[UPNP_DESCRIPTION_URL_SIZE];
+} upnp_description_service_t;
+
+// Device description, parsed as it is received.
+// Only the first device name and UDN are kept (root device), and services
+// of any embedded device.
+typedef struct
+{
+    upnp_xml_parser_t parser;
+    const char *base;           // Description path, for relative URLs.
+    bool malformed;             // Document is malformed.
+    uint8_t service;            // Service parsed (upnp_service_t).
+    uint32_t services;          // Services found (bit mask).
+    upnp_description_service_t parsed;  // URLs of service parsed.
+    upnp_description_service_t service_urls[UPNP_SERVICE_NB_MAX];
+    char name[UPNP_DESCRIPTION_NAME_SIZE];  // Friendly name.
+    char udn[UPNP_DESCRIPTION_NAME_SIZE];   // Unique device name.
+} upnp_description_t;
+
+// Initialise description for a new document, located at path on renderer.
+extern void upnp_description_init(
+    upnp_description_t * const description, const char *base);
+// Feed description with next chunk of document.
+// Return true on success, false if document is malformed.
+extern bool upnp_description_feed(
+    upnp_description_t * const description, const char *data,
+    size_t length);
+// Check if control URLs of all renderer services are found.
+extern bool upnp_description_complete(
+    const upnp_description_t * const description);
+// Get device description from renderer.
+// Return true on success, false on error or if a service is missing.
+extern bool upnp_description_fetch(
+    upnp_description_t * const description,
+    const struct sockaddr_in * const address, const char *path);
+
+#endif  // UPNP_DESCRIPTION_H_
@@ -0,0 +1,21 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#ifndef UPNP_DISCOVERY_H_
+#define UPNP_DISCOVERY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Initialise renderer group discovery.
+// Group found on a previous boot is loaded from flash and applied at once,
+// then its renderers are searched (or revalidated) in background once Wi-Fi
+// is connected. Renderers are selected by friendly names given (comma
+// separated, one per group member), else group is the first renderer found.
+extern void upnp_discovery_init(const char *names);
+// Report group members not responding (bit mask), they are searched again.
+extern void upnp_discovery_lost(uint32_t members);
+
+#endif  // UPNP_DISCOVERY_H_
@@ -0,0 +1,36 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#ifndef UPNP_EXECUTOR_H_
+#define UPNP_EXECUTOR_H_
+
+#include "command.h"
+#include "upnp_soap.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+// Action executor statistics.
+typedef struct
+{
+    uint32_t submitted;         // Actions submitted (to each renderer).
+    uint32_t superseded;        // Actions folded in newer ones, not sent.
+    uint32_t retries;           // Actions tried again, not sent before.
+    uint32_t expired;           // Actions dropped, older than deadline.
+    uint32_t failures;          // Actions dropped, attempts exhausted.
+} upnp_executor_stats_t;
+
+// Initialise action executor, the only user of UPnP sink.
+extern void upnp_executor_init(void);
+// Set renderer group controlled, applied by executor task before next
+// actions.
+extern void upnp_executor_group_set(const upnp_group_t * const group);
+// Submit folded actions for all group renderers, without waiting.
+// Actions of a renderer still waiting (or in flight, if not sent) are
+// superseded: folded with newer ones and sent once.
+extern void upnp_executor_submit(const command_action_t * const action);
+// Get action executor statistics.
+extern void upnp_executor_stats_get(upnp_executor_stats_t * const stats);
+
+#endif  // UPNP_EXECUTOR_H_
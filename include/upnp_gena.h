@@ -0,0 +1,65 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#ifndef UPNP_GENA_H_
+#define UPNP_GENA_H_
+
+#include "upnp_soap.h"
+#include <sys/select.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define UPNP_GENA_PORT                8058u     // Event listener port.
+
+// Renderer state variables cached, from LastChange events.
+typedef enum
+{
+    UPNP_GENA_TRANSPORT_STATE = 0,      // AVTransport: 1 if playing.
+    UPNP_GENA_VOLUME,                   // RenderingControl: master volume.
+    UPNP_GENA_MUTE,                     // RenderingControl: master mute.
+    UPNP_GENA_VARIABLE_NB_MAX
+} upnp_gena_variable_t;
+
+// UPnP events statistics.
+typedef struct
+{
+    uint32_t subscribes;        // Subscriptions accepted.
+    uint32_t renewals;          // Subscriptions renewed.
+    uint32_t events;            // Events received.
+    uint32_t failures;          // Subscriptions failed, or events missed.
+} upnp_gena_stats_t;
+
+// Initialise events of group renderers, subscriptions are done by polling.
+// State cache is cleared, previous subscriptions are left to expire.
+extern void upnp_gena_init(const upnp_group_t * const group);
+// Process subscription response and events received, without waiting.
+extern void upnp_gena_receive(void);
+// Add event listener, or event connection, to readable set and socket of
+// subscription in progress to its set, then update highest descriptor of
+// sets.
+// Return time before next subscription or renewal (or deadline), UINT32_MAX
+// if none.
+extern uint32_t upnp_gena_poll_set(
+    fd_set * const readable, fd_set * const writable, int * const fd_max);
+// Process subscription response and events received, then start next
+// subscription or renewal due, without waiting. Called periodically.
+extern void upnp_gena_poll(void);
+// Get state variable of group member renderer from cache.
+// Return true on success, false if variable is unknown or stale.
+extern bool upnp_gena_value_get(
+    size_t member, upnp_gena_variable_t variable, uint32_t * const value);
+// Set state variable of group member renderer in cache, from an action
+// accepted by renderer (next events have precedence). Ignored while service
+// of variable is not subscribed, as changes made by other control points
+// would be missed.
+extern void upnp_gena_value_set(
+    size_t member, upnp_gena_variable_t variable, uint32_t value);
+// Check if events of all services of group renderers are subscribed.
+extern bool upnp_gena_subscribed(void);
+// Get UPnP events statistics.
+extern void upnp_gena_stats_get(upnp_gena_stats_t * const stats);
+
+#endif  // UPNP_GENA_H_
@@ -0,0 +1,110 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#ifndef UPNP_HTTP_H_
+#define UPNP_HTTP_H_
+
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Persistent connections, one per renderer.
+#define UPNP_HTTP_CONNECTION_NB          4u
+#define UPNP_HTTP_PART_NB                7u  // Parts of a request.
+
+// Response consumer. Body consumer is called for each chunk as it is
+// received, and without data when body starts (again if request is sent
+// again). Header consumer is called once with whole header.
+typedef void (*upnp_http_body_t)(
+    void *context, const char *data, size_t length);
+
+// Part of HTTP request.
+typedef struct
+{
+    const char *data;
+    size_t length;
+} upnp_http_part_t;
+
+// HTTP request, with its response status once received.
+// Request is made of parts sent in turn (gathered in same segments), so
+// constant parts are not copied in RAM.
+typedef struct
+{
+    upnp_http_part_t parts[UPNP_HTTP_PART_NB];  // Request header and body.
+    size_t parts_nb;
+    size_t length;              // Request length, all parts.
+    upnp_http_body_t header;    // Response header consumer, NULL if not needed.
+    upnp_http_body_t body;      // Response body consumer, NULL if not needed.
+    void *context;              // Response consumers context.
+    uint16_t status;            // Response status, 0 if no response.
+} upnp_http_request_t;
+
+// Requests pipelined to a renderer of a group, with their dispatch result.
+typedef struct
+{
+    struct sockaddr_in address;
+    upnp_http_request_t *requests;
+    size_t requests_nb;
+    uint32_t timeout_ms;        // Response deadline, from dispatch start.
+    size_t sent;                // Requests sent, answered or not.
+    size_t answered;            // Requests answered.
+    uint32_t latency_us;        // Time to last response, or to failure.
+} upnp_http_member_t;
+
+// HTTP connections statistics.
+typedef struct
+{
+    uint32_t connects;          // Connections opened.
+    uint32_t requests;          // Requests sent.
+    uint32_t reuses;            // Requests sent on a connection reused.
+    uint32_t reconnects;        // Connections closed by renderer.
+    uint32_t refreshes;         // Connections reopened before idle timeout.
+} upnp_http_stats_t;
+
+// Send requests of each renderer back-to-back on its connection
+// (pipelining), all renderers at once, then receive their responses in order
+// as they come. Requests without response are sent again on a new connection
+// if renderer closed the previous one. Renderers which did not answer before
+// their deadline are given up, without delaying the others.
+// Return number of renderers which answered all their requests.
+extern size_t upnp_http_fanout(
+    upnp_http_member_t * const members, size_t members_nb);
+// Send requests back-to-back on renderer connection, as a group of one
+// renderer.
+// Return number of requests answered.
+extern size_t upnp_http_pipeline(
+    const struct sockaddr_in * const address,
+    upnp_http_request_t * const requests, size_t requests_nb);
+// Send one request and receive its response body.
+// Return HTTP status on success, 0 on error.
+extern uint16_t upnp_http_exchange(
+    const struct sockaddr_in * const address, const char *request,
+    size_t length, upnp_http_body_t body, void *context);
+// Send one request on a connection of its own, closed once response body is
+// received. Unlike other functions, it can be called from any task.
+// Return HTTP status on success, 0 on error.
+extern uint16_t upnp_http_fetch(
+    const struct sockaddr_in * const address, const char *request,
+    size_t length, upnp_http_body_t body, void *context);
+// Add sockets of connections kept opened to readable set, they are readable
+// once closed by renderer, and sockets of connections being opened to
+// writable set, then update highest descriptor of sets.
+// Return time before next connection refresh (or deadline), UINT32_MAX if
+// none.
+extern uint32_t upnp_http_poll_set(
+    fd_set * const readable, fd_set * const writable, int * const fd_max);
+// Reopen connections idle for too long, before renderer closes them, or
+// closed by renderer, without waiting: they are established on next calls.
+// Connections unused for a while, or of renderers not answering, are closed
+// instead.
+extern void upnp_http_poll(void);
+// Close all connections.
+extern void upnp_http_close_all(void);
+// Get HTTP connections statistics.
+extern void upnp_http_stats_get(upnp_http_stats_t * const stats);
+
+#endif  // UPNP_HTTP_H_
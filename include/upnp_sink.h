@@ -0,0 +1,52 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#ifndef UPNP_SINK_H_
+#define UPNP_SINK_H_
+
+#include "command.h"
+#include "upnp_soap.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+// UPnP sink statistics.
+typedef struct
+{
+    uint32_t actions;           // SOAP actions sent (to each renderer).
+    uint32_t failures;          // SOAP actions failed.
+    uint32_t bytes;             // Request bytes sent.
+    uint32_t queries;           // State queries, when events cache is stale.
+    uint32_t dispatches;        // Actions dispatched to the group.
+    uint32_t latency_us;        // Last dispatch time, of slowest renderer.
+    // Last dispatch time of each group member.
+    uint32_t member_latencies_us[UPNP_GROUP_MEMBER_NB];
+} upnp_sink_stats_t;
+
+// Initialise UPnP sink for the renderer group.
+// Return true on success, false if no renderer configuration is valid.
+extern bool upnp_sink_init(const upnp_group_t * const group);
+// Get group members not configured, or which did not answer any of last
+// actions (bit mask). All members are unreachable if none is configured.
+extern uint32_t upnp_sink_unreachable(void);
+// Send SOAP action to all group renderers, with its argument value if any.
+// Return true if action is accepted by all renderers, else false.
+extern bool upnp_sink_send(upnp_soap_action_t action, uint32_t value);
+// Process folded actions of each group renderer (one per member), mapped to
+// its SOAP actions, within its timeout. Actions sent to renderers are
+// cleared, the ones left (never sent) can be sent again.
+// Return group members which did not answer all their actions, or not
+// configured (bit mask), 0 on success.
+extern uint32_t upnp_sink_process(
+    command_action_t * const actions, const uint32_t * const timeouts_ms);
+// Wait wakeup descriptor signaled (none if negative), timeout, or renderer
+// connections and events to be polled.
+// Note: waits forever if timeout is UINT32_MAX, and nothing is to be polled.
+extern void upnp_sink_wait(int wakeup, uint32_t timeout_ms);
+// Keep renderer connections ready for next actions, when waited.
+extern void upnp_sink_poll(void);
+// Get UPnP sink statistics.
+extern void upnp_sink_stats_get(upnp_sink_stats_t * const stats);
+
+#endif  // UPNP_SINK_H_
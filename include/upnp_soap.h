@@ -0,0 +1,79 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#ifndef UPNP_SOAP_H_
+#define UPNP_SOAP_H_
+
+#include "upnp_http.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define UPNP_RENDERER_HOST_SIZE          16u
+#define UPNP_RENDERER_PATH_SIZE          96u
+#define UPNP_GROUP_MEMBER_NB              4u   // Renderers per group.
+#define UPNP_SOAP_INSTANCE_WIDTH          4u   // Patched fields width.
+#define UPNP_SOAP_VALUE_WIDTH_MAX         5u
+
+// UPnP renderer control configuration.
+typedef struct
+{
+    char host[UPNP_RENDERER_HOST_SIZE]; // IPv4 address.
+    uint16_t port;
+    // Control URL paths of AVTransport and RenderingControl services.
+    char av_transport_path[UPNP_RENDERER_PATH_SIZE];
+    char rendering_control_path[UPNP_RENDERER_PATH_SIZE];
+    // Event subscription URL paths of the same services (empty if none).
+    char av_transport_event_path[UPNP_RENDERER_PATH_SIZE];
+    char rendering_control_event_path[UPNP_RENDERER_PATH_SIZE];
+} upnp_renderer_t;
+
+// UPnP renderer group, each command is sent to all its members.
+typedef struct
+{
+    upnp_renderer_t members[UPNP_GROUP_MEMBER_NB];
+    uint32_t nb;
+} upnp_group_t;
+
+// SOAP actions supported.
+typedef enum
+{
+    UPNP_SOAP_PLAY = 0,                 // AVTransport actions.
+    UPNP_SOAP_PAUSE,
+    UPNP_SOAP_NEXT,
+    UPNP_SOAP_PREVIOUS,
+    UPNP_SOAP_SEEK_TRACK,
+    UPNP_SOAP_GET_POSITION_INFO,
+    UPNP_SOAP_GET_TRANSPORT_INFO,
+    UPNP_SOAP_SET_MUTE,                 // RenderingControl actions.
+    UPNP_SOAP_SET_VOLUME,
+    UPNP_SOAP_GET_VOLUME,
+    UPNP_SOAP_NB_MAX
+} upnp_soap_action_t;
+
+// Variable fields of an action request (instance ID and action argument
+// value), referenced by request until it is sent.
+typedef struct
+{
+    char instance[UPNP_SOAP_INSTANCE_WIDTH];
+    char value[UPNP_SOAP_VALUE_WIDTH_MAX];
+} upnp_soap_fields_t;
+
+// Build HTTP request lines of renderer of group member (paths and host),
+// other request parts are the same for all renderers.
+// Return true on success, false if renderer configuration is too long.
+extern bool upnp_soap_init(
+    size_t member, const upnp_renderer_t * const renderer);
+// Get HTTP request of action for group member, with instance ID and action
+// argument value (volume, mute state or track number) written in fields.
+// Only request parts are set, response consumers are left to caller.
+extern void upnp_soap_request(
+    size_t member, upnp_soap_action_t action, uint32_t instance,
+    uint32_t value, upnp_soap_fields_t * const fields,
+    upnp_http_request_t * const request);
+// Get action name.
+extern const char *upnp_soap_action_str(upnp_soap_action_t action);
+
+#endif  // UPNP_SOAP_H_
@@ -0,0 +1,50 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#ifndef UPNP_SSDP_H_
+#define UPNP_SSDP_H_
+
+#include "upnp_soap.h"
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define UPNP_SSDP_ADDRESS       "239.255.255.250"
+#define UPNP_SSDP_PORT                1900u
+#define UPNP_SSDP_UDN_SIZE              64u
+
+// SSDP message kinds.
+typedef enum
+{
+    UPNP_SSDP_RESPONSE = 0,     // Response to search.
+    UPNP_SSDP_ALIVE,            // Device advertisement.
+    UPNP_SSDP_BYEBYE            // Device leaving.
+} upnp_ssdp_kind_t;
+
+// SSDP message of a MediaRenderer device.
+typedef struct
+{
+    uint8_t kind;               // Message kind (upnp_ssdp_kind_t).
+    struct sockaddr_in location;    // Description address.
+    char path[UPNP_RENDERER_PATH_SIZE]; // Description path.
+    char udn[UPNP_SSDP_UDN_SIZE];   // Unique device name.
+} upnp_ssdp_message_t;
+
+// Open SSDP socket, joined to multicast group for advertisements.
+// Return true on success, false on error.
+extern bool upnp_ssdp_init(void);
+// Close SSDP socket.
+extern void upnp_ssdp_deinit(void);
+// Send search request of MediaRenderer devices.
+// Return true on success, false on error.
+extern bool upnp_ssdp_search(void);
+// Receive next message of a MediaRenderer device, other messages are
+// dropped. Waiting ends on timeout (never if UINT32_MAX), or once wakeup
+// descriptor (none if negative) is readable, it is not cleared.
+// Return true on success, false on timeout, wakeup or error.
+extern bool upnp_ssdp_receive(
+    upnp_ssdp_message_t * const message, uint32_t timeout_ms, int wakeup);
+
+#endif  // UPNP_SSDP_H_
@@ -0,0 +1,69 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#ifndef UPNP_XML_H_
+#define UPNP_XML_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define UPNP_XML_PATH_SIZE             128u
+#define UPNP_XML_TEXT_SIZE             128u
+
+// Matched element callback, with index of its path and its text content
+// (entities decoded, surrounding spaces trimmed), or its attributes for an
+// attributes path (as written in start tag).
+typedef void (*upnp_xml_callback_t)(
+    void *context, size_t path, const char *text);
+
+// Streaming XML parser, document is fed by chunks and never held in memory.
+// Only elements matching one of the paths are reported, once ended. A path is
+// the suffix of element local names (without namespace prefix) separated by
+// '/', such as "service/controlURL". A path ending with '@' matches the same
+// elements, reported with their attributes once start tag ends, such as
+// "InstanceID/Volume@".
+typedef struct
+{
+    const char * const *paths;  // Paths to match.
+    size_t paths_nb;
+    upnp_xml_callback_t callback;
+    void *context;
+    uint8_t state;              // Lexer state.
+    uint8_t quote;              // Quote of attribute value.
+    uint8_t markers;            // End markers seen in comment or section.
+    bool started;               // Root element started.
+    bool text_overflow;         // Text of matched element is too long.
+    bool attributes_overflow;   // Attributes of matched element too long.
+    int32_t attributes_match;   // Attributes path matched, negative if none.
+    uint32_t overflow;          // Elements nested beyond path buffer.
+    size_t match_length;        // Path length of matched element, 0 if none.
+    size_t name_start;          // Path offset of current element name.
+    size_t path_length;
+    size_t text_length;
+    size_t attributes_length;
+    size_t entity_length;
+    char entity[8];
+    char path[UPNP_XML_PATH_SIZE];
+    char text[UPNP_XML_TEXT_SIZE];
+    char attributes[UPNP_XML_TEXT_SIZE];
+} upnp_xml_parser_t;
+
+// Initialise parser for a new document.
+extern void upnp_xml_init(
+    upnp_xml_parser_t * const parser, const char * const *paths,
+    size_t paths_nb, upnp_xml_callback_t callback, void *context);
+// Feed parser with next chunk of document.
+// Return true on success, false if document is malformed.
+extern bool upnp_xml_feed(
+    upnp_xml_parser_t * const parser, const char *data, size_t length);
+// Check if document is complete (all elements ended).
+extern bool upnp_xml_complete(const upnp_xml_parser_t * const parser);
+// Get attribute value from attributes of an element (entities not decoded).
+// Return true on success, false if attribute is not found or too long.
+extern bool upnp_xml_attribute(
+    const char *attributes, const char *name, char *value, size_t size);
+
+#endif  // UPNP_XML_H_
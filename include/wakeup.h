@@ -0,0 +1,22 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#ifndef WAKEUP_H_
+#define WAKEUP_H_
+
+#include <stdbool.h>
+
+// Open wakeup descriptor, readable once signaled, so a task blocked in
+// select() on its sockets is woken up by other tasks.
+// Return descriptor, negative on error.
+extern int wakeup_open(void);
+// Signal wakeup descriptor, without waiting.
+// Note: not from ISR.
+extern void wakeup_signal(int wakeup);
+// Clear wakeup descriptor, without waiting.
+// Return true if it was signaled, else false.
+extern bool wakeup_clear(int wakeup);
+
+#endif  // WAKEUP_H_
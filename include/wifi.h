@@ -0,0 +1,63 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#ifndef WIFI_H_
+#define WIFI_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Link handler, called from event task when station gets its IP address
+// (up), or loses its connection.
+typedef void (*wifi_link_handler_t)(bool up);
+
+// Station power save modes.
+typedef enum
+{
+    WIFI_POWER_SLEEP = 0,       // Modem sleep, woken up on DTIM beacons.
+    WIFI_POWER_ACTIVE,          // No power save, during remote activity.
+    WIFI_POWER_NB_MAX
+} wifi_power_t;
+
+// Statistics of a power save mode.
+typedef struct
+{
+    uint32_t time_ms;           // Time spent in mode.
+    uint32_t actions;           // Actions dispatched in mode.
+    uint32_t latency_mean_us;   // Mean action latency.
+    uint32_t latency_max_us;    // Longest action latency.
+} wifi_power_stats_t;
+
+// Power save governor statistics.
+typedef struct
+{
+    uint32_t switches;          // Power save mode switches.
+    wifi_power_stats_t modes[WIFI_POWER_NB_MAX];
+} wifi_stats_t;
+
+// Initialise Wi-Fi station, and connect to access point.
+// Access point found last (BSSID and channel) is tried first, without
+// scanning all channels. Connection is restored by itself when lost.
+extern void wifi_init(
+    const char *ssid, const char *password, wifi_link_handler_t link_handler);
+// Initialise power save governor, before remote activity is reported.
+// Station is in modem sleep, until remote activity.
+// Idle window is the time without activity before going back to sleep.
+extern void wifi_power_init(uint32_t idle_ms);
+// Report remote activity, station leaves modem sleep until idle window
+// has elapsed since last activity.
+// Note: not from ISR.
+extern void wifi_activity(void);
+// Record latency of actions dispatched, accounted to current mode.
+extern void wifi_latency_record(uint32_t latency_us);
+// Get power save governor statistics.
+extern void wifi_stats_get(wifi_stats_t * const stats);
+// Dump power save governor statistics on console.
+extern void wifi_power_dump(void);
+// Wait Wi-Fi station connection (with IP address).
+// Return true if connected, false on timeout.
+extern bool wifi_wait_connected(uint32_t timeout_ms);
+
+#endif  // WIFI_H_
@@ -0,0 +1,201 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "binlog.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#define LOGGER_TAG "binlog"
+
+#define BINLOG_TASK_STACK_SIZE      (4u * configMINIMAL_STACK_SIZE)
+// Lowest of application tasks, records are emitted when others are idle.
+#define BINLOG_TASK_PRIORITY        (tskIDLE_PRIORITY + 1u)
+#define BINLOG_RING_NB              128u    // Power of 2.
+// Record line prefix, decoded by host/tools/binlog_decode.py.
+#define BINLOG_LINE_PREFIX          "#BL"
+// Level of records written on start up, debug records are opt-in (build
+// flag, or console key).
+#ifndef BINLOG_LEVEL
+#define BINLOG_LEVEL                ESP_LOG_INFO
+#endif
+
+static_assert(
+    (BINLOG_RING_NB & (BINLOG_RING_NB - 1u)) == 0u,
+    "Ring size is not a power of 2");
+
+// Record of ring.
+// Sequence is the position of the record when it can be written, position
+// plus one once written, and next position in ring once read.
+typedef struct
+{
+    atomic_uint_least32_t sequence;
+    uint32_t time_ms;
+    const char *tag;
+    const char *format;
+    uint8_t level;
+    uint8_t args_nb;
+    uint32_t args[BINLOG_ARGS_NB_MAX];
+} binlog_record_t;
+
+// Deferred binary logger handle.
+// Records are written by any task in a lock-free ring (several producers,
+// one consumer): a position is claimed on head, written, then published by
+// its sequence. Drain task is only notified when ring was empty, it emits
+// records as hexadecimal lines, formatted on host with firmware ELF.
+typedef struct
+{
+    StaticTask_t task;
+    StackType_t task_stack[BINLOG_TASK_STACK_SIZE];
+    atomic_uint_least32_t head; // Next position claimed by producers.
+    atomic_uint_least32_t tail; // Next position read by drain task.
+    atomic_uint_least32_t level;
+    atomic_uint_least32_t records;
+    atomic_uint_least32_t drops;
+    binlog_record_t records_ring[BINLOG_RING_NB];
+} binlog_handle_t;
+
+static binlog_handle_t binlog_handle;
+
+// Emit record on console: level, time, tag and format addresses, then
+// arguments.
+static void binlog_emit(const binlog_record_t * const record)
+{
+    assert(record);
+    printf(BINLOG_LINE_PREFIX " %x %lx %lx %lx",
+        (unsigned int) record->level, (unsigned long) record->time_ms,
+        (unsigned long) (uintptr_t) record->tag,
+        (unsigned long) (uintptr_t) record->format);
+    for (uint32_t i = 0; i < record->args_nb; i++)
+        printf(" %lx", (unsigned long) record->args[i]);
+    printf("\n");
+}
+
+// Drain task handler.
+static void binlog_task_handler(void *context)
+{
+    assert(context);
+    binlog_handle_t * const handle = (binlog_handle_t *) context;
+    uint32_t drops = 0u;
+    while (true)
+    {
+        // Wait records, then emit all of them.
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        uint32_t tail = atomic_load_explicit(&handle->tail,
+            memory_order_relaxed);
+        while (true)
+        {
+            binlog_record_t * const record =
+                &handle->records_ring[tail & (BINLOG_RING_NB - 1u)];
+            const uint32_t sequence = atomic_load_explicit(
+                &record->sequence, memory_order_seq_cst);
+            if (sequence != (tail + 1u))
+                break;
+            binlog_emit(record);
+            // Record is read before being released to producers.
+            atomic_store_explicit(&record->sequence, tail + BINLOG_RING_NB,
+                memory_order_release);
+            tail++;
+            atomic_store_explicit(&handle->tail, tail, memory_order_seq_cst);
+        }
+        fflush(stdout);
+        const uint32_t dropped =
+            atomic_load_explicit(&handle->drops, memory_order_relaxed);
+        if (dropped != drops)
+        {
+            ESP_LOGW(LOGGER_TAG, "Records dropped nb=%lu",
+                (unsigned long) (dropped - drops));
+            drops = dropped;
+        }
+    }
+}
+
+void binlog_init(void)
+{
+    memset(&binlog_handle, 0, sizeof(binlog_handle_t));
+    atomic_init(&binlog_handle.head, 0u);
+    atomic_init(&binlog_handle.tail, 0u);
+    atomic_init(&binlog_handle.level, BINLOG_LEVEL);
+    atomic_init(&binlog_handle.records, 0u);
+    atomic_init(&binlog_handle.drops, 0u);
+    for (uint32_t i = 0; i < BINLOG_RING_NB; i++)
+        atomic_init(&binlog_handle.records_ring[i].sequence, i);
+    // Create drain task.
+    xTaskCreateStatic(
+        &binlog_task_handler,
+        "Binlog",
+        BINLOG_TASK_STACK_SIZE,
+        &binlog_handle,
+        BINLOG_TASK_PRIORITY,
+        binlog_handle.task_stack,
+        &binlog_handle.task
+    );
+}
+
+void binlog_level_set(esp_log_level_t level)
+{
+    atomic_store_explicit(&binlog_handle.level, level, memory_order_relaxed);
+}
+
+esp_log_level_t binlog_level_get(void)
+{
+    return (esp_log_level_t)
+        atomic_load_explicit(&binlog_handle.level, memory_order_relaxed);
+}
+
+bool binlog_write(
+    esp_log_level_t level, const char *tag, const char *format,
+    const uint32_t *args, uint32_t args_nb)
+{
+    assert(format);
+    assert(args_nb <= BINLOG_ARGS_NB_MAX);
+    binlog_handle_t * const handle = &binlog_handle;
+    binlog_record_t *record;
+    // Claim position of a record free, released by drain task.
+    uint32_t head = atomic_load_explicit(&handle->head, memory_order_relaxed);
+    while (true)
+    {
+        record = &handle->records_ring[head & (BINLOG_RING_NB - 1u)];
+        const int32_t available = (int32_t) (atomic_load_explicit(
+            &record->sequence, memory_order_acquire) - head);
+        if (available < 0)
+        {
+            atomic_fetch_add_explicit(&handle->drops, 1u,
+                memory_order_relaxed);
+            return false;
+        }
+        if ((available == 0)
+            && atomic_compare_exchange_weak_explicit(&handle->head, &head,
+                head + 1u, memory_order_relaxed, memory_order_relaxed))
+            break;
+        if (available > 0)
+            head = atomic_load_explicit(&handle->head, memory_order_relaxed);
+    }
+    record->time_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    record->tag = tag;
+    record->format = format;
+    record->level = (uint8_t) level;
+    record->args_nb = (uint8_t) args_nb;
+    memcpy(record->args, args, args_nb * sizeof(uint32_t));
+    // Record is written before being published to drain task, which is
+    // notified if it has emitted all records before this one.
+    atomic_store_explicit(&record->sequence, head + 1u, memory_order_seq_cst);
+    atomic_fetch_add_explicit(&handle->records, 1u, memory_order_relaxed);
+    if (atomic_load_explicit(&handle->tail, memory_order_seq_cst) == head)
+        xTaskNotifyGive((TaskHandle_t) &handle->task);
+    return true;
+}
+
+void binlog_stats_get(binlog_stats_t * const stats)
+{
+    assert(stats);
+    stats->records =
+        atomic_load_explicit(&binlog_handle.records, memory_order_relaxed);
+    stats->drops =
+        atomic_load_explicit(&binlog_handle.drops, memory_order_relaxed);
+}
@@ -0,0 +1,47 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "boot.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <assert.h>
+#include <stdatomic.h>
+
+#define LOGGER_TAG "boot"
+
+// Boot milestones times (ms), set once by the first task reaching them.
+static atomic_uint_least32_t boot_times_ms[BOOT_NB_MAX];
+
+static const char * const boot_milestone_str[] = {
+    [BOOT_IR_READY] = "IR ready",
+    [BOOT_LINK_UP] = "Link up",
+    [BOOT_FIRST_ACTION] = "First action",
+};
+
+void boot_mark(boot_milestone_t milestone)
+{
+    assert(milestone < BOOT_NB_MAX);
+    // System timer runs from boot, 0 stands for milestone not reached.
+    const uint32_t now_ms = (uint32_t) (esp_timer_get_time() / 1000) | 1u;
+    uint_least32_t expected = 0u;
+    if (atomic_compare_exchange_strong_explicit(&boot_times_ms[milestone],
+        &expected, now_ms, memory_order_relaxed, memory_order_relaxed))
+        ESP_LOGI(LOGGER_TAG, "%s boot=%lums", boot_milestone_str[milestone],
+            (unsigned long) now_ms);
+}
+
+uint32_t boot_time_get(boot_milestone_t milestone)
+{
+    assert(milestone < BOOT_NB_MAX);
+    return atomic_load_explicit(&boot_times_ms[milestone],
+        memory_order_relaxed);
+}
+
+void boot_dump(void)
+{
+    for (uint32_t i = 0; i < BOOT_NB_MAX; i++)
+        ESP_LOGI(LOGGER_TAG, "%-12s boot=%lums", boot_milestone_str[i],
+            (unsigned long) boot_time_get((boot_milestone_t) i));
+}
@@ -4,25 +4,45 @@
  */
 
 #include "command.h"
+#include "binlog.h"
+#include "command_ring.h"
+#include "led.h"
+#include "trace.h"
+#include "upnp_executor.h"
+#include "esp_attr.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
 #include "freertos/task.h"
 #include <assert.h>
+#include <stdatomic.h>
 #include <string.h>
 
 #define LOGGER_TAG "command"
 
-#define COMMAND_TASK_STACK_SIZE     (2u * configMINIMAL_STACK_SIZE)
-#define COMMAND_TASK_PRIORITY       tskIDLE_PRIORITY
-#define COMMAND_QUEUE_NB            16u
+#define COMMAND_TASK_STACK_SIZE     (6u * configMINIMAL_STACK_SIZE)
+// Below IR decoder, so frames are not delayed by folding commands.
+#define COMMAND_TASK_PRIORITY       (tskIDLE_PRIORITY + 4u)
+#define COMMAND_DEADLINE_MS         500u    // Older commands are dropped.
+// Commands held while link is down, replayed once up unless older.
+#define COMMAND_HELD_NB              16u
+#define COMMAND_HELD_DEADLINE_MS   5000u
 
+// Command handle.
+// Each producer context has its own ring: task pushes to one ring, and ISR
+// to the other one. Processing task is notified on each push.
+// Folded actions are submitted to the action executor, processing task never
+// waits for renderers. While link is down (boot or connection lost),
+// commands are held with their capture time, then replayed when it is up.
 typedef struct
 {
     StaticTask_t task;
-    StaticQueue_t queue;
     StackType_t task_stack[COMMAND_TASK_STACK_SIZE];
-    command_t queue_buffer[COMMAND_QUEUE_NB];
+    command_ring_t ring_task;
+    command_ring_t ring_isr;
+    atomic_bool link_up;
+    command_entry_t held[COMMAND_HELD_NB];  // Oldest first.
+    size_t held_nb;
+    command_stats_t stats;
 } command_handle_t;
 
 static command_handle_t command_handle;
@@ -36,14 +56,128 @@ static char* command_debug_str[] = {
     [COMMAND_VOLUME_DOWN] = "Volume Down",
 };
 
-// Get last command from queue.
-// Return true on success, false on error.
-static bool command_pop(command_handle_t * const handle, command_t * const cmd)
+// Get oldest command from one of the rings.
+// Return true on success, false if no command is available.
+static bool command_pop(
+    command_handle_t * const handle, command_entry_t * const entry)
 {
     assert(handle);
-    assert(cmd);
-    return pdPASS == xQueueReceive(
-        (QueueHandle_t) &handle->queue, cmd, pdMS_TO_TICKS(1000));
+    assert(entry);
+    return command_ring_pop(&handle->ring_isr, entry)
+        || command_ring_pop(&handle->ring_task, entry);
+}
+
+// Fold command in actions.
+static void command_coalesce(command_action_t * const action, command_t cmd)
+{
+    assert(action);
+    switch (cmd)
+    {
+        case COMMAND_PLAY_PAUSE:
+            action->play_pause = !action->play_pause;
+            break;
+        case COMMAND_PREVIOUS:
+            action->skip--;
+            break;
+        case COMMAND_NEXT:
+            action->skip++;
+            break;
+        case COMMAND_MUTE:
+            action->mute = !action->mute;
+            break;
+        case COMMAND_VOLUME_UP:
+            action->volume++;
+            break;
+        case COMMAND_VOLUME_DOWN:
+            action->volume--;
+            break;
+        default:
+            break;
+    }
+}
+
+// Fold command entry in actions, traced from oldest command.
+static void command_fold(
+    command_action_t * const action, const command_entry_t * const entry)
+{
+    assert(action);
+    assert(entry);
+    BINLOG_D(LOGGER_TAG, "Command received cmd='%s'",
+        (uintptr_t) command_debug_str[entry->command]);
+    trace_event(TRACE_STAGE_POP, entry->origin);
+    action->origin = trace_oldest(action->origin, entry->origin);
+    command_coalesce(action, entry->command);
+}
+
+// Hold command until link is up, oldest one is dropped if full.
+static void command_hold(
+    command_handle_t * const handle, const command_entry_t * const entry)
+{
+    assert(handle);
+    assert(entry);
+    if (handle->held_nb == COMMAND_HELD_NB)
+    {
+        memmove(&handle->held[0], &handle->held[1],
+            (COMMAND_HELD_NB - 1u) * sizeof(command_entry_t));
+        handle->held_nb--;
+        handle->stats.expired++;
+    }
+    handle->held[handle->held_nb++] = *entry;
+    handle->stats.held++;
+    BINLOG_D(LOGGER_TAG, "Command held cmd='%s'",
+        (uintptr_t) command_debug_str[entry->command]);
+}
+
+// Replay commands held in actions, unless older than deadline.
+// Return number of commands folded.
+static uint32_t command_replay(
+    command_handle_t * const handle, command_action_t * const action,
+    uint32_t now_ms)
+{
+    assert(handle);
+    assert(action);
+    uint32_t commands = 0u;
+    for (size_t i = 0; i < handle->held_nb; i++)
+    {
+        const command_entry_t * const entry = &handle->held[i];
+        if ((now_ms - entry->time_ms) > COMMAND_HELD_DEADLINE_MS)
+        {
+            handle->stats.expired++;
+            continue;
+        }
+        command_fold(action, entry);
+        commands++;
+    }
+    if (handle->held_nb > 0u)
+        ESP_LOGI(LOGGER_TAG, "Commands replayed nb=%lu held=%u",
+            (unsigned long) commands, (unsigned int) handle->held_nb);
+    handle->held_nb = 0u;
+    return commands;
+}
+
+// Get number of actions to process.
+static uint32_t command_action_nb(const command_action_t * const action)
+{
+    assert(action);
+    return (action->volume != 0) + (action->skip != 0)
+        + action->play_pause + action->mute;
+}
+
+// Process folded actions, submitted to renderers.
+static void command_action_process(const command_action_t * const action)
+{
+    assert(action);
+    if (action->play_pause)
+        ESP_LOGI(LOGGER_TAG, "Action play/pause");
+    if (action->skip != 0)
+        ESP_LOGI(LOGGER_TAG, "Action skip tracks=%+ld", action->skip);
+    if (action->mute)
+        ESP_LOGI(LOGGER_TAG, "Action mute");
+    if (action->volume != 0)
+        ESP_LOGI(LOGGER_TAG, "Action volume steps=%+ld", action->volume);
+    upnp_executor_submit(action);
+    // Commands are acknowledged once submitted.
+    led_flash(LED_SOFT);
 }
 
 // Command task handler.
@@ -53,29 +187,57 @@ static void command_task_handler(void *context)
     command_handle_t * const handle = (command_handle_t *) context;
     while (true)
     {
-        command_t command;
         // Wait command from receiver process.
-        if (command_pop(handle, &command))
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // Drain queued commands and fold them in the minimum set of actions,
+        // after the ones held while link was down. Commands older than
+        // deadline are stale and dropped.
+        const uint32_t now_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+        const bool link_up =
+            atomic_load_explicit(&handle->link_up, memory_order_acquire);
+        command_action_t action = { 0 };
+        command_entry_t entry;
+        uint32_t commands = link_up
+            ? command_replay(handle, &action, now_ms) : 0u;
+        while (command_pop(handle, &entry))
         {
             // Check if received command is in range.
-            if (command >= COMMAND_NB_MAX)
+            if (entry.command >= COMMAND_NB_MAX)
                 continue;
-            ESP_LOGI(LOGGER_TAG,
-                "Command received cmd='%s'", command_debug_str[command]);
+            if (!link_up)
+            {
+                command_hold(handle, &entry);
+                continue;
+            }
+            if ((now_ms - entry.time_ms) > COMMAND_DEADLINE_MS)
+            {
+                BINLOG_D(LOGGER_TAG, "Command expired cmd='%s'",
+                    (uintptr_t) command_debug_str[entry.command]);
+                handle->stats.expired++;
+                continue;
+            }
+            command_fold(&action, &entry);
+            commands++;
         }
+        if (commands == 0u)
+            continue;
+        const uint32_t actions = command_action_nb(&action);
+        handle->stats.commands += commands;
+        handle->stats.batches++;
+        handle->stats.merged += commands - actions;
+        if (commands > 1u)
+            BINLOG_D(LOGGER_TAG,
+                "Commands coalesced nb=%lu actions=%lu", commands, actions);
+        command_action_process(&action);
     }
 }
 
 void command_init(void)
 {
     memset(&command_handle, 0, sizeof(command_handle_t));
-    // Initialise command queue.
-    xQueueCreateStatic(
-        COMMAND_QUEUE_NB,
-        sizeof(command_t),
-        (uint8_t *) command_handle.queue_buffer,
-        &command_handle.queue
-    );
+    command_ring_init(&command_handle.ring_task);
+    command_ring_init(&command_handle.ring_isr);
+    atomic_init(&command_handle.link_up, false);
     // Create processing task.
     xTaskCreateStatic(
         &command_task_handler,
@@ -88,9 +250,62 @@ void command_init(void)
     );
 }
 
-bool command_push(command_t cmd)
+void command_stats_get(command_stats_t * const stats)
+{
+    assert(stats);
+    const command_ring_t * const ring_task = &command_handle.ring_task;
+    const command_ring_t * const ring_isr = &command_handle.ring_isr;
+    *stats = command_handle.stats;
+    stats->overflows = ring_task->overflows + ring_isr->overflows;
+    stats->high_water = (ring_task->high_water > ring_isr->high_water)
+        ? ring_task->high_water : ring_isr->high_water;
+}
+
+const char *command_str(command_t cmd)
 {
     assert(cmd < COMMAND_NB_MAX);
-    return pdPASS == xQueueSend(
-        (QueueHandle_t) &command_handle.queue, &cmd, pdMS_TO_TICKS(1000));
+    return command_debug_str[cmd];
+}
+
+void command_link_set(bool up)
+{
+    atomic_store_explicit(&command_handle.link_up, up, memory_order_release);
+    // Commands held are replayed at once.
+    if (up)
+        xTaskNotifyGive((TaskHandle_t) &command_handle.task);
+}
+
+bool command_push(command_t cmd, uint32_t origin)
+{
+    assert(cmd < COMMAND_NB_MAX);
+    const command_entry_t entry = {
+        .time_ms = xTaskGetTickCount() * portTICK_PERIOD_MS,
+        .origin = origin,
+        .command = cmd
+    };
+    if (!command_ring_push(&command_handle.ring_task, &entry))
+        return false;
+    trace_event(TRACE_STAGE_PUSH, origin);
+    xTaskNotifyGive((TaskHandle_t) &command_handle.task);
+    return true;
+}
+
+bool IRAM_ATTR command_push_from_isr(
+    command_t cmd, uint32_t origin, bool * const task_wakeup)
+{
+    BaseType_t wakeup = false;
+    if (cmd >= COMMAND_NB_MAX)
+        return false;
+    const command_entry_t entry = {
+        .time_ms = xTaskGetTickCountFromISR() * portTICK_PERIOD_MS,
+        .origin = origin,
+        .command = cmd
+    };
+    if (!command_ring_push(&command_handle.ring_isr, &entry))
+        return false;
+    trace_event(TRACE_STAGE_PUSH, origin);
+    vTaskNotifyGiveFromISR((TaskHandle_t) &command_handle.task, &wakeup);
+    if (wakeup == pdTRUE)
+        *task_wakeup = true;
+    return true;
 }
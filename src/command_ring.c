@@ -0,0 +1,61 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "command_ring.h"
+#include "esp_attr.h"
+#include <assert.h>
+
+static_assert(
+    (COMMAND_RING_NB & (COMMAND_RING_NB - 1u)) == 0u,
+    "Ring size is not a power of 2");
+
+void command_ring_init(command_ring_t * const ring)
+{
+    assert(ring);
+    atomic_init(&ring->head, 0u);
+    atomic_init(&ring->tail, 0u);
+    ring->high_water = 0u;
+    ring->overflows = 0u;
+}
+
+bool IRAM_ATTR command_ring_push(
+    command_ring_t * const ring, const command_entry_t * const entry)
+{
+    assert(ring);
+    assert(entry);
+    const uint32_t head =
+        atomic_load_explicit(&ring->head, memory_order_relaxed);
+    const uint32_t tail =
+        atomic_load_explicit(&ring->tail, memory_order_acquire);
+    const uint32_t used = head - tail;
+    if (used >= COMMAND_RING_NB)
+    {
+        ring->overflows++;
+        return false;
+    }
+    // Entry is written before being published to consumer.
+    ring->entries[head & (COMMAND_RING_NB - 1u)] = *entry;
+    atomic_store_explicit(&ring->head, head + 1u, memory_order_release);
+    if (used + 1u > ring->high_water)
+        ring->high_water = used + 1u;
+    return true;
+}
+
+bool command_ring_pop(
+    command_ring_t * const ring, command_entry_t * const entry)
+{
+    assert(ring);
+    assert(entry);
+    const uint32_t tail =
+        atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    const uint32_t head =
+        atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (head == tail)
+        return false;
+    // Entry is read before being released to producer.
+    *entry = ring->entries[tail & (COMMAND_RING_NB - 1u)];
+    atomic_store_explicit(&ring->tail, tail + 1u, memory_order_release);
+    return true;
+}
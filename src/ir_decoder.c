@@ -3,12 +3,21 @@
  * Copyright (c) 2024 William Vallet
  */
 
+#include "binlog.h"
 #include "command.h"
 #include "ir_decoder.h"
+#include "ir_decoder_codeset.h"
+#include "ir_decoder_partition.h"
+#include "ir_decoder_repeat.h"
+#include "power.h"
+#include "trace.h"
+#include "driver/gpio.h"
 #include "driver/rmt_rx.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
 #include "esp_log.h"
+#include "esp_sleep.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
 #include "freertos/task.h"
 #include <assert.h>
 #include <string.h>
@@ -16,203 +25,575 @@
 #define LOGGER_TAG "ir_decoder"
 
 #define IR_DECODER_TASK_STACK_SIZE       (4u * configMINIMAL_STACK_SIZE)
-#define IR_DECODER_TASK_PRIORITY         tskIDLE_PRIORITY
-#define IR_DECODER_QUEUE_NB              1u
+// Highest of application tasks, frames are decoded as soon as received.
+#define IR_DECODER_TASK_PRIORITY         (tskIDLE_PRIORITY + 5u)
+#define IR_DECODER_BUFFER_NB             4u    // One receiving, others pending.
 #define IR_DECODER_RAW_SYMBOLS_NB        64u
+#define IR_DECODER_MEM_BLOCK_SYMBOLS     48u   // Chunk of half block.
 #define IR_DECODER_RESOLUTION_HZ         1000000u   // 1us / tick.
 #define IR_DECODER_THRESHOLD_MIN_NS      1250u
-#define IR_DECODER_THRESHOLD_MAX_NS      12000000u
-
-// IR decoder parser selector.
-typedef enum
-{
-    IR_DECODER_PARSER_NEC = 0,      // NEC protocol.
-    IR_DECODER_PARSER_NEC_1,        // NEC protocol with first pulse shorter.
-                                    // Note: used by Samsung remote.
-} ir_decoder_parser_t;
-
-// IR decoder codeset configuration.
-typedef struct
-{
-    uint8_t parser;
-    uint8_t codeset[COMMAND_NB_MAX];
-} ir_decoder_codeset_t;
+// Auto-repeat of held key, frames are repeated every 45ms to 114ms.
+#define IR_DECODER_REPEAT_TIMEOUT_MS     150u
+#define IR_DECODER_REPEAT_DELAY_MS       450u
+#define IR_DECODER_REPEAT_INTERVAL_MS    300u
+#define IR_DECODER_REPEAT_INTERVAL_MIN_MS 100u
+#define IR_DECODER_REPEAT_ACCELERATION_MS 50u
+// Reception is stopped once IR line is idle, so light sleep is possible: it
+// stays armed while a key is held, and between presses in a row.
+#define IR_DECODER_SLEEP_IDLE_MS         500u
+// Truncated leading pulse is only restored for NEC family frames, reception
+// is kept running while remotes of other protocols can be received.
+#define IR_DECODER_SLEEP_PROTOCOL_MAX    IR_PROTOCOL_SAMSUNG32
+// Reception is stopped once the frame received meanwhile is complete.
+#define IR_DECODER_SLEEP_RETRY_MS        20u
+// Remote activity is reported on first frame decoded, then once a period.
+#define IR_DECODER_ACTIVITY_MS          1000u
+// Task notification of IR line edge waking up reception, and of remote
+// activity (frames decoded in RMT callback), others are the buffers
+// received.
+#define IR_DECODER_NOTIFY_WAKE           (1u << 31)
+#define IR_DECODER_NOTIFY_ACTIVITY       (1u << 30)
+#define IR_DECODER_NOTIFY_BUFFERS        ((1u << IR_DECODER_BUFFER_NB) - 1u)
 
 // IR decoder handle.
+// NEC family frames of enabled codesets are decoded by chunks in the RMT
+// callback, and their command is pushed without waking up the task.
+// Other frames go to the task: symbol buffers are used in turn, the RMT
+// callback re-arms reception in the next buffer and notifies the task with
+// the bit of the received one, the task parses buffers in turn and releases
+// them once parsed.
+// With power management, the task stops reception once idle and arms a
+// level interrupt on IR line, which wakes up light sleep. Reception is
+// started again in the leading pulse of the first frame, which is restored
+// (NEC family only, reception is not stopped for other protocols).
 typedef struct
 {
-    const ir_decoder_codeset_t *codeset;
     rmt_channel_handle_t rmt_handle;
+    uint8_t gpio_num;
+    uint8_t protocol_max;       // Highest protocol of enabled codesets.
+    ir_decoder_activity_handler_t activity_handler;
+    volatile bool activity_reported;    // Activity reported, at time.
+    volatile uint32_t activity_reported_ms;
     StaticTask_t task;
-    StaticQueue_t queue;
     StackType_t task_stack[IR_DECODER_TASK_STACK_SIZE];
-    rmt_rx_done_event_data_t queue_buffer[IR_DECODER_QUEUE_NB];
-    rmt_symbol_word_t raw_symbols[IR_DECODER_RAW_SYMBOLS_NB];
+    uint8_t buffer_receiving;
+    volatile uint8_t buffer_busy[IR_DECODER_BUFFER_NB];
+    size_t buffer_symbols_nb[IR_DECODER_BUFFER_NB];
+    uint32_t buffer_origins[IR_DECODER_BUFFER_NB];  // Trace stamps.
+    bool buffer_woken[IR_DECODER_BUFFER_NB];    // First frame after wake.
+    bool asleep;                // Reception stopped, waiting IR line.
+    volatile bool wake_first;   // First frame after wake up not received.
+    volatile uint32_t wake_origin;  // Trace stamp of IR line edge.
+    volatile uint32_t activity_ms;  // Time of last RMT callback.
+    ir_decoder_stream_t stream;
+    bool stream_handled;
+    portMUX_TYPE lock;
+    ir_decoder_repeat_t repeat;
+    ir_frame_t last_frame;
+    uint8_t hold_protocol;      // Repeat code protocol of held key.
+    volatile uint32_t frames;
+    volatile uint32_t overruns;
+    volatile uint32_t fast_frames;
+    volatile uint32_t callback_cycles;
+    volatile uint32_t callback_cycles_max;
+    volatile uint32_t wakeups;
+    volatile uint32_t wake_frames;
+    uint32_t asleep_ms;         // Time with reception stopped, before:
+    uint32_t asleep_since_ms;   // time reception was stopped.
+    rmt_symbol_word_t
+        raw_symbols[IR_DECODER_BUFFER_NB][IR_DECODER_RAW_SYMBOLS_NB];
 } ir_decoder_handle_t;
 
+static const DRAM_ATTR ir_decoder_repeat_policy_t ir_decoder_repeat_policy = {
+    .timeout_ms = IR_DECODER_REPEAT_TIMEOUT_MS,
+    .delay_ms = IR_DECODER_REPEAT_DELAY_MS,
+    .interval_ms = IR_DECODER_REPEAT_INTERVAL_MS,
+    .interval_min_ms = IR_DECODER_REPEAT_INTERVAL_MIN_MS,
+    .acceleration_ms = IR_DECODER_REPEAT_ACCELERATION_MS,
+};
 
-static ir_decoder_handle_t ir_decoder_handle;
+// Protocols without repeat code, the full frame is sent while key is held.
+static const DRAM_ATTR bool ir_decoder_retransmitted[IR_PROTOCOL_NB_MAX] = {
+    [IR_PROTOCOL_SAMSUNG32] = true,
+    [IR_PROTOCOL_SIRC]      = true,
+    [IR_PROTOCOL_RC5]       = true,
+    [IR_PROTOCOL_RC6]       = true,
+};
 
-static const ir_decoder_codeset_t ir_decoder_codeset[] = {
-    // Parser                ,   P/P , Prev, Next, Mute, Vol+, Vol-
-    { IR_DECODER_PARSER_NEC  , { 0x0D, 0x1C, 0x18, 0x04, 0x0C, 0x10 }},
-    { IR_DECODER_PARSER_NEC_1, { 0x47, 0x45, 0x48, 0x0F, 0x07, 0x0B }},
+// Protocol of repeat codes sent while key is held, NB_MAX if none (NEC_1
+// and Samsung32 repeat codes are the same).
+static const DRAM_ATTR uint8_t ir_decoder_repeat_code[IR_PROTOCOL_NB_MAX] = {
+    [IR_PROTOCOL_NEC]       = IR_PROTOCOL_NEC,
+    [IR_PROTOCOL_NEC_1]     = IR_PROTOCOL_NEC_1,
+    [IR_PROTOCOL_SAMSUNG32] = IR_PROTOCOL_NEC_1,
+    [IR_PROTOCOL_SIRC]      = IR_PROTOCOL_NB_MAX,
+    [IR_PROTOCOL_RC5]       = IR_PROTOCOL_NB_MAX,
+    [IR_PROTOCOL_RC6]       = IR_PROTOCOL_NB_MAX,
 };
-static const size_t ir_decoder_codeset_nb =
-    sizeof(ir_decoder_codeset) / sizeof(ir_decoder_codeset_t);
 
-// Parse codeset configuration to find command key.
-static bool ir_decoder_parse_codeset(
-    const ir_decoder_codeset_t * const codeset, uint8_t ir_cmd,
-    command_t * const cmd)
+static ir_decoder_handle_t ir_decoder_handle;
+
+// Track held key from decoded frame, command is set for a key press and
+// returned for a repeat code.
+// Note: called from RMT callback, with lock taken.
+// Return true if command has to be pushed, else false.
+static bool IRAM_ATTR ir_decoder_track(
+    ir_decoder_handle_t * const handle, const ir_frame_t * const frame,
+    command_t * const command, uint32_t now_ms)
 {
-    assert(codeset);
-    assert(cmd);
-    for (size_t i = 0; i < COMMAND_NB_MAX; i++)
-    {
-        if (codeset->codeset[i] == ir_cmd)
-        {
-            *cmd = (command_t) i;
-            return true;
-        }
-    }
-    return false;
+    // Repeat codes carry no address, only the ones of the protocol of the
+    // held key are taken.
+    if (frame->flags & IR_FRAME_FLAG_REPEAT)
+        return (frame->protocol == handle->hold_protocol)
+            && ir_decoder_repeat_hold(&handle->repeat, now_ms, command);
+    // Same frame (with same toggle bit for RC5/RC6) is sent while held.
+    const ir_frame_t * const last = &handle->last_frame;
+    const bool retransmission = ir_decoder_retransmitted[frame->protocol]
+        && (frame->protocol == last->protocol)
+        && (frame->flags == last->flags)
+        && (frame->address == last->address)
+        && (frame->command == last->command);
+    handle->last_frame = *frame;
+    handle->hold_protocol = ir_decoder_repeat_code[frame->protocol];
+    return ir_decoder_repeat_press(
+        &handle->repeat, *command, retransmission, now_ms);
 }
 
-// Manage NEC protocol.
-static void ir_decoder_parser_nec(
-    ir_decoder_handle_t * const handle,
-    const rmt_rx_done_event_data_t * const event, bool variant)
+// Manage decoded frame, traced from origin.
+static void ir_decoder_process(
+    ir_decoder_handle_t * const handle, const ir_frame_t * const frame,
+    uint32_t origin)
 {
-    uint8_t ir_command;
-    if (ir_decoder_format_nec(event, NULL, &ir_command, variant))
+    BINLOG_D(LOGGER_TAG,
+        "Frame decoded protocol=%s address=0x%04x command=0x%02x flags=0x%x",
+        (uintptr_t) ir_decoder_protocol_str(frame->protocol), frame->address,
+        frame->command, frame->flags);
+    // Convert command if not a repeat, from enabled codesets then codeset
+    // database. Frames of unknown remotes are dropped, or learned.
+    command_t command = COMMAND_NB_MAX;
+    if (((frame->flags & IR_FRAME_FLAG_REPEAT) == 0u)
+        && !ir_decoder_codeset_lookup(frame, &command)
+        && !ir_decoder_partition_lookup(frame, &command))
     {
-        command_t command;
-        // Convert command if not a repeat and push it.
-        if (ir_command != 0u)
-        {
-            if (ir_decoder_parse_codeset(
-                    handle->codeset, ir_command, &command))
-            {
-                ESP_LOGD(LOGGER_TAG, "Command found");
-                if (!command_push(command))
-                    ESP_LOGE(LOGGER_TAG, "Push command failed");
-            }
-            else
-                ESP_LOGW(LOGGER_TAG, "Command unsupported cmd=0x%02x",
-                    ir_command);
-        }
-        else
-            ESP_LOGD(LOGGER_TAG, "Command ignored");
+        // Next repeat codes come from an unknown remote.
+        portENTER_CRITICAL(&handle->lock);
+        handle->hold_protocol = IR_PROTOCOL_NB_MAX;
+        portEXIT_CRITICAL(&handle->lock);
+        if (!ir_decoder_partition_learn(frame))
+            BINLOG_D(LOGGER_TAG, "Command unsupported");
+        return;
+    }
+    // Push command on key press, and on auto-repeat while key is held.
+    const uint32_t now_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    portENTER_CRITICAL(&handle->lock);
+    const bool push = ir_decoder_track(handle, frame, &command, now_ms);
+    portEXIT_CRITICAL(&handle->lock);
+    if (push)
+    {
+        BINLOG_D(LOGGER_TAG, "Command found");
+        if (!command_push(command, origin))
+            ESP_LOGE(LOGGER_TAG, "Push command failed");
     }
     else
-        ESP_LOGW(LOGGER_TAG, "NEC formatter failed");
+        BINLOG_D(LOGGER_TAG, "Command ignored");
+}
+
+// Check if frame decoded is reported as remote activity.
+// Note: called from RMT callback.
+static bool IRAM_ATTR ir_decoder_active(
+    ir_decoder_handle_t * const handle, uint32_t now_ms)
+{
+    assert(handle);
+    if (handle->activity_reported
+        && ((now_ms - handle->activity_reported_ms) < IR_DECODER_ACTIVITY_MS))
+        return false;
+    handle->activity_reported = true;
+    handle->activity_reported_ms = now_ms;
+    return true;
 }
 
-// Start RMT reception for specific decoder.
-static void ir_decoder_receive(ir_decoder_handle_t * const handle)
+// Start RMT reception for specific decoder in one of its buffers.
+// Note: called from RMT callback.
+static void IRAM_ATTR ir_decoder_receive(
+    ir_decoder_handle_t * const handle, uint32_t buffer)
 {
     assert(handle);
     const rmt_receive_config_t rmt_rx_cfg = {
         .signal_range_min_ns = IR_DECODER_THRESHOLD_MIN_NS,
-        .signal_range_max_ns = IR_DECODER_THRESHOLD_MAX_NS
+        .signal_range_max_ns = IR_DECODER_THRESHOLD_MAX_NS,
+        .flags.en_partial_rx = true
     };
+    handle->buffer_symbols_nb[buffer] = 0u;
+    ir_decoder_stream_init(&handle->stream);
+    handle->stream_handled = false;
     ESP_ERROR_CHECK(rmt_receive(
         handle->rmt_handle,
-        handle->raw_symbols,
-        sizeof(handle->raw_symbols),
+        handle->raw_symbols[buffer],
+        sizeof(handle->raw_symbols[buffer]),
         &rmt_rx_cfg
     ));
 }
 
+// Manage received symbols in RMT callback, traced from origin.
+// Return true if a context switch is requested, else false.
+static bool IRAM_ATTR ir_decoder_rmt_receive_done(
+    ir_decoder_handle_t * const handle, const rmt_rx_done_event_data_t *data,
+    uint32_t origin)
+{
+    bool task_wakeup = false;
+    const uint32_t buffer = handle->buffer_receiving;
+    const bool first = handle->wake_first;
+    const uint32_t now_ms = xTaskGetTickCountFromISR() * portTICK_PERIOD_MS;
+    // Leading pulse of first frame after wake up is truncated.
+    if (first && (handle->buffer_symbols_nb[buffer] == 0u)
+        && (data->num_symbols > 0u))
+        ir_decoder_leader_restore(&data->received_symbols[0]);
+    handle->buffer_symbols_nb[buffer] += data->num_symbols;
+    handle->activity_ms = now_ms;
+    // Fast path: decode received chunk, and track held key of known remote.
+    ir_frame_t frame;
+    command_t command = COMMAND_NB_MAX;
+    const bool decoded = ir_decoder_stream_feed(&handle->stream,
+        data->received_symbols, data->num_symbols, &frame);
+    if (decoded)
+    {
+        trace_event(TRACE_STAGE_DECODE, origin);
+        if (first)
+        {
+            trace_event(TRACE_STAGE_WAKE, handle->wake_origin);
+            handle->wake_frames++;
+        }
+        // Remote activity is reported by task.
+        if (ir_decoder_active(handle, now_ms))
+        {
+            BaseType_t notify_wakeup = pdFALSE;
+            xTaskNotifyFromISR((TaskHandle_t) &handle->task,
+                IR_DECODER_NOTIFY_ACTIVITY, eSetBits, &notify_wakeup);
+            task_wakeup = task_wakeup || (notify_wakeup == pdTRUE);
+        }
+    }
+    if (decoded
+        && ((frame.flags & IR_FRAME_FLAG_REPEAT)
+            || ir_decoder_codeset_lookup(&frame, &command)))
+    {
+        portENTER_CRITICAL_ISR(&handle->lock);
+        const bool push = ir_decoder_track(handle, &frame, &command, now_ms);
+        portEXIT_CRITICAL_ISR(&handle->lock);
+        handle->stream_handled =
+            !push || command_push_from_isr(command, origin, &task_wakeup);
+    }
+    // Reception goes on in same buffer until end of frame.
+    if (!data->flags.is_last)
+        return task_wakeup;
+    handle->frames++;
+    handle->wake_first = false;
+    if (handle->stream_handled)
+    {
+        handle->fast_frames++;
+        ir_decoder_receive(handle, buffer);
+        return task_wakeup;
+    }
+    // Slow path: drop frame if all buffers are waiting for parsing, and
+    // receive again in the same buffer.
+    const uint32_t buffer_next = (buffer + 1u) % IR_DECODER_BUFFER_NB;
+    if (handle->buffer_busy[buffer_next])
+    {
+        handle->overruns++;
+        ir_decoder_receive(handle, buffer);
+        return task_wakeup;
+    }
+    // Re-arm reception first, then send buffer to parsing process.
+    handle->buffer_busy[buffer] = true;
+    handle->buffer_origins[buffer] = origin;
+    handle->buffer_woken[buffer] = first && !decoded;
+    handle->buffer_receiving = buffer_next;
+    ir_decoder_receive(handle, buffer_next);
+    BaseType_t notify_wakeup = pdFALSE;
+    xTaskNotifyFromISR((TaskHandle_t) &handle->task, 1u << buffer, eSetBits,
+        &notify_wakeup);
+    return task_wakeup || (notify_wakeup == pdTRUE);
+}
+
 // RMT event callback.
-static bool ir_decoder_rmt_handler(
+static bool IRAM_ATTR ir_decoder_rmt_handler(
     rmt_channel_handle_t channel, const rmt_rx_done_event_data_t *data,
     void *context)
 {
     (void) channel;
-    BaseType_t task_wakeup = false;
-    QueueHandle_t queue = (QueueHandle_t) context;
-    // Send data to parsing process.
-    xQueueSendFromISR(queue, data, &task_wakeup);
+    ir_decoder_handle_t * const handle = (ir_decoder_handle_t *) context;
+    const uint32_t start = esp_cpu_get_cycle_count();
+    // Events of frame are traced from the callback which completes it.
+    const uint32_t origin = trace_stamp();
+    const bool task_wakeup =
+        ir_decoder_rmt_receive_done(handle, data, origin);
+    // Record callback duration, to check ISR budget.
+    const uint32_t cycles = esp_cpu_get_cycle_count() - start;
+    handle->callback_cycles = cycles;
+    if (cycles > handle->callback_cycles_max)
+        handle->callback_cycles_max = cycles;
+    trace_event(TRACE_STAGE_RMT, origin);
     return task_wakeup;
 }
 
+// Parse frame of received buffer, then release it for reception.
+static void ir_decoder_parse(
+    ir_decoder_handle_t * const handle, uint32_t buffer)
+{
+    assert(handle);
+    const uint32_t origin = handle->buffer_origins[buffer];
+    trace_event(TRACE_STAGE_WAKEUP, origin);
+    // Symbols beyond buffer are wrapped over the first ones, such frame is
+    // too long for any protocol and rejected.
+    const size_t num_symbols = handle->buffer_symbols_nb[buffer];
+    const rmt_rx_done_event_data_t event = {
+        .received_symbols = handle->raw_symbols[buffer],
+        .num_symbols = (num_symbols <= IR_DECODER_RAW_SYMBOLS_NB)
+            ? num_symbols : 0u
+    };
+    // Symbols are logged without formatting, not to delay decoding.
+    BINLOG_D(LOGGER_TAG, "IR event detected nb=%d", num_symbols);
+    for (size_t i = 0;
+        (binlog_level_get() >= ESP_LOG_VERBOSE) && (i < event.num_symbols);
+        i++)
+    {
+        BINLOG_V(LOGGER_TAG, "event %3d: {%d, %5d} {%d, %5d}",
+            i,
+            event.received_symbols[i].level0,
+            event.received_symbols[i].duration0,
+            event.received_symbols[i].level1,
+            event.received_symbols[i].duration1);
+    }
+    // Detect protocol and decode frame.
+    ir_frame_t frame;
+    bool active = false;
+    if (ir_decoder_format(&event, &frame))
+    {
+        trace_event(TRACE_STAGE_DECODE, origin);
+        if (handle->buffer_woken[buffer])
+        {
+            trace_event(TRACE_STAGE_WAKE, handle->wake_origin);
+            handle->wake_frames++;
+        }
+        active = ir_decoder_active(handle,
+            xTaskGetTickCount() * portTICK_PERIOD_MS);
+        ir_decoder_process(handle, &frame, origin);
+    }
+    else
+        ESP_LOGW(LOGGER_TAG, "IR formatter failed");
+    // Release buffer for reception.
+    handle->buffer_busy[buffer] = false;
+    // Remote activity is reported once command is pushed, not to delay it.
+    if (active)
+        handle->activity_handler();
+}
+
+#if CONFIG_PM_ENABLE
+// IR line interrupt, first edge of a frame while reception is stopped.
+static void IRAM_ATTR ir_decoder_gpio_handler(void *context)
+{
+    ir_decoder_handle_t * const handle = (ir_decoder_handle_t *) context;
+    // Level interrupt, enabled again on next sleep.
+    gpio_intr_disable(handle->gpio_num);
+    power_acquire(POWER_LOCK_IR);
+    handle->wake_origin = trace_stamp();
+    BaseType_t notify_wakeup = pdFALSE;
+    xTaskNotifyFromISR((TaskHandle_t) &handle->task, IR_DECODER_NOTIFY_WAKE,
+        eSetBits, &notify_wakeup);
+    portYIELD_FROM_ISR(notify_wakeup);
+}
+#endif
+
+// Start reception again, on IR line edge (power lock taken by interrupt).
+static void ir_decoder_wake(ir_decoder_handle_t * const handle)
+{
+    assert(handle);
+    const uint32_t now_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    portENTER_CRITICAL(&handle->lock);
+    handle->asleep = false;
+    handle->asleep_ms += now_ms - handle->asleep_since_ms;
+    portEXIT_CRITICAL(&handle->lock);
+    handle->wakeups++;
+    handle->activity_ms = now_ms;
+    handle->wake_first = true;
+    ESP_ERROR_CHECK(rmt_enable(handle->rmt_handle));
+    ir_decoder_receive(handle, handle->buffer_receiving);
+}
+
+// Return true if reception can be stopped, false if first frame after wake
+// up would be lost (protocol enabled other than NEC family).
+static bool ir_decoder_sleep_allowed(const ir_decoder_handle_t * const handle)
+{
+    assert(handle);
+    return (handle->protocol_max <= IR_DECODER_SLEEP_PROTOCOL_MAX)
+        && (ir_decoder_partition_protocol_max()
+            <= IR_DECODER_SLEEP_PROTOCOL_MAX);
+}
+
+// Stop reception once IR line is idle, until its next edge.
+// Return time to wait before reception is idle, 0 if stopped or kept
+// running.
+static uint32_t ir_decoder_sleep(ir_decoder_handle_t * const handle)
+{
+    assert(handle);
+#if CONFIG_PM_ENABLE
+    if (!ir_decoder_sleep_allowed(handle))
+        return 0u;
+    const uint32_t idle_ms =
+        xTaskGetTickCount() * portTICK_PERIOD_MS - handle->activity_ms;
+    if (idle_ms < IR_DECODER_SLEEP_IDLE_MS)
+        return IR_DECODER_SLEEP_IDLE_MS - idle_ms;
+    for (size_t i = 0; i < IR_DECODER_BUFFER_NB; i++)
+    {
+        if (handle->buffer_busy[i])
+            return IR_DECODER_SLEEP_IDLE_MS;
+    }
+    // Frame started since last RMT callback (IR line active low).
+    if (gpio_get_level(handle->gpio_num) == 0)
+        return IR_DECODER_SLEEP_RETRY_MS;
+    ESP_ERROR_CHECK(rmt_disable(handle->rmt_handle));
+    portENTER_CRITICAL(&handle->lock);
+    handle->asleep = true;
+    handle->asleep_since_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    portEXIT_CRITICAL(&handle->lock);
+    handle->wake_first = false;
+    gpio_intr_enable(handle->gpio_num);
+    power_release(POWER_LOCK_IR);
+    return 0u;
+#else
+    (void) handle;
+    return 0u;
+#endif
+}
+
 // IR decoder task handler.
 static void ir_decoder_task_handler(void *context)
 {
     assert(context);
-    rmt_rx_done_event_data_t event;
     ir_decoder_handle_t * const handle = (ir_decoder_handle_t *) context;
-    assert(handle->codeset);
+    uint32_t overruns = 0u;
+    uint32_t received = 0u;     // Buffers not parsed yet (bit mask).
+    uint32_t buffer = handle->buffer_receiving;
+    uint32_t wait_ms = 0u;      // Time before reception is idle, if awake.
     // Trigger first reception.
-    ir_decoder_receive(handle);
+    ir_decoder_receive(handle, handle->buffer_receiving);
     while (true)
     {
-        // Wait event from RMT callback.
-        if (pdPASS == xQueueReceive(
-                (QueueHandle_t) &handle->queue, &event, pdMS_TO_TICKS(1000)))
+        // Wait received buffers from RMT callback, then parse them in turn.
+        uint32_t notified = 0u;
+        xTaskNotifyWait(0u, UINT32_MAX, &notified,
+            (wait_ms > 0u) ? pdMS_TO_TICKS(wait_ms) : portMAX_DELAY);
+        if ((notified & IR_DECODER_NOTIFY_WAKE) != 0u)
+            ir_decoder_wake(handle);
+        received |= notified & IR_DECODER_NOTIFY_BUFFERS;
+        while ((received & (1u << buffer)) != 0u)
+        {
+            received &= ~(1u << buffer);
+            ir_decoder_parse(handle, buffer);
+            buffer = (buffer + 1u) % IR_DECODER_BUFFER_NB;
+        }
+        // After frames pending, whose commands are pushed first.
+        if ((notified & IR_DECODER_NOTIFY_ACTIVITY) != 0u)
+            handle->activity_handler();
+        if (overruns != handle->overruns)
         {
-            ESP_LOGD(LOGGER_TAG, "IR event detected nb=%d", event.num_symbols);
-            for (int i = 0; i < event.num_symbols; i++)
-            {
-                ESP_LOGV(LOGGER_TAG, "event %3d: {%d, %5d} {%d, %5d}",
-                    i,
-                    event.received_symbols[i].level0,
-                    event.received_symbols[i].duration0,
-                    event.received_symbols[i].level1,
-                    event.received_symbols[i].duration1);
-            }
-            // Send to parsing method.
-            switch (handle->codeset->parser)
-            {
-                case IR_DECODER_PARSER_NEC:
-                    ir_decoder_parser_nec(handle, &event, false);
-                    break;
-                case IR_DECODER_PARSER_NEC_1:
-                    ir_decoder_parser_nec(handle, &event, true);
-                    break;
-                default:
-                    ESP_LOGW(LOGGER_TAG, "IR parser unsupported");
-                    break;
-            }
-            // Trigger next reception.
-            ir_decoder_receive(handle);
+            overruns = handle->overruns;
+            ESP_LOGW(LOGGER_TAG, "Reception overrun nb=%lu", overruns);
         }
+        wait_ms = handle->asleep ? 0u : ir_decoder_sleep(handle);
     }
 }
 
-void ir_decoder_init(uint8_t gpio_num, uint8_t codeset)
+void ir_decoder_stats_get(ir_decoder_stats_t * const stats)
 {
-    assert(codeset < ir_decoder_codeset_nb);
+    assert(stats);
+    stats->frames = ir_decoder_handle.frames;
+    stats->overruns = ir_decoder_handle.overruns;
+    stats->fast_frames = ir_decoder_handle.fast_frames;
+    stats->callback_cycles = ir_decoder_handle.callback_cycles;
+    stats->callback_cycles_max = ir_decoder_handle.callback_cycles_max;
+    stats->wakeups = ir_decoder_handle.wakeups;
+    stats->wake_frames = ir_decoder_handle.wake_frames;
+    // Include reception stopped now.
+    const uint32_t now_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    portENTER_CRITICAL(&ir_decoder_handle.lock);
+    stats->asleep_ms = ir_decoder_handle.asleep_ms;
+    if (ir_decoder_handle.asleep)
+        stats->asleep_ms += now_ms - ir_decoder_handle.asleep_since_ms;
+    portEXIT_CRITICAL(&ir_decoder_handle.lock);
+}
+
+void ir_decoder_power_dump(void)
+{
+    ir_decoder_stats_t stats;
+    ir_decoder_stats_get(&stats);
+    const uint32_t uptime_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    ESP_LOGI(LOGGER_TAG, "Reception stopped %lu/%lums (%lu%%) wakeups=%lu "
+        "wake_frames=%lu", (unsigned long) stats.asleep_ms,
+        (unsigned long) uptime_ms, (unsigned long) ((uptime_ms > 0u)
+            ? (uint64_t) stats.asleep_ms * 100u / uptime_ms : 0u),
+        (unsigned long) stats.wakeups, (unsigned long) stats.wake_frames);
+#if CONFIG_PM_ENABLE
+    if (!ir_decoder_sleep_allowed(&ir_decoder_handle))
+        ESP_LOGW(LOGGER_TAG, "Reception kept running, codeset protocol=%u "
+            "database protocol=%u", ir_decoder_handle.protocol_max,
+            ir_decoder_partition_protocol_max());
+#endif
+}
+
+void ir_decoder_init(uint8_t gpio_num, uint32_t codesets,
+    ir_decoder_activity_handler_t activity_handler)
+{
+    assert(activity_handler);
     memset(&ir_decoder_handle, 0, sizeof(ir_decoder_handle_t));
+    ir_decoder_handle.gpio_num = gpio_num;
+    ir_decoder_handle.hold_protocol = IR_PROTOCOL_NB_MAX;
+    ir_decoder_handle.activity_handler = activity_handler;
+    portMUX_INITIALIZE(&ir_decoder_handle.lock);
+    ir_decoder_repeat_init(
+        &ir_decoder_handle.repeat, &ir_decoder_repeat_policy);
     const rmt_rx_channel_config_t rmt_cfg = {
         .gpio_num = gpio_num,
         .clk_src = RMT_CLK_SRC_DEFAULT,
         .resolution_hz = IR_DECODER_RESOLUTION_HZ,
-        .mem_block_symbols = IR_DECODER_RAW_SYMBOLS_NB
+        .mem_block_symbols = IR_DECODER_MEM_BLOCK_SYMBOLS
     };
     const rmt_rx_event_callbacks_t rmt_cbs = {
         .on_recv_done = ir_decoder_rmt_handler
     };
-    // Register codeset.
-    ESP_LOGI(LOGGER_TAG, "codeset=%d", codeset);
-    ir_decoder_handle.codeset = &ir_decoder_codeset[codeset];
+    // Build lookup table of enabled codesets.
+    ESP_LOGI(LOGGER_TAG, "codesets=0x%08lx", codesets);
+    if (!ir_decoder_codeset_init(codesets))
+        ESP_LOGE(LOGGER_TAG, "Codesets lookup table failed");
+    for (size_t i = 0; i < ir_decoder_codeset_nb; i++)
+    {
+        const ir_decoder_codeset_t * const codeset =
+            ir_decoder_codeset_get((uint8_t) i);
+        if (((codesets & (1u << i)) != 0u) && codeset
+            && (codeset->protocol > ir_decoder_handle.protocol_max))
+            ir_decoder_handle.protocol_max = codeset->protocol;
+    }
+    // Other remotes are looked up in codeset database, by task.
+    ir_decoder_partition_init();
     // Initialise RX channel.
     ESP_ERROR_CHECK(rmt_new_rx_channel(&rmt_cfg, &ir_decoder_handle.rmt_handle));
-    // Initialise RX queue and register handler.
-    xQueueCreateStatic(
-        IR_DECODER_QUEUE_NB,
-        sizeof(rmt_rx_done_event_data_t),
-        (uint8_t *) ir_decoder_handle.queue_buffer,
-        &ir_decoder_handle.queue
-    );
+    // Register handler.
     ESP_ERROR_CHECK(rmt_rx_register_event_callbacks(
         ir_decoder_handle.rmt_handle,
         &rmt_cbs,
-        (QueueHandle_t) &ir_decoder_handle.queue
+        &ir_decoder_handle
     ));
-    // Enable processing.
+#if CONFIG_PM_ENABLE
+    // IR line (active low) wakes up light sleep once reception is stopped.
+    ESP_ERROR_CHECK(gpio_wakeup_enable(gpio_num, GPIO_INTR_LOW_LEVEL));
+    ESP_ERROR_CHECK(esp_sleep_enable_gpio_wakeup());
+    ESP_ERROR_CHECK(gpio_install_isr_service(ESP_INTR_FLAG_IRAM));
+    ESP_ERROR_CHECK(gpio_isr_handler_add(
+        gpio_num, &ir_decoder_gpio_handler, &ir_decoder_handle));
+    ESP_ERROR_CHECK(gpio_intr_disable(gpio_num));
+#endif
+    // Enable processing, awake until IR line is idle.
+    power_acquire(POWER_LOCK_IR);
+    ir_decoder_handle.activity_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
     ESP_ERROR_CHECK(rmt_enable(ir_decoder_handle.rmt_handle));
     // Create parsing task.
     xTaskCreateStatic(
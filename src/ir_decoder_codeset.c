@@ -0,0 +1,175 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "ir_decoder_codeset.h"
+#include "esp_attr.h"
+#include <assert.h>
+#include <string.h>
+
+// Lookup table is a two-level perfect hash: key hash selects a bucket, and
+// bucket displacement selects the slot of each key without collision.
+#define CODESET_SLOT_BITS                  6u
+#define CODESET_SLOT_NB         (1u << CODESET_SLOT_BITS)
+#define CODESET_BUCKET_BITS                4u
+#define CODESET_BUCKET_NB       (1u << CODESET_BUCKET_BITS)
+#define CODESET_DISPLACEMENT_NB          256u
+
+// Slot content: key (protocol, address, IR command), valid flag and command.
+#define CODESET_KEY(protocol, address, command) \
+    (((uint32_t) (protocol) << 24u) | ((uint32_t) (address) << 8u) \
+        | (uint32_t) (command))
+#define CODESET_KEY_MASK                0x07FFFFFFu
+#define CODESET_SLOT_VALID              (1u << 27u)
+#define CODESET_SLOT_COMMAND_SHIFT        28u
+
+// Codeset lookup table.
+typedef struct
+{
+    uint8_t displacement[CODESET_BUCKET_NB];
+    uint32_t slots[CODESET_SLOT_NB];
+} ir_decoder_codeset_table_t;
+
+static const ir_decoder_codeset_t ir_decoder_codeset[] = {
+    // Protocol            , Address,   P/P , Prev, Next, Mute, Vol+, Vol-
+    { IR_PROTOCOL_NEC      , 0xFF00u, { 0x0D, 0x1C, 0x18, 0x04, 0x0C, 0x10 }},
+    { IR_PROTOCOL_SAMSUNG32, 0x0707u, { 0x47, 0x45, 0x48, 0x0F, 0x07, 0x0B }},
+    { IR_PROTOCOL_SIRC     , 0x0001u, { 0x1A, 0x11, 0x10, 0x14, 0x12, 0x13 }},
+    { IR_PROTOCOL_RC5      , 0x0000u, { 0x35, 0x21, 0x20, 0x0D, 0x10, 0x11 }},
+    { IR_PROTOCOL_RC6      , 0x0000u, { 0x2C, 0x21, 0x20, 0x0D, 0x10, 0x11 }},
+};
+const size_t ir_decoder_codeset_nb =
+    sizeof(ir_decoder_codeset) / sizeof(ir_decoder_codeset_t);
+
+static_assert(
+    sizeof(ir_decoder_codeset) / sizeof(ir_decoder_codeset_t) <= 32u,
+    "Codeset does not fit in enabled codesets mask");
+static_assert(
+    IR_PROTOCOL_NB_MAX <= 8u, "Protocol does not fit in codeset key");
+static_assert(
+    COMMAND_NB_MAX <= 16u, "Command does not fit in codeset slot");
+
+static ir_decoder_codeset_table_t ir_decoder_codeset_table;
+
+FORCE_INLINE_ATTR uint32_t codeset_bucket(uint32_t key)
+{
+    return (key * 0xCC9E2D51u) >> (32u - CODESET_BUCKET_BITS);
+}
+
+FORCE_INLINE_ATTR uint32_t codeset_slot(uint32_t key, uint32_t displacement)
+{
+    return ((key ^ (displacement * 0x85EBCA6Bu)) * 0x9E3779B1u)
+        >> (32u - CODESET_SLOT_BITS);
+}
+
+// Find displacement placing all bucket entries in free slots.
+// Return true on success, false if no displacement is available.
+static bool codeset_place_bucket(
+    ir_decoder_codeset_table_t * const table, const uint32_t * const entries,
+    size_t entries_nb, uint32_t bucket)
+{
+    for (uint32_t displacement = 0u;
+        displacement < CODESET_DISPLACEMENT_NB;
+        displacement++)
+    {
+        uint64_t used = 0u;
+        bool placed = true;
+        for (size_t i = 0; placed && (i < entries_nb); i++)
+        {
+            const uint32_t key = entries[i] & CODESET_KEY_MASK;
+            if (codeset_bucket(key) != bucket)
+                continue;
+            const uint32_t slot = codeset_slot(key, displacement);
+            placed = (table->slots[slot] == 0u)
+                && ((used & (1ull << slot)) == 0u);
+            used |= 1ull << slot;
+        }
+        if (!placed)
+            continue;
+        for (size_t i = 0; i < entries_nb; i++)
+        {
+            const uint32_t key = entries[i] & CODESET_KEY_MASK;
+            if (codeset_bucket(key) == bucket)
+                table->slots[codeset_slot(key, displacement)] = entries[i];
+        }
+        table->displacement[bucket] = (uint8_t) displacement;
+        return true;
+    }
+    return false;
+}
+
+const ir_decoder_codeset_t *ir_decoder_codeset_get(uint8_t codeset)
+{
+    if (codeset >= ir_decoder_codeset_nb)
+        return NULL;
+    return &ir_decoder_codeset[codeset];
+}
+
+bool ir_decoder_codeset_init(uint32_t codesets)
+{
+    static_assert(CODESET_SLOT_NB <= 64u, "Slot mask is too small");
+    ir_decoder_codeset_table_t * const table = &ir_decoder_codeset_table;
+    uint32_t entries[CODESET_SLOT_NB];
+    size_t entries_nb = 0u;
+    uint32_t bucket_size[CODESET_BUCKET_NB] = { 0 };
+    memset(table, 0, sizeof(ir_decoder_codeset_table_t));
+    // Collect keys of enabled codesets.
+    for (size_t i = 0; i < ir_decoder_codeset_nb; i++)
+    {
+        if ((codesets & (1u << i)) == 0u)
+            continue;
+        const ir_decoder_codeset_t * const codeset = &ir_decoder_codeset[i];
+        for (size_t cmd = 0; cmd < COMMAND_NB_MAX; cmd++)
+        {
+            const uint32_t key = CODESET_KEY(
+                codeset->protocol, codeset->address, codeset->codeset[cmd]);
+            const uint32_t entry = key | CODESET_SLOT_VALID
+                | ((uint32_t) cmd << CODESET_SLOT_COMMAND_SHIFT);
+            bool duplicate = false;
+            for (size_t j = 0; j < entries_nb; j++)
+            {
+                if ((entries[j] & CODESET_KEY_MASK) != key)
+                    continue;
+                // Same key is only allowed for the same command.
+                if (entries[j] != entry)
+                    return false;
+                duplicate = true;
+            }
+            if (duplicate)
+                continue;
+            if (entries_nb >= CODESET_SLOT_NB)
+                return false;
+            entries[entries_nb++] = entry;
+            bucket_size[codeset_bucket(key)]++;
+        }
+    }
+    // Place largest buckets first, while most slots are free.
+    for (uint32_t size = CODESET_SLOT_NB; size > 0u; size--)
+    {
+        for (uint32_t bucket = 0u; bucket < CODESET_BUCKET_NB; bucket++)
+        {
+            if ((bucket_size[bucket] == size)
+                && !codeset_place_bucket(table, entries, entries_nb, bucket))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool IRAM_ATTR ir_decoder_codeset_lookup(
+    const ir_frame_t * const frame, command_t * const cmd)
+{
+    assert(frame);
+    assert(cmd);
+    const ir_decoder_codeset_table_t * const table = &ir_decoder_codeset_table;
+    const uint32_t key =
+        CODESET_KEY(frame->protocol, frame->address, frame->command);
+    const uint32_t slot = table->slots[
+        codeset_slot(key, table->displacement[codeset_bucket(key)])];
+    if ((slot & (CODESET_KEY_MASK | CODESET_SLOT_VALID))
+        != (key | CODESET_SLOT_VALID))
+        return false;
+    *cmd = (command_t) (slot >> CODESET_SLOT_COMMAND_SHIFT);
+    return true;
+}
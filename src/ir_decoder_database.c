@@ -0,0 +1,107 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "ir_decoder_database.h"
+#include <assert.h>
+#include <string.h>
+
+static_assert(sizeof(ir_decoder_database_header_t) == 16u,
+    "Codeset database header layout changed");
+static_assert(sizeof(ir_decoder_database_record_t) == 8u,
+    "Codeset database record layout changed");
+
+bool ir_decoder_database_open(ir_decoder_database_t * const database,
+    const void *image, size_t size)
+{
+    assert(database);
+    assert(image);
+    const ir_decoder_database_header_t * const header =
+        (const ir_decoder_database_header_t *) image;
+    memset(database, 0, sizeof(ir_decoder_database_t));
+    if ((size < sizeof(ir_decoder_database_header_t))
+        || (header->magic != IR_DECODER_DATABASE_MAGIC)
+        || (header->version != IR_DECODER_DATABASE_VERSION)
+        || (header->record_size != sizeof(ir_decoder_database_record_t)))
+        return false;
+    const size_t records_max = (size - sizeof(ir_decoder_database_header_t))
+        / sizeof(ir_decoder_database_record_t);
+    if (header->records_nb > records_max)
+        return false;
+    database->records = (const ir_decoder_database_record_t *) &header[1];
+    database->records_nb = header->records_nb;
+    // Binary search needs keys strictly sorted.
+    for (size_t i = 1; i < database->records_nb; i++)
+    {
+        if (database->records[i - 1u].key >= database->records[i].key)
+            return false;
+    }
+    // Journal ends at first erased record.
+    database->journal = &database->records[database->records_nb];
+    database->journal_max = records_max - database->records_nb;
+    while ((database->journal_nb < database->journal_max)
+        && (database->journal[database->journal_nb].key
+            != IR_DECODER_DATABASE_KEY_FREE))
+        database->journal_nb++;
+    return true;
+}
+
+const ir_decoder_database_record_t *ir_decoder_database_find(
+    const ir_decoder_database_t * const database, uint32_t key)
+{
+    assert(database);
+    // Last record learned wins, journal is short.
+    for (size_t i = database->journal_nb; i > 0u; i--)
+    {
+        if (database->journal[i - 1u].key == key)
+            return &database->journal[i - 1u];
+    }
+    size_t low = 0u;
+    size_t high = database->records_nb;
+    while (low < high)
+    {
+        const size_t middle = low + ((high - low) >> 1u);
+        const uint32_t middle_key = database->records[middle].key;
+        if (middle_key == key)
+            return &database->records[middle];
+        if (middle_key < key)
+            low = middle + 1u;
+        else
+            high = middle;
+    }
+    return NULL;
+}
+
+uint8_t ir_decoder_database_protocol_max(
+    const ir_decoder_database_t * const database)
+{
+    assert(database);
+    // Protocol is the key high byte, so last sorted record has the highest.
+    uint32_t key_max = (database->records_nb > 0u)
+        ? database->records[database->records_nb - 1u].key : 0u;
+    for (size_t i = 0; i < database->journal_nb; i++)
+    {
+        if (database->journal[i].key > key_max)
+            key_max = database->journal[i].key;
+    }
+    return (uint8_t) (key_max >> 24u);
+}
+
+size_t ir_decoder_database_journal_offset(
+    const ir_decoder_database_t * const database)
+{
+    assert(database);
+    if (database->journal_nb == database->journal_max)
+        return 0u;
+    return sizeof(ir_decoder_database_header_t)
+        + ((database->records_nb + database->journal_nb)
+            * sizeof(ir_decoder_database_record_t));
+}
+
+void ir_decoder_database_journal_add(ir_decoder_database_t * const database)
+{
+    assert(database);
+    assert(database->journal_nb < database->journal_max);
+    database->journal_nb++;
+}
@@ -0,0 +1,95 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "ir_decoder.h"
+#include <assert.h>
+
+// Leading code durations are quantised by bucket of 64us. Buckets are wide
+// enough to only tell protocols apart, decoders check exact timings.
+#define FORMAT_BUCKET_SHIFT                6u
+#define FORMAT_BUCKET_MAX_DURATION      9599u
+#define FORMAT_BUCKET_NB \
+    ((FORMAT_BUCKET_MAX_DURATION >> FORMAT_BUCKET_SHIFT) + 1u)
+#define FORMAT_BUCKET_RANGE(min, max) \
+    [(min) >> FORMAT_BUCKET_SHIFT ... (max) >> FORMAT_BUCKET_SHIFT]
+
+// Leading code duration class.
+typedef enum
+{
+    FORMAT_DURATION_INVALID = 0,
+    FORMAT_DURATION_600,        // SIRC leading space.
+    FORMAT_DURATION_889,        // RC5 half bit, RC6 leading space.
+    FORMAT_DURATION_1778,       // RC5 merged half bits.
+    FORMAT_DURATION_2400,       // SIRC/RC6 leading pulse, NEC repeat space.
+    FORMAT_DURATION_4500,       // NEC leading space, NEC_1 leading code.
+    FORMAT_DURATION_9000,       // NEC leading pulse.
+    FORMAT_DURATION_NB_MAX
+} format_duration_t;
+
+static const uint8_t format_duration_bucket[FORMAT_BUCKET_NB] = {
+    FORMAT_BUCKET_RANGE( 400,  767) = FORMAT_DURATION_600,
+    FORMAT_BUCKET_RANGE( 768, 1215) = FORMAT_DURATION_889,
+    FORMAT_BUCKET_RANGE(1472, 2047) = FORMAT_DURATION_1778,
+    FORMAT_BUCKET_RANGE(2048, 2943) = FORMAT_DURATION_2400,
+    FORMAT_BUCKET_RANGE(4096, 4927) = FORMAT_DURATION_4500,
+    FORMAT_BUCKET_RANGE(8448, 9599) = FORMAT_DURATION_9000,
+};
+
+// Frame decoder selected by the leading code signature (pulse, space).
+static const ir_decoder_format_t
+    format_decoder[FORMAT_DURATION_NB_MAX][FORMAT_DURATION_NB_MAX] = {
+    [FORMAT_DURATION_9000][FORMAT_DURATION_4500] = ir_decoder_format_nec,
+    [FORMAT_DURATION_9000][FORMAT_DURATION_2400] = ir_decoder_format_nec,
+    [FORMAT_DURATION_4500][FORMAT_DURATION_4500] = ir_decoder_format_nec_1,
+    [FORMAT_DURATION_2400][FORMAT_DURATION_2400] = ir_decoder_format_nec_1,
+    [FORMAT_DURATION_2400][FORMAT_DURATION_600]  = ir_decoder_format_sirc,
+    [FORMAT_DURATION_2400][FORMAT_DURATION_889]  = ir_decoder_format_rc6,
+    [FORMAT_DURATION_889][FORMAT_DURATION_889]   = ir_decoder_format_rc5,
+    [FORMAT_DURATION_889][FORMAT_DURATION_1778]  = ir_decoder_format_rc5,
+    [FORMAT_DURATION_1778][FORMAT_DURATION_889]  = ir_decoder_format_rc5,
+    [FORMAT_DURATION_1778][FORMAT_DURATION_1778] = ir_decoder_format_rc5,
+};
+
+static const char *format_protocol_str[] = {
+    [IR_PROTOCOL_NEC]       = "NEC",
+    [IR_PROTOCOL_NEC_1]     = "NEC_1",
+    [IR_PROTOCOL_SAMSUNG32] = "Samsung32",
+    [IR_PROTOCOL_SIRC]      = "SIRC",
+    [IR_PROTOCOL_RC5]       = "RC5",
+    [IR_PROTOCOL_RC6]       = "RC6",
+};
+
+// Quantise leading code duration and get its class.
+static inline format_duration_t format_classify(uint32_t duration)
+{
+    const uint32_t bucket = duration >> FORMAT_BUCKET_SHIFT;
+    if (bucket >= FORMAT_BUCKET_NB)
+        return FORMAT_DURATION_INVALID;
+    return (format_duration_t) format_duration_bucket[bucket];
+}
+
+bool ir_decoder_format(
+    const rmt_rx_done_event_data_t * const event, ir_frame_t * const frame)
+{
+    assert(event);
+    assert(frame);
+    const rmt_symbol_word_t * const symbols = event->received_symbols;
+    if (event->num_symbols < 2u)
+        return false;
+    // Route frame to its decoder from the first symbol only.
+    const ir_decoder_format_t decoder = format_decoder
+        [format_classify(symbols[0].duration0)]
+        [format_classify(symbols[0].duration1)];
+    if (!decoder)
+        return false;
+    return decoder(symbols, event->num_symbols, frame);
+}
+
+const char *ir_decoder_protocol_str(uint8_t protocol)
+{
+    if (protocol >= IR_PROTOCOL_NB_MAX)
+        return "Unknown";
+    return format_protocol_str[protocol];
+}
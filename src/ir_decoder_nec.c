@@ -4,13 +4,12 @@
  */
 
 #include "ir_decoder.h"
-#include "esp_log.h"
-#include <stdio.h>
-
-#define LOGGER_TAG "ir_decoder_nec"
+#include "esp_attr.h"
+#include <assert.h>
 
 #define NEC_FRAME_NORMAL                  34u
 #define NEC_FRAME_REPEAT                   2u
+#define NEC_FRAME_DATA_BITS               32u
 #define NEC_RANGE_MARGIN                 150u
 #define NEC_LEADING_CODE_DURATION_0     9000u
 #define NEC_LEADING_CODE_DURATION_1     4500u
@@ -21,138 +20,276 @@
 #define NEC_ONE_DURATION_0               562u
 #define NEC_ONE_DURATION_1              1675u
 
-static inline bool nec_check_range(uint32_t value, uint32_t expected)
-{
-    return ((expected - NEC_RANGE_MARGIN) < value)
-        && (value < (expected + NEC_RANGE_MARGIN));
-}
+// Durations are quantised by bucket of 32us, covering the 15-bit range.
+#define NEC_BUCKET_SHIFT                   5u
+#define NEC_BUCKET_NB               ((0x7FFFu >> NEC_BUCKET_SHIFT) + 1u)
+#define NEC_BUCKET_MIN(duration) \
+    (((duration) - NEC_RANGE_MARGIN) >> NEC_BUCKET_SHIFT)
+#define NEC_BUCKET_MAX(duration) \
+    (((duration) + NEC_RANGE_MARGIN) >> NEC_BUCKET_SHIFT)
+#define NEC_BUCKET_RANGE(duration) \
+    [NEC_BUCKET_MIN(duration) ... NEC_BUCKET_MAX(duration)]
 
-static bool nec_check_leading_code(
-    const rmt_symbol_word_t * const symbol, bool variant)
+// Duration class, one per nominal duration used by the protocol.
+typedef enum
 {
-    assert(symbol);
-    if (variant)
-        return nec_check_range(symbol->duration0, NEC_LEADING_CODE_DURATION_1)
-            && nec_check_range(symbol->duration1, NEC_LEADING_CODE_DURATION_1);
-    else
-        return nec_check_range(symbol->duration0, NEC_LEADING_CODE_DURATION_0)
-            && nec_check_range(symbol->duration1, NEC_LEADING_CODE_DURATION_1);
-}
+    NEC_DURATION_INVALID = 0,
+    NEC_DURATION_562,
+    NEC_DURATION_1675,
+    NEC_DURATION_2250,
+    NEC_DURATION_4500,
+    NEC_DURATION_9000,
+    NEC_DURATION_NB_MAX
+} nec_duration_t;
 
-static bool nec_check_repeat_code(
-    const rmt_symbol_word_t * const symbol, bool variant)
+// Symbol class, zero and one values are consecutive to give the bit value.
+typedef enum
 {
-    assert(symbol);
-    if (variant)
-        return nec_check_range(symbol->duration0, NEC_REPEAT_CODE_DURATION_1)
-            && nec_check_range(symbol->duration1, NEC_REPEAT_CODE_DURATION_1);
-    else
-        return nec_check_range(symbol->duration0, NEC_REPEAT_CODE_DURATION_0)
-            && nec_check_range(symbol->duration1, NEC_REPEAT_CODE_DURATION_1);
-}
+    NEC_SYMBOL_INVALID = 0,
+    NEC_SYMBOL_ZERO,
+    NEC_SYMBOL_ONE,
+    NEC_SYMBOL_LEADER,
+    NEC_SYMBOL_REPEAT
+} nec_symbol_t;
 
-static bool nec_check_zero(const rmt_symbol_word_t * const symbol)
-{
-    assert(symbol);
-    return nec_check_range(symbol->duration0, NEC_ZERO_DURATION_0)
-        && nec_check_range(symbol->duration1, NEC_ZERO_DURATION_1);
-}
+// Symbol class table, indexed by duration class of both symbol levels.
+typedef uint8_t nec_symbol_table_t[NEC_DURATION_NB_MAX][NEC_DURATION_NB_MAX];
+
+// Tables are used from RMT callback, and placed in internal RAM.
+static const DRAM_ATTR uint8_t nec_duration_bucket[NEC_BUCKET_NB] = {
+    NEC_BUCKET_RANGE(NEC_ZERO_DURATION_0)         = NEC_DURATION_562,
+    NEC_BUCKET_RANGE(NEC_ONE_DURATION_1)          = NEC_DURATION_1675,
+    NEC_BUCKET_RANGE(NEC_REPEAT_CODE_DURATION_1)  = NEC_DURATION_2250,
+    NEC_BUCKET_RANGE(NEC_LEADING_CODE_DURATION_1) = NEC_DURATION_4500,
+    NEC_BUCKET_RANGE(NEC_LEADING_CODE_DURATION_0) = NEC_DURATION_9000,
+};
+
+// Standard NEC: 9ms leading pulse.
+static const DRAM_ATTR nec_symbol_table_t nec_symbol_table = {
+    [NEC_DURATION_562][NEC_DURATION_562]   = NEC_SYMBOL_ZERO,
+    [NEC_DURATION_562][NEC_DURATION_1675]  = NEC_SYMBOL_ONE,
+    [NEC_DURATION_9000][NEC_DURATION_4500] = NEC_SYMBOL_LEADER,
+    [NEC_DURATION_9000][NEC_DURATION_2250] = NEC_SYMBOL_REPEAT,
+};
 
-static bool nec_check_one(const rmt_symbol_word_t * const symbol)
+// NEC variant: 4.5ms leading pulse.
+static const DRAM_ATTR nec_symbol_table_t nec_1_symbol_table = {
+    [NEC_DURATION_562][NEC_DURATION_562]   = NEC_SYMBOL_ZERO,
+    [NEC_DURATION_562][NEC_DURATION_1675]  = NEC_SYMBOL_ONE,
+    [NEC_DURATION_4500][NEC_DURATION_4500] = NEC_SYMBOL_LEADER,
+    [NEC_DURATION_2250][NEC_DURATION_2250] = NEC_SYMBOL_REPEAT,
+};
+
+// Quantise symbol durations and get its class.
+FORCE_INLINE_ATTR nec_symbol_t nec_classify(
+    const nec_symbol_table_t table, const rmt_symbol_word_t * const symbol)
 {
-    assert(symbol);
-    return nec_check_range(symbol->duration0, NEC_ONE_DURATION_0)
-        && nec_check_range(symbol->duration1, NEC_ONE_DURATION_1);
+    return (nec_symbol_t) table
+        [nec_duration_bucket[symbol->duration0 >> NEC_BUCKET_SHIFT]]
+        [nec_duration_bucket[symbol->duration1 >> NEC_BUCKET_SHIFT]];
 }
 
-static bool nec_parse_normal(
-    const rmt_symbol_word_t *symbols, uint16_t * const address,
-    uint8_t * const command, bool variant)
+static inline bool nec_parse_normal(
+    const nec_symbol_table_t table, const rmt_symbol_word_t *symbols,
+    uint32_t * const data)
 {
     assert(symbols);
+    assert(data);
     // Normal frame is composed of leading code, address and command.
     // Check if leading code is valid.
-    if (!nec_check_leading_code(symbols++, variant))
+    if (nec_classify(table, symbols++) != NEC_SYMBOL_LEADER)
         return false;
-    // Decode address if requested.
-    if (address)
+    // Decode address and command in one pass, abort on first invalid symbol.
+    uint32_t value = 0u;
+    for (uint32_t i = 0; i < NEC_FRAME_DATA_BITS; i++)
     {
-        *address = 0u;
-        for (uint32_t i = 0; i < 16u; i++)
-        {
-            if (nec_check_one(symbols))
-                *address |= 1u << i;
-            else if (nec_check_zero(symbols))
-            {
-                // Already at zero, nothing to do.
-            }
-            else
-                return false;
-            symbols++;
-        }
-    }
-    else
-        symbols += 16u;
-    // Decode command if requested.
-    if (command)
-    {
-        uint16_t command_raw = 0u;
-        for (uint32_t i = 0; i < 16u; i++)
-        {
-            if (nec_check_one(symbols))
-                command_raw |= 1u << i;
-            else if (nec_check_zero(symbols))
-            {
-                // Already at zero, nothing to do.
-            }
-            else
-                return false;
-            symbols++;
-        }
-        // Check inversion format.
-        if (((~command_raw & 0xFF00u) >> 8u) != (command_raw & 0xFFu))
+        const uint32_t bit =
+            (uint32_t) nec_classify(table, symbols++) - NEC_SYMBOL_ZERO;
+        if (bit > 1u)
             return false;
-        *command = command_raw & 0xFFu;
+        value |= bit << i;
     }
-    ESP_LOGD(LOGGER_TAG,
-        "Frame decoded address=0x%04x command=0x%02x",
-        (address) ? *address : 0,
-        (command) ? *command : 0);
+    // Check command inversion format.
+    if ((((value >> 24u) ^ (value >> 16u)) & 0xFFu) != 0xFFu)
+        return false;
+    *data = value;
     return true;
 }
 
-static bool nec_parse_repeat(
-    const rmt_symbol_word_t * const symbols, uint16_t * const address,
-    uint8_t * const command, bool variant)
+static inline bool nec_parse_repeat(
+    const nec_symbol_table_t table, const rmt_symbol_word_t * const symbols)
 {
     assert(symbols);
     // No information on this frame, use only first symbol.
-    if (nec_check_repeat_code(&symbols[0], variant))
-    {
-        if (address)
-            *address = 0u;
-        if (command)
-            *command = 0u;
-        return true;
-    }
-    return false;
+    return nec_classify(table, &symbols[0]) == NEC_SYMBOL_REPEAT;
 }
 
-bool ir_decoder_format_nec(
-    const rmt_rx_done_event_data_t * const event, uint16_t * const address,
-    uint8_t * const command, bool variant)
+// Set frame content from decoded data.
+FORCE_INLINE_ATTR void nec_frame_set(uint32_t data, ir_frame_t * const frame)
+{
+    frame->flags = 0u;
+    frame->bits = NEC_FRAME_DATA_BITS;
+    frame->address = data & 0xFFFFu;
+    frame->command = (data >> 16u) & 0xFFu;
+}
+
+// Get protocol of NEC_1 frame.
+FORCE_INLINE_ATTR uint8_t nec_1_protocol(const ir_frame_t * const frame)
 {
-    const rmt_symbol_word_t * const symbols = event->received_symbols;
-    switch (event->num_symbols)
+    // Samsung32 uses same frame format, with address byte sent twice.
+    if (((frame->flags & IR_FRAME_FLAG_REPEAT) == 0u)
+        && ((frame->address >> 8u) == (frame->address & 0xFFu)))
+        return IR_PROTOCOL_SAMSUNG32;
+    return IR_PROTOCOL_NEC_1;
+}
+
+// Frame parser, specialised by symbol table of the protocol variant.
+// Return frame data, or repeat code.
+static inline bool nec_format(
+    const nec_symbol_table_t table, const rmt_symbol_word_t * const symbols,
+    size_t num_symbols, ir_frame_t * const frame)
+{
+    assert(frame);
+    uint32_t data;
+    switch (num_symbols)
     {
         case NEC_FRAME_NORMAL:
-            ESP_LOGD(LOGGER_TAG, "Normal frame");
-            return nec_parse_normal(symbols, address, command, variant);
+            if (!nec_parse_normal(table, symbols, &data))
+                return false;
+            nec_frame_set(data, frame);
+            return true;
         case NEC_FRAME_REPEAT:
-            ESP_LOGD(LOGGER_TAG, "Repeat frame");
-            return nec_parse_repeat(symbols, NULL, NULL, variant);
+            if (!nec_parse_repeat(table, symbols))
+                return false;
+            frame->flags = IR_FRAME_FLAG_REPEAT;
+            frame->bits = 0u;
+            frame->address = 0u;
+            frame->command = 0u;
+            return true;
         default:
-            ESP_LOGW(LOGGER_TAG, "Frame unsupported");
             return false;
     }
 }
+
+bool ir_decoder_format_nec(
+    const rmt_symbol_word_t * const symbols, size_t num_symbols,
+    ir_frame_t * const frame)
+{
+    if (!nec_format(nec_symbol_table, symbols, num_symbols, frame))
+        return false;
+    frame->protocol = IR_PROTOCOL_NEC;
+    return true;
+}
+
+bool ir_decoder_format_nec_1(
+    const rmt_symbol_word_t * const symbols, size_t num_symbols,
+    ir_frame_t * const frame)
+{
+    if (!nec_format(nec_1_symbol_table, symbols, num_symbols, frame))
+        return false;
+    frame->protocol = nec_1_protocol(frame);
+    return true;
+}
+
+void IRAM_ATTR ir_decoder_leader_restore(rmt_symbol_word_t * const symbol)
+{
+    assert(symbol);
+    // Leading space is received whole, it tells a leading code (4.5ms) from
+    // a repeat code (2.25ms) and pulse durations possible.
+    const nec_duration_t space = (nec_duration_t)
+        nec_duration_bucket[symbol->duration1 >> NEC_BUCKET_SHIFT];
+    uint32_t pulse_1;
+    if (space == NEC_DURATION_4500)
+        pulse_1 = NEC_LEADING_CODE_DURATION_1;
+    else if (space == NEC_DURATION_2250)
+        pulse_1 = NEC_REPEAT_CODE_DURATION_1;
+    else
+        return;
+    // Pulse longer than NEC_1 one is a truncated NEC pulse.
+    if (symbol->duration0 >= (NEC_LEADING_CODE_DURATION_0 - NEC_RANGE_MARGIN))
+        return;
+    if (symbol->duration0 > (pulse_1 + NEC_RANGE_MARGIN))
+        symbol->duration0 = NEC_LEADING_CODE_DURATION_0;
+    else if (symbol->duration0 < (pulse_1 - NEC_RANGE_MARGIN))
+        symbol->duration0 = pulse_1;
+}
+
+void IRAM_ATTR ir_decoder_stream_init(ir_decoder_stream_t * const stream)
+{
+    assert(stream);
+    stream->state = IR_DECODER_STREAM_LEADER;
+    stream->protocol = IR_PROTOCOL_NB_MAX;
+    stream->bits = 0u;
+    stream->data = 0u;
+}
+
+bool IRAM_ATTR ir_decoder_stream_feed(
+    ir_decoder_stream_t * const stream, const rmt_symbol_word_t *symbols,
+    size_t num_symbols, ir_frame_t * const frame)
+{
+    assert(stream);
+    assert(symbols || (num_symbols == 0u));
+    assert(frame);
+    for (; num_symbols > 0u; num_symbols--, symbols++)
+    {
+        if (stream->state == IR_DECODER_STREAM_LEADER)
+        {
+            // Only NEC family frames are streamed, leading code selects the
+            // protocol variant. Repeat code is decoded at once.
+            const nec_symbol_t nec = nec_classify(nec_symbol_table, symbols);
+            const nec_symbol_t nec_1 =
+                nec_classify(nec_1_symbol_table, symbols);
+            if ((nec == NEC_SYMBOL_REPEAT) || (nec_1 == NEC_SYMBOL_REPEAT))
+            {
+                frame->protocol = (nec == NEC_SYMBOL_REPEAT)
+                    ? IR_PROTOCOL_NEC : IR_PROTOCOL_NEC_1;
+                frame->flags = IR_FRAME_FLAG_REPEAT;
+                frame->bits = 0u;
+                frame->address = 0u;
+                frame->command = 0u;
+                stream->state = IR_DECODER_STREAM_DECODED;
+                return true;
+            }
+            if (nec == NEC_SYMBOL_LEADER)
+                stream->protocol = IR_PROTOCOL_NEC;
+            else if (nec_1 == NEC_SYMBOL_LEADER)
+                stream->protocol = IR_PROTOCOL_NEC_1;
+            else
+            {
+                stream->state = IR_DECODER_STREAM_FALLBACK;
+                return false;
+            }
+            stream->state = IR_DECODER_STREAM_DATA;
+        }
+        else if (stream->state == IR_DECODER_STREAM_DATA)
+        {
+            const uint32_t bit = (uint32_t) nec_classify(
+                (stream->protocol == IR_PROTOCOL_NEC)
+                    ? nec_symbol_table : nec_1_symbol_table,
+                symbols) - NEC_SYMBOL_ZERO;
+            if (bit > 1u)
+            {
+                stream->state = IR_DECODER_STREAM_FALLBACK;
+                return false;
+            }
+            stream->data |= bit << stream->bits++;
+            if (stream->bits < NEC_FRAME_DATA_BITS)
+                continue;
+            // Last data bit received, frame is complete without stop bit.
+            const uint32_t value = stream->data;
+            if ((((value >> 24u) ^ (value >> 16u)) & 0xFFu) != 0xFFu)
+            {
+                stream->state = IR_DECODER_STREAM_FALLBACK;
+                return false;
+            }
+            nec_frame_set(value, frame);
+            frame->protocol = (stream->protocol == IR_PROTOCOL_NEC)
+                ? IR_PROTOCOL_NEC : nec_1_protocol(frame);
+            stream->state = IR_DECODER_STREAM_DECODED;
+            return true;
+        }
+        else
+            return false;
+    }
+    return false;
+}
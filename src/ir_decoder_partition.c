@@ -0,0 +1,187 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "ir_decoder_partition.h"
+#include "ir_decoder_database.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include <assert.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#define LOGGER_TAG "ir_database"
+
+#define IR_DECODER_PARTITION_LABEL      "codesets"
+
+// Codeset database partition handle.
+// Database is read in place from flash mapping, so its size does not
+// depend on RAM. Records learned are appended by IR decoder task, which is
+// the only one reading the database.
+typedef struct
+{
+    const esp_partition_t *partition;
+    esp_partition_mmap_handle_t mmap;
+    ir_decoder_database_t database;
+    bool mapped;
+    uint8_t protocol_max;       // Highest protocol of records.
+    atomic_uint_least32_t learning; // Command learned, none if NB_MAX.
+} ir_decoder_partition_handle_t;
+
+static ir_decoder_partition_handle_t ir_decoder_partition_handle;
+
+// Write empty database header in erased partition.
+// Return true on success, false on error.
+static bool ir_decoder_partition_format(const esp_partition_t *partition)
+{
+    assert(partition);
+    ir_decoder_database_header_t header;
+    ESP_ERROR_CHECK(esp_partition_read(partition, 0u, &header,
+        sizeof(ir_decoder_database_header_t)));
+    if (header.magic != IR_DECODER_DATABASE_KEY_FREE)
+        return true;
+    ESP_LOGI(LOGGER_TAG, "Codeset database empty");
+    header.magic = IR_DECODER_DATABASE_MAGIC;
+    header.version = IR_DECODER_DATABASE_VERSION;
+    header.record_size = sizeof(ir_decoder_database_record_t);
+    header.records_nb = 0u;
+    header.crc = 0u;
+    return esp_partition_write(partition, 0u, &header,
+        sizeof(ir_decoder_database_header_t)) == ESP_OK;
+}
+
+bool ir_decoder_partition_init(void)
+{
+    ir_decoder_partition_handle_t * const handle =
+        &ir_decoder_partition_handle;
+    memset(handle, 0, sizeof(ir_decoder_partition_handle_t));
+    atomic_init(&handle->learning, COMMAND_NB_MAX);
+    handle->partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+        ESP_PARTITION_SUBTYPE_ANY, IR_DECODER_PARTITION_LABEL);
+    if (!handle->partition)
+    {
+        ESP_LOGW(LOGGER_TAG, "Codeset partition not found");
+        return false;
+    }
+    if (!ir_decoder_partition_format(handle->partition))
+    {
+        ESP_LOGE(LOGGER_TAG, "Codeset partition write failed");
+        return false;
+    }
+    const void *image = NULL;
+    ESP_ERROR_CHECK(esp_partition_mmap(handle->partition, 0u,
+        handle->partition->size, ESP_PARTITION_MMAP_DATA, &image,
+        &handle->mmap));
+    const ir_decoder_database_header_t * const header =
+        (const ir_decoder_database_header_t *) image;
+    if (!ir_decoder_database_open(&handle->database, image,
+            handle->partition->size)
+        || (esp_rom_crc32_le(0u, (const uint8_t *) handle->database.records,
+                handle->database.records_nb
+                    * sizeof(ir_decoder_database_record_t))
+            != header->crc))
+    {
+        ESP_LOGE(LOGGER_TAG, "Codeset database not valid");
+        esp_partition_munmap(handle->mmap);
+        return false;
+    }
+    handle->mapped = true;
+    handle->protocol_max =
+        ir_decoder_database_protocol_max(&handle->database);
+    ESP_LOGI(LOGGER_TAG, "Codeset database records=%lu learned=%lu/%lu",
+        (unsigned long) handle->database.records_nb,
+        (unsigned long) handle->database.journal_nb,
+        (unsigned long) handle->database.journal_max);
+    return true;
+}
+
+bool ir_decoder_partition_lookup(
+    const ir_frame_t * const frame, command_t * const cmd)
+{
+    assert(frame);
+    assert(cmd);
+    const ir_decoder_partition_handle_t * const handle =
+        &ir_decoder_partition_handle;
+    if (!handle->mapped)
+        return false;
+    const ir_decoder_database_record_t * const record =
+        ir_decoder_database_find(&handle->database,
+            IR_DECODER_DATABASE_KEY(
+                frame->protocol, frame->address, frame->command));
+    if (!record || (record->command >= COMMAND_NB_MAX))
+        return false;
+    *cmd = (command_t) record->command;
+    return true;
+}
+
+uint8_t ir_decoder_partition_protocol_max(void)
+{
+    return ir_decoder_partition_handle.protocol_max;
+}
+
+void ir_decoder_partition_learn_start(void)
+{
+    ir_decoder_partition_handle_t * const handle =
+        &ir_decoder_partition_handle;
+    if (!handle->mapped)
+    {
+        ESP_LOGW(LOGGER_TAG, "Learning not available");
+        return;
+    }
+    atomic_store_explicit(&handle->learning, 0u, memory_order_relaxed);
+    ESP_LOGI(LOGGER_TAG, "Learning, press key of command=%s",
+        command_str((command_t) 0));
+}
+
+bool ir_decoder_partition_learn(const ir_frame_t * const frame)
+{
+    assert(frame);
+    ir_decoder_partition_handle_t * const handle =
+        &ir_decoder_partition_handle;
+    const uint32_t learning =
+        atomic_load_explicit(&handle->learning, memory_order_relaxed);
+    if (learning >= COMMAND_NB_MAX)
+        return false;
+    const size_t offset =
+        ir_decoder_database_journal_offset(&handle->database);
+    if (offset == 0u)
+    {
+        ESP_LOGE(LOGGER_TAG, "Codeset database full");
+        atomic_store_explicit(&handle->learning, COMMAND_NB_MAX,
+            memory_order_relaxed);
+        return false;
+    }
+    // Record is written through flash driver, then read from mapping.
+    const ir_decoder_database_record_t record = {
+        .key = IR_DECODER_DATABASE_KEY(
+            frame->protocol, frame->address, frame->command),
+        .remote = IR_DECODER_DATABASE_REMOTE_LEARNED,
+        .command = (uint8_t) learning,
+        .reserved = 0xFFu,
+    };
+    if (esp_partition_write(handle->partition, offset, &record,
+            sizeof(ir_decoder_database_record_t)) != ESP_OK)
+    {
+        ESP_LOGE(LOGGER_TAG, "Learned key write failed");
+        return false;
+    }
+    ir_decoder_database_journal_add(&handle->database);
+    if (frame->protocol > handle->protocol_max)
+        handle->protocol_max = frame->protocol;
+    ESP_LOGI(LOGGER_TAG,
+        "Key learned command=%s protocol=%s address=0x%04x code=0x%02x",
+        command_str((command_t) learning),
+        ir_decoder_protocol_str(frame->protocol), frame->address,
+        frame->command);
+    // Next command, learning is done after last one.
+    atomic_store_explicit(&handle->learning, learning + 1u,
+        memory_order_relaxed);
+    if ((learning + 1u) < COMMAND_NB_MAX)
+        ESP_LOGI(LOGGER_TAG, "Learning, press key of command=%s",
+            command_str((command_t) (learning + 1u)));
+    else
+        ESP_LOGI(LOGGER_TAG, "Learning done");
+    return true;
+}
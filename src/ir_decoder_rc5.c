@@ -0,0 +1,101 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "ir_decoder.h"
+#include <assert.h>
+
+#define RC5_FRAME_BITS                    14u
+#define RC5_FRAME_UNITS         (2u * RC5_FRAME_BITS)
+#define RC5_RANGE_MARGIN                 300u
+#define RC5_HALF_BIT_DURATION            889u
+#define RC5_LEVEL_SPACE                    1u
+
+// Durations are quantised by bucket of 32us, up to the longest pulse.
+#define RC5_BUCKET_SHIFT                   5u
+#define RC5_BUCKET_NB \
+    (((2u * RC5_HALF_BIT_DURATION + RC5_RANGE_MARGIN) >> RC5_BUCKET_SHIFT) \
+        + 1u)
+#define RC5_BUCKET_RANGE(duration) \
+    [((duration) - RC5_RANGE_MARGIN) >> RC5_BUCKET_SHIFT \
+        ... ((duration) + RC5_RANGE_MARGIN) >> RC5_BUCKET_SHIFT]
+
+// Number of half-bit units given by duration (0 if invalid).
+static const uint8_t rc5_duration_bucket[RC5_BUCKET_NB] = {
+    RC5_BUCKET_RANGE(RC5_HALF_BIT_DURATION)      = 1u,
+    RC5_BUCKET_RANGE(2u * RC5_HALF_BIT_DURATION) = 2u,
+};
+
+// Quantise duration into half-bit units.
+static inline uint32_t rc5_units(uint32_t duration)
+{
+    const uint32_t bucket = duration >> RC5_BUCKET_SHIFT;
+    if (bucket >= RC5_BUCKET_NB)
+        return 0u;
+    return rc5_duration_bucket[bucket];
+}
+
+// Append level to half-bit units stream.
+// Return false if duration is invalid or stream is too long.
+static inline bool rc5_push(
+    uint32_t * const levels, uint32_t * const position, uint32_t level,
+    uint32_t duration)
+{
+    const uint32_t units = rc5_units(duration);
+    if ((units == 0u) || ((*position + units) > RC5_FRAME_UNITS))
+        return false;
+    if (level == RC5_LEVEL_SPACE)
+        *levels |= ((1u << units) - 1u) << *position;
+    *position += units;
+    return true;
+}
+
+bool ir_decoder_format_rc5(
+    const rmt_symbol_word_t * const symbols, size_t num_symbols,
+    ir_frame_t * const frame)
+{
+    assert(symbols);
+    assert(frame);
+    // First start bit is always one, its first half (space) is merged with
+    // idle level before the frame.
+    uint32_t levels = 1u << 0u;
+    uint32_t position = 1u;
+    for (size_t i = 0; i < num_symbols; i++)
+    {
+        const rmt_symbol_word_t * const symbol = &symbols[i];
+        if (!rc5_push(&levels, &position, symbol->level0, symbol->duration0))
+            return false;
+        // Last half-bit space is merged with end of frame idle.
+        if ((symbol->duration1 == 0u) && (i + 1u == num_symbols))
+        {
+            if ((RC5_FRAME_UNITS - position) > 1u)
+                return false;
+            levels |= ((1u << (RC5_FRAME_UNITS - position)) - 1u) << position;
+            position = RC5_FRAME_UNITS;
+        }
+        else if (!rc5_push(
+                &levels, &position, symbol->level1, symbol->duration1))
+            return false;
+    }
+    if (position != RC5_FRAME_UNITS)
+        return false;
+    // Manchester decoding, one is a space to mark transition. Bits are sent
+    // MSB first: start, field, toggle, address (5 bits), command (6 bits).
+    uint32_t data = 0u;
+    for (uint32_t i = 0; i < RC5_FRAME_BITS; i++)
+    {
+        const uint32_t first = (levels >> (2u * i)) & 1u;
+        const uint32_t second = (levels >> (2u * i + 1u)) & 1u;
+        if (first == second)
+            return false;
+        data = (data << 1u) | first;
+    }
+    frame->protocol = IR_PROTOCOL_RC5;
+    frame->flags = (data & (1u << 11u)) ? IR_FRAME_FLAG_TOGGLE : 0u;
+    frame->bits = RC5_FRAME_BITS;
+    frame->address = (data >> 6u) & 0x1Fu;
+    // Field bit is the inverted seventh command bit (RC5X).
+    frame->command = (data & 0x3Fu) | (((~data >> 12u) & 1u) << 6u);
+    return true;
+}
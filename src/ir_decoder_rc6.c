@@ -0,0 +1,133 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "ir_decoder.h"
+#include <assert.h>
+
+#define RC6_FRAME_UNITS                   44u   // Start, mode, trailer, data.
+#define RC6_MODE                           0u
+#define RC6_RANGE_MARGIN                 200u
+#define RC6_LEADING_CODE_DURATION_0     2666u
+#define RC6_LEADING_CODE_DURATION_1      889u
+#define RC6_UNIT_DURATION                444u
+#define RC6_LEVEL_SPACE                    1u
+
+// Durations are quantised by bucket of 32us, up to the longest pulse.
+#define RC6_BUCKET_SHIFT                   5u
+#define RC6_BUCKET_NB \
+    (((RC6_LEADING_CODE_DURATION_0 + RC6_RANGE_MARGIN) >> RC6_BUCKET_SHIFT) \
+        + 1u)
+#define RC6_BUCKET_RANGE(duration) \
+    [((duration) - RC6_RANGE_MARGIN) >> RC6_BUCKET_SHIFT \
+        ... ((duration) + RC6_RANGE_MARGIN) >> RC6_BUCKET_SHIFT]
+#define RC6_BUCKET_LEADER               0xFFu
+
+// Number of units given by duration (0 if invalid). Trailer bit halves are
+// two units long, so up to three units can be merged.
+static const uint8_t rc6_duration_bucket[RC6_BUCKET_NB] = {
+    RC6_BUCKET_RANGE(RC6_UNIT_DURATION)           = 1u,
+    RC6_BUCKET_RANGE(2u * RC6_UNIT_DURATION)      = 2u,
+    RC6_BUCKET_RANGE(3u * RC6_UNIT_DURATION)      = 3u,
+    RC6_BUCKET_RANGE(RC6_LEADING_CODE_DURATION_0) = RC6_BUCKET_LEADER,
+};
+
+// Quantise duration into units.
+static inline uint32_t rc6_units(uint32_t duration)
+{
+    const uint32_t bucket = duration >> RC6_BUCKET_SHIFT;
+    if (bucket >= RC6_BUCKET_NB)
+        return 0u;
+    return rc6_duration_bucket[bucket];
+}
+
+// Append level to units stream.
+// Return false if duration is invalid or stream is too long.
+static inline bool rc6_push(
+    uint64_t * const levels, uint32_t * const position, uint32_t level,
+    uint32_t duration)
+{
+    const uint32_t units = rc6_units(duration);
+    if ((units == 0u) || (units > 3u)
+        || ((*position + units) > RC6_FRAME_UNITS))
+        return false;
+    if (level == RC6_LEVEL_SPACE)
+        *levels |= ((1ull << units) - 1u) << *position;
+    *position += units;
+    return true;
+}
+
+// Decode Manchester bit from two half-bit levels, one is a mark to space
+// transition. Return bit value, or 2 if invalid.
+static inline uint32_t rc6_bit(uint64_t levels, uint32_t first, uint32_t second)
+{
+    const uint32_t level_first = (levels >> first) & 1u;
+    const uint32_t level_second = (levels >> second) & 1u;
+    return (level_first == level_second) ? 2u : (level_first ^ 1u);
+}
+
+bool ir_decoder_format_rc6(
+    const rmt_symbol_word_t * const symbols, size_t num_symbols,
+    ir_frame_t * const frame)
+{
+    assert(symbols);
+    assert(frame);
+    if ((num_symbols < 2u)
+        || (rc6_units(symbols[0].duration0) != RC6_BUCKET_LEADER)
+        || (rc6_units(symbols[0].duration1) != 2u))
+        return false;
+    uint64_t levels = 0u;
+    uint32_t position = 0u;
+    for (size_t i = 1; i < num_symbols; i++)
+    {
+        const rmt_symbol_word_t * const symbol = &symbols[i];
+        if (!rc6_push(&levels, &position, symbol->level0, symbol->duration0))
+            return false;
+        // Last space is merged with end of frame idle.
+        if ((symbol->duration1 == 0u) && (i + 1u == num_symbols))
+        {
+            if ((RC6_FRAME_UNITS - position) > 1u)
+                return false;
+            levels |= ((1ull << (RC6_FRAME_UNITS - position)) - 1u) << position;
+            position = RC6_FRAME_UNITS;
+        }
+        else if (!rc6_push(
+                &levels, &position, symbol->level1, symbol->duration1))
+            return false;
+    }
+    if (position != RC6_FRAME_UNITS)
+        return false;
+    // Start bit is always one, followed by mode (3 bits).
+    uint32_t header = 0u;
+    for (uint32_t i = 0; i < 4u; i++)
+    {
+        const uint32_t bit = rc6_bit(levels, 2u * i, 2u * i + 1u);
+        if (bit > 1u)
+            return false;
+        header = (header << 1u) | bit;
+    }
+    if (header != (0x8u | RC6_MODE))
+        return false;
+    // Trailer bit is twice longer and gives the toggle.
+    const uint32_t toggle = rc6_bit(levels, 8u, 10u);
+    if ((toggle > 1u)
+        || (((levels >> 8u) & 1u) != ((levels >> 9u) & 1u))
+        || (((levels >> 10u) & 1u) != ((levels >> 11u) & 1u)))
+        return false;
+    // Address and command (8 bits each), MSB first.
+    uint32_t data = 0u;
+    for (uint32_t i = 0; i < 16u; i++)
+    {
+        const uint32_t bit = rc6_bit(levels, 12u + 2u * i, 13u + 2u * i);
+        if (bit > 1u)
+            return false;
+        data = (data << 1u) | bit;
+    }
+    frame->protocol = IR_PROTOCOL_RC6;
+    frame->flags = toggle ? IR_FRAME_FLAG_TOGGLE : 0u;
+    frame->bits = 16u;
+    frame->address = data >> 8u;
+    frame->command = data & 0xFFu;
+    return true;
+}
@@ -0,0 +1,98 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "ir_decoder_repeat.h"
+#include "esp_attr.h"
+#include <assert.h>
+
+// Commands repeated while key is held, others are only sent on key press.
+static const DRAM_ATTR bool repeat_command_repeatable[COMMAND_NB_MAX] = {
+    [COMMAND_PREVIOUS]    = true,
+    [COMMAND_NEXT]        = true,
+    [COMMAND_VOLUME_UP]   = true,
+    [COMMAND_VOLUME_DOWN] = true,
+};
+
+// Check if time is reached, handles tick counter wrap.
+FORCE_INLINE_ATTR bool repeat_time_reached(uint32_t now_ms, uint32_t time_ms)
+{
+    return (int32_t) (now_ms - time_ms) >= 0;
+}
+
+// Check if held key is still active.
+FORCE_INLINE_ATTR bool repeat_active(
+    const ir_decoder_repeat_t * const repeat, uint32_t now_ms)
+{
+    return repeat->held
+        && ((now_ms - repeat->last_ms) <= repeat->policy->timeout_ms);
+}
+
+// Update held key, and schedule next repeat with accelerated rate.
+// Return true if command has to be repeated, else false.
+FORCE_INLINE_ATTR bool repeat_step(
+    ir_decoder_repeat_t * const repeat, uint32_t now_ms)
+{
+    const ir_decoder_repeat_policy_t * const policy = repeat->policy;
+    repeat->last_ms = now_ms;
+    if (!repeat_command_repeatable[repeat->command]
+        || !repeat_time_reached(now_ms, repeat->next_ms))
+        return false;
+    repeat->next_ms = now_ms + repeat->interval_ms;
+    const uint32_t interval_ms = repeat->interval_ms - policy->acceleration_ms;
+    if ((repeat->interval_ms >= policy->acceleration_ms)
+        && (interval_ms >= policy->interval_min_ms))
+        repeat->interval_ms = interval_ms;
+    else
+        repeat->interval_ms = policy->interval_min_ms;
+    return true;
+}
+
+void ir_decoder_repeat_init(
+    ir_decoder_repeat_t * const repeat,
+    const ir_decoder_repeat_policy_t * const policy)
+{
+    assert(repeat);
+    assert(policy);
+    repeat->policy = policy;
+    repeat->held = false;
+    repeat->command = COMMAND_NB_MAX;
+    repeat->last_ms = 0u;
+    repeat->next_ms = 0u;
+    repeat->interval_ms = policy->interval_ms;
+}
+
+bool IRAM_ATTR ir_decoder_repeat_press(
+    ir_decoder_repeat_t * const repeat, command_t command,
+    bool retransmission, uint32_t now_ms)
+{
+    assert(repeat);
+    assert(command < COMMAND_NB_MAX);
+    if (retransmission && (repeat->command == command)
+        && repeat_active(repeat, now_ms))
+        return repeat_step(repeat, now_ms);
+    // New key press, command is sent and repeat starts after delay.
+    repeat->held = true;
+    repeat->command = command;
+    repeat->last_ms = now_ms;
+    repeat->next_ms = now_ms + repeat->policy->delay_ms;
+    repeat->interval_ms = repeat->policy->interval_ms;
+    return true;
+}
+
+bool IRAM_ATTR ir_decoder_repeat_hold(
+    ir_decoder_repeat_t * const repeat, uint32_t now_ms,
+    command_t * const command)
+{
+    assert(repeat);
+    assert(command);
+    // Repeat code without recent key press is ignored.
+    if (!repeat_active(repeat, now_ms))
+    {
+        repeat->held = false;
+        return false;
+    }
+    *command = repeat->command;
+    return repeat_step(repeat, now_ms);
+}
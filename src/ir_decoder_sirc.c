@@ -0,0 +1,85 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "ir_decoder.h"
+#include <assert.h>
+
+#define SIRC_COMMAND_BITS                  7u
+#define SIRC_RANGE_MARGIN                200u
+#define SIRC_LEADING_CODE_DURATION_0    2400u
+#define SIRC_LEADING_CODE_DURATION_1     600u
+#define SIRC_ZERO_DURATION_0             600u
+#define SIRC_ONE_DURATION_0             1200u
+
+// Durations are quantised by bucket of 32us, up to the longest pulse.
+#define SIRC_BUCKET_SHIFT                  5u
+#define SIRC_BUCKET_NB \
+    (((SIRC_LEADING_CODE_DURATION_0 + SIRC_RANGE_MARGIN) >> SIRC_BUCKET_SHIFT) \
+        + 1u)
+#define SIRC_BUCKET_RANGE(duration) \
+    [((duration) - SIRC_RANGE_MARGIN) >> SIRC_BUCKET_SHIFT \
+        ... ((duration) + SIRC_RANGE_MARGIN) >> SIRC_BUCKET_SHIFT]
+
+// Duration class, one per nominal duration used by the protocol.
+typedef enum
+{
+    SIRC_DURATION_INVALID = 0,
+    SIRC_DURATION_600,
+    SIRC_DURATION_1200,
+    SIRC_DURATION_2400
+} sirc_duration_t;
+
+static const uint8_t sirc_duration_bucket[SIRC_BUCKET_NB] = {
+    SIRC_BUCKET_RANGE(SIRC_ZERO_DURATION_0)         = SIRC_DURATION_600,
+    SIRC_BUCKET_RANGE(SIRC_ONE_DURATION_0)          = SIRC_DURATION_1200,
+    SIRC_BUCKET_RANGE(SIRC_LEADING_CODE_DURATION_0) = SIRC_DURATION_2400,
+};
+
+// Quantise duration and get its class.
+static inline sirc_duration_t sirc_classify(uint32_t duration)
+{
+    const uint32_t bucket = duration >> SIRC_BUCKET_SHIFT;
+    if (bucket >= SIRC_BUCKET_NB)
+        return SIRC_DURATION_INVALID;
+    return (sirc_duration_t) sirc_duration_bucket[bucket];
+}
+
+bool ir_decoder_format_sirc(
+    const rmt_symbol_word_t * const symbols, size_t num_symbols,
+    ir_frame_t * const frame)
+{
+    assert(symbols);
+    assert(frame);
+    // Frame is composed of leading code and 12, 15 or 20 bits.
+    const size_t bits = num_symbols - 1u;
+    if ((bits != 12u) && (bits != 15u) && (bits != 20u))
+        return false;
+    if ((sirc_classify(symbols[0].duration0) != SIRC_DURATION_2400)
+        || (sirc_classify(symbols[0].duration1) != SIRC_DURATION_600))
+        return false;
+    // Bit value is given by pulse width, LSB first. Last space is merged
+    // with end of frame idle.
+    uint32_t data = 0u;
+    for (uint32_t i = 0; i < bits; i++)
+    {
+        const rmt_symbol_word_t * const symbol = &symbols[i + 1u];
+        const uint32_t bit =
+            (uint32_t) sirc_classify(symbol->duration0) - SIRC_DURATION_600;
+        if (bit > 1u)
+            return false;
+        if ((i + 1u < bits)
+            && (sirc_classify(symbol->duration1) != SIRC_DURATION_600))
+            return false;
+        data |= bit << i;
+    }
+    frame->protocol = IR_PROTOCOL_SIRC;
+    frame->flags = 0u;
+    frame->bits = (uint8_t) bits;
+    frame->command = data & ((1u << SIRC_COMMAND_BITS) - 1u);
+    // Address is 5-bit device (12 bits), 8-bit device (15 bits), or 5-bit
+    // device followed by 8-bit extended (20 bits).
+    frame->address = (uint16_t) (data >> SIRC_COMMAND_BITS);
+    return true;
+}
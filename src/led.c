@@ -5,10 +5,20 @@
 
 #include "board_cfg.h"
 #include "led.h"
+#include "esp_attr.h"
 #include "esp_err.h"
 #include "driver/ledc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <assert.h>
+#include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
+#define LED_TASK_STACK_SIZE (3u * configMINIMAL_STACK_SIZE)
+// Lowest of application tasks, only woken up at end of fades.
+#define LED_TASK_PRIORITY   (tskIDLE_PRIORITY + 1u)
 #define LED_SPEED           LEDC_LOW_SPEED_MODE
 #define LED_TIMER           LEDC_TIMER_0
 #define LED_DUTY_RES        LEDC_TIMER_13_BIT
@@ -20,7 +30,8 @@ static const ledc_timer_config_t led_timer_config[] = {
         .duty_resolution = LED_DUTY_RES,
         .timer_num = LED_TIMER,
         .freq_hz = BOARD_LED_FREQUENCY,
-        .clk_cfg = LEDC_AUTO_CLK,
+        // Internal oscillator keeps running in light sleep, unlike APB.
+        .clk_cfg = LEDC_USE_RC_FAST_CLK,
         .deconfigure = false
     }
 };
@@ -58,23 +69,274 @@ static const ledc_channel_config_t led_channel_config[] = {
 };
 static const size_t led_channel_config_nb =
     sizeof(led_channel_config) / sizeof(ledc_channel_config_t);
+static_assert(
+    sizeof(led_channel_config) / sizeof(ledc_channel_config_t) == LED_NB_MAX,
+    "LED channels do not match LEDs");
+
+// Pattern step: level reached by a fade over its time, at once if none.
+// A step at same level as previous one is held for its time.
+typedef struct
+{
+    uint8_t percent;
+    uint16_t fade_ms;
+} led_step_t;
+
+// Steps of a pattern, or of a flash.
+typedef struct
+{
+    const led_step_t *steps;
+    size_t steps_nb;
+} led_sequence_t;
+
+#define LED_SEQUENCE(steps) { (steps), sizeof(steps) / sizeof(led_step_t) }
+
+static const led_step_t led_steps_off[] = { { 0u, 0u } };
+static const led_step_t led_steps_on[] = { { BOARD_LED_DUTY_CYCLE, 0u } };
+static const led_step_t led_steps_dim[] = {
+    { BOARD_LED_DUTY_CYCLE_DIM, 0u }
+};
+static const led_step_t led_steps_breathe[] = {
+    { BOARD_LED_DUTY_CYCLE, 1500u },
+    { 0u, 1500u },
+};
+static const led_step_t led_steps_blink[] = {
+    { BOARD_LED_DUTY_CYCLE, 0u },
+    { BOARD_LED_DUTY_CYCLE, 250u },
+    { 0u, 0u },
+    { 0u, 250u },
+};
+static const led_step_t led_steps_heartbeat[] = {
+    { BOARD_LED_DUTY_CYCLE, 0u },
+    { BOARD_LED_DUTY_CYCLE, 100u },
+    { 0u, 0u },
+    { 0u, 150u },
+    { BOARD_LED_DUTY_CYCLE, 0u },
+    { BOARD_LED_DUTY_CYCLE, 100u },
+    { 0u, 0u },
+    { 0u, 850u },
+};
+// Flash is inverted from a LED on: off, on, then pattern again.
+static const led_step_t led_steps_flash[] = {
+    { 0u, 0u },
+    { 0u, 60u },
+    { BOARD_LED_DUTY_CYCLE, 0u },
+    { BOARD_LED_DUTY_CYCLE, 60u },
+};
+
+static const led_sequence_t led_patterns[] = {
+    [LED_PATTERN_OFF] = LED_SEQUENCE(led_steps_off),
+    [LED_PATTERN_ON] = LED_SEQUENCE(led_steps_on),
+    [LED_PATTERN_DIM] = LED_SEQUENCE(led_steps_dim),
+    [LED_PATTERN_BREATHE] = LED_SEQUENCE(led_steps_breathe),
+    [LED_PATTERN_BLINK] = LED_SEQUENCE(led_steps_blink),
+    [LED_PATTERN_HEARTBEAT] = LED_SEQUENCE(led_steps_heartbeat),
+};
+static const led_sequence_t led_flash_sequence =
+    LED_SEQUENCE(led_steps_flash);
+
+// Pattern of a LED.
+typedef struct
+{
+    led_pattern_t pattern;
+    uint32_t count;             // Repetitions of pattern, 0 for ever.
+    uint32_t repeats;           // Repetitions done.
+    const led_sequence_t *sequence; // Pattern, or flash running.
+    size_t step;                // Next step of sequence.
+    uint32_t duty;              // Duty of last step.
+    bool fading;                // Hardware fade running.
+} led_channel_t;
+
+// LED handle.
+// Each step of a pattern runs as a hardware fade (a hold is a fade of one
+// duty unit), LEDC fade end interrupt notifies the task with the bit of
+// the LED, which starts the fade of next step: fade functions can not be
+// called from ISR. A LED without fade (static level) never wakes up task.
+// Channels are shared under lock, with tasks setting patterns.
+typedef struct
+{
+    StaticTask_t task;
+    StackType_t task_stack[LED_TASK_STACK_SIZE];
+    StaticSemaphore_t lock;
+    led_channel_t channels[LED_NB_MAX];
+} led_handle_t;
+
+static led_handle_t led_handle;
 
 // Compute duty cycle value from percent.
 static inline uint32_t led_duty_format(uint32_t percent)
 {
-    return (((1u << LED_DUTY_RES_VAL) - 1u) * 100u) / percent;
+    return (((1u << LED_DUTY_RES_VAL) - 1u) * percent) / 100u;
+}
+
+// Check if sequence has a step with a fade, else it is a static level.
+static bool led_sequence_timed(const led_sequence_t * const sequence)
+{
+    assert(sequence);
+    for (size_t i = 0; i < sequence->steps_nb; i++)
+    {
+        if (sequence->steps[i].fade_ms > 0u)
+            return true;
+    }
+    return false;
+}
+
+// Run steps of LED until a fade is started, or pattern is done.
+// Note: called with lock held.
+static void led_run(led_handle_t * const handle, led_t led)
+{
+    assert(handle);
+    assert(led < LED_NB_MAX);
+    led_channel_t * const channel = &handle->channels[led];
+    const uint32_t ledc_channel = led_channel_config[led].channel;
+    channel->fading = false;
+    while (true)
+    {
+        if (channel->step == channel->sequence->steps_nb)
+        {
+            // Flash done, pattern starts again.
+            channel->step = 0u;
+            if (channel->sequence == &led_flash_sequence)
+            {
+                channel->sequence = &led_patterns[channel->pattern];
+                channel->repeats = 0u;
+                continue;
+            }
+            channel->repeats++;
+            if (!led_sequence_timed(channel->sequence)
+                || ((channel->count != 0u)
+                    && (channel->repeats >= channel->count)))
+                return;
+        }
+        const led_step_t * const step =
+            &channel->sequence->steps[channel->step++];
+        uint32_t duty = led_duty_format(step->percent);
+        if (step->fade_ms == 0u)
+        {
+            ledc_set_duty(LED_SPEED, ledc_channel, duty);
+            ledc_update_duty(LED_SPEED, ledc_channel);
+            channel->duty = duty;
+            continue;
+        }
+        // Level is held by a fade of one duty unit over step time.
+        if (duty == channel->duty)
+            duty = (duty > 0u) ? duty - 1u : 1u;
+        ledc_set_fade_with_time(LED_SPEED, ledc_channel, duty, step->fade_ms);
+        ledc_fade_start(LED_SPEED, ledc_channel, LEDC_FADE_NO_WAIT);
+        channel->duty = duty;
+        channel->fading = true;
+        return;
+    }
+}
+
+// Start sequence of LED, from its first step.
+// Note: called with lock held.
+static void led_start(
+    led_handle_t * const handle, led_t led,
+    const led_sequence_t * const sequence)
+{
+    assert(handle);
+    assert(led < LED_NB_MAX);
+    assert(sequence);
+    led_channel_t * const channel = &handle->channels[led];
+    if (channel->fading)
+        ledc_fade_stop(LED_SPEED, led_channel_config[led].channel);
+    channel->sequence = sequence;
+    channel->step = 0u;
+    led_run(handle, led);
+}
+
+// LEDC fade end callback.
+static bool IRAM_ATTR led_fade_handler(
+    const ledc_cb_param_t *param, void *context)
+{
+    const led_t led = (led_t) (uintptr_t) context;
+    BaseType_t task_wakeup = pdFALSE;
+    if (param->event == LEDC_FADE_END_EVT)
+        xTaskNotifyFromISR((TaskHandle_t) &led_handle.task, 1u << led,
+            eSetBits, &task_wakeup);
+    return task_wakeup == pdTRUE;
+}
+
+// LED task handler.
+static void led_task_handler(void *context)
+{
+    assert(context);
+    led_handle_t * const handle = (led_handle_t *) context;
+    while (true)
+    {
+        // Wait fades done, then start next step of their LED.
+        uint32_t done = 0u;
+        xTaskNotifyWait(0u, UINT32_MAX, &done, portMAX_DELAY);
+        xSemaphoreTake((SemaphoreHandle_t) &handle->lock, portMAX_DELAY);
+        for (uint32_t i = 0; i < LED_NB_MAX; i++)
+        {
+            if (((done & (1u << i)) != 0u) && handle->channels[i].fading)
+                led_run(handle, (led_t) i);
+        }
+        xSemaphoreGive((SemaphoreHandle_t) &handle->lock);
+    }
 }
 
 void led_init(void)
 {
+    memset(&led_handle, 0, sizeof(led_handle_t));
+    xSemaphoreCreateMutexStatic(&led_handle.lock);
+    for (size_t i = 0; i < LED_NB_MAX; i++)
+    {
+        led_handle.channels[i].pattern = LED_PATTERN_OFF;
+        led_handle.channels[i].sequence = &led_patterns[LED_PATTERN_OFF];
+    }
     // Timer configuration.
     for (size_t i = 0; i < led_timer_config_nb; i++)
         ESP_ERROR_CHECK(ledc_timer_config(&led_timer_config[i]));
     // Channels configuration.
     for (size_t i = 0; i < led_channel_config_nb; i++)
         ESP_ERROR_CHECK(ledc_channel_config(&led_channel_config[i]));
-    // Initialise fade service.
+    // Initialise fade service, steps are chained on fade end.
     ESP_ERROR_CHECK(ledc_fade_func_install(0));
+    ledc_cbs_t callbacks = { .fade_cb = &led_fade_handler };
+    for (size_t i = 0; i < led_channel_config_nb; i++)
+        ESP_ERROR_CHECK(ledc_cb_register(LED_SPEED,
+            led_channel_config[i].channel, &callbacks, (void *) (uintptr_t) i));
+    // Create pattern task.
+    xTaskCreateStatic(
+        &led_task_handler,
+        "LED",
+        LED_TASK_STACK_SIZE,
+        &led_handle,
+        LED_TASK_PRIORITY,
+        led_handle.task_stack,
+        &led_handle.task
+    );
+}
+
+void led_pattern_set(led_t led, led_pattern_t pattern, uint32_t count)
+{
+    assert(led < LED_NB_MAX);
+    assert(pattern < LED_PATTERN_NB_MAX);
+    led_handle_t * const handle = &led_handle;
+    led_channel_t * const channel = &handle->channels[led];
+    xSemaphoreTake((SemaphoreHandle_t) &handle->lock, portMAX_DELAY);
+    // Pattern running is not restarted, and flash running goes on before
+    // new pattern.
+    if ((channel->pattern != pattern) || (channel->count != count))
+    {
+        channel->pattern = pattern;
+        channel->count = count;
+        channel->repeats = 0u;
+        if (channel->sequence != &led_flash_sequence)
+            led_start(handle, led, &led_patterns[pattern]);
+    }
+    xSemaphoreGive((SemaphoreHandle_t) &handle->lock);
+}
+
+void led_flash(led_t led)
+{
+    assert(led < LED_NB_MAX);
+    led_handle_t * const handle = &led_handle;
+    xSemaphoreTake((SemaphoreHandle_t) &handle->lock, portMAX_DELAY);
+    led_start(handle, led, &led_flash_sequence);
+    xSemaphoreGive((SemaphoreHandle_t) &handle->lock);
 }
 
 void led_wifi_set(led_wifi_t value)
@@ -82,14 +344,13 @@ void led_wifi_set(led_wifi_t value)
     switch (value)
     {
         case WIFI_NOT_CONNECTED:
-            ledc_set_duty(LED_SPEED, BOARD_LED_CHANNEL_WIFI, 0);
-            ledc_update_duty(LED_SPEED, BOARD_LED_CHANNEL_WIFI);
+            led_pattern_set(LED_WIFI, LED_PATTERN_OFF, 0u);
             break;
         case WIFI_CONNECTED:
-            ledc_set_duty(
-                LED_SPEED, BOARD_LED_CHANNEL_WIFI,
-                led_duty_format(BOARD_LED_DUTY_CYCLE));
-            ledc_update_duty(LED_SPEED, BOARD_LED_CHANNEL_WIFI);
+            led_pattern_set(LED_WIFI, LED_PATTERN_ON, 0u);
+            break;
+        case WIFI_CONNECTED_SLEEP:
+            led_pattern_set(LED_WIFI, LED_PATTERN_DIM, 0u);
             break;
         default:
             // Nothing to do.
@@ -102,14 +363,10 @@ void led_bt_set(led_bt_t value)
     switch (value)
     {
         case BT_NOT_CONNECTED:
-            ledc_set_duty(LED_SPEED, BOARD_LED_CHANNEL_BT, 0);
-            ledc_update_duty(LED_SPEED, BOARD_LED_CHANNEL_BT);
+            led_pattern_set(LED_BT, LED_PATTERN_OFF, 0u);
             break;
         case BT_CONNECTED:
-            ledc_set_duty(
-                LED_SPEED, BOARD_LED_CHANNEL_BT,
-                led_duty_format(BOARD_LED_DUTY_CYCLE));
-            ledc_update_duty(LED_SPEED, BOARD_LED_CHANNEL_BT);
+            led_pattern_set(LED_BT, LED_PATTERN_ON, 0u);
             break;
         default:
             // Nothing to do.
@@ -122,14 +379,10 @@ void led_soft_set(led_soft_t value)
     switch (value)
     {
         case SOFT_OFF:
-            ledc_set_duty(LED_SPEED, BOARD_LED_CHANNEL_SOFT, 0);
-            ledc_update_duty(LED_SPEED, BOARD_LED_CHANNEL_SOFT);
+            led_pattern_set(LED_SOFT, LED_PATTERN_OFF, 0u);
             break;
         case SOFT_ON:
-            ledc_set_duty(
-                LED_SPEED, BOARD_LED_CHANNEL_SOFT,
-                led_duty_format(BOARD_LED_DUTY_CYCLE));
-            ledc_update_duty(LED_SPEED, BOARD_LED_CHANNEL_SOFT);
+            led_pattern_set(LED_SOFT, LED_PATTERN_ON, 0u);
             break;
         default:
             // Nothing to do.
@@ -3,22 +3,39 @@
  * Copyright (c) 2024 William Vallet
  */
 
+#include "binlog.h"
 #include "board.h"
+#include "boot.h"
 #include "board_cfg.h"
 #include "command.h"
 #include "ir_decoder.h"
+#include "ir_decoder_partition.h"
 #include "led.h"
+#include "power.h"
+#include "trace.h"
+#include "upnp_discovery.h"
+#include "upnp_executor.h"
+#include "wifi.h"
 #include "sdkconfig.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
+#include "driver/uart.h"
 #include "esp_chip_info.h"
 #include "esp_flash.h"
 #include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_vfs_dev.h"
+#include "esp_vfs_eventfd.h"
 #include <stdio.h>
 #include <stdint.h>
 
 #define LOGGER_TAG      "main"
 
+#define MAIN_KEY_TRACE_DUMP     't'
+#define MAIN_KEY_TRACE_RESET    'r'
+#define MAIN_KEY_LEARN          'l'
+#define MAIN_KEY_DEBUG          'd'
+#define MAIN_CONSOLE_BUFFER_SIZE        256u    // Reception, at least 128.
+#define MAIN_CONSOLE_WAKEUP_EDGES       3u      // Edges waking up sleep.
+
 static void display_chip_information(void)
 {
     // Get chip information.
@@ -45,22 +62,89 @@ static void display_chip_information(void)
         (chip_info.features & CHIP_FEATURE_IEEE802154) ? " IEEE-802.15.4" : "");
 }
 
+// Wait keys pressed on serial console, forever.
+// Console reads go through UART driver, so they block until data is
+// received instead of polling.
+static void console_process(void)
+{
+#if CONFIG_ESP_CONSOLE_UART
+    ESP_ERROR_CHECK(uart_driver_install(CONFIG_ESP_CONSOLE_UART_NUM,
+        MAIN_CONSOLE_BUFFER_SIZE, 0, 0, NULL, 0));
+    esp_vfs_dev_uart_use_driver(CONFIG_ESP_CONSOLE_UART_NUM);
+#if CONFIG_PM_ENABLE
+    // Console wakes up light sleep, first key pressed is lost.
+    ESP_ERROR_CHECK(uart_set_wakeup_threshold(CONFIG_ESP_CONSOLE_UART_NUM,
+        MAIN_CONSOLE_WAKEUP_EDGES));
+    ESP_ERROR_CHECK(esp_sleep_enable_uart_wakeup(CONFIG_ESP_CONSOLE_UART_NUM));
+#endif
+    while (1)
+    {
+        switch (getchar())
+        {
+            case MAIN_KEY_TRACE_DUMP:
+                boot_dump();
+                power_dump();
+                ir_decoder_power_dump();
+                wifi_power_dump();
+                trace_dump();
+                break;
+            case MAIN_KEY_TRACE_RESET:
+                trace_reset();
+                break;
+            case MAIN_KEY_LEARN:
+                ir_decoder_partition_learn_start();
+                break;
+            case MAIN_KEY_DEBUG:
+                // Toggle deferred debug logs.
+                binlog_level_set((binlog_level_get() >= ESP_LOG_DEBUG)
+                    ? ESP_LOG_INFO : ESP_LOG_DEBUG);
+                ESP_LOGI(LOGGER_TAG, "Debug logs %s",
+                    (binlog_level_get() >= ESP_LOG_DEBUG) ? "on" : "off");
+                break;
+            case EOF:
+                clearerr(stdin);
+                break;
+            default:
+                break;
+        }
+    }
+#else
+    ESP_LOGW(LOGGER_TAG, "Console keys not supported");
+#endif
+}
+
 void app_main(void)
 {
     board_initialise();
     esp_log_level_set("*", ESP_LOG_INFO);
+    // Debug logs of hot tasks are deferred, decoded on host.
+    binlog_init();
+    // Light sleep while idle, woken up by IR line, network and console.
+    power_init();
+    // IR path first: command processing and IR decoder (enabled codesets
+    // mask), commands are held until network link is up. Wi-Fi leaves power
+    // save on remote activity, until idle window (from build flags) has
+    // elapsed.
+    command_init();
+    wifi_power_init(WIFI_POWER_IDLE_MS);
+    ir_decoder_init(BOARD_IO_IR_RX, IR_CODESET_CFG, &wifi_activity);
+    boot_mark(BOOT_IR_READY);
+    // Network tasks are woken up by other tasks through event descriptors.
+    const esp_vfs_eventfd_config_t eventfd_cfg =
+        ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_vfs_eventfd_register(&eventfd_cfg));
+    upnp_executor_init();
+    // Network configuration (credentials from build flags), connection goes
+    // on in background. Then renderer discovery (group renderers selected
+    // by names from build flags, any single one if empty).
+    wifi_init(WIFI_SSID, WIFI_PASSWORD, &command_link_set);
+    upnp_discovery_init(UPNP_RENDERER_NAME);
+    // Banner is deferred, out of boot path.
     ESP_LOGI(LOGGER_TAG, "*** ESP UPnP remote ***");
     display_chip_information();
-    // Initialise command processing.
-    command_init();
-    // IR decoder configuration.
-    ir_decoder_init(BOARD_IO_IR_RX, IR_CODESET_CFG);
-    // Process.
-    led_soft_t led_soft = SOFT_ON;
-    while (1)
-    {
-        led_soft_set(led_soft);
-        led_soft = (led_soft == SOFT_ON) ? SOFT_OFF : SOFT_ON;
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
-    }
+    // Tasks are running, only woken up by events from now on. Latency
+    // trace, boot times and power save statistics are dumped, or trace
+    // reset, from serial console.
+    led_soft_set(SOFT_ON);
+    console_process();
 }
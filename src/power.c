@@ -0,0 +1,82 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "power.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "sdkconfig.h"
+#include <assert.h>
+#include <stdio.h>
+
+#define LOGGER_TAG "power"
+
+// CPU runs from crystal while idle, and at default frequency otherwise.
+#define POWER_FREQ_MAX_MHZ      CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ
+#define POWER_FREQ_MIN_MHZ      CONFIG_XTAL_FREQ
+
+#if CONFIG_PM_ENABLE
+// Power management handle.
+typedef struct
+{
+    esp_pm_lock_handle_t locks[POWER_LOCK_NB_MAX];
+} power_handle_t;
+
+static const char * const power_lock_str[] = {
+    [POWER_LOCK_IR] = "ir",
+    [POWER_LOCK_NETWORK] = "network",
+};
+
+static power_handle_t power_handle;
+#endif
+
+void power_init(void)
+{
+#if CONFIG_PM_ENABLE
+    const esp_pm_config_t pm_cfg = {
+        .max_freq_mhz = POWER_FREQ_MAX_MHZ,
+        .min_freq_mhz = POWER_FREQ_MIN_MHZ,
+        .light_sleep_enable = true
+    };
+    ESP_ERROR_CHECK(esp_pm_configure(&pm_cfg));
+    for (size_t i = 0; i < POWER_LOCK_NB_MAX; i++)
+        ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0,
+            power_lock_str[i], &power_handle.locks[i]));
+    ESP_LOGI(LOGGER_TAG, "Light sleep enabled freq=%u-%uMHz",
+        (unsigned int) POWER_FREQ_MIN_MHZ, (unsigned int) POWER_FREQ_MAX_MHZ);
+#else
+    ESP_LOGI(LOGGER_TAG, "Power management disabled");
+#endif
+}
+
+void IRAM_ATTR power_acquire(power_lock_t lock)
+{
+    assert(lock < POWER_LOCK_NB_MAX);
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_acquire(power_handle.locks[lock]);
+#else
+    (void) lock;
+#endif
+}
+
+void IRAM_ATTR power_release(power_lock_t lock)
+{
+    assert(lock < POWER_LOCK_NB_MAX);
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_release(power_handle.locks[lock]);
+#else
+    (void) lock;
+#endif
+}
+
+void power_dump(void)
+{
+#if CONFIG_PM_PROFILING
+    // Time spent in each power mode (light sleep residency) and locks.
+    esp_pm_dump_locks(stdout);
+#elif CONFIG_PM_ENABLE
+    ESP_LOGI(LOGGER_TAG, "Power mode statistics disabled");
+#endif
+}
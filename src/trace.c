@@ -0,0 +1,227 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "trace.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#if CONFIG_PM_ENABLE
+#include "esp_timer.h"
+#endif
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#define LOGGER_TAG "trace"
+
+#define TRACE_RING_NB           128u    // Power of 2.
+#define TRACE_DUMP_NB            16u    // Last events dumped.
+// Latency histogram buckets: each power of 2 is split in sub-buckets, so
+// bucket width is at most a quarter of its latency.
+#define TRACE_SUB_BITS            2u
+#define TRACE_SUB_NB            (1u << TRACE_SUB_BITS)
+#define TRACE_BUCKET_NB         ((33u - TRACE_SUB_BITS) * TRACE_SUB_NB)
+#if CONFIG_PM_ENABLE
+// Cycle counter stops in light sleep and follows CPU frequency, stamps are
+// taken from system timer (us) instead.
+#define TRACE_TICKS_PER_US      1u
+#else
+#define TRACE_TICKS_PER_US      esp_rom_get_cpu_ticks_per_us()
+#endif
+
+// Trace event, stamp is origin plus latency.
+typedef struct
+{
+    uint32_t origin;            // Stamp of IR frame.
+    uint32_t latency;           // Stamp units from origin.
+    uint8_t stage;              // Pipeline stage (trace_stage_t).
+} trace_event_t;
+
+// Trace handle.
+// Events are recorded from ISR and tasks, ring index and histogram counts
+// are only updated atomically, so recording never waits. Ring is read
+// without lock, events recorded meanwhile may be dumped torn.
+typedef struct
+{
+    atomic_uint_least32_t head; // Next event written, runs freely.
+    atomic_uint_least32_t
+        histograms[TRACE_STAGE_NB_MAX][TRACE_BUCKET_NB];
+    trace_event_t events[TRACE_RING_NB];
+} trace_handle_t;
+
+static const char * const trace_stage_str[] = {
+    [TRACE_STAGE_RMT] = "rmt",
+    [TRACE_STAGE_WAKEUP] = "wakeup",
+    [TRACE_STAGE_DECODE] = "decode",
+    [TRACE_STAGE_PUSH] = "push",
+    [TRACE_STAGE_POP] = "pop",
+    [TRACE_STAGE_SENT] = "sent",
+    [TRACE_STAGE_RESPONSE] = "response",
+    [TRACE_STAGE_WAKE] = "wake",
+};
+
+static trace_handle_t trace_handle;
+
+// Get current time stamp.
+FORCE_INLINE_ATTR uint32_t trace_now(void)
+{
+#if CONFIG_PM_ENABLE
+    return (uint32_t) esp_timer_get_time();
+#else
+    return (uint32_t) esp_cpu_get_cycle_count();
+#endif
+}
+
+// Get most significant bit set of non-zero value.
+FORCE_INLINE_ATTR uint32_t trace_msb(uint32_t value)
+{
+    uint32_t msb = 0u;
+    for (uint32_t shift = 16u; shift > 0u; shift >>= 1u)
+    {
+        if (value >> shift)
+        {
+            value >>= shift;
+            msb += shift;
+        }
+    }
+    return msb;
+}
+
+// Get histogram bucket of latency.
+FORCE_INLINE_ATTR uint32_t trace_bucket(uint32_t latency)
+{
+    if (latency < TRACE_SUB_NB)
+        return latency;
+    const uint32_t shift = trace_msb(latency) - TRACE_SUB_BITS;
+    return ((shift + 1u) << TRACE_SUB_BITS) + (latency >> shift)
+        - TRACE_SUB_NB;
+}
+
+// Get latency in middle of histogram bucket.
+static uint32_t trace_bucket_latency(uint32_t bucket)
+{
+    if (bucket < TRACE_SUB_NB)
+        return bucket;
+    const uint32_t shift = (bucket >> TRACE_SUB_BITS) - 1u;
+    const uint32_t low =
+        (TRACE_SUB_NB + (bucket & (TRACE_SUB_NB - 1u))) << shift;
+    return low + ((1u << shift) >> 1u);
+}
+
+// Get latency percentile of histogram, in us.
+static uint32_t trace_percentile_us(
+    const uint32_t * const counts, uint32_t events, uint32_t percent)
+{
+    const uint32_t rank = (uint32_t)
+        (((uint64_t) events * percent + 99u) / 100u);
+    uint32_t cumulated = 0u;
+    for (uint32_t i = 0; i < TRACE_BUCKET_NB; i++)
+    {
+        cumulated += counts[i];
+        if ((cumulated >= rank) && (cumulated > 0u))
+            return trace_bucket_latency(i) / TRACE_TICKS_PER_US;
+    }
+    return 0u;
+}
+
+uint32_t IRAM_ATTR trace_stamp(void)
+{
+    return trace_now() | 1u;
+}
+
+uint32_t trace_oldest(uint32_t origin, uint32_t other)
+{
+    if ((origin == 0u)
+        || ((other != 0u) && ((int32_t) (other - origin) < 0)))
+        return other;
+    return origin;
+}
+
+uint32_t trace_stamp_us(uint32_t duration_us)
+{
+    return duration_us * TRACE_TICKS_PER_US;
+}
+
+void IRAM_ATTR trace_event(trace_stage_t stage, uint32_t origin)
+{
+    trace_event_at(stage, origin, trace_now());
+}
+
+void IRAM_ATTR trace_event_at(
+    trace_stage_t stage, uint32_t origin, uint32_t stamp)
+{
+    trace_handle_t * const handle = &trace_handle;
+    if ((origin == 0u) || (stage >= TRACE_STAGE_NB_MAX))
+        return;
+    const uint32_t latency = stamp - origin;
+    const uint32_t index = atomic_fetch_add_explicit(
+        &handle->head, 1u, memory_order_relaxed) & (TRACE_RING_NB - 1u);
+    trace_event_t * const event = &handle->events[index];
+    event->origin = origin;
+    event->latency = latency;
+    event->stage = stage;
+    atomic_fetch_add_explicit(
+        &handle->histograms[stage][trace_bucket(latency)], 1u,
+        memory_order_relaxed);
+}
+
+void trace_summary_get(
+    trace_stage_t stage, trace_summary_t * const summary)
+{
+    assert(stage < TRACE_STAGE_NB_MAX);
+    assert(summary);
+    uint32_t counts[TRACE_BUCKET_NB];
+    summary->events = 0u;
+    for (uint32_t i = 0; i < TRACE_BUCKET_NB; i++)
+    {
+        counts[i] = atomic_load_explicit(
+            &trace_handle.histograms[stage][i], memory_order_relaxed);
+        summary->events += counts[i];
+    }
+    summary->p50_us = trace_percentile_us(counts, summary->events, 50u);
+    summary->p95_us = trace_percentile_us(counts, summary->events, 95u);
+    summary->p99_us = trace_percentile_us(counts, summary->events, 99u);
+}
+
+void trace_dump(void)
+{
+    trace_summary_t summary;
+    ESP_LOGI(LOGGER_TAG, "Latency from IR frame (us):");
+    ESP_LOGI(LOGGER_TAG, "%-8s %8s %8s %8s %8s",
+        "stage", "events", "p50", "p95", "p99");
+    for (uint32_t i = 0; i < TRACE_STAGE_NB_MAX; i++)
+    {
+        trace_summary_get((trace_stage_t) i, &summary);
+        ESP_LOGI(LOGGER_TAG, "%-8s %8lu %8lu %8lu %8lu", trace_stage_str[i],
+            (unsigned long) summary.events, (unsigned long) summary.p50_us,
+            (unsigned long) summary.p95_us, (unsigned long) summary.p99_us);
+    }
+    // Last events, oldest first.
+    const uint32_t head =
+        atomic_load_explicit(&trace_handle.head, memory_order_relaxed);
+    const uint32_t events_nb = (head < TRACE_DUMP_NB) ? head : TRACE_DUMP_NB;
+    for (uint32_t i = head - events_nb; i != head; i++)
+    {
+        const trace_event_t event =
+            trace_handle.events[i & (TRACE_RING_NB - 1u)];
+        if (event.stage >= TRACE_STAGE_NB_MAX)
+            continue;
+        ESP_LOGI(LOGGER_TAG, "Event origin=%08lx stage=%s latency=%luus",
+            (unsigned long) event.origin, trace_stage_str[event.stage],
+            (unsigned long) (event.latency / TRACE_TICKS_PER_US));
+    }
+}
+
+void trace_reset(void)
+{
+    for (uint32_t i = 0; i < TRACE_STAGE_NB_MAX; i++)
+    {
+        for (uint32_t j = 0; j < TRACE_BUCKET_NB; j++)
+            atomic_store_explicit(&trace_handle.histograms[i][j], 0u,
+                memory_order_relaxed);
+    }
+    atomic_store_explicit(&trace_handle.head, 0u, memory_order_relaxed);
+}
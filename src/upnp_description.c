@@ -0,0 +1,215 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "upnp_description.h"
+#include "upnp_http.h"
+#include "esp_log.h"
+#include <arpa/inet.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define LOGGER_TAG "upnp_description"
+
+#define UPNP_DESCRIPTION_REQUEST_SIZE  256u
+// Service types are matched without version, any version is compatible.
+#define UPNP_DESCRIPTION_SERVICE_TYPE  "urn:schemas-upnp-org:service:"
+
+// Description elements extracted, see upnp_description_paths.
+typedef enum
+{
+    UPNP_DESCRIPTION_ELEMENT_NAME = 0,
+    UPNP_DESCRIPTION_ELEMENT_UDN,
+    UPNP_DESCRIPTION_ELEMENT_SERVICE_TYPE,
+    UPNP_DESCRIPTION_ELEMENT_CONTROL_URL,
+    UPNP_DESCRIPTION_ELEMENT_EVENT_URL,
+    UPNP_DESCRIPTION_ELEMENT_SERVICE,
+    UPNP_DESCRIPTION_ELEMENT_NB_MAX
+} upnp_description_element_t;
+
+static const char * const upnp_description_paths[] = {
+    [UPNP_DESCRIPTION_ELEMENT_NAME] = "device/friendlyName",
+    [UPNP_DESCRIPTION_ELEMENT_UDN] = "device/UDN",
+    [UPNP_DESCRIPTION_ELEMENT_SERVICE_TYPE] = "service/serviceType",
+    [UPNP_DESCRIPTION_ELEMENT_CONTROL_URL] = "service/controlURL",
+    [UPNP_DESCRIPTION_ELEMENT_EVENT_URL] = "service/eventSubURL",
+    [UPNP_DESCRIPTION_ELEMENT_SERVICE] = "serviceList/service",
+};
+
+static const char * const upnp_description_service_names[] = {
+    [UPNP_SERVICE_AV_TRANSPORT] = "AVTransport:",
+    [UPNP_SERVICE_RENDERING_CONTROL] = "RenderingControl:",
+};
+
+// Copy text, if it fits in destination.
+static void upnp_description_copy(char *dest, size_t size, const char *text)
+{
+    const size_t length = strlen(text);
+    if (length < size)
+        memcpy(dest, text, length + 1u);
+}
+
+// Get path of URL on renderer, relative URLs are resolved from description
+// path.
+static void upnp_description_url(
+    const upnp_description_t * const description, char *dest,
+    const char *url)
+{
+    dest[0] = '\0';
+    if (strncmp(url, "http://", 7u) == 0)
+    {
+        // Absolute URL, renderer address is the one of description.
+        url = strchr(&url[7], '/');
+        upnp_description_copy(dest, UPNP_DESCRIPTION_URL_SIZE,
+            url ? url : "/");
+        return;
+    }
+    if (url[0] == '/')
+    {
+        upnp_description_copy(dest, UPNP_DESCRIPTION_URL_SIZE, url);
+        return;
+    }
+    const char *base = description->base ? description->base : "/";
+    const char *base_end = strrchr(base, '/');
+    const size_t base_length = base_end ? (size_t) (base_end - base) + 1u : 0u;
+    if ((base_length + strlen(url)) >= UPNP_DESCRIPTION_URL_SIZE)
+        return;
+    if (base_length == 0u)
+        dest[0] = '/';
+    else
+        memcpy(dest, base, base_length);
+    strcpy(&dest[(base_length == 0u) ? 1u : base_length], url);
+}
+
+// Description element parsed.
+static void upnp_description_element(
+    void *context, size_t path, const char *text)
+{
+    assert(context);
+    upnp_description_t * const description = (upnp_description_t *) context;
+    upnp_description_service_t * const parsed = &description->parsed;
+    switch (path)
+    {
+        case UPNP_DESCRIPTION_ELEMENT_NAME:
+            if (description->name[0] == '\0')
+                upnp_description_copy(
+                    description->name, sizeof(description->name), text);
+            break;
+        case UPNP_DESCRIPTION_ELEMENT_UDN:
+            if (description->udn[0] == '\0')
+                upnp_description_copy(
+                    description->udn, sizeof(description->udn), text);
+            break;
+        case UPNP_DESCRIPTION_ELEMENT_SERVICE_TYPE:
+            if (strncmp(text, UPNP_DESCRIPTION_SERVICE_TYPE,
+                    sizeof(UPNP_DESCRIPTION_SERVICE_TYPE) - 1u) != 0)
+                break;
+            text += sizeof(UPNP_DESCRIPTION_SERVICE_TYPE) - 1u;
+            for (size_t i = 0; i < UPNP_SERVICE_NB_MAX; i++)
+            {
+                const char * const name = upnp_description_service_names[i];
+                if (strncmp(text, name, strlen(name)) == 0)
+                    description->service = (uint8_t) i;
+            }
+            break;
+        case UPNP_DESCRIPTION_ELEMENT_CONTROL_URL:
+            upnp_description_url(description, parsed->control_url, text);
+            break;
+        case UPNP_DESCRIPTION_ELEMENT_EVENT_URL:
+            upnp_description_url(description, parsed->event_url, text);
+            break;
+        case UPNP_DESCRIPTION_ELEMENT_SERVICE:
+            // Service ended, its URLs are kept if it is a renderer service
+            // not found yet.
+            if ((description->service < UPNP_SERVICE_NB_MAX)
+                && ((description->services & (1u << description->service))
+                    == 0u)
+                && (parsed->control_url[0] != '\0'))
+            {
+                description->service_urls[description->service] = *parsed;
+                description->services |= 1u << description->service;
+            }
+            description->service = UPNP_SERVICE_NB_MAX;
+            memset(parsed, 0, sizeof(upnp_description_service_t));
+            break;
+        default:
+            break;
+    }
+}
+
+// Description body received, parsed by chunk.
+static void upnp_description_body(
+    void *context, const char *data, size_t length)
+{
+    assert(context);
+    upnp_description_t * const description = (upnp_description_t *) context;
+    if (!data)
+        upnp_description_init(description, description->base);
+    else if (!description->malformed)
+        description->malformed =
+            !upnp_description_feed(description, data, length);
+}
+
+void upnp_description_init(
+    upnp_description_t * const description, const char *base)
+{
+    assert(description);
+    memset(description, 0, sizeof(upnp_description_t));
+    description->base = base;
+    description->service = UPNP_SERVICE_NB_MAX;
+    upnp_xml_init(&description->parser, upnp_description_paths,
+        UPNP_DESCRIPTION_ELEMENT_NB_MAX, &upnp_description_element,
+        description);
+}
+
+bool upnp_description_feed(
+    upnp_description_t * const description, const char *data,
+    size_t length)
+{
+    assert(description);
+    return upnp_xml_feed(&description->parser, data, length);
+}
+
+bool upnp_description_complete(
+    const upnp_description_t * const description)
+{
+    assert(description);
+    return description->services == ((1u << UPNP_SERVICE_NB_MAX) - 1u);
+}
+
+bool upnp_description_fetch(
+    upnp_description_t * const description,
+    const struct sockaddr_in * const address, const char *path)
+{
+    assert(description);
+    assert(address);
+    assert(path);
+    char host[INET_ADDRSTRLEN];
+    char request[UPNP_DESCRIPTION_REQUEST_SIZE];
+    inet_ntop(AF_INET, &address->sin_addr, host, sizeof(host));
+    const int length = snprintf(request, sizeof(request),
+        "GET %s HTTP/1.1\r\n"
+        "HOST: %s:%u\r\n"
+        "Connection: close\r\n"
+        "\r\n",
+        path, host, (unsigned int) ntohs(address->sin_port));
+    if ((length < 0) || ((size_t) length >= sizeof(request)))
+        return false;
+    upnp_description_init(description, path);
+    // Description is fetched by discovery task, apart from renderer
+    // connections used for actions.
+    const uint16_t status = upnp_http_fetch(address, request,
+        (size_t) length, &upnp_description_body, description);
+    if ((status != 200u) || description->malformed
+        || !upnp_description_complete(description))
+    {
+        ESP_LOGW(LOGGER_TAG, "Description invalid status=%u services=%lu",
+            (unsigned int) status, (unsigned long) description->services);
+        return false;
+    }
+    ESP_LOGI(LOGGER_TAG, "Description name='%s' udn=%s",
+        description->name, description->udn);
+    return true;
+}
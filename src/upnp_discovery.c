@@ -0,0 +1,472 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "upnp_discovery.h"
+#include "upnp_description.h"
+#include "upnp_executor.h"
+#include "upnp_ssdp.h"
+#include "wakeup.h"
+#include "wifi.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <arpa/inet.h>
+#include <assert.h>
+#include <string.h>
+
+#define LOGGER_TAG "upnp_discovery"
+
+#define UPNP_DISCOVERY_TASK_STACK_SIZE  (6u * configMINIMAL_STACK_SIZE)
+// Lowest of network tasks, discovery is not on the path of IR commands.
+#define UPNP_DISCOVERY_TASK_PRIORITY    (tskIDLE_PRIORITY + 2u)
+#define UPNP_DISCOVERY_NVS_NAMESPACE    "upnp"
+#define UPNP_DISCOVERY_NVS_KEY          "renderer"
+#define UPNP_DISCOVERY_VERSION              3u  // Cache record layout.
+// Search is sent again until group is complete, with period doubled each
+// time (responses are spread over 2s by renderers).
+#define UPNP_DISCOVERY_SEARCH_MIN_MS     2000u
+#define UPNP_DISCOVERY_SEARCH_MAX_MS    60000u
+#define UPNP_DISCOVERY_REJECTED_NB          4u  // Renderers not selected.
+
+// Group member identity, to follow its advertisements.
+typedef struct
+{
+    char udn[UPNP_SSDP_UDN_SIZE];
+    char name[UPNP_DESCRIPTION_NAME_SIZE];
+    char path[UPNP_RENDERER_PATH_SIZE];     // Description path.
+} upnp_discovery_member_t;
+
+// Renderer group cache record, stored in flash.
+typedef struct
+{
+    uint32_t version;
+    upnp_group_t group;
+    upnp_discovery_member_t members[UPNP_GROUP_MEMBER_NB];
+} upnp_discovery_record_t;
+
+// UPnP discovery handle.
+// Group record is only used by discovery task once initialised. Discovery
+// task waits SSDP messages until next search, its wakeup descriptor is
+// signaled when members are lost (notified to task).
+typedef struct
+{
+    StaticTask_t task;
+    StackType_t task_stack[UPNP_DISCOVERY_TASK_STACK_SIZE];
+    int wakeup;                 // Signaled on members lost.
+    // Friendly names selected, none for any single renderer.
+    char names[UPNP_GROUP_MEMBER_NB][UPNP_DESCRIPTION_NAME_SIZE];
+    size_t names_nb;
+    bool searching;             // Group not complete yet, or member lost.
+    uint32_t lost;              // Members lost (bit mask).
+    uint32_t search_ms;         // Time of next search.
+    uint32_t period_ms;         // Search period.
+    upnp_discovery_record_t record;
+    char rejected[UPNP_DISCOVERY_REJECTED_NB][UPNP_SSDP_UDN_SIZE];
+    size_t rejected_next;       // Oldest renderer rejected, replaced next.
+    upnp_ssdp_message_t message;
+    upnp_description_t description;
+} upnp_discovery_handle_t;
+
+static upnp_discovery_handle_t upnp_discovery_handle;
+
+static uint32_t upnp_discovery_time_ms(void)
+{
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+// Load renderer record from flash.
+// Return true on success, false if there is no valid record.
+static bool upnp_discovery_load(upnp_discovery_handle_t * const handle)
+{
+    assert(handle);
+    nvs_handle_t nvs;
+    size_t size = sizeof(upnp_discovery_record_t);
+    if (nvs_open(UPNP_DISCOVERY_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK)
+        return false;
+    const esp_err_t err =
+        nvs_get_blob(nvs, UPNP_DISCOVERY_NVS_KEY, &handle->record, &size);
+    nvs_close(nvs);
+    return (err == ESP_OK) && (size == sizeof(upnp_discovery_record_t))
+        && (handle->record.version == UPNP_DISCOVERY_VERSION);
+}
+
+// Store renderer record in flash.
+static void upnp_discovery_store(const upnp_discovery_handle_t * const handle)
+{
+    assert(handle);
+    nvs_handle_t nvs;
+    esp_err_t err =
+        nvs_open(UPNP_DISCOVERY_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_blob(nvs, UPNP_DISCOVERY_NVS_KEY, &handle->record,
+            sizeof(upnp_discovery_record_t));
+        if (err == ESP_OK)
+            err = nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+    if (err != ESP_OK)
+        ESP_LOGW(LOGGER_TAG, "Renderer not stored err=%s",
+            esp_err_to_name(err));
+}
+
+// Check if group has all its members, and all of them respond.
+static bool upnp_discovery_complete(
+    const upnp_discovery_handle_t * const handle)
+{
+    assert(handle);
+    const uint32_t expected = (handle->names_nb > 0u) ? handle->names_nb : 1u;
+    return (handle->record.group.nb == expected) && (handle->lost == 0u);
+}
+
+// Search renderers from now on, until group is complete.
+static void upnp_discovery_search_start(
+    upnp_discovery_handle_t * const handle)
+{
+    assert(handle);
+    handle->searching = true;
+    handle->search_ms = upnp_discovery_time_ms();
+    handle->period_ms = UPNP_DISCOVERY_SEARCH_MIN_MS;
+    memset(handle->rejected, 0, sizeof(handle->rejected));
+}
+
+// Get group member from its UDN.
+// Return member index, or -1 if renderer is not a member.
+static int32_t upnp_discovery_member(
+    const upnp_discovery_handle_t * const handle, const char *udn)
+{
+    assert(handle);
+    assert(udn);
+    for (size_t i = 0; i < handle->record.group.nb; i++)
+    {
+        if (strcmp(handle->record.members[i].udn, udn) == 0)
+            return (int32_t) i;
+    }
+    return -1;
+}
+
+// Report group members lost, they are searched again.
+static void upnp_discovery_members_lost(
+    upnp_discovery_handle_t * const handle, uint32_t members)
+{
+    assert(handle);
+    const uint32_t lost = members & ~handle->lost
+        & ((1u << handle->record.group.nb) - 1u);
+    for (size_t i = 0; i < handle->record.group.nb; i++)
+    {
+        if ((lost & (1u << i)) != 0u)
+            ESP_LOGI(LOGGER_TAG, "Renderer lost member=%u name='%s'",
+                (unsigned int) i, handle->record.members[i].name);
+    }
+    handle->lost |= lost;
+    if (!handle->searching && !upnp_discovery_complete(handle))
+        upnp_discovery_search_start(handle);
+}
+
+// Check if renderer has been rejected since search start.
+static bool upnp_discovery_rejected(
+    const upnp_discovery_handle_t * const handle, const char *udn)
+{
+    assert(handle);
+    assert(udn);
+    for (size_t i = 0; i < UPNP_DISCOVERY_REJECTED_NB; i++)
+    {
+        if (strcmp(handle->rejected[i], udn) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Record renderer rejected, its description is not fetched again.
+static void upnp_discovery_reject(
+    upnp_discovery_handle_t * const handle, const char *udn)
+{
+    assert(handle);
+    assert(udn);
+    strcpy(handle->rejected[handle->rejected_next], udn);
+    handle->rejected_next =
+        (handle->rejected_next + 1u) % UPNP_DISCOVERY_REJECTED_NB;
+}
+
+// Check if renderer friendly name is selected, any is if there is no names.
+static bool upnp_discovery_named(
+    const upnp_discovery_handle_t * const handle, const char *name)
+{
+    assert(handle);
+    assert(name);
+    bool selected = (handle->names_nb == 0u);
+    for (size_t i = 0; i < handle->names_nb; i++)
+        selected = selected || (strcmp(handle->names[i], name) == 0);
+    return selected;
+}
+
+// Get group member slot of renderer named, from names selected.
+// Return member index (next one if renderer is added), or -1 if renderer
+// is not selected.
+static int32_t upnp_discovery_slot(
+    const upnp_discovery_handle_t * const handle, const char *name)
+{
+    assert(handle);
+    assert(name);
+    const upnp_discovery_record_t * const record = &handle->record;
+    if (!upnp_discovery_named(handle, name))
+        return -1;
+    // Any renderer replaces single one when there is no names.
+    if (handle->names_nb == 0u)
+        return 0;
+    // Renderer replaces the lost member with same name, if any.
+    for (size_t i = 0; i < record->group.nb; i++)
+    {
+        if (strcmp(record->members[i].name, name) == 0)
+            return ((handle->lost & (1u << i)) != 0u) ? (int32_t) i : -1;
+    }
+    return (int32_t) record->group.nb;
+}
+
+// Wait Wi-Fi connection, then open SSDP socket.
+static void upnp_discovery_connect(void)
+{
+    while (!wifi_wait_connected(UPNP_DISCOVERY_SEARCH_MAX_MS)
+        || !upnp_ssdp_init())
+        vTaskDelay(pdMS_TO_TICKS(UPNP_DISCOVERY_SEARCH_MIN_MS));
+}
+
+// Check if member description is still at the location recorded.
+static bool upnp_discovery_located(
+    const upnp_discovery_handle_t * const handle, size_t member,
+    const upnp_ssdp_message_t * const message)
+{
+    assert(handle);
+    assert(member < handle->record.group.nb);
+    assert(message);
+    const upnp_renderer_t * const renderer =
+        &handle->record.group.members[member];
+    char host[UPNP_RENDERER_HOST_SIZE];
+    inet_ntop(AF_INET, &message->location.sin_addr, host, sizeof(host));
+    return (strcmp(host, renderer->host) == 0)
+        && (ntohs(message->location.sin_port) == renderer->port)
+        && (strcmp(message->path, handle->record.members[member].path) == 0);
+}
+
+// Select renderer found as group member, added or replacing a lost one
+// (or itself if moved), its control URLs are read from its description.
+// Return true on success, false if renderer is not usable.
+static bool upnp_discovery_select(
+    upnp_discovery_handle_t * const handle,
+    const upnp_ssdp_message_t * const message, int32_t member)
+{
+    assert(handle);
+    assert(message);
+    upnp_description_t * const description = &handle->description;
+    if (!upnp_description_fetch(description, &message->location,
+            message->path))
+        return false;
+    const int32_t slot = (member >= 0)
+        ? (upnp_discovery_named(handle, description->name) ? member : -1)
+        : upnp_discovery_slot(handle, description->name);
+    if (slot < 0)
+    {
+        ESP_LOGI(LOGGER_TAG, "Renderer ignored name='%s'",
+            description->name);
+        upnp_discovery_reject(handle, message->udn);
+        return false;
+    }
+    upnp_discovery_record_t * const record = &handle->record;
+    upnp_renderer_t * const renderer = &record->group.members[slot];
+    upnp_discovery_member_t * const identity = &record->members[slot];
+    memset(renderer, 0, sizeof(upnp_renderer_t));
+    memset(identity, 0, sizeof(upnp_discovery_member_t));
+    inet_ntop(AF_INET, &message->location.sin_addr, renderer->host,
+        sizeof(renderer->host));
+    renderer->port = ntohs(message->location.sin_port);
+    const upnp_description_service_t * const av_transport =
+        &description->service_urls[UPNP_SERVICE_AV_TRANSPORT];
+    const upnp_description_service_t * const rendering_control =
+        &description->service_urls[UPNP_SERVICE_RENDERING_CONTROL];
+    strcpy(renderer->av_transport_path, av_transport->control_url);
+    strcpy(renderer->rendering_control_path, rendering_control->control_url);
+    strcpy(renderer->av_transport_event_path, av_transport->event_url);
+    strcpy(renderer->rendering_control_event_path,
+        rendering_control->event_url);
+    strcpy(identity->udn, message->udn);
+    strcpy(identity->name, description->name);
+    strcpy(identity->path, message->path);
+    if ((uint32_t) slot == record->group.nb)
+        record->group.nb++;
+    record->version = UPNP_DISCOVERY_VERSION;
+    handle->lost &= ~(1u << slot);
+    handle->searching = !upnp_discovery_complete(handle);
+    ESP_LOGI(LOGGER_TAG, "Renderer selected member=%u name='%s' host=%s:%u",
+        (unsigned int) slot, identity->name, renderer->host,
+        (unsigned int) renderer->port);
+    upnp_executor_group_set(&record->group);
+    upnp_discovery_store(handle);
+    return true;
+}
+
+// Process SSDP message of a renderer.
+// Group members are kept while they respond, another renderer is only
+// selected if group is not complete yet, or if a member is lost.
+static void upnp_discovery_message(
+    upnp_discovery_handle_t * const handle,
+    const upnp_ssdp_message_t * const message)
+{
+    assert(handle);
+    assert(message);
+    const int32_t member = upnp_discovery_member(handle, message->udn);
+    if (message->kind == UPNP_SSDP_BYEBYE)
+    {
+        if ((member >= 0) && ((handle->lost & (1u << member)) == 0u))
+        {
+            ESP_LOGI(LOGGER_TAG, "Renderer left member=%u name='%s'",
+                (unsigned int) member, handle->record.members[member].name);
+            handle->lost |= 1u << member;
+            if (!handle->searching)
+                upnp_discovery_search_start(handle);
+        }
+        return;
+    }
+    if ((member >= 0) && upnp_discovery_located(handle, member, message))
+    {
+        if ((handle->lost & (1u << member)) != 0u)
+            ESP_LOGI(LOGGER_TAG, "Renderer back member=%u name='%s'",
+                (unsigned int) member, handle->record.members[member].name);
+        handle->lost &= ~(1u << member);
+        handle->searching = !upnp_discovery_complete(handle);
+        return;
+    }
+    if (((member < 0) && !handle->searching)
+        || upnp_discovery_rejected(handle, message->udn))
+        return;
+    upnp_discovery_select(handle, message, member);
+}
+
+// Discovery task handler.
+static void upnp_discovery_task_handler(void *context)
+{
+    assert(context);
+    upnp_discovery_handle_t * const handle =
+        (upnp_discovery_handle_t *) context;
+    upnp_discovery_connect();
+    // Group recorded is revalidated by a single search, else renderers are
+    // searched until group is complete.
+    if (upnp_discovery_complete(handle))
+        upnp_ssdp_search();
+    else
+        upnp_discovery_search_start(handle);
+    while (true)
+    {
+        uint32_t lost;
+        wakeup_clear(handle->wakeup);
+        if (xTaskNotifyWait(0u, UINT32_MAX, &lost, 0u) == pdTRUE)
+            upnp_discovery_members_lost(handle, lost);
+        uint32_t now_ms = upnp_discovery_time_ms();
+        if (handle->searching
+            && ((int32_t) (now_ms - handle->search_ms) >= 0))
+        {
+            ESP_LOGD(LOGGER_TAG, "Search period=%lu", handle->period_ms);
+            // Socket is opened again if network has been restarted.
+            if (!upnp_ssdp_search())
+                upnp_discovery_connect();
+            handle->search_ms = now_ms + handle->period_ms;
+            handle->period_ms = (handle->period_ms
+                < (UPNP_DISCOVERY_SEARCH_MAX_MS / 2u))
+                    ? handle->period_ms * 2u : UPNP_DISCOVERY_SEARCH_MAX_MS;
+        }
+        // Messages are waited until next search, forever once group is
+        // complete.
+        now_ms = upnp_discovery_time_ms();
+        const int32_t search_ms = (int32_t) (handle->search_ms - now_ms);
+        const uint32_t wait_ms = !handle->searching ? UINT32_MAX
+            : (search_ms > 0) ? (uint32_t) search_ms : 0u;
+        if (upnp_ssdp_receive(&handle->message, wait_ms, handle->wakeup))
+            upnp_discovery_message(handle, &handle->message);
+    }
+}
+
+// Split friendly names selected, comma separated.
+static void upnp_discovery_names_set(
+    upnp_discovery_handle_t * const handle, const char *names)
+{
+    assert(handle);
+    assert(names);
+    while ((names[0] != '\0') && (handle->names_nb < UPNP_GROUP_MEMBER_NB))
+    {
+        const size_t length = strcspn(names, ",");
+        if ((length > 0u) && (length < UPNP_DESCRIPTION_NAME_SIZE))
+        {
+            memcpy(handle->names[handle->names_nb], names, length);
+            handle->names[handle->names_nb][length] = '\0';
+            handle->names_nb++;
+        }
+        else if (length > 0u)
+            ESP_LOGW(LOGGER_TAG, "Renderer name too long");
+        names += length;
+        if (names[0] == ',')
+            names++;
+    }
+}
+
+// Check if group recorded matches names selected.
+static bool upnp_discovery_matching(
+    const upnp_discovery_handle_t * const handle)
+{
+    assert(handle);
+    const upnp_discovery_record_t * const record = &handle->record;
+    if ((record->group.nb == 0u) || (record->group.nb > UPNP_GROUP_MEMBER_NB))
+        return false;
+    if (handle->names_nb == 0u)
+        return record->group.nb == 1u;
+    for (size_t i = 0; i < record->group.nb; i++)
+    {
+        if (!upnp_discovery_named(handle, record->members[i].name))
+            return false;
+    }
+    return true;
+}
+
+void upnp_discovery_init(const char *names)
+{
+    assert(names);
+    upnp_discovery_handle_t * const handle = &upnp_discovery_handle;
+    memset(handle, 0, sizeof(upnp_discovery_handle_t));
+    handle->wakeup = wakeup_open();
+    if (handle->wakeup < 0)
+        ESP_LOGE(LOGGER_TAG, "Wakeup descriptor failed");
+    upnp_discovery_names_set(handle, names);
+    // Group found on previous boot is used at once, without waiting for
+    // network and search responses.
+    if (upnp_discovery_load(handle) && upnp_discovery_matching(handle))
+    {
+        const upnp_group_t * const group = &handle->record.group;
+        for (size_t i = 0; i < group->nb; i++)
+            ESP_LOGI(LOGGER_TAG,
+                "Renderer restored member=%u name='%s' host=%s:%u",
+                (unsigned int) i, handle->record.members[i].name,
+                group->members[i].host,
+                (unsigned int) group->members[i].port);
+        upnp_executor_group_set(group);
+    }
+    else
+        memset(&handle->record, 0, sizeof(upnp_discovery_record_t));
+    // Create discovery task.
+    xTaskCreateStatic(
+        &upnp_discovery_task_handler,
+        "Discovery",
+        UPNP_DISCOVERY_TASK_STACK_SIZE,
+        handle,
+        UPNP_DISCOVERY_TASK_PRIORITY,
+        handle->task_stack,
+        &handle->task
+    );
+}
+
+void upnp_discovery_lost(uint32_t members)
+{
+    xTaskNotify((TaskHandle_t) &upnp_discovery_handle.task, members,
+        eSetBits);
+    wakeup_signal(upnp_discovery_handle.wakeup);
+}
@@ -0,0 +1,366 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "upnp_executor.h"
+#include "upnp_discovery.h"
+#include "upnp_sink.h"
+#include "boot.h"
+#include "power.h"
+#include "trace.h"
+#include "wakeup.h"
+#include "wifi.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <assert.h>
+#include <string.h>
+
+#define LOGGER_TAG "upnp_executor"
+
+#define UPNP_EXECUTOR_TASK_STACK_SIZE   (6u * configMINIMAL_STACK_SIZE)
+// Below command task, which only submits actions, above discovery.
+#define UPNP_EXECUTOR_TASK_PRIORITY     (tskIDLE_PRIORITY + 3u)
+#define UPNP_EXECUTOR_DEADLINE_MS       2000u   // Older actions are dropped.
+#define UPNP_EXECUTOR_ATTEMPT_NB           3u
+// Backoff of a renderer not responding, doubled on each failure.
+#define UPNP_EXECUTOR_BACKOFF_MS          50u
+#define UPNP_EXECUTOR_BACKOFF_DOUBLINGS    5u   // Up to 1.6s.
+// Response deadline of an attempt, shorter for a renderer not responding
+// (probed) so it does not hold the others.
+#define UPNP_EXECUTOR_ATTEMPT_MS        1000u
+#define UPNP_EXECUTOR_PROBE_MS           250u
+
+// Actions of a group renderer.
+typedef struct
+{
+    command_action_t waiting;   // Actions not sent yet, or to send again.
+    bool in_flight;             // Actions being sent by executor task.
+    bool superseded;            // Newer actions submitted while in flight.
+    uint32_t deadline_ms;       // Waiting actions are dropped after.
+    uint32_t retry_ms;          // Time of next attempt.
+    uint32_t attempts;          // Attempts of waiting actions.
+    uint32_t failures;          // Consecutive attempts without response.
+} upnp_executor_slot_t;
+
+// Action executor handle.
+// Renderers are only reached from executor task, command task only submits
+// actions, so a slow renderer never delays IR commands. Executor task waits
+// renderer sockets and its wakeup descriptor together, it is only woken up
+// by submitted actions, renderer events, and deadlines. Slots are shared
+// under lock, one per group renderer: each renderer has at most one batch
+// of actions in flight, and one waiting. A renderer not responding is only
+// tried again after its backoff, so it does not delay the others.
+typedef struct
+{
+    StaticTask_t task;
+    StackType_t task_stack[UPNP_EXECUTOR_TASK_STACK_SIZE];
+    int wakeup;                 // Signaled on actions or group submitted.
+    portMUX_TYPE lock;
+    upnp_executor_slot_t slots[UPNP_GROUP_MEMBER_NB];
+    size_t slots_nb;            // Renderers of group set last.
+    upnp_executor_stats_t stats;
+    bool group_pending;         // Group changed, not applied yet.
+    upnp_group_t group;
+    upnp_group_t group_applied; // Copy taken out of lock, to be applied.
+    // Actions in flight, sent out of lock (answered ones are cleared).
+    command_action_t actions[UPNP_GROUP_MEMBER_NB];
+    uint32_t timeouts_ms[UPNP_GROUP_MEMBER_NB];
+    upnp_sink_stats_t sink_stats;
+} upnp_executor_handle_t;
+
+static upnp_executor_handle_t upnp_executor_handle;
+
+static uint32_t upnp_executor_time_ms(void)
+{
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+// Check if folded actions have something to send.
+static bool upnp_executor_pending(const command_action_t * const action)
+{
+    assert(action);
+    return (action->volume != 0) || (action->skip != 0)
+        || action->play_pause || action->mute;
+}
+
+// Fold actions in older ones, as if their commands were received together.
+static void upnp_executor_fold(
+    command_action_t * const older, const command_action_t * const action)
+{
+    assert(older);
+    assert(action);
+    older->volume += action->volume;
+    older->skip += action->skip;
+    older->play_pause = older->play_pause != action->play_pause;
+    older->mute = older->mute != action->mute;
+    older->origin = trace_oldest(older->origin, action->origin);
+}
+
+// Apply renderer group change, if any.
+static void upnp_executor_group_apply(upnp_executor_handle_t * const handle)
+{
+    assert(handle);
+    const upnp_group_t * const group = &handle->group_applied;
+    bool pending;
+    portENTER_CRITICAL(&handle->lock);
+    pending = handle->group_pending;
+    if (pending)
+        handle->group_applied = handle->group;
+    handle->group_pending = false;
+    portEXIT_CRITICAL(&handle->lock);
+    if (!pending)
+        return;
+    if (!upnp_sink_init(group))
+    {
+        ESP_LOGE(LOGGER_TAG, "UPnP renderer configuration invalid");
+        return;
+    }
+    for (size_t i = 0; i < group->nb; i++)
+        ESP_LOGI(LOGGER_TAG, "Renderer member=%u host=%s:%u",
+            (unsigned int) i, group->members[i].host,
+            (unsigned int) group->members[i].port);
+}
+
+// Get time to wait before next attempt due, UINT32_MAX if none.
+static uint32_t upnp_executor_wait_ms(upnp_executor_handle_t * const handle)
+{
+    assert(handle);
+    const uint32_t now_ms = upnp_executor_time_ms();
+    uint32_t wait_ms = UINT32_MAX;
+    portENTER_CRITICAL(&handle->lock);
+    for (size_t i = 0; i < handle->slots_nb; i++)
+    {
+        const upnp_executor_slot_t * const slot = &handle->slots[i];
+        if (!upnp_executor_pending(&slot->waiting))
+            continue;
+        const int32_t due_ms = (int32_t) (slot->retry_ms - now_ms);
+        if (due_ms <= 0)
+            wait_ms = 0u;
+        else if ((uint32_t) due_ms < wait_ms)
+            wait_ms = (uint32_t) due_ms;
+    }
+    portEXIT_CRITICAL(&handle->lock);
+    return wait_ms;
+}
+
+// Take waiting actions due, they are in flight until completed, with the
+// time left before their deadline. Actions older than deadline are dropped.
+// Return number of renderers with actions to send.
+static size_t upnp_executor_take(upnp_executor_handle_t * const handle)
+{
+    assert(handle);
+    const uint32_t now_ms = upnp_executor_time_ms();
+    uint32_t expired = 0u;
+    size_t taken = 0u;
+    memset(handle->actions, 0, sizeof(handle->actions));
+    memset(handle->timeouts_ms, 0, sizeof(handle->timeouts_ms));
+    portENTER_CRITICAL(&handle->lock);
+    for (size_t i = 0; i < handle->slots_nb; i++)
+    {
+        upnp_executor_slot_t * const slot = &handle->slots[i];
+        if (!upnp_executor_pending(&slot->waiting)
+            || ((int32_t) (now_ms - slot->retry_ms) < 0))
+            continue;
+        const int32_t left_ms = (int32_t) (slot->deadline_ms - now_ms);
+        if (left_ms <= 0)
+        {
+            memset(&slot->waiting, 0, sizeof(command_action_t));
+            handle->stats.expired++;
+            expired |= 1u << i;
+            continue;
+        }
+        handle->actions[i] = slot->waiting;
+        memset(&slot->waiting, 0, sizeof(command_action_t));
+        slot->in_flight = true;
+        handle->timeouts_ms[i] = (slot->failures > 0u)
+            ? UPNP_EXECUTOR_PROBE_MS : UPNP_EXECUTOR_ATTEMPT_MS;
+        if ((uint32_t) left_ms < handle->timeouts_ms[i])
+            handle->timeouts_ms[i] = (uint32_t) left_ms;
+        taken++;
+    }
+    portEXIT_CRITICAL(&handle->lock);
+    for (size_t i = 0; i < UPNP_GROUP_MEMBER_NB; i++)
+    {
+        if ((expired & (1u << i)) != 0u)
+            ESP_LOGW(LOGGER_TAG, "Actions expired member=%u",
+                (unsigned int) i);
+    }
+    return taken;
+}
+
+// Complete actions in flight, the ones left (not sent) are folded in newer
+// ones if superseded, else sent again after a backoff. Backoff is doubled
+// while renderer does not answer.
+static void upnp_executor_complete(
+    upnp_executor_handle_t * const handle, uint32_t unanswered)
+{
+    assert(handle);
+    const uint32_t now_ms = upnp_executor_time_ms();
+    uint32_t dropped = 0u;
+    bool answered = false;
+    portENTER_CRITICAL(&handle->lock);
+    for (size_t i = 0; i < UPNP_GROUP_MEMBER_NB; i++)
+    {
+        upnp_executor_slot_t * const slot = &handle->slots[i];
+        const command_action_t * const left = &handle->actions[i];
+        const bool superseded = slot->superseded;
+        if (!slot->in_flight)
+            continue;
+        const bool failing = (unanswered & (1u << i)) != 0u;
+        slot->in_flight = false;
+        slot->superseded = false;
+        if (!failing)
+            slot->failures = 0u;
+        answered = answered || !failing;
+        if (!failing && !upnp_executor_pending(left))
+            continue;
+        slot->retry_ms = now_ms + (UPNP_EXECUTOR_BACKOFF_MS << slot->failures);
+        if (failing && (slot->failures < UPNP_EXECUTOR_BACKOFF_DOUBLINGS))
+            slot->failures++;
+        // Actions of renderers removed from group are dropped.
+        if ((i >= handle->slots_nb) || !upnp_executor_pending(left))
+            continue;
+        if (superseded)
+        {
+            upnp_executor_fold(&slot->waiting, left);
+            handle->stats.superseded++;
+        }
+        else if ((slot->attempts + 1u) < UPNP_EXECUTOR_ATTEMPT_NB)
+        {
+            slot->waiting = *left;
+            slot->attempts++;
+            handle->stats.retries++;
+        }
+        else
+        {
+            handle->stats.failures++;
+            dropped |= 1u << i;
+        }
+    }
+    portEXIT_CRITICAL(&handle->lock);
+    if (answered)
+        boot_mark(BOOT_FIRST_ACTION);
+    for (size_t i = 0; i < UPNP_GROUP_MEMBER_NB; i++)
+    {
+        if ((dropped & (1u << i)) != 0u)
+            ESP_LOGW(LOGGER_TAG, "Actions dropped member=%u attempts=%u",
+                (unsigned int) i, (unsigned int) UPNP_EXECUTOR_ATTEMPT_NB);
+    }
+}
+
+// Executor task handler.
+static void upnp_executor_task_handler(void *context)
+{
+    assert(context);
+    upnp_executor_handle_t * const handle =
+        (upnp_executor_handle_t *) context;
+    while (true)
+    {
+        // Wait actions submitted or next attempt, renderer connections are
+        // kept ready and renderer events are received meanwhile. Wakeup is
+        // cleared before actions are taken, so none submitted is missed.
+        upnp_sink_wait(handle->wakeup, upnp_executor_wait_ms(handle));
+        wakeup_clear(handle->wakeup);
+        upnp_executor_group_apply(handle);
+        if (upnp_executor_take(handle) == 0u)
+        {
+            upnp_sink_poll();
+            continue;
+        }
+        // Full speed while actions are in flight, responses are awaited
+        // with light sleep prevented.
+        power_acquire(POWER_LOCK_NETWORK);
+        const uint32_t unanswered =
+            upnp_sink_process(handle->actions, handle->timeouts_ms);
+        power_release(POWER_LOCK_NETWORK);
+        // Dispatch latency is accounted to Wi-Fi power save mode.
+        upnp_sink_stats_get(&handle->sink_stats);
+        wifi_latency_record(handle->sink_stats.latency_us);
+        upnp_executor_complete(handle, unanswered);
+        if (unanswered == 0u)
+            continue;
+        ESP_LOGW(LOGGER_TAG, "Actions not answered by renderers");
+        // Renderers are searched again when they do not respond anymore.
+        const uint32_t unreachable = upnp_sink_unreachable();
+        if (unreachable != 0u)
+            upnp_discovery_lost(unreachable);
+    }
+}
+
+void upnp_executor_init(void)
+{
+    memset(&upnp_executor_handle, 0, sizeof(upnp_executor_handle_t));
+    portMUX_INITIALIZE(&upnp_executor_handle.lock);
+    upnp_executor_handle.wakeup = wakeup_open();
+    if (upnp_executor_handle.wakeup < 0)
+        ESP_LOGE(LOGGER_TAG, "Wakeup descriptor failed");
+    // Create executor task.
+    xTaskCreateStatic(
+        &upnp_executor_task_handler,
+        "Executor",
+        UPNP_EXECUTOR_TASK_STACK_SIZE,
+        &upnp_executor_handle,
+        UPNP_EXECUTOR_TASK_PRIORITY,
+        upnp_executor_handle.task_stack,
+        &upnp_executor_handle.task
+    );
+}
+
+void upnp_executor_group_set(const upnp_group_t * const group)
+{
+    assert(group);
+    assert(group->nb <= UPNP_GROUP_MEMBER_NB);
+    upnp_executor_handle_t * const handle = &upnp_executor_handle;
+    portENTER_CRITICAL(&handle->lock);
+    handle->group = *group;
+    handle->group_pending = true;
+    handle->slots_nb = group->nb;
+    // Actions of renderers removed from group are dropped.
+    for (size_t i = group->nb; i < UPNP_GROUP_MEMBER_NB; i++)
+        memset(&handle->slots[i].waiting, 0, sizeof(command_action_t));
+    portEXIT_CRITICAL(&handle->lock);
+    wakeup_signal(handle->wakeup);
+}
+
+void upnp_executor_submit(const command_action_t * const action)
+{
+    assert(action);
+    upnp_executor_handle_t * const handle = &upnp_executor_handle;
+    const uint32_t now_ms = upnp_executor_time_ms();
+    size_t slots_nb;
+    portENTER_CRITICAL(&handle->lock);
+    slots_nb = handle->slots_nb;
+    for (size_t i = 0; i < slots_nb; i++)
+    {
+        upnp_executor_slot_t * const slot = &handle->slots[i];
+        if (upnp_executor_pending(&slot->waiting))
+            handle->stats.superseded++;
+        if (slot->in_flight)
+            slot->superseded = true;
+        // Newer actions are sent at once with a new deadline, unless
+        // renderer is not responding.
+        upnp_executor_fold(&slot->waiting, action);
+        slot->deadline_ms = now_ms + UPNP_EXECUTOR_DEADLINE_MS;
+        if (slot->failures == 0u)
+            slot->retry_ms = now_ms;
+        slot->attempts = 0u;
+        handle->stats.submitted++;
+    }
+    portEXIT_CRITICAL(&handle->lock);
+    if (slots_nb == 0u)
+    {
+        ESP_LOGW(LOGGER_TAG, "No renderer configured");
+        return;
+    }
+    wakeup_signal(handle->wakeup);
+}
+
+void upnp_executor_stats_get(upnp_executor_stats_t * const stats)
+{
+    assert(stats);
+    portENTER_CRITICAL(&upnp_executor_handle.lock);
+    *stats = upnp_executor_handle.stats;
+    portEXIT_CRITICAL(&upnp_executor_handle.lock);
+}
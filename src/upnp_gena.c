@@ -0,0 +1,978 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "upnp_gena.h"
+#include "upnp_description.h"
+#include "upnp_xml.h"
+#include "esp_log.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOGGER_TAG "upnp_gena"
+
+#define UPNP_GENA_BUFFER_SIZE             512u  // Holds an event header.
+#define UPNP_GENA_SID_SIZE                 64u
+#define UPNP_GENA_VALUE_SIZE               24u
+#define UPNP_GENA_TIMEOUT_S               300u  // Subscription requested.
+#define UPNP_GENA_RECEIVE_TIMEOUT_MS      500u
+#define UPNP_GENA_SUBSCRIBE_TIMEOUT_MS   2000u
+#define UPNP_GENA_EVENT_NB                  4u  // Events processed per poll.
+// Subscription is retried after a failure, with period doubled each time.
+#define UPNP_GENA_RETRY_MIN_MS           5000u
+#define UPNP_GENA_RETRY_MAX_MS         300000u
+#define UPNP_GENA_HEADER_END             "\r\n\r\n"
+
+// LastChange variables, reported with their attributes (value and channel).
+static const char * const upnp_gena_event_paths[] = {
+    [UPNP_GENA_TRANSPORT_STATE] = "InstanceID/TransportState@",
+    [UPNP_GENA_VOLUME] = "InstanceID/Volume@",
+    [UPNP_GENA_MUTE] = "InstanceID/Mute@",
+};
+
+// Service of each variable, variables are stale once it is not subscribed.
+static const uint8_t upnp_gena_variable_services[] = {
+    [UPNP_GENA_TRANSPORT_STATE] = UPNP_SERVICE_AV_TRANSPORT,
+    [UPNP_GENA_VOLUME] = UPNP_SERVICE_RENDERING_CONTROL,
+    [UPNP_GENA_MUTE] = UPNP_SERVICE_RENDERING_CONTROL,
+};
+
+static const char * const upnp_gena_service_names[] = {
+    [UPNP_SERVICE_AV_TRANSPORT] = "AVTransport",
+    [UPNP_SERVICE_RENDERING_CONTROL] = "RenderingControl",
+};
+
+// Event subscription to a renderer service.
+typedef struct
+{
+    char path[UPNP_RENDERER_PATH_SIZE];  // Subscription path, empty if none.
+    char sid[UPNP_GENA_SID_SIZE];   // Subscription ID, empty if none.
+    uint32_t seq;               // Event key expected next.
+    uint32_t renew_ms;          // Time of next subscription or renewal.
+    uint32_t retry_ms;          // Subscription retry period.
+} upnp_gena_subscription_t;
+
+// Events of a renderer of the group.
+typedef struct
+{
+    struct sockaddr_in address;     // Renderer address.
+    char host[UPNP_RENDERER_HOST_SIZE];
+    bool configured;
+    upnp_gena_subscription_t subscriptions[UPNP_SERVICE_NB_MAX];
+    uint32_t known;             // Variables known (bit mask).
+    uint32_t values[UPNP_GENA_VARIABLE_NB_MAX];
+} upnp_gena_member_t;
+
+// Subscription exchange state.
+typedef enum
+{
+    UPNP_GENA_EXCHANGE_IDLE = 0,        // No subscription in progress.
+    UPNP_GENA_EXCHANGE_CONNECTING,      // Connection being established.
+    UPNP_GENA_EXCHANGE_SENDING,         // Request being sent.
+    UPNP_GENA_EXCHANGE_RECEIVING,       // Response header being received.
+} upnp_gena_exchange_state_t;
+
+// Subscription exchange in progress, on its own connection.
+typedef struct
+{
+    upnp_gena_exchange_state_t state;
+    int sock;                   // Socket, negative if none.
+    size_t member;
+    upnp_service_t service;
+    bool renewal;
+    size_t length;              // Request length, then response received.
+    size_t sent;
+    uint32_t deadline_ms;
+    char buffer[UPNP_GENA_BUFFER_SIZE + 1u];    // Request, then response.
+} upnp_gena_exchange_t;
+
+// Event being received.
+typedef struct
+{
+    int sock;                   // Connection, negative if none.
+    bool body;                  // Header received, body being parsed.
+    size_t buffered;            // Header received.
+    size_t remaining;           // Body expected, SIZE_MAX until closed.
+    uint8_t service;
+    uint32_t seq;
+    uint32_t deadline_ms;
+} upnp_gena_notify_t;
+
+// UPnP events handle.
+// Renderer state variables are cached from events, as long as services are
+// subscribed. Events of all renderers are received on a listener waited by
+// the caller task, so cache is only used from this task.
+// Sockets never wait: one subscription exchange and one event are in
+// progress at a time, and go on as their sockets are ready, so a renderer
+// not answering does not hold the caller task.
+typedef struct
+{
+    int listener;               // Event listener socket, negative if none.
+    upnp_gena_member_t members[UPNP_GROUP_MEMBER_NB];
+    size_t members_nb;
+    upnp_gena_exchange_t exchange;
+    upnp_gena_notify_t notify;
+    upnp_gena_member_t *event;  // Member of event being parsed.
+    char sid[UPNP_GENA_SID_SIZE];   // Subscription response ID.
+    uint32_t timeout_s;         // Subscription response duration.
+    upnp_xml_parser_t parser;   // Event document parser.
+    bool entity;                // Entity reference being unescaped.
+    size_t entity_length;
+    char entity_name[8];
+    char buffer[UPNP_GENA_BUFFER_SIZE + 1u];
+    upnp_gena_stats_t stats;
+} upnp_gena_handle_t;
+
+static upnp_gena_handle_t upnp_gena_handle = {
+    .listener = -1,
+    .exchange.sock = -1,
+    .notify.sock = -1
+};
+
+static uint32_t upnp_gena_time_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) ts.tv_sec * 1000u + (uint32_t) (ts.tv_nsec / 1000000);
+}
+
+// Get value of header field, surrounding spaces trimmed.
+// Return true on success, false if field is not found or too long.
+static bool upnp_gena_field(
+    const char *header, size_t length, const char *name, char *value,
+    size_t size)
+{
+    const char * const end = &header[length];
+    const size_t name_length = strlen(name);
+    for (const char *line = header; line < end;)
+    {
+        const char *next = memchr(line, '\n', (size_t) (end - line));
+        next = next ? next + 1 : end;
+        if ((((size_t) (next - line)) <= name_length)
+            || (strncasecmp(line, name, name_length) != 0)
+            || (line[name_length] != ':'))
+        {
+            line = next;
+            continue;
+        }
+        line += name_length + 1u;
+        line += strspn(line, " \t");
+        size_t value_length = (size_t) (next - line);
+        while ((value_length > 0u) && ((line[value_length - 1u] == '\r')
+                || (line[value_length - 1u] == '\n')
+                || (line[value_length - 1u] == ' ')))
+            value_length--;
+        if (value_length >= size)
+            return false;
+        memcpy(value, line, value_length);
+        value[value_length] = '\0';
+        return true;
+    }
+    return false;
+}
+
+// Check if time is reached.
+static bool upnp_gena_time_reached(uint32_t now_ms, uint32_t time_ms)
+{
+    return (int32_t) (now_ms - time_ms) >= 0;
+}
+
+// Shorten time to wait until time given, 0 if reached.
+static void upnp_gena_wait(
+    uint32_t now_ms, uint32_t time_ms, uint32_t * const wait_ms)
+{
+    const int32_t due_ms = (int32_t) (time_ms - now_ms);
+    if (due_ms <= 0)
+        *wait_ms = 0u;
+    else if ((uint32_t) due_ms < *wait_ms)
+        *wait_ms = (uint32_t) due_ms;
+}
+
+// Add socket to set, and update highest descriptor of sets.
+static void upnp_gena_fd_set(int sock, fd_set * const set, int * const fd_max)
+{
+    FD_SET(sock, set);
+    if (sock > *fd_max)
+        *fd_max = sock;
+}
+
+// Check if socket is writable, without waiting.
+static bool upnp_gena_writable(int sock)
+{
+    fd_set writable;
+    struct timeval timeout = { .tv_sec = 0, .tv_usec = 0 };
+    FD_ZERO(&writable);
+    FD_SET(sock, &writable);
+    return select(sock + 1, NULL, &writable, NULL, &timeout) > 0;
+}
+
+// Subscription response header received.
+static void upnp_gena_subscribe_header(
+    upnp_gena_handle_t * const handle, const char *data, size_t length)
+{
+    assert(handle);
+    char value[UPNP_GENA_VALUE_SIZE];
+    if (!upnp_gena_field(data, length, "SID", handle->sid,
+            sizeof(handle->sid)))
+        handle->sid[0] = '\0';
+    // Duration granted may differ from the one requested (or be infinite).
+    handle->timeout_s = UPNP_GENA_TIMEOUT_S;
+    if (upnp_gena_field(data, length, "TIMEOUT", value, sizeof(value))
+        && (strncasecmp(value, "Second-", 7u) == 0)
+        && (strtoul(&value[7], NULL, 10) > 0u))
+        handle->timeout_s = (uint32_t) strtoul(&value[7], NULL, 10);
+}
+
+// Open event listener.
+// Return true on success, false on error.
+static bool upnp_gena_listen(upnp_gena_handle_t * const handle)
+{
+    assert(handle);
+    const int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock < 0)
+        return false;
+    const int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    const struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = htons(UPNP_GENA_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY)
+    };
+    if ((bind(sock, (const struct sockaddr *) &address, sizeof(address)) != 0)
+        || (listen(sock, UPNP_GENA_EVENT_NB) != 0))
+    {
+        ESP_LOGW(LOGGER_TAG, "Event listener configuration failed");
+        close(sock);
+        return false;
+    }
+    handle->listener = sock;
+    return true;
+}
+
+// Get local address on the route to renderer, for event callback URL.
+// Return true on success, false on error.
+static bool upnp_gena_local_address(
+    const upnp_gena_member_t * const member, char *host, size_t size)
+{
+    assert(member);
+    struct sockaddr_in address;
+    socklen_t length = sizeof(address);
+    const int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0)
+        return false;
+    // No datagram is sent, connection only selects the route.
+    const bool success = (connect(sock,
+            (const struct sockaddr *) &member->address,
+            sizeof(member->address)) == 0)
+        && (getsockname(sock, (struct sockaddr *) &address, &length) == 0)
+        && inet_ntop(AF_INET, &address.sin_addr, host, size);
+    close(sock);
+    return success;
+}
+
+// Drop subscription to service, its variables are stale.
+static void upnp_gena_unsubscribed(
+    upnp_gena_member_t * const member, upnp_service_t service)
+{
+    assert(member);
+    member->subscriptions[service].sid[0] = '\0';
+    for (size_t i = 0; i < UPNP_GENA_VARIABLE_NB_MAX; i++)
+    {
+        if (upnp_gena_variable_services[i] == service)
+            member->known &= ~(1u << i);
+    }
+}
+
+// Start subscription to events of service of a member, or renewal. Its
+// connection is opened without waiting, exchange goes on as socket is ready.
+// Return true on success, false on error.
+static bool upnp_gena_subscribe(
+    upnp_gena_handle_t * const handle, size_t index, upnp_service_t service)
+{
+    assert(handle);
+    upnp_gena_member_t * const member = &handle->members[index];
+    upnp_gena_subscription_t * const subscription =
+        &member->subscriptions[service];
+    upnp_gena_exchange_t * const exchange = &handle->exchange;
+    const unsigned int port = ntohs(member->address.sin_port);
+    char * const request = exchange->buffer;
+    int length;
+    exchange->member = index;
+    exchange->service = service;
+    exchange->renewal = subscription->sid[0] != '\0';
+    if (exchange->renewal)
+        length = snprintf(request, sizeof(exchange->buffer),
+            "SUBSCRIBE %s HTTP/1.1\r\n"
+            "HOST: %s:%u\r\n"
+            "SID: %s\r\n"
+            "TIMEOUT: Second-%u\r\n"
+            "\r\n",
+            subscription->path, member->host, port, subscription->sid,
+            UPNP_GENA_TIMEOUT_S);
+    else
+    {
+        char local[INET_ADDRSTRLEN];
+        if (((handle->listener < 0) && !upnp_gena_listen(handle))
+            || !upnp_gena_local_address(member, local, sizeof(local)))
+            return false;
+        length = snprintf(request, sizeof(exchange->buffer),
+            "SUBSCRIBE %s HTTP/1.1\r\n"
+            "HOST: %s:%u\r\n"
+            "CALLBACK: <http://%s:%u/%u/%s>\r\n"
+            "NT: upnp:event\r\n"
+            "TIMEOUT: Second-%u\r\n"
+            "\r\n",
+            subscription->path, member->host, port, local, UPNP_GENA_PORT,
+            (unsigned int) index, upnp_gena_service_names[service],
+            UPNP_GENA_TIMEOUT_S);
+    }
+    if ((length < 0) || ((size_t) length >= sizeof(exchange->buffer)))
+        return false;
+    const int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock < 0)
+        return false;
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    if ((connect(sock, (const struct sockaddr *) &member->address,
+            sizeof(member->address)) != 0)
+        && (errno != EINPROGRESS))
+    {
+        close(sock);
+        return false;
+    }
+    exchange->sock = sock;
+    exchange->state = UPNP_GENA_EXCHANGE_CONNECTING;
+    exchange->length = (size_t) length;
+    exchange->sent = 0u;
+    exchange->deadline_ms =
+        upnp_gena_time_ms() + UPNP_GENA_SUBSCRIBE_TIMEOUT_MS;
+    return true;
+}
+
+// Check subscription response, and record subscription.
+// Return true on success, false on error.
+static bool upnp_gena_subscribe_response(
+    upnp_gena_handle_t * const handle, size_t header_length)
+{
+    assert(handle);
+    upnp_gena_exchange_t * const exchange = &handle->exchange;
+    upnp_gena_subscription_t * const subscription =
+        &handle->members[exchange->member].subscriptions[exchange->service];
+    const char * const status = memchr(exchange->buffer, ' ', header_length);
+    if ((strncmp(exchange->buffer, "HTTP/1.", 7u) != 0) || !status
+        || (strtoul(status + 1, NULL, 10) != 200u))
+        return false;
+    upnp_gena_subscribe_header(handle, exchange->buffer, header_length);
+    if ((handle->sid[0] == '\0')
+        || (exchange->renewal && (strcmp(handle->sid, subscription->sid) != 0)))
+        return false;
+    if (!exchange->renewal)
+    {
+        strcpy(subscription->sid, handle->sid);
+        subscription->seq = 0u;
+    }
+    // Subscription is renewed at half its duration.
+    subscription->renew_ms = upnp_gena_time_ms() + handle->timeout_s * 500u;
+    return true;
+}
+
+// Close subscription exchange, and account its result.
+static void upnp_gena_subscribe_done(
+    upnp_gena_handle_t * const handle, bool success)
+{
+    assert(handle);
+    upnp_gena_exchange_t * const exchange = &handle->exchange;
+    const size_t index = exchange->member;
+    const upnp_service_t service = exchange->service;
+    upnp_gena_member_t * const member = &handle->members[index];
+    upnp_gena_subscription_t * const subscription =
+        &member->subscriptions[service];
+    if (exchange->sock >= 0)
+        close(exchange->sock);
+    exchange->sock = -1;
+    exchange->state = UPNP_GENA_EXCHANGE_IDLE;
+    if (success)
+    {
+        if (exchange->renewal)
+            handle->stats.renewals++;
+        else
+        {
+            handle->stats.subscribes++;
+            ESP_LOGI(LOGGER_TAG,
+                "Subscribed member=%u service=%s timeout=%lus",
+                (unsigned int) index, upnp_gena_service_names[service],
+                (unsigned long) handle->timeout_s);
+        }
+        subscription->retry_ms = UPNP_GENA_RETRY_MIN_MS;
+        return;
+    }
+    // Renewal refused, a new subscription is done at once. Then it is
+    // retried less and less often.
+    handle->stats.failures++;
+    upnp_gena_unsubscribed(member, service);
+    if (exchange->renewal)
+    {
+        ESP_LOGW(LOGGER_TAG, "Renewal failed member=%u service=%s",
+            (unsigned int) index, upnp_gena_service_names[service]);
+        return;
+    }
+    ESP_LOGD(LOGGER_TAG, "Subscription failed member=%u service=%s",
+        (unsigned int) index, upnp_gena_service_names[service]);
+    subscription->renew_ms = upnp_gena_time_ms() + subscription->retry_ms;
+    subscription->retry_ms =
+        (subscription->retry_ms < (UPNP_GENA_RETRY_MAX_MS / 2u))
+            ? subscription->retry_ms * 2u : UPNP_GENA_RETRY_MAX_MS;
+}
+
+// Go on with subscription exchange in progress, without waiting.
+static void upnp_gena_subscribe_step(upnp_gena_handle_t * const handle)
+{
+    assert(handle);
+    upnp_gena_exchange_t * const exchange = &handle->exchange;
+    bool failed = false;
+    if ((exchange->state == UPNP_GENA_EXCHANGE_CONNECTING)
+        && upnp_gena_writable(exchange->sock))
+    {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        failed = (getsockopt(exchange->sock, SOL_SOCKET, SO_ERROR, &error,
+                &length) != 0)
+            || (error != 0);
+        exchange->state = UPNP_GENA_EXCHANGE_SENDING;
+    }
+    if (!failed && (exchange->state == UPNP_GENA_EXCHANGE_SENDING))
+    {
+        const ssize_t nb = send(exchange->sock,
+            &exchange->buffer[exchange->sent],
+            exchange->length - exchange->sent, 0);
+        failed = (nb < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK);
+        if (nb > 0)
+            exchange->sent += (size_t) nb;
+        if (exchange->sent == exchange->length)
+        {
+            exchange->state = UPNP_GENA_EXCHANGE_RECEIVING;
+            exchange->length = 0u;
+        }
+    }
+    while (!failed && (exchange->state == UPNP_GENA_EXCHANGE_RECEIVING))
+    {
+        const ssize_t nb = recv(exchange->sock,
+            &exchange->buffer[exchange->length],
+            UPNP_GENA_BUFFER_SIZE - exchange->length, 0);
+        if ((nb < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+            break;
+        failed = nb <= 0;
+        if (failed)
+            break;
+        exchange->length += (size_t) nb;
+        exchange->buffer[exchange->length] = '\0';
+        // Response body, if any, is not needed.
+        const char * const end =
+            strstr(exchange->buffer, UPNP_GENA_HEADER_END);
+        if (end)
+        {
+            upnp_gena_subscribe_done(handle, upnp_gena_subscribe_response(
+                handle, (size_t) (end - exchange->buffer)
+                    + sizeof(UPNP_GENA_HEADER_END) - 1u));
+            return;
+        }
+        failed = exchange->length >= UPNP_GENA_BUFFER_SIZE;
+    }
+    if (failed
+        || upnp_gena_time_reached(upnp_gena_time_ms(), exchange->deadline_ms))
+        upnp_gena_subscribe_done(handle, false);
+}
+
+// Get character of entity reference.
+// Return character on success, '\0' if entity is unknown.
+static char upnp_gena_entity(const char *entity)
+{
+    static const struct
+    {
+        const char *name;
+        char c;
+    } entities[] = {
+        { "amp", '&' }, { "lt", '<' }, { "gt", '>' },
+        { "quot", '"' }, { "apos", '\'' },
+    };
+    if (entity[0] == '#')
+    {
+        // Character reference, only ASCII characters are kept.
+        const unsigned long code = (entity[1] == 'x')
+            ? strtoul(&entity[2], NULL, 16) : strtoul(&entity[1], NULL, 10);
+        return ((code > 0u) && (code < 0x80u)) ? (char) code : '?';
+    }
+    for (size_t i = 0; i < (sizeof(entities) / sizeof(entities[0])); i++)
+    {
+        if (strcmp(entity, entities[i].name) == 0)
+            return entities[i].c;
+    }
+    return '\0';
+}
+
+// Event variable parsed, only master channel is kept.
+static void upnp_gena_event_element(
+    void *context, size_t path, const char *attributes)
+{
+    assert(context);
+    upnp_gena_member_t * const member =
+        ((upnp_gena_handle_t *) context)->event;
+    char value[UPNP_GENA_VALUE_SIZE];
+    uint32_t variable;
+    if ((upnp_xml_attribute(attributes, "channel", value, sizeof(value))
+            && (strcmp(value, "Master") != 0))
+        || !upnp_xml_attribute(attributes, "val", value, sizeof(value)))
+        return;
+    if (path == UPNP_GENA_TRANSPORT_STATE)
+        variable = (strcmp(value, "PLAYING") == 0)
+            || (strcmp(value, "TRANSITIONING") == 0);
+    else if (path == UPNP_GENA_MUTE)
+        variable = (strcmp(value, "1") == 0)
+            || (strcasecmp(value, "true") == 0);
+    else
+    {
+        char *end;
+        variable = (uint32_t) strtoul(value, &end, 10);
+        if ((value[0] == '\0') || (*end != '\0'))
+            return;
+    }
+    member->values[path] = variable;
+    member->known |= 1u << path;
+}
+
+// Unescape chunk of event body in place, then parse it.
+// LastChange document is escaped in its property: event document is
+// unescaped once, so LastChange is parsed as part of it.
+// Return true on success, false if document is malformed.
+static bool upnp_gena_unescape(
+    upnp_gena_handle_t * const handle, char *data, size_t length)
+{
+    assert(handle);
+    size_t written = 0u;
+    for (size_t i = 0; i < length; i++)
+    {
+        const char c = data[i];
+        if (!handle->entity)
+        {
+            if (c == '&')
+            {
+                handle->entity = true;
+                handle->entity_length = 0u;
+            }
+            else
+                data[written++] = c;
+            continue;
+        }
+        if (c != ';')
+        {
+            if (handle->entity_length >= (sizeof(handle->entity_name) - 1u))
+                return false;
+            handle->entity_name[handle->entity_length++] = c;
+            continue;
+        }
+        handle->entity_name[handle->entity_length] = '\0';
+        handle->entity = false;
+        data[written] = upnp_gena_entity(handle->entity_name);
+        if (data[written++] == '\0')
+            return false;
+    }
+    return upnp_xml_feed(&handle->parser, data, written);
+}
+
+// Check header of event received, its body is parsed next if event is
+// expected. Event of a subscription whose response is not processed yet is
+// checked again afterwards.
+// Return HTTP status of response, 0 if event is deferred.
+static uint16_t upnp_gena_event(
+    upnp_gena_handle_t * const handle, size_t header_length)
+{
+    assert(handle);
+    upnp_gena_notify_t * const notify = &handle->notify;
+    char value[UPNP_GENA_SID_SIZE];
+    if (strncmp(handle->buffer, "NOTIFY ", 7u) != 0)
+        return 405u;
+    // Event is matched to its subscription by ID.
+    upnp_gena_member_t *member = NULL;
+    size_t service = 0u;
+    if (!upnp_gena_field(handle->buffer, header_length, "SID", value,
+            sizeof(value)))
+        return 412u;
+    for (size_t i = 0; !member && (i < handle->members_nb); i++)
+    {
+        for (service = 0u; service < UPNP_SERVICE_NB_MAX; service++)
+        {
+            if (strcmp(value,
+                    handle->members[i].subscriptions[service].sid) == 0)
+            {
+                member = &handle->members[i];
+                break;
+            }
+        }
+    }
+    if (!member)
+        return ((handle->exchange.state != UPNP_GENA_EXCHANGE_IDLE)
+            && !handle->exchange.renewal) ? 0u : 412u;
+    upnp_gena_subscription_t * const subscription =
+        &member->subscriptions[service];
+    if (!upnp_gena_field(handle->buffer, header_length, "SEQ", value,
+            sizeof(value)))
+        return 400u;
+    handle->stats.events++;
+    const uint32_t seq = (uint32_t) strtoul(value, NULL, 10);
+    if (seq != subscription->seq)
+    {
+        // Variables changed meanwhile are not known, whole state is read
+        // again from initial event of a new subscription.
+        ESP_LOGW(LOGGER_TAG, "Event missed service=%s seq=%lu expected=%lu",
+            upnp_gena_service_names[service], (unsigned long) seq,
+            (unsigned long) subscription->seq);
+        handle->stats.failures++;
+        upnp_gena_unsubscribed(member, (upnp_service_t) service);
+        subscription->renew_ms = upnp_gena_time_ms();
+        return 200u;
+    }
+    // Event key wraps to 1, 0 is only used by initial event.
+    subscription->seq = (seq == UINT32_MAX) ? 1u : seq + 1u;
+    notify->remaining = SIZE_MAX;
+    if (upnp_gena_field(handle->buffer, header_length, "Content-Length",
+            value, sizeof(value)))
+        notify->remaining = strtoul(value, NULL, 10);
+    notify->body = true;
+    notify->service = (uint8_t) service;
+    notify->seq = seq;
+    upnp_xml_init(&handle->parser, upnp_gena_event_paths,
+        UPNP_GENA_VARIABLE_NB_MAX, &upnp_gena_event_element, handle);
+    handle->event = member;
+    handle->entity = false;
+    return 200u;
+}
+
+// Get reason phrase of event response status.
+static const char *upnp_gena_reason(uint16_t status)
+{
+    switch (status)
+    {
+        case 200u:
+            return "OK";
+        case 400u:
+            return "Bad Request";
+        case 405u:
+            return "Method Not Allowed";
+        default:
+            return "Precondition Failed";
+    }
+}
+
+// Close event connection, once response is sent if status is set.
+static void upnp_gena_notify_done(
+    upnp_gena_handle_t * const handle, uint16_t status)
+{
+    assert(handle);
+    upnp_gena_notify_t * const notify = &handle->notify;
+    if (notify->body)
+        ESP_LOGD(LOGGER_TAG, "Event member=%u service=%s seq=%lu known=%lx",
+            (unsigned int) (handle->event - handle->members),
+            upnp_gena_service_names[notify->service],
+            (unsigned long) notify->seq,
+            (unsigned long) handle->event->known);
+    if (status != 0u)
+    {
+        const int length = snprintf(handle->buffer, sizeof(handle->buffer),
+            "HTTP/1.1 %u %s\r\n"
+            "Content-Length: 0\r\n"
+            "Connection: close\r\n"
+            "\r\n",
+            (unsigned int) status, upnp_gena_reason(status));
+        // Connection did not send anything yet, response fits its buffer.
+        send(notify->sock, handle->buffer, (size_t) length, 0);
+    }
+    close(notify->sock);
+    notify->sock = -1;
+}
+
+// Parse chunk of event body, cached variables are updated.
+// Return true while body goes on, false once event is done.
+static bool upnp_gena_notify_body(
+    upnp_gena_handle_t * const handle, char *data, size_t length)
+{
+    assert(handle);
+    upnp_gena_notify_t * const notify = &handle->notify;
+    if (length > notify->remaining)
+        length = notify->remaining;
+    notify->remaining -= length;
+    // Parsing stops on malformed event, variables found are kept.
+    if (upnp_gena_unescape(handle, data, length) && (notify->remaining > 0u))
+        return true;
+    upnp_gena_notify_done(handle, 200u);
+    return false;
+}
+
+// Go on with event being received, without waiting.
+// Return true once event is done, false while in progress.
+static bool upnp_gena_notify_step(upnp_gena_handle_t * const handle)
+{
+    assert(handle);
+    upnp_gena_notify_t * const notify = &handle->notify;
+    const bool expired =
+        upnp_gena_time_reached(upnp_gena_time_ms(), notify->deadline_ms);
+    while (true)
+    {
+        const char * const end = notify->body
+            ? NULL : strstr(handle->buffer, UPNP_GENA_HEADER_END);
+        if (end)
+        {
+            const size_t header_length = (size_t) (end - handle->buffer)
+                + sizeof(UPNP_GENA_HEADER_END) - 1u;
+            const uint16_t status = upnp_gena_event(handle, header_length);
+            if ((status == 0u) && !expired)
+                return false;
+            if (!notify->body)
+            {
+                upnp_gena_notify_done(handle, (status != 0u) ? status : 412u);
+                return true;
+            }
+            if (!upnp_gena_notify_body(handle,
+                    &handle->buffer[header_length],
+                    notify->buffered - header_length))
+                return true;
+            continue;
+        }
+        char * const data = notify->body
+            ? handle->buffer : &handle->buffer[notify->buffered];
+        const size_t size = notify->body
+            ? UPNP_GENA_BUFFER_SIZE : UPNP_GENA_BUFFER_SIZE - notify->buffered;
+        if (size == 0u)
+        {
+            upnp_gena_notify_done(handle, 400u);
+            return true;
+        }
+        const ssize_t received = recv(notify->sock, data, size, 0);
+        if ((received < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            && !expired)
+            return false;
+        // Closed, or out of time: variables parsed are kept.
+        if (received <= 0)
+        {
+            upnp_gena_notify_done(handle, notify->body ? 200u : 0u);
+            return true;
+        }
+        if (notify->body)
+        {
+            if (!upnp_gena_notify_body(handle, data, (size_t) received))
+                return true;
+            continue;
+        }
+        notify->buffered += (size_t) received;
+        handle->buffer[notify->buffered] = '\0';
+    }
+}
+
+// Accept next event connection, without waiting.
+// Return true on success, false if none.
+static bool upnp_gena_accept(upnp_gena_handle_t * const handle)
+{
+    assert(handle);
+    upnp_gena_notify_t * const notify = &handle->notify;
+    if (handle->listener < 0)
+        return false;
+    struct timeval timeout = { .tv_sec = 0, .tv_usec = 0 };
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(handle->listener, &readable);
+    if (select(handle->listener + 1, &readable, NULL, NULL, &timeout) <= 0)
+        return false;
+    const int sock = accept(handle->listener, NULL, NULL);
+    if (sock < 0)
+        return false;
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    notify->sock = sock;
+    notify->body = false;
+    notify->buffered = 0u;
+    handle->buffer[0] = '\0';
+    notify->deadline_ms = upnp_gena_time_ms() + UPNP_GENA_RECEIVE_TIMEOUT_MS;
+    return true;
+}
+
+void upnp_gena_init(const upnp_group_t * const group)
+{
+    assert(group);
+    assert(group->nb <= UPNP_GROUP_MEMBER_NB);
+    upnp_gena_handle_t * const handle = &upnp_gena_handle;
+    // Exchanges in progress are dropped, they refer to previous members.
+    if (handle->exchange.sock >= 0)
+        close(handle->exchange.sock);
+    handle->exchange.sock = -1;
+    handle->exchange.state = UPNP_GENA_EXCHANGE_IDLE;
+    if (handle->notify.sock >= 0)
+        close(handle->notify.sock);
+    handle->notify.sock = -1;
+    // Events of previous subscriptions are refused (unknown ID), so
+    // renderers drop them.
+    memset(handle->members, 0, sizeof(handle->members));
+    handle->members_nb = group->nb;
+    const uint32_t now_ms = upnp_gena_time_ms();
+    for (size_t i = 0; i < group->nb; i++)
+    {
+        const upnp_renderer_t * const renderer = &group->members[i];
+        upnp_gena_member_t * const member = &handle->members[i];
+        const char * const paths[] = {
+            [UPNP_SERVICE_AV_TRANSPORT] = renderer->av_transport_event_path,
+            [UPNP_SERVICE_RENDERING_CONTROL] =
+                renderer->rendering_control_event_path,
+        };
+        member->address.sin_family = AF_INET;
+        member->address.sin_port = htons(renderer->port);
+        member->configured = inet_pton(AF_INET, renderer->host,
+            &member->address.sin_addr) == 1;
+        strcpy(member->host, renderer->host);
+        for (size_t j = 0; j < UPNP_SERVICE_NB_MAX; j++)
+        {
+            upnp_gena_subscription_t * const subscription =
+                &member->subscriptions[j];
+            strcpy(subscription->path, paths[j]);
+            subscription->renew_ms = now_ms;
+            subscription->retry_ms = UPNP_GENA_RETRY_MIN_MS;
+        }
+    }
+}
+
+void upnp_gena_receive(void)
+{
+    upnp_gena_handle_t * const handle = &upnp_gena_handle;
+    // Initial event follows subscription response at once, so it is known
+    // first.
+    if (handle->exchange.state != UPNP_GENA_EXCHANGE_IDLE)
+        upnp_gena_subscribe_step(handle);
+    for (size_t i = 0; i < UPNP_GENA_EVENT_NB; i++)
+    {
+        if ((handle->notify.sock < 0) && !upnp_gena_accept(handle))
+            return;
+        if (!upnp_gena_notify_step(handle))
+            return;
+    }
+}
+
+uint32_t upnp_gena_poll_set(
+    fd_set * const readable, fd_set * const writable, int * const fd_max)
+{
+    assert(readable);
+    assert(writable);
+    assert(fd_max);
+    upnp_gena_handle_t * const handle = &upnp_gena_handle;
+    const upnp_gena_exchange_t * const exchange = &handle->exchange;
+    const uint32_t now_ms = upnp_gena_time_ms();
+    uint32_t wait_ms = UINT32_MAX;
+    // Next events wait in listener backlog while one is received.
+    if (handle->notify.sock >= 0)
+    {
+        upnp_gena_fd_set(handle->notify.sock, readable, fd_max);
+        upnp_gena_wait(now_ms, handle->notify.deadline_ms, &wait_ms);
+    }
+    else if (handle->listener >= 0)
+        upnp_gena_fd_set(handle->listener, readable, fd_max);
+    // Next subscription is started once previous one is done.
+    if (exchange->state != UPNP_GENA_EXCHANGE_IDLE)
+    {
+        upnp_gena_fd_set(exchange->sock,
+            (exchange->state == UPNP_GENA_EXCHANGE_RECEIVING)
+                ? readable : writable, fd_max);
+        upnp_gena_wait(now_ms, exchange->deadline_ms, &wait_ms);
+        return wait_ms;
+    }
+    for (size_t i = 0; i < handle->members_nb; i++)
+    {
+        const upnp_gena_member_t * const member = &handle->members[i];
+        for (size_t j = 0; member->configured && (j < UPNP_SERVICE_NB_MAX);
+            j++)
+        {
+            const upnp_gena_subscription_t * const subscription =
+                &member->subscriptions[j];
+            if (subscription->path[0] != '\0')
+                upnp_gena_wait(now_ms, subscription->renew_ms, &wait_ms);
+        }
+    }
+    return wait_ms;
+}
+
+void upnp_gena_poll(void)
+{
+    upnp_gena_handle_t * const handle = &upnp_gena_handle;
+    upnp_gena_receive();
+    for (size_t i = 0; i < handle->members_nb; i++)
+    {
+        upnp_gena_member_t * const member = &handle->members[i];
+        for (size_t j = 0; member->configured && (j < UPNP_SERVICE_NB_MAX)
+            && (handle->exchange.state == UPNP_GENA_EXCHANGE_IDLE); j++)
+        {
+            const upnp_gena_subscription_t * const subscription =
+                &member->subscriptions[j];
+            if ((subscription->path[0] == '\0')
+                || !upnp_gena_time_reached(
+                    upnp_gena_time_ms(), subscription->renew_ms))
+                continue;
+            if (!upnp_gena_subscribe(handle, i, (upnp_service_t) j))
+                upnp_gena_subscribe_done(handle, false);
+        }
+    }
+}
+
+bool upnp_gena_value_get(
+    size_t member, upnp_gena_variable_t variable, uint32_t * const value)
+{
+    assert(variable < UPNP_GENA_VARIABLE_NB_MAX);
+    assert(value);
+    const upnp_gena_handle_t * const handle = &upnp_gena_handle;
+    if ((member >= handle->members_nb)
+        || ((handle->members[member].known & (1u << variable)) == 0u))
+        return false;
+    *value = handle->members[member].values[variable];
+    return true;
+}
+
+void upnp_gena_value_set(
+    size_t member, upnp_gena_variable_t variable, uint32_t value)
+{
+    assert(variable < UPNP_GENA_VARIABLE_NB_MAX);
+    upnp_gena_handle_t * const handle = &upnp_gena_handle;
+    if (member >= handle->members_nb)
+        return;
+    upnp_gena_member_t * const state = &handle->members[member];
+    const upnp_gena_subscription_t * const subscription =
+        &state->subscriptions[upnp_gena_variable_services[variable]];
+    if (subscription->sid[0] == '\0')
+        return;
+    state->values[variable] = value;
+    state->known |= 1u << variable;
+}
+
+bool upnp_gena_subscribed(void)
+{
+    const upnp_gena_handle_t * const handle = &upnp_gena_handle;
+    for (size_t i = 0; i < handle->members_nb; i++)
+    {
+        for (size_t j = 0; j < UPNP_SERVICE_NB_MAX; j++)
+        {
+            if (handle->members[i].subscriptions[j].sid[0] == '\0')
+                return false;
+        }
+    }
+    return true;
+}
+
+void upnp_gena_stats_get(upnp_gena_stats_t * const stats)
+{
+    assert(stats);
+    *stats = upnp_gena_handle.stats;
+}
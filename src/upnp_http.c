@@ -0,0 +1,974 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "upnp_http.h"
+#include "esp_log.h"
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOGGER_TAG "upnp_http"
+
+#define UPNP_HTTP_BUFFER_SIZE             512u  // Holds a response header.
+#define UPNP_HTTP_TIMEOUT_MS             2000u  // Also pipeline deadline.
+// Connections are reopened before keep-alive timeout of renderer (5s for
+// most HTTP servers), as long as renderer has been used recently.
+#define UPNP_HTTP_IDLE_TIMEOUT_MS        4000u
+#define UPNP_HTTP_WARM_MS               60000u
+#define UPNP_HTTP_HEADER_END             "\r\n\r\n"
+#define UPNP_HTTP_BODY_UNTIL_CLOSE       SIZE_MAX
+
+// Response header fields.
+typedef struct
+{
+    size_t header_length;
+    size_t body_length;         // Body delimited by connection close if max.
+    uint16_t status;
+    bool keep_alive;
+    bool chunked;               // Body sent in chunks, of their own size.
+} upnp_http_header_t;
+
+// Part of chunked response body expected.
+typedef enum
+{
+    UPNP_HTTP_CHUNK_SIZE = 0,           // Chunk size line.
+    UPNP_HTTP_CHUNK_DATA,               // Chunk data, remaining bytes.
+    UPNP_HTTP_CHUNK_DATA_END,           // Line end after chunk data.
+    UPNP_HTTP_CHUNK_TRAILER,            // Trailer fields, up to empty line.
+} upnp_http_chunk_t;
+
+// Persistent connection to a renderer.
+// Response is received incrementally, so connections of a group are served
+// together as data comes.
+typedef struct
+{
+    struct sockaddr_in address;
+    int sock;                   // Socket, negative if not connected.
+    bool connecting;            // Opened without waiting, not established.
+    bool failing;               // Renderer did not answer, not refreshed.
+    bool busy;                  // Taken by a dispatch in progress.
+    uint32_t exchanges;         // Responses received on this connection.
+    uint32_t last_ms;           // Time of connection or last response.
+    uint32_t used_ms;           // Time of last request.
+    bool body;                  // Response header received, body pending.
+    upnp_http_header_t header;  // Header of response being received.
+    size_t remaining;           // Response body bytes not received yet.
+    upnp_http_chunk_t chunk;    // Part of chunked response body expected.
+    size_t buffered;            // Received bytes not yet consumed.
+    char buffer[UPNP_HTTP_BUFFER_SIZE + 1u];
+} upnp_http_connection_t;
+
+// Progress of response being received.
+typedef enum
+{
+    UPNP_HTTP_RESPONSE_PENDING = 0,     // More data needed.
+    UPNP_HTTP_RESPONSE_DONE,
+    UPNP_HTTP_RESPONSE_FAILED,          // Connection is closed.
+} upnp_http_response_t;
+
+// Dispatch state of a group member.
+typedef enum
+{
+    UPNP_HTTP_DISPATCH_CONNECTING = 0,
+    UPNP_HTTP_DISPATCH_SENDING,
+    UPNP_HTTP_DISPATCH_RECEIVING,
+    UPNP_HTTP_DISPATCH_DONE,
+} upnp_http_dispatch_state_t;
+
+// Dispatch of requests of a group member, on its connection.
+typedef struct
+{
+    upnp_http_connection_t *connection;
+    upnp_http_dispatch_state_t state;
+    bool reused;                // Connection opened before dispatch.
+    size_t first;               // First request sent on connection.
+    size_t sent;                // Requests fully sent.
+    size_t offset;              // Bytes of next request sent.
+} upnp_http_dispatch_t;
+
+// UPnP HTTP handle.
+typedef struct
+{
+    upnp_http_connection_t connections[UPNP_HTTP_CONNECTION_NB];
+    upnp_http_stats_t stats;
+    bool initialised;
+} upnp_http_handle_t;
+
+static upnp_http_handle_t upnp_http_handle;
+
+static uint64_t upnp_http_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000u + (uint64_t) (ts.tv_nsec / 1000);
+}
+
+static uint32_t upnp_http_time_ms(void)
+{
+    return (uint32_t) (upnp_http_time_us() / 1000u);
+}
+
+static upnp_http_handle_t *upnp_http_handle_get(void)
+{
+    upnp_http_handle_t * const handle = &upnp_http_handle;
+    if (!handle->initialised)
+    {
+        for (size_t i = 0; i < UPNP_HTTP_CONNECTION_NB; i++)
+            handle->connections[i].sock = -1;
+        handle->initialised = true;
+    }
+    return handle;
+}
+
+static void upnp_http_close(upnp_http_connection_t * const connection)
+{
+    assert(connection);
+    if (connection->sock >= 0)
+        close(connection->sock);
+    connection->sock = -1;
+    connection->connecting = false;
+    connection->body = false;
+    connection->buffered = 0u;
+}
+
+// Open connection to its renderer, previous one is closed. Without waiting,
+// connection is established once its socket is writable.
+// Statistics are not updated without handle (private connection).
+// Return true on success, false on error.
+static bool upnp_http_connect(
+    upnp_http_handle_t * const handle,
+    upnp_http_connection_t * const connection, bool wait)
+{
+    assert(connection);
+    upnp_http_close(connection);
+    const int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock < 0)
+        return false;
+    const struct timeval timeout = {
+        .tv_sec = UPNP_HTTP_TIMEOUT_MS / 1000u,
+        .tv_usec = (UPNP_HTTP_TIMEOUT_MS % 1000u) * 1000u
+    };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    // Pipelined requests are not delayed until previous one is acknowledged.
+    const int nodelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    if (!wait)
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    if ((connect(sock, (const struct sockaddr *) &connection->address,
+            sizeof(connection->address)) != 0)
+        && (wait || (errno != EINPROGRESS)))
+    {
+        close(sock);
+        return false;
+    }
+    connection->sock = sock;
+    connection->connecting = !wait;
+    connection->exchanges = 0u;
+    connection->last_ms = upnp_http_time_ms();
+    if (handle)
+        handle->stats.connects++;
+    return true;
+}
+
+// Check if connection opened without waiting is established, once its
+// socket is writable. Its socket is blocking again then.
+static bool upnp_http_connected(upnp_http_connection_t * const connection)
+{
+    assert(connection);
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if ((getsockopt(connection->sock, SOL_SOCKET, SO_ERROR, &error, &length)
+            != 0)
+        || (error != 0))
+        return false;
+    fcntl(connection->sock, F_SETFL,
+        fcntl(connection->sock, F_GETFL, 0) & ~O_NONBLOCK);
+    connection->connecting = false;
+    return true;
+}
+
+// Check if socket of connection opened without waiting is writable
+// (connection established or failed), without waiting.
+static bool upnp_http_writable(
+    const upnp_http_connection_t * const connection)
+{
+    assert(connection);
+    fd_set writable;
+    struct timeval timeout = { .tv_sec = 0, .tv_usec = 0 };
+    FD_ZERO(&writable);
+    FD_SET(connection->sock, &writable);
+    return select(connection->sock + 1, NULL, &writable, NULL, &timeout) > 0;
+}
+
+// Check if idle connection has been closed by renderer. Data received
+// without request would be taken as next response, so such connection is
+// not usable anymore either.
+static bool upnp_http_closed(const upnp_http_connection_t * const connection)
+{
+    assert(connection);
+    char data;
+    const ssize_t nb =
+        recv(connection->sock, &data, 1u, MSG_PEEK | MSG_DONTWAIT);
+    return (nb >= 0)
+        || ((errno != EAGAIN) && (errno != EWOULDBLOCK));
+}
+
+// Get connection to renderer, closed if it is not usable anymore.
+// Least recently used connection is taken over if renderer has none,
+// connections of a dispatch in progress are left alone.
+// Return connection.
+static upnp_http_connection_t *upnp_http_get(
+    upnp_http_handle_t * const handle,
+    const struct sockaddr_in * const address)
+{
+    assert(handle);
+    assert(address);
+    upnp_http_connection_t *connection = NULL;
+    for (size_t i = 0; i < UPNP_HTTP_CONNECTION_NB; i++)
+    {
+        upnp_http_connection_t * const candidate = &handle->connections[i];
+        if (candidate->busy)
+            continue;
+        if ((candidate->address.sin_addr.s_addr == address->sin_addr.s_addr)
+            && (candidate->address.sin_port == address->sin_port))
+        {
+            connection = candidate;
+            break;
+        }
+        if (!connection
+            || ((connection->sock >= 0)
+                && ((candidate->sock < 0)
+                    || ((int32_t) (candidate->used_ms - connection->used_ms)
+                        < 0))))
+            connection = candidate;
+    }
+    assert(connection);
+    if ((connection->address.sin_addr.s_addr != address->sin_addr.s_addr)
+        || (connection->address.sin_port != address->sin_port))
+    {
+        upnp_http_close(connection);
+        connection->address = *address;
+    }
+    if ((connection->sock >= 0) && !connection->connecting)
+    {
+        // Renderer may have closed idle connection meanwhile, or is about to.
+        const uint32_t now_ms = upnp_http_time_ms();
+        if (upnp_http_closed(connection))
+        {
+            handle->stats.reconnects++;
+            upnp_http_close(connection);
+        }
+        else if ((now_ms - connection->last_ms) >= UPNP_HTTP_IDLE_TIMEOUT_MS)
+        {
+            handle->stats.refreshes++;
+            upnp_http_close(connection);
+        }
+    }
+    return connection;
+}
+
+// Send request on connection, from offset of data already sent. Without
+// waiting, only data accepted by socket at once is sent.
+// Statistics are not updated without handle (private connection).
+// Return true on success (request may be partially sent), false on error.
+static bool upnp_http_send(
+    upnp_http_handle_t * const handle,
+    upnp_http_connection_t * const connection,
+    const upnp_http_request_t * const request, size_t * const offset,
+    bool wait)
+{
+    assert(connection);
+    assert(request);
+    assert(offset);
+    if (connection->sock < 0)
+        return false;
+    while (*offset < request->length)
+    {
+        // Parts left are sent at once, without a segment each.
+        struct iovec parts[UPNP_HTTP_PART_NB];
+        size_t parts_nb = 0u;
+        size_t skip = *offset;
+        for (size_t i = 0; i < request->parts_nb; i++)
+        {
+            const upnp_http_part_t * const part = &request->parts[i];
+            if (skip >= part->length)
+            {
+                skip -= part->length;
+                continue;
+            }
+            parts[parts_nb].iov_base = (void *) &part->data[skip];
+            parts[parts_nb].iov_len = part->length - skip;
+            parts_nb++;
+            skip = 0u;
+        }
+        const struct msghdr message = {
+            .msg_iov = parts,
+            .msg_iovlen = parts_nb
+        };
+        const ssize_t nb = sendmsg(connection->sock, &message,
+            wait ? 0 : MSG_DONTWAIT);
+        if ((nb < 0) && !wait && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+            return true;
+        if (nb <= 0)
+            return false;
+        *offset += (size_t) nb;
+    }
+    connection->used_ms = upnp_http_time_ms();
+    if (!handle)
+        return true;
+    handle->stats.requests++;
+    if (connection->exchanges > 0u)
+        handle->stats.reuses++;
+    return true;
+}
+
+// Receive more data in connection buffer.
+// Return number of bytes received, 0 if connection is closed, negative on
+// error (or if no data is available without waiting).
+static ssize_t upnp_http_fill(
+    upnp_http_connection_t * const connection, bool wait)
+{
+    assert(connection);
+    if ((connection->sock < 0)
+        || (connection->buffered >= UPNP_HTTP_BUFFER_SIZE))
+        return -1;
+    const ssize_t nb = recv(connection->sock,
+        &connection->buffer[connection->buffered],
+        UPNP_HTTP_BUFFER_SIZE - connection->buffered,
+        wait ? 0 : MSG_DONTWAIT);
+    if (nb <= 0)
+        return nb;
+    connection->buffered += (size_t) nb;
+    connection->buffer[connection->buffered] = '\0';
+    return nb;
+}
+
+// Drop consumed data from connection buffer.
+static void upnp_http_consume(
+    upnp_http_connection_t * const connection, size_t length)
+{
+    assert(connection);
+    assert(length <= connection->buffered);
+    connection->buffered -= length;
+    memmove(connection->buffer, &connection->buffer[length],
+        connection->buffered);
+    connection->buffer[connection->buffered] = '\0';
+}
+
+// Parse response header, once fully received.
+// Return true if header is complete, else false.
+static bool upnp_http_header_parse(
+    const upnp_http_connection_t * const connection,
+    upnp_http_header_t * const header)
+{
+    assert(connection);
+    assert(header);
+    const char * const data = connection->buffer;
+    const char * const end = strstr(data, UPNP_HTTP_HEADER_END);
+    if (!end)
+        return false;
+    header->header_length =
+        (size_t) (end - data) + sizeof(UPNP_HTTP_HEADER_END) - 1u;
+    header->body_length = UPNP_HTTP_BODY_UNTIL_CLOSE;
+    header->status = 0u;
+    header->keep_alive = true;
+    header->chunked = false;
+    if ((strncmp(data, "HTTP/1.", 7u) == 0) && (data[8] == ' '))
+        header->status = (uint16_t) strtoul(&data[9], NULL, 10);
+    // Field names are case-insensitive, other fields are ignored.
+    for (const char *line = strstr(data, "\r\n") + 2; line < end;
+        line = strstr(line, "\r\n") + 2)
+    {
+        if (strncasecmp(line, "Content-Length:", 15u) == 0)
+            header->body_length = strtoul(&line[15], NULL, 10);
+        else if ((strncasecmp(line, "Connection:", 11u) == 0)
+            && (strncasecmp(&line[11 + strspn(&line[11], " ")], "close", 5u)
+                == 0))
+            header->keep_alive = false;
+        else if ((strncasecmp(line, "Transfer-Encoding:", 18u) == 0)
+            && (strncasecmp(&line[18 + strspn(&line[18], " ")], "chunked",
+                7u) == 0))
+            header->chunked = true;
+    }
+    // Chunked body ends with a chunk of size 0, whatever its length.
+    if (header->chunked)
+        header->body_length = 0u;
+    return true;
+}
+
+// Complete response received, connection is closed if renderer asked so.
+static void upnp_http_complete(upnp_http_connection_t * const connection)
+{
+    assert(connection);
+    connection->body = false;
+    connection->exchanges++;
+    connection->last_ms = upnp_http_time_ms();
+    if (!connection->header.keep_alive
+        || (connection->header.body_length == UPNP_HTTP_BODY_UNTIL_CLOSE))
+        upnp_http_close(connection);
+}
+
+// Process received data of chunked response body. Chunk data is given to
+// body consumer, chunk size lines and trailer fields are dropped.
+// Return response progress, connection is closed on failure.
+static upnp_http_response_t upnp_http_chunked(
+    upnp_http_connection_t * const connection,
+    const upnp_http_request_t * const request)
+{
+    assert(connection);
+    assert(request);
+    while (true)
+    {
+        if (connection->chunk == UPNP_HTTP_CHUNK_DATA)
+        {
+            const size_t nb = (connection->buffered < connection->remaining)
+                ? connection->buffered : connection->remaining;
+            if (nb == 0u)
+                return UPNP_HTTP_RESPONSE_PENDING;
+            if (request->body)
+                request->body(request->context, connection->buffer, nb);
+            upnp_http_consume(connection, nb);
+            connection->remaining -= nb;
+            if (connection->remaining == 0u)
+                connection->chunk = UPNP_HTTP_CHUNK_DATA_END;
+            continue;
+        }
+        // Other parts are lines, which fit in buffer.
+        const char * const end = strstr(connection->buffer, "\r\n");
+        if (!end)
+        {
+            if (connection->buffered < UPNP_HTTP_BUFFER_SIZE)
+                return UPNP_HTTP_RESPONSE_PENDING;
+            upnp_http_close(connection);
+            return UPNP_HTTP_RESPONSE_FAILED;
+        }
+        const size_t line_length = (size_t) (end - connection->buffer);
+        char *last = NULL;
+        bool valid = true;
+        switch (connection->chunk)
+        {
+            case UPNP_HTTP_CHUNK_SIZE:
+                // Chunk extensions are ignored.
+                connection->remaining = strtoul(connection->buffer, &last, 16);
+                valid = last != connection->buffer;
+                connection->chunk = (connection->remaining > 0u)
+                    ? UPNP_HTTP_CHUNK_DATA : UPNP_HTTP_CHUNK_TRAILER;
+                break;
+            case UPNP_HTTP_CHUNK_DATA_END:
+                valid = line_length == 0u;
+                connection->chunk = UPNP_HTTP_CHUNK_SIZE;
+                break;
+            default:
+                if (line_length > 0u)
+                    break;
+                upnp_http_consume(connection, sizeof("\r\n") - 1u);
+                upnp_http_complete(connection);
+                return UPNP_HTTP_RESPONSE_DONE;
+        }
+        if (!valid)
+        {
+            upnp_http_close(connection);
+            return UPNP_HTTP_RESPONSE_FAILED;
+        }
+        upnp_http_consume(connection, line_length + sizeof("\r\n") - 1u);
+    }
+}
+
+// Process received data of response to oldest request sent on connection.
+// Body is given to its consumer as it is received, never held whole.
+// Return response progress, connection is closed on failure.
+static upnp_http_response_t upnp_http_process(
+    upnp_http_connection_t * const connection,
+    const upnp_http_request_t * const request)
+{
+    assert(connection);
+    assert(request);
+    upnp_http_header_t * const header = &connection->header;
+    if (!connection->body)
+    {
+        if (!upnp_http_header_parse(connection, header))
+        {
+            if (connection->buffered < UPNP_HTTP_BUFFER_SIZE)
+                return UPNP_HTTP_RESPONSE_PENDING;
+            upnp_http_close(connection);
+            return UPNP_HTTP_RESPONSE_FAILED;
+        }
+        if (header->status == 0u)
+        {
+            upnp_http_close(connection);
+            return UPNP_HTTP_RESPONSE_FAILED;
+        }
+        if (request->header)
+            request->header(
+                request->context, connection->buffer, header->header_length);
+        upnp_http_consume(connection, header->header_length);
+        if (request->body)
+            request->body(request->context, NULL, 0u);
+        connection->body = true;
+        connection->remaining = header->body_length;
+        connection->chunk = UPNP_HTTP_CHUNK_SIZE;
+    }
+    if (header->chunked)
+        return upnp_http_chunked(connection, request);
+    while ((connection->remaining > 0u) && (connection->buffered > 0u))
+    {
+        const size_t nb = (connection->buffered < connection->remaining)
+            ? connection->buffered : connection->remaining;
+        if (request->body)
+            request->body(request->context, connection->buffer, nb);
+        upnp_http_consume(connection, nb);
+        if (header->body_length != UPNP_HTTP_BODY_UNTIL_CLOSE)
+            connection->remaining -= nb;
+    }
+    if (connection->remaining > 0u)
+        return UPNP_HTTP_RESPONSE_PENDING;
+    upnp_http_complete(connection);
+    return UPNP_HTTP_RESPONSE_DONE;
+}
+
+// Connection closed (or failed) while response is pending, which ends a body
+// delimited by connection close.
+// Return response progress, connection is closed.
+static upnp_http_response_t upnp_http_end(
+    upnp_http_connection_t * const connection)
+{
+    assert(connection);
+    if (connection->body
+        && (connection->header.body_length == UPNP_HTTP_BODY_UNTIL_CLOSE))
+    {
+        upnp_http_complete(connection);
+        return UPNP_HTTP_RESPONSE_DONE;
+    }
+    upnp_http_close(connection);
+    return UPNP_HTTP_RESPONSE_FAILED;
+}
+
+// Receive response of oldest request sent on connection, waiting for it.
+// Return HTTP status on success, 0 on error (connection is closed).
+static uint16_t upnp_http_receive(
+    upnp_http_connection_t * const connection,
+    const upnp_http_request_t * const request)
+{
+    assert(connection);
+    assert(request);
+    upnp_http_response_t response;
+    while ((response = upnp_http_process(connection, request))
+        == UPNP_HTTP_RESPONSE_PENDING)
+    {
+        if (upnp_http_fill(connection, true) <= 0)
+        {
+            response = upnp_http_end(connection);
+            break;
+        }
+    }
+    return (response == UPNP_HTTP_RESPONSE_DONE)
+        ? connection->header.status : 0u;
+}
+
+// Dispatch of member failed, its connection is closed. Requests without
+// response are sent again on a new connection, unless it was a new one which
+// did not answer any request.
+static void upnp_http_dispatch_fail(
+    upnp_http_handle_t * const handle, upnp_http_member_t * const member,
+    upnp_http_dispatch_t * const dispatch)
+{
+    assert(handle);
+    assert(member);
+    assert(dispatch);
+    upnp_http_close(dispatch->connection);
+    dispatch->state = UPNP_HTTP_DISPATCH_DONE;
+    if (!dispatch->reused && (member->answered == dispatch->first))
+        return;
+    handle->stats.reconnects++;
+    ESP_LOGD(LOGGER_TAG, "Connection closed by renderer answered=%u/%u",
+        (unsigned int) member->answered, (unsigned int) member->requests_nb);
+    dispatch->reused = false;
+    dispatch->first = member->answered;
+    dispatch->sent = member->answered;
+    dispatch->offset = 0u;
+    if (upnp_http_connect(handle, dispatch->connection, false))
+        dispatch->state = UPNP_HTTP_DISPATCH_CONNECTING;
+}
+
+// Send pending requests of member, as much as socket accepts.
+static void upnp_http_dispatch_send(
+    upnp_http_handle_t * const handle, upnp_http_member_t * const member,
+    upnp_http_dispatch_t * const dispatch)
+{
+    assert(member);
+    assert(dispatch);
+    while (dispatch->sent < member->requests_nb)
+    {
+        const upnp_http_request_t * const request =
+            &member->requests[dispatch->sent];
+        if (!upnp_http_send(handle, dispatch->connection, request,
+                &dispatch->offset, false))
+        {
+            upnp_http_dispatch_fail(handle, member, dispatch);
+            return;
+        }
+        if (dispatch->offset < request->length)
+            return;
+        dispatch->offset = 0u;
+        dispatch->sent++;
+    }
+    dispatch->state = UPNP_HTTP_DISPATCH_RECEIVING;
+}
+
+// Receive available responses of member.
+static void upnp_http_dispatch_receive(
+    upnp_http_handle_t * const handle, upnp_http_member_t * const member,
+    upnp_http_dispatch_t * const dispatch)
+{
+    assert(member);
+    assert(dispatch);
+    upnp_http_connection_t * const connection = dispatch->connection;
+    const ssize_t nb = upnp_http_fill(connection, false);
+    if ((nb < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        return;
+    while (member->answered < member->requests_nb)
+    {
+        upnp_http_request_t * const request =
+            &member->requests[member->answered];
+        upnp_http_response_t response =
+            upnp_http_process(connection, request);
+        if ((response == UPNP_HTTP_RESPONSE_PENDING) && (nb <= 0))
+            response = upnp_http_end(connection);
+        if (response == UPNP_HTTP_RESPONSE_PENDING)
+            return;
+        if (response == UPNP_HTTP_RESPONSE_FAILED)
+        {
+            upnp_http_dispatch_fail(handle, member, dispatch);
+            return;
+        }
+        request->status = connection->header.status;
+        member->answered++;
+    }
+    dispatch->state = UPNP_HTTP_DISPATCH_DONE;
+}
+
+// Advance dispatch of member, once its socket is ready.
+static void upnp_http_dispatch_step(
+    upnp_http_handle_t * const handle, upnp_http_member_t * const member,
+    upnp_http_dispatch_t * const dispatch)
+{
+    assert(dispatch);
+    switch (dispatch->state)
+    {
+        case UPNP_HTTP_DISPATCH_CONNECTING:
+            if (!upnp_http_connected(dispatch->connection))
+            {
+                upnp_http_dispatch_fail(handle, member, dispatch);
+                break;
+            }
+            dispatch->state = UPNP_HTTP_DISPATCH_SENDING;
+            upnp_http_dispatch_send(handle, member, dispatch);
+            break;
+        case UPNP_HTTP_DISPATCH_SENDING:
+            upnp_http_dispatch_send(handle, member, dispatch);
+            break;
+        case UPNP_HTTP_DISPATCH_RECEIVING:
+            upnp_http_dispatch_receive(handle, member, dispatch);
+            break;
+        default:
+            break;
+    }
+}
+
+// Give up dispatch of member, if not done.
+static void upnp_http_dispatch_timeout(
+    const upnp_http_member_t * const member,
+    upnp_http_dispatch_t * const dispatch)
+{
+    assert(member);
+    assert(dispatch);
+    if (dispatch->state == UPNP_HTTP_DISPATCH_DONE)
+        return;
+    // Late responses would be taken for the ones of next requests.
+    ESP_LOGD(LOGGER_TAG, "Renderer timeout answered=%u/%u",
+        (unsigned int) member->answered, (unsigned int) member->requests_nb);
+    upnp_http_close(dispatch->connection);
+    dispatch->state = UPNP_HTTP_DISPATCH_DONE;
+}
+
+// Start dispatch of member, on its connection.
+static void upnp_http_dispatch_start(
+    upnp_http_handle_t * const handle, upnp_http_member_t * const member,
+    upnp_http_dispatch_t * const dispatch)
+{
+    assert(handle);
+    assert(member);
+    assert(dispatch);
+    member->answered = 0u;
+    member->latency_us = 0u;
+    for (size_t i = 0; i < member->requests_nb; i++)
+        member->requests[i].status = 0u;
+    memset(dispatch, 0, sizeof(upnp_http_dispatch_t));
+    dispatch->state = UPNP_HTTP_DISPATCH_DONE;
+    if (member->requests_nb == 0u)
+        return;
+    upnp_http_connection_t * const connection =
+        upnp_http_get(handle, &member->address);
+    connection->busy = true;
+    dispatch->connection = connection;
+    dispatch->reused = (connection->sock >= 0) && !connection->connecting;
+    if (connection->connecting)
+        dispatch->state = UPNP_HTTP_DISPATCH_CONNECTING;
+    else if (dispatch->reused)
+        dispatch->state = UPNP_HTTP_DISPATCH_SENDING;
+    else if (upnp_http_connect(handle, connection, false))
+        dispatch->state = UPNP_HTTP_DISPATCH_CONNECTING;
+}
+
+size_t upnp_http_fanout(
+    upnp_http_member_t * const members, size_t members_nb)
+{
+    assert(members || (members_nb == 0u));
+    assert(members_nb <= UPNP_HTTP_CONNECTION_NB);
+    upnp_http_handle_t * const handle = upnp_http_handle_get();
+    upnp_http_dispatch_t dispatches[UPNP_HTTP_CONNECTION_NB];
+    const uint64_t start_us = upnp_http_time_us();
+    size_t pending = 0u;
+    for (size_t i = 0; i < members_nb; i++)
+    {
+        upnp_http_dispatch_start(handle, &members[i], &dispatches[i]);
+        if (dispatches[i].state != UPNP_HTTP_DISPATCH_DONE)
+            pending++;
+    }
+    // Sockets of all members are multiplexed, each member progresses as soon
+    // as its socket is ready.
+    while (pending > 0u)
+    {
+        const uint64_t elapsed_us = upnp_http_time_us() - start_us;
+        uint64_t wait_us = UINT64_MAX;
+        fd_set readable;
+        fd_set writable;
+        int sock_max = -1;
+        FD_ZERO(&readable);
+        FD_ZERO(&writable);
+        for (size_t i = 0; i < members_nb; i++)
+        {
+            upnp_http_dispatch_t * const dispatch = &dispatches[i];
+            if (dispatch->state == UPNP_HTTP_DISPATCH_DONE)
+                continue;
+            const uint64_t timeout_us =
+                (uint64_t) members[i].timeout_ms * 1000u;
+            if (elapsed_us >= timeout_us)
+            {
+                upnp_http_dispatch_timeout(&members[i], dispatch);
+                members[i].latency_us = (uint32_t) elapsed_us;
+                pending--;
+                continue;
+            }
+            if ((timeout_us - elapsed_us) < wait_us)
+                wait_us = timeout_us - elapsed_us;
+            const int sock = dispatch->connection->sock;
+            FD_SET(sock, (dispatch->state == UPNP_HTTP_DISPATCH_RECEIVING)
+                ? &readable : &writable);
+            if (sock > sock_max)
+                sock_max = sock;
+        }
+        if (pending == 0u)
+            break;
+        struct timeval timeout = {
+            .tv_sec = (time_t) (wait_us / 1000000u),
+            .tv_usec = (suseconds_t) (wait_us % 1000000u)
+        };
+        const int ready =
+            select(sock_max + 1, &readable, &writable, NULL, &timeout);
+        if ((ready < 0) && (errno != EINTR))
+            break;
+        for (size_t i = 0; (ready > 0) && (i < members_nb); i++)
+        {
+            upnp_http_dispatch_t * const dispatch = &dispatches[i];
+            if ((dispatch->state == UPNP_HTTP_DISPATCH_DONE)
+                || (!FD_ISSET(dispatch->connection->sock, &readable)
+                    && !FD_ISSET(dispatch->connection->sock, &writable)))
+                continue;
+            upnp_http_dispatch_step(handle, &members[i], dispatch);
+            if (dispatch->state != UPNP_HTTP_DISPATCH_DONE)
+                continue;
+            members[i].latency_us =
+                (uint32_t) (upnp_http_time_us() - start_us);
+            pending--;
+        }
+    }
+    size_t answered = 0u;
+    for (size_t i = 0; i < members_nb; i++)
+    {
+        upnp_http_member_t * const member = &members[i];
+        upnp_http_dispatch_t * const dispatch = &dispatches[i];
+        if (dispatch->state != UPNP_HTTP_DISPATCH_DONE)
+        {
+            upnp_http_dispatch_timeout(member, dispatch);
+            member->latency_us = (uint32_t) (upnp_http_time_us() - start_us);
+        }
+        if (dispatch->connection)
+        {
+            dispatch->connection->busy = false;
+            dispatch->connection->failing =
+                member->answered < member->requests_nb;
+        }
+        member->sent = dispatch->sent;
+        if (member->answered == member->requests_nb)
+            answered++;
+    }
+    return answered;
+}
+
+size_t upnp_http_pipeline(
+    const struct sockaddr_in * const address,
+    upnp_http_request_t * const requests, size_t requests_nb)
+{
+    assert(address);
+    upnp_http_member_t member = {
+        .address = *address,
+        .requests = requests,
+        .requests_nb = requests_nb,
+        .timeout_ms = UPNP_HTTP_TIMEOUT_MS
+    };
+    upnp_http_fanout(&member, 1u);
+    return member.answered;
+}
+
+uint16_t upnp_http_exchange(
+    const struct sockaddr_in * const address, const char *request,
+    size_t length, upnp_http_body_t body, void *context)
+{
+    assert(request);
+    upnp_http_request_t exchange = {
+        .parts = {{ .data = request, .length = length }},
+        .parts_nb = 1u,
+        .length = length,
+        .body = body,
+        .context = context
+    };
+    upnp_http_pipeline(address, &exchange, 1u);
+    return exchange.status;
+}
+
+uint16_t upnp_http_fetch(
+    const struct sockaddr_in * const address, const char *request,
+    size_t length, upnp_http_body_t body, void *context)
+{
+    assert(address);
+    assert(request);
+    upnp_http_request_t exchange = {
+        .parts = {{ .data = request, .length = length }},
+        .parts_nb = 1u,
+        .length = length,
+        .body = body,
+        .context = context
+    };
+    upnp_http_connection_t connection = {
+        .address = *address,
+        .sock = -1
+    };
+    size_t offset = 0u;
+    if (upnp_http_connect(NULL, &connection, true)
+        && upnp_http_send(NULL, &connection, &exchange, &offset, true))
+        exchange.status = upnp_http_receive(&connection, &exchange);
+    upnp_http_close(&connection);
+    return exchange.status;
+}
+
+uint32_t upnp_http_poll_set(
+    fd_set * const readable, fd_set * const writable, int * const fd_max)
+{
+    assert(readable);
+    assert(writable);
+    assert(fd_max);
+    upnp_http_handle_t * const handle = upnp_http_handle_get();
+    const uint32_t now_ms = upnp_http_time_ms();
+    uint32_t wait_ms = UINT32_MAX;
+    for (size_t i = 0; i < UPNP_HTTP_CONNECTION_NB; i++)
+    {
+        const upnp_http_connection_t * const connection =
+            &handle->connections[i];
+        if (connection->sock < 0)
+            continue;
+        // Connections being opened are given up after their deadline.
+        FD_SET(connection->sock, connection->connecting ? writable : readable);
+        if (connection->sock > *fd_max)
+            *fd_max = connection->sock;
+        const uint32_t idle_ms = now_ms - connection->last_ms;
+        const uint32_t timeout_ms = connection->connecting
+            ? UPNP_HTTP_TIMEOUT_MS : UPNP_HTTP_IDLE_TIMEOUT_MS;
+        const uint32_t refresh_ms = (idle_ms < timeout_ms)
+            ? timeout_ms - idle_ms : 0u;
+        if (refresh_ms < wait_ms)
+            wait_ms = refresh_ms;
+    }
+    return wait_ms;
+}
+
+void upnp_http_poll(void)
+{
+    upnp_http_handle_t * const handle = upnp_http_handle_get();
+    const uint32_t now_ms = upnp_http_time_ms();
+    for (size_t i = 0; i < UPNP_HTTP_CONNECTION_NB; i++)
+    {
+        upnp_http_connection_t * const connection = &handle->connections[i];
+        if (connection->sock < 0)
+            continue;
+        if (connection->connecting)
+        {
+            // Connection is opened without waiting, so a renderer not
+            // answering does not hold the executor.
+            if (upnp_http_writable(connection)
+                ? !upnp_http_connected(connection)
+                : ((now_ms - connection->last_ms) >= UPNP_HTTP_TIMEOUT_MS))
+            {
+                ESP_LOGD(LOGGER_TAG, "Connection to renderer failed");
+                upnp_http_close(connection);
+                connection->failing = true;
+            }
+            continue;
+        }
+        const bool closed = upnp_http_closed(connection);
+        const bool idle =
+            (now_ms - connection->last_ms) >= UPNP_HTTP_IDLE_TIMEOUT_MS;
+        if (!closed && !idle)
+            continue;
+        // Only connections of renderers used recently and answering are
+        // kept opened, so next request does not wait for a new connection.
+        upnp_http_close(connection);
+        if (((now_ms - connection->used_ms) >= UPNP_HTTP_WARM_MS)
+            || connection->failing)
+            continue;
+        if (closed)
+            handle->stats.reconnects++;
+        else
+            handle->stats.refreshes++;
+        if (!upnp_http_connect(handle, connection, false))
+        {
+            ESP_LOGD(LOGGER_TAG, "Connection to renderer failed");
+            connection->failing = true;
+        }
+    }
+}
+
+void upnp_http_close_all(void)
+{
+    upnp_http_handle_t * const handle = upnp_http_handle_get();
+    for (size_t i = 0; i < UPNP_HTTP_CONNECTION_NB; i++)
+        upnp_http_close(&handle->connections[i]);
+}
+
+void upnp_http_stats_get(upnp_http_stats_t * const stats)
+{
+    assert(stats);
+    *stats = upnp_http_handle_get()->stats;
+}
@@ -0,0 +1,557 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "upnp_sink.h"
+#include "upnp_gena.h"
+#include "upnp_http.h"
+#include "upnp_xml.h"
+#include "trace.h"
+#include "esp_log.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOGGER_TAG "upnp_sink"
+
+#define UPNP_SINK_PIPELINE_NB               4u  // One per action kind.
+#define UPNP_SINK_INSTANCE                  0u
+#define UPNP_SINK_VOLUME_STEP               2
+#define UPNP_SINK_VOLUME_MAX              100
+#define UPNP_SINK_UNREACHABLE_NB            2u  // Actions without response.
+#define UPNP_SINK_TIMEOUT_MS             2000u  // Renderer response deadline.
+
+// Response elements extracted, see upnp_sink_response_paths.
+typedef enum
+{
+    UPNP_SINK_ELEMENT_TRACK = 0,
+    UPNP_SINK_ELEMENT_VOLUME,
+    UPNP_SINK_ELEMENT_TRANSPORT_STATE,
+    UPNP_SINK_ELEMENT_NB_MAX
+} upnp_sink_element_t;
+
+// SOAP actions sent back-to-back, responses are read once all are sent.
+typedef struct
+{
+    upnp_soap_action_t actions[UPNP_SINK_PIPELINE_NB];
+    uint32_t values[UPNP_SINK_PIPELINE_NB];
+    upnp_http_request_t requests[UPNP_SINK_PIPELINE_NB];
+    upnp_soap_fields_t fields[UPNP_SINK_PIPELINE_NB];
+    size_t nb;
+} upnp_sink_pipeline_t;
+
+// Renderer of the group.
+// Responses are parsed as they are received, only extracted values are kept.
+typedef struct
+{
+    struct sockaddr_in address;
+    bool configured;            // Renderer configuration is valid.
+    uint32_t unanswered;        // Consecutive actions without response.
+    bool muted;                 // Mute state sent last, if cache is stale.
+    uint32_t timeout_ms;        // Time left to process actions.
+    upnp_xml_parser_t parser;
+    uint32_t elements;          // Response elements found (bit mask).
+    uint32_t values[UPNP_SINK_ELEMENT_NB_MAX];
+    upnp_sink_pipeline_t pipeline;  // Actions of next dispatch.
+} upnp_sink_member_t;
+
+// UPnP sink handle.
+// Actions are dispatched to all renderers of the group at once, so group
+// latency is the one of its slowest renderer, not the sum of all.
+// Renderer state needed to map toggles and relative actions is taken from
+// events cache, and only read from renderers when cache is stale.
+typedef struct
+{
+    upnp_sink_member_t members[UPNP_GROUP_MEMBER_NB];
+    size_t members_nb;
+    upnp_sink_stats_t stats;
+} upnp_sink_handle_t;
+
+static upnp_sink_handle_t upnp_sink_handle;
+
+static const char * const upnp_sink_response_paths[] = {
+    [UPNP_SINK_ELEMENT_TRACK] = "GetPositionInfoResponse/Track",
+    [UPNP_SINK_ELEMENT_VOLUME] = "GetVolumeResponse/CurrentVolume",
+    [UPNP_SINK_ELEMENT_TRANSPORT_STATE] =
+        "GetTransportInfoResponse/CurrentTransportState",
+};
+
+// Response element parsed, its value is kept.
+static void upnp_sink_response_element(
+    void *context, size_t path, const char *text)
+{
+    assert(context);
+    upnp_sink_member_t * const member = (upnp_sink_member_t *) context;
+    uint32_t value;
+    if (path == UPNP_SINK_ELEMENT_TRANSPORT_STATE)
+        value = (strcmp(text, "PLAYING") == 0)
+            || (strcmp(text, "TRANSITIONING") == 0);
+    else
+    {
+        char *end;
+        value = (uint32_t) strtoul(text, &end, 10);
+        if ((*text == '\0') || (*end != '\0'))
+            return;
+    }
+    member->values[path] = value;
+    member->elements |= 1u << path;
+}
+
+// Response body received, parsed by chunk.
+// Responses of renderers come interleaved, each one has its own parser.
+static void upnp_sink_response_body(
+    void *context, const char *data, size_t length)
+{
+    assert(context);
+    upnp_sink_member_t * const member = (upnp_sink_member_t *) context;
+    if (!data)
+    {
+        upnp_xml_init(&member->parser, upnp_sink_response_paths,
+            UPNP_SINK_ELEMENT_NB_MAX, &upnp_sink_response_element, member);
+        return;
+    }
+    // Parsing stops on malformed response, elements found are kept.
+    if (!upnp_xml_feed(&member->parser, data, length))
+        upnp_xml_init(&member->parser, NULL, 0u,
+            &upnp_sink_response_element, member);
+}
+
+// Get value of response element of last dispatch.
+// Return true on success, false if element is not found.
+static bool upnp_sink_response_value(
+    const upnp_sink_member_t * const member, upnp_sink_element_t element,
+    uint32_t * const value)
+{
+    assert(member);
+    assert(value);
+    if ((member->elements & (1u << element)) == 0u)
+        return false;
+    *value = member->values[element];
+    return true;
+}
+
+// Add SOAP action to pipeline of member, only query responses are parsed.
+static void upnp_sink_pipeline_add(
+    upnp_sink_handle_t * const handle, size_t index,
+    upnp_soap_action_t action, uint32_t value)
+{
+    assert(handle);
+    upnp_sink_member_t * const member = &handle->members[index];
+    upnp_sink_pipeline_t * const pipeline = &member->pipeline;
+    assert(pipeline->nb < UPNP_SINK_PIPELINE_NB);
+    upnp_http_request_t * const request = &pipeline->requests[pipeline->nb];
+    const bool query = (action == UPNP_SOAP_GET_POSITION_INFO)
+        || (action == UPNP_SOAP_GET_TRANSPORT_INFO)
+        || (action == UPNP_SOAP_GET_VOLUME);
+    upnp_soap_request(index, action, UPNP_SINK_INSTANCE, value,
+        &pipeline->fields[pipeline->nb], request);
+    request->header = NULL;
+    request->body = query ? &upnp_sink_response_body : NULL;
+    request->context = member;
+    pipeline->actions[pipeline->nb] = action;
+    pipeline->values[pipeline->nb] = value;
+    pipeline->nb++;
+}
+
+// Account SOAP action response.
+// Return true if action is accepted by renderer, else false.
+static bool upnp_sink_result(
+    upnp_sink_handle_t * const handle, size_t index,
+    upnp_soap_action_t action, uint32_t value, size_t length,
+    uint16_t status)
+{
+    assert(handle);
+    upnp_sink_member_t * const member = &handle->members[index];
+    handle->stats.actions++;
+    handle->stats.bytes += length;
+    member->unanswered = (status == 0u) ? member->unanswered + 1u : 0u;
+    if (status != 200u)
+    {
+        handle->stats.failures++;
+        ESP_LOGW(LOGGER_TAG, "Action failed member=%u action=%s status=%u",
+            (unsigned int) index, upnp_soap_action_str(action),
+            (unsigned int) status);
+        return false;
+    }
+    ESP_LOGD(LOGGER_TAG, "Action sent member=%u action=%s value=%lu",
+        (unsigned int) index, upnp_soap_action_str(action),
+        (unsigned long) value);
+    return true;
+}
+
+// Clear folded action answered by renderer, it is not sent again.
+static void upnp_sink_action_clear(
+    command_action_t * const action, upnp_soap_action_t soap_action)
+{
+    assert(action);
+    switch (soap_action)
+    {
+        case UPNP_SOAP_PLAY:
+        case UPNP_SOAP_PAUSE:
+            action->play_pause = false;
+            break;
+        case UPNP_SOAP_NEXT:
+        case UPNP_SOAP_PREVIOUS:
+        case UPNP_SOAP_SEEK_TRACK:
+            action->skip = 0;
+            break;
+        case UPNP_SOAP_SET_MUTE:
+            action->mute = false;
+            break;
+        case UPNP_SOAP_SET_VOLUME:
+            action->volume = 0;
+            break;
+        default:
+            break;
+    }
+}
+
+// Update cached renderer state from accepted action, until next events.
+static void upnp_sink_state_update(
+    upnp_sink_handle_t * const handle, size_t index,
+    upnp_soap_action_t action, uint32_t value)
+{
+    assert(handle);
+    switch (action)
+    {
+        case UPNP_SOAP_PLAY:
+        case UPNP_SOAP_PAUSE:
+            upnp_gena_value_set(index,
+                UPNP_GENA_TRANSPORT_STATE, action == UPNP_SOAP_PLAY);
+            break;
+        case UPNP_SOAP_SET_MUTE:
+            handle->members[index].muted = value != 0u;
+            upnp_gena_value_set(index, UPNP_GENA_MUTE, value);
+            break;
+        case UPNP_SOAP_SET_VOLUME:
+            upnp_gena_value_set(index, UPNP_GENA_VOLUME, value);
+            break;
+        default:
+            break;
+    }
+}
+
+// Get renderer state variable from events cache, or from query response of
+// last dispatch if cache is stale.
+// Return true on success, false if state is unknown.
+static bool upnp_sink_state(
+    const upnp_sink_handle_t * const handle, size_t index,
+    upnp_gena_variable_t variable, uint32_t * const value)
+{
+    static const upnp_sink_element_t elements[] = {
+        [UPNP_GENA_TRANSPORT_STATE] = UPNP_SINK_ELEMENT_TRANSPORT_STATE,
+        [UPNP_GENA_VOLUME] = UPNP_SINK_ELEMENT_VOLUME,
+    };
+    assert(handle);
+    assert(variable < (sizeof(elements) / sizeof(elements[0])));
+    return upnp_gena_value_get(index, variable, value)
+        || upnp_sink_response_value(
+            &handle->members[index], elements[variable], value);
+}
+
+// Add state query of renderer to its pipeline, if cache is stale.
+static void upnp_sink_state_query(
+    upnp_sink_handle_t * const handle, size_t index,
+    upnp_gena_variable_t variable)
+{
+    assert(handle);
+    uint32_t value;
+    if (upnp_gena_value_get(index, variable, &value))
+        return;
+    handle->stats.queries++;
+    upnp_sink_pipeline_add(handle, index,
+        (variable == UPNP_GENA_VOLUME)
+            ? UPNP_SOAP_GET_VOLUME : UPNP_SOAP_GET_TRANSPORT_INFO, 0u);
+}
+
+// Dispatch pipelines of all renderers at once, then account their
+// responses. Pipelines are emptied, and folded actions sent are cleared (one
+// per member, if any), as the ones without response may have been executed.
+// Time left of renderers is decreased by their dispatch time, and the ones
+// which did not answer all actions are added to unanswered (bit mask).
+// Return true if all actions are accepted, else false.
+static bool upnp_sink_dispatch(
+    upnp_sink_handle_t * const handle, command_action_t * const actions,
+    uint32_t * const unanswered)
+{
+    assert(handle);
+    assert(unanswered);
+    upnp_http_member_t dispatch[UPNP_GROUP_MEMBER_NB];
+    size_t indexes[UPNP_GROUP_MEMBER_NB];
+    size_t dispatch_nb = 0u;
+    bool success = true;
+    for (size_t i = 0; i < handle->members_nb; i++)
+    {
+        upnp_sink_member_t * const member = &handle->members[i];
+        if (member->pipeline.nb == 0u)
+            continue;
+        member->elements = 0u;
+        dispatch[dispatch_nb].address = member->address;
+        dispatch[dispatch_nb].requests = member->pipeline.requests;
+        dispatch[dispatch_nb].requests_nb = member->pipeline.nb;
+        dispatch[dispatch_nb].timeout_ms = member->timeout_ms;
+        indexes[dispatch_nb++] = i;
+    }
+    if (dispatch_nb == 0u)
+        return true;
+    // Actions are traced, renderer responses are stamped from their latency.
+    const uint32_t start = trace_stamp();
+    for (size_t i = 0; actions && (i < dispatch_nb); i++)
+        trace_event_at(TRACE_STAGE_SENT, actions[indexes[i]].origin, start);
+    upnp_http_fanout(dispatch, dispatch_nb);
+    handle->stats.dispatches++;
+    handle->stats.latency_us = 0u;
+    for (size_t i = 0; i < dispatch_nb; i++)
+    {
+        const size_t index = indexes[i];
+        upnp_sink_member_t * const member = &handle->members[index];
+        upnp_sink_pipeline_t * const pipeline = &member->pipeline;
+        const uint32_t elapsed_ms = dispatch[i].latency_us / 1000u;
+        member->timeout_ms = (elapsed_ms < member->timeout_ms)
+            ? member->timeout_ms - elapsed_ms : 0u;
+        handle->stats.member_latencies_us[index] = dispatch[i].latency_us;
+        if (dispatch[i].latency_us > handle->stats.latency_us)
+            handle->stats.latency_us = dispatch[i].latency_us;
+        ESP_LOGI(LOGGER_TAG, "Dispatch member=%u latency=%luus answered=%u/%u",
+            (unsigned int) index, (unsigned long) dispatch[i].latency_us,
+            (unsigned int) dispatch[i].answered,
+            (unsigned int) pipeline->nb);
+        if (dispatch[i].answered < pipeline->nb)
+            *unanswered |= 1u << index;
+        else if (actions)
+            trace_event_at(TRACE_STAGE_RESPONSE, actions[index].origin,
+                start + trace_stamp_us(dispatch[i].latency_us));
+        for (size_t j = 0; j < pipeline->nb; j++)
+        {
+            if (actions && (j < dispatch[i].sent))
+                upnp_sink_action_clear(&actions[index], pipeline->actions[j]);
+            if (upnp_sink_result(handle, index, pipeline->actions[j],
+                    pipeline->values[j], pipeline->requests[j].length,
+                    pipeline->requests[j].status))
+                upnp_sink_state_update(
+                    handle, index, pipeline->actions[j], pipeline->values[j]);
+            else
+                success = false;
+        }
+        pipeline->nb = 0u;
+    }
+    return success;
+}
+
+// Add actions of renderer to its pipeline, mapped with its state. Track
+// seek and volume are not added while track or volume is unknown, Play is
+// sent if transport state is unknown, and mute is toggled from the last
+// mute state sent.
+static void upnp_sink_actions_add(
+    upnp_sink_handle_t * const handle, size_t index,
+    const command_action_t * const action)
+{
+    assert(handle);
+    assert(action);
+    upnp_sink_member_t * const member = &handle->members[index];
+    // No toggle action, transport and mute states are taken from events
+    // cache (there is no mute query, last mute state sent is used instead).
+    if (action->play_pause)
+    {
+        uint32_t playing = 0u;
+        upnp_sink_state(handle, index, UPNP_GENA_TRANSPORT_STATE, &playing);
+        upnp_sink_pipeline_add(handle, index,
+            (playing != 0u) ? UPNP_SOAP_PAUSE : UPNP_SOAP_PLAY, 0u);
+    }
+    // Track seek when more than one track is skipped.
+    uint32_t track;
+    if ((action->skip == 1) || (action->skip == -1))
+        upnp_sink_pipeline_add(handle, index,
+            (action->skip == 1) ? UPNP_SOAP_NEXT : UPNP_SOAP_PREVIOUS, 0u);
+    else if ((action->skip != 0)
+        && upnp_sink_response_value(member, UPNP_SINK_ELEMENT_TRACK, &track))
+    {
+        const int32_t target = (int32_t) track + action->skip;
+        upnp_sink_pipeline_add(handle, index, UPNP_SOAP_SEEK_TRACK,
+            (target > 1) ? (uint32_t) target : 1u);
+    }
+    if (action->mute)
+    {
+        uint32_t muted = member->muted;
+        upnp_gena_value_get(index, UPNP_GENA_MUTE, &muted);
+        upnp_sink_pipeline_add(handle, index, UPNP_SOAP_SET_MUTE,
+            muted == 0u);
+    }
+    uint32_t current;
+    if ((action->volume != 0)
+        && upnp_sink_state(handle, index, UPNP_GENA_VOLUME, &current))
+    {
+        int32_t volume =
+            (int32_t) current + action->volume * UPNP_SINK_VOLUME_STEP;
+        if (volume < 0)
+            volume = 0;
+        else if (volume > UPNP_SINK_VOLUME_MAX)
+            volume = UPNP_SINK_VOLUME_MAX;
+        upnp_sink_pipeline_add(handle, index, UPNP_SOAP_SET_VOLUME,
+            (uint32_t) volume);
+    }
+}
+
+bool upnp_sink_init(const upnp_group_t * const group)
+{
+    assert(group);
+    assert(group->nb <= UPNP_GROUP_MEMBER_NB);
+    upnp_sink_handle_t * const handle = &upnp_sink_handle;
+    // Statistics are kept when group changes.
+    const upnp_sink_stats_t stats = handle->stats;
+    memset(handle, 0, sizeof(upnp_sink_handle_t));
+    handle->stats = stats;
+    handle->members_nb = group->nb;
+    bool configured = false;
+    for (size_t i = 0; i < group->nb; i++)
+    {
+        const upnp_renderer_t * const renderer = &group->members[i];
+        upnp_sink_member_t * const member = &handle->members[i];
+        member->address.sin_family = AF_INET;
+        member->address.sin_port = htons(renderer->port);
+        // Request lines are built once, envelopes are constant and only
+        // variable fields are written afterwards.
+        member->configured = (inet_pton(AF_INET, renderer->host,
+                &member->address.sin_addr) == 1)
+            && upnp_soap_init(i, renderer);
+        if (!member->configured)
+            ESP_LOGW(LOGGER_TAG, "Renderer configuration invalid member=%u",
+                (unsigned int) i);
+        configured = configured || member->configured;
+    }
+    upnp_gena_init(group);
+    return configured;
+}
+
+uint32_t upnp_sink_unreachable(void)
+{
+    const upnp_sink_handle_t * const handle = &upnp_sink_handle;
+    uint32_t unreachable = 0u;
+    bool configured = false;
+    for (size_t i = 0; i < handle->members_nb; i++)
+    {
+        const upnp_sink_member_t * const member = &handle->members[i];
+        configured = configured || member->configured;
+        if (!member->configured
+            || (member->unanswered >= UPNP_SINK_UNREACHABLE_NB))
+            unreachable |= 1u << i;
+    }
+    return configured ? unreachable : ((1u << UPNP_GROUP_MEMBER_NB) - 1u);
+}
+
+bool upnp_sink_send(upnp_soap_action_t action, uint32_t value)
+{
+    upnp_sink_handle_t * const handle = &upnp_sink_handle;
+    uint32_t unanswered = 0u;
+    bool configured = false;
+    for (size_t i = 0; i < handle->members_nb; i++)
+    {
+        if (!handle->members[i].configured)
+            continue;
+        handle->members[i].timeout_ms = UPNP_SINK_TIMEOUT_MS;
+        upnp_sink_pipeline_add(handle, i, action, value);
+        configured = true;
+    }
+    return upnp_sink_dispatch(handle, NULL, &unanswered) && configured;
+}
+
+uint32_t upnp_sink_process(
+    command_action_t * const actions, const uint32_t * const timeouts_ms)
+{
+    assert(actions);
+    assert(timeouts_ms);
+    upnp_sink_handle_t * const handle = &upnp_sink_handle;
+    uint32_t unanswered = 0u;
+    bool configured = false;
+    // Renderer state needed by relative actions is read first if cache is
+    // stale, then actions are pipelined on connection of each renderer.
+    // Both are dispatched to all renderers at once.
+    upnp_gena_receive();
+    for (size_t i = 0; i < handle->members_nb; i++)
+    {
+        const command_action_t * const action = &actions[i];
+        handle->members[i].elements = 0u;
+        handle->members[i].timeout_ms = timeouts_ms[i];
+        if (!handle->members[i].configured)
+        {
+            // Never answered, not worth sending again.
+            memset(&actions[i], 0, sizeof(command_action_t));
+            unanswered |= 1u << i;
+            continue;
+        }
+        configured = true;
+        if (action->play_pause)
+            upnp_sink_state_query(handle, i, UPNP_GENA_TRANSPORT_STATE);
+        if ((action->skip > 1) || (action->skip < -1))
+            upnp_sink_pipeline_add(
+                handle, i, UPNP_SOAP_GET_POSITION_INFO, 0u);
+        if (action->volume != 0)
+            upnp_sink_state_query(handle, i, UPNP_GENA_VOLUME);
+    }
+    if (!configured)
+        ESP_LOGW(LOGGER_TAG, "No renderer configured");
+    upnp_sink_dispatch(handle, NULL, &unanswered);
+    for (size_t i = 0; i < handle->members_nb; i++)
+    {
+        // Renderers out of time, or with state unknown, are left with their
+        // actions.
+        const upnp_sink_member_t * const member = &handle->members[i];
+        if (member->configured && (member->timeout_ms > 0u))
+            upnp_sink_actions_add(handle, i, &actions[i]);
+    }
+    upnp_sink_dispatch(handle, actions, &unanswered);
+    return unanswered;
+}
+
+void upnp_sink_wait(int wakeup, uint32_t timeout_ms)
+{
+    fd_set readable;
+    fd_set writable;
+    int fd_max = -1;
+    FD_ZERO(&readable);
+    FD_ZERO(&writable);
+    if (wakeup >= 0)
+    {
+        FD_SET(wakeup, &readable);
+        fd_max = wakeup;
+    }
+    // Connections closed by renderers and events are received as they come,
+    // connections are refreshed and subscriptions renewed when due (both
+    // established once writable).
+    if (upnp_sink_handle.members_nb > 0u)
+    {
+        const uint32_t http_ms = upnp_http_poll_set(
+            &readable, &writable, &fd_max);
+        const uint32_t gena_ms = upnp_gena_poll_set(
+            &readable, &writable, &fd_max);
+        if (http_ms < timeout_ms)
+            timeout_ms = http_ms;
+        if (gena_ms < timeout_ms)
+            timeout_ms = gena_ms;
+    }
+    struct timeval timeout = {
+        .tv_sec = timeout_ms / 1000u,
+        .tv_usec = (timeout_ms % 1000u) * 1000u
+    };
+    select(fd_max + 1, &readable, &writable, NULL,
+        (timeout_ms == UINT32_MAX) ? NULL : &timeout);
+}
+
+void upnp_sink_poll(void)
+{
+    if (upnp_sink_handle.members_nb == 0u)
+        return;
+    upnp_http_poll();
+    upnp_gena_poll();
+}
+
+void upnp_sink_stats_get(upnp_sink_stats_t * const stats)
+{
+    assert(stats);
+    *stats = upnp_sink_handle.stats;
+}
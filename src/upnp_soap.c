@@ -0,0 +1,210 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "upnp_soap.h"
+#include <assert.h>
+#include <stdio.h>
+
+// Request line and host of a service (longest paths fit), and header
+// fields of an action.
+#define SOAP_LINE_SIZE                   144u
+#define SOAP_HEADER_SIZE                 176u
+#define SOAP_AV_TRANSPORT_URN \
+    "urn:schemas-upnp-org:service:AVTransport:1"
+#define SOAP_RENDERING_CONTROL_URN \
+    "urn:schemas-upnp-org:service:RenderingControl:1"
+
+// Envelope is split around its variable fields, which have a fixed width
+// (leading zeros are valid in integer values), so envelope and
+// Content-Length never change.
+#define SOAP_ENVELOPE_HEAD(service, action) \
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>" \
+    "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" " \
+    "s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\">" \
+    "<s:Body><u:" action " xmlns:u=\"" service "\"><InstanceID>"
+#define SOAP_ENVELOPE_MIDDLE(args) \
+    "</InstanceID>" args
+#define SOAP_ENVELOPE_TAIL(action, args_end) \
+    args_end "</u:" action "></s:Body></s:Envelope>"
+
+// Services of actions, each one has its control URL path.
+typedef enum
+{
+    SOAP_AV_TRANSPORT = 0,
+    SOAP_RENDERING_CONTROL,
+    SOAP_SERVICE_NB_MAX
+} soap_service_t;
+
+// Action template: envelope up to instance ID, up to argument value, and
+// end. Service URN is named after service.
+typedef struct
+{
+    soap_service_t service;
+    const char *name;
+    const char *head;
+    const char *middle;
+    const char *tail;
+    uint16_t head_length;
+    uint16_t middle_length;
+    uint16_t tail_length;
+    uint16_t value_width;       // No argument value if 0.
+} soap_template_t;
+
+// Request line and host of each service, for a renderer.
+typedef struct
+{
+    char lines[SOAP_SERVICE_NB_MAX][SOAP_LINE_SIZE];
+    uint16_t lengths[SOAP_SERVICE_NB_MAX];
+} soap_member_t;
+
+// Header fields of an action, same for all renderers.
+typedef struct
+{
+    char data[SOAP_HEADER_SIZE];
+    uint16_t length;
+} soap_header_t;
+
+#define SOAP_TEMPLATE(service, action, args, value_width, args_end) \
+    { \
+        service, action, \
+        SOAP_ENVELOPE_HEAD(service ## _URN, action), \
+        SOAP_ENVELOPE_MIDDLE(args), \
+        SOAP_ENVELOPE_TAIL(action, args_end), \
+        sizeof(SOAP_ENVELOPE_HEAD(service ## _URN, action)) - 1u, \
+        sizeof(SOAP_ENVELOPE_MIDDLE(args)) - 1u, \
+        sizeof(SOAP_ENVELOPE_TAIL(action, args_end)) - 1u, \
+        value_width \
+    }
+static const char * const soap_service_urn[SOAP_SERVICE_NB_MAX] = {
+    [SOAP_AV_TRANSPORT] = SOAP_AV_TRANSPORT_URN,
+    [SOAP_RENDERING_CONTROL] = SOAP_RENDERING_CONTROL_URN,
+};
+
+static const soap_template_t soap_template[UPNP_SOAP_NB_MAX] = {
+    [UPNP_SOAP_PLAY] = SOAP_TEMPLATE(SOAP_AV_TRANSPORT,
+        "Play", "<Speed>1</Speed>", 0u, ""),
+    [UPNP_SOAP_PAUSE] = SOAP_TEMPLATE(SOAP_AV_TRANSPORT,
+        "Pause", "", 0u, ""),
+    [UPNP_SOAP_NEXT] = SOAP_TEMPLATE(SOAP_AV_TRANSPORT,
+        "Next", "", 0u, ""),
+    [UPNP_SOAP_PREVIOUS] = SOAP_TEMPLATE(SOAP_AV_TRANSPORT,
+        "Previous", "", 0u, ""),
+    [UPNP_SOAP_SEEK_TRACK] = SOAP_TEMPLATE(SOAP_AV_TRANSPORT,
+        "Seek", "<Unit>TRACK_NR</Unit><Target>", 5u, "</Target>"),
+    [UPNP_SOAP_GET_POSITION_INFO] = SOAP_TEMPLATE(SOAP_AV_TRANSPORT,
+        "GetPositionInfo", "", 0u, ""),
+    [UPNP_SOAP_GET_TRANSPORT_INFO] = SOAP_TEMPLATE(SOAP_AV_TRANSPORT,
+        "GetTransportInfo", "", 0u, ""),
+    [UPNP_SOAP_SET_MUTE] = SOAP_TEMPLATE(SOAP_RENDERING_CONTROL,
+        "SetMute", "<Channel>Master</Channel><DesiredMute>", 1u,
+        "</DesiredMute>"),
+    [UPNP_SOAP_SET_VOLUME] = SOAP_TEMPLATE(SOAP_RENDERING_CONTROL,
+        "SetVolume", "<Channel>Master</Channel><DesiredVolume>", 3u,
+        "</DesiredVolume>"),
+    [UPNP_SOAP_GET_VOLUME] = SOAP_TEMPLATE(SOAP_RENDERING_CONTROL,
+        "GetVolume", "<Channel>Master</Channel>", 0u, ""),
+};
+
+static_assert(UPNP_HTTP_PART_NB >= 7u, "SOAP request parts do not fit");
+
+// Request lines of each group member, and header fields of each action.
+static soap_member_t soap_member[UPNP_GROUP_MEMBER_NB];
+static soap_header_t soap_header[UPNP_SOAP_NB_MAX];
+
+// Write value as decimal number with leading zeros, in slot of fixed width.
+static inline void soap_slot_patch(char *slot, uint16_t width, uint32_t value)
+{
+    while (width-- > 0u)
+    {
+        slot[width] = (char) ('0' + (value % 10u));
+        value /= 10u;
+    }
+}
+
+// Add part to request.
+static inline void soap_part_add(
+    upnp_http_request_t * const request, const char *data, size_t length)
+{
+    request->parts[request->parts_nb].data = data;
+    request->parts[request->parts_nb].length = length;
+    request->parts_nb++;
+    request->length += length;
+}
+
+bool upnp_soap_init(size_t member, const upnp_renderer_t * const renderer)
+{
+    assert(member < UPNP_GROUP_MEMBER_NB);
+    assert(renderer);
+    soap_member_t * const lines = &soap_member[member];
+    const char * const paths[SOAP_SERVICE_NB_MAX] = {
+        [SOAP_AV_TRANSPORT] = renderer->av_transport_path,
+        [SOAP_RENDERING_CONTROL] = renderer->rendering_control_path,
+    };
+    for (size_t i = 0; i < SOAP_SERVICE_NB_MAX; i++)
+    {
+        const int length = snprintf(lines->lines[i], SOAP_LINE_SIZE,
+            "POST %s HTTP/1.1\r\n"
+            "HOST: %s:%u\r\n",
+            paths[i], renderer->host, renderer->port);
+        if ((length < 0) || ((size_t) length >= SOAP_LINE_SIZE))
+            return false;
+        lines->lengths[i] = (uint16_t) length;
+    }
+    // Header fields do not depend on renderer, built again at no cost.
+    for (size_t i = 0; i < UPNP_SOAP_NB_MAX; i++)
+    {
+        const soap_template_t * const template = &soap_template[i];
+        soap_header_t * const header = &soap_header[i];
+        const int length = snprintf(header->data, SOAP_HEADER_SIZE,
+            "CONTENT-TYPE: text/xml; charset=\"utf-8\"\r\n"
+            "CONTENT-LENGTH: %u\r\n"
+            "SOAPACTION: \"%s#%s\"\r\n"
+            "Connection: keep-alive\r\n"
+            "\r\n",
+            (unsigned int) (template->head_length + UPNP_SOAP_INSTANCE_WIDTH
+                + template->middle_length + template->value_width
+                + template->tail_length),
+            soap_service_urn[template->service], template->name);
+        if ((length < 0) || ((size_t) length >= SOAP_HEADER_SIZE))
+            return false;
+        header->length = (uint16_t) length;
+    }
+    return true;
+}
+
+void upnp_soap_request(
+    size_t member, upnp_soap_action_t action, uint32_t instance,
+    uint32_t value, upnp_soap_fields_t * const fields,
+    upnp_http_request_t * const request)
+{
+    assert(member < UPNP_GROUP_MEMBER_NB);
+    assert(action < UPNP_SOAP_NB_MAX);
+    assert(fields);
+    assert(request);
+    const soap_template_t * const template = &soap_template[action];
+    const soap_member_t * const lines = &soap_member[member];
+    assert(template->value_width <= UPNP_SOAP_VALUE_WIDTH_MAX);
+    soap_slot_patch(fields->instance, UPNP_SOAP_INSTANCE_WIDTH, instance);
+    soap_slot_patch(fields->value, template->value_width, value);
+    request->parts_nb = 0u;
+    request->length = 0u;
+    soap_part_add(request, lines->lines[template->service],
+        lines->lengths[template->service]);
+    soap_part_add(request, soap_header[action].data,
+        soap_header[action].length);
+    soap_part_add(request, template->head, template->head_length);
+    soap_part_add(request, fields->instance, UPNP_SOAP_INSTANCE_WIDTH);
+    soap_part_add(request, template->middle, template->middle_length);
+    if (template->value_width > 0u)
+        soap_part_add(request, fields->value, template->value_width);
+    soap_part_add(request, template->tail, template->tail_length);
+}
+
+const char *upnp_soap_action_str(upnp_soap_action_t action)
+{
+    if (action >= UPNP_SOAP_NB_MAX)
+        return "Unknown";
+    return soap_template[action].name;
+}
@@ -0,0 +1,248 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "upnp_ssdp.h"
+#include "esp_log.h"
+#include <arpa/inet.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOGGER_TAG "upnp_ssdp"
+
+#define UPNP_SSDP_BUFFER_SIZE          768u
+#define UPNP_SSDP_VALUE_SIZE           128u
+#define UPNP_SSDP_TTL                    2u
+#define UPNP_SSDP_DEVICE_TYPE \
+    "urn:schemas-upnp-org:device:MediaRenderer:"
+
+// UPnP SSDP handle.
+typedef struct
+{
+    int sock;                   // Socket, negative if not opened.
+    struct sockaddr_in group;
+    char buffer[UPNP_SSDP_BUFFER_SIZE + 1u];
+} upnp_ssdp_handle_t;
+
+static upnp_ssdp_handle_t upnp_ssdp_handle = { .sock = -1 };
+
+static uint32_t upnp_ssdp_time_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) ts.tv_sec * 1000u + (uint32_t) (ts.tv_nsec / 1000000);
+}
+
+// Get value of header field, surrounding spaces trimmed.
+// Return true on success, false if field is not found or too long.
+static bool upnp_ssdp_header(
+    const char *message, const char *name, char *value, size_t size)
+{
+    const size_t name_length = strlen(name);
+    for (const char *line = strstr(message, "\r\n"); line;
+        line = strstr(line, "\r\n"))
+    {
+        line += 2;
+        if ((strncasecmp(line, name, name_length) != 0)
+            || (line[name_length] != ':'))
+            continue;
+        line += name_length + 1u;
+        line += strspn(line, " \t");
+        size_t length = strcspn(line, "\r\n");
+        while ((length > 0u) && (line[length - 1u] == ' '))
+            length--;
+        if (length >= size)
+            return false;
+        memcpy(value, line, length);
+        value[length] = '\0';
+        return true;
+    }
+    return false;
+}
+
+// Get description address and path from location URL (IPv4 only).
+// Return true on success, false if URL is not supported.
+static bool upnp_ssdp_location(
+    const char *url, upnp_ssdp_message_t * const message)
+{
+    char host[UPNP_RENDERER_HOST_SIZE];
+    if (strncasecmp(url, "http://", 7u) != 0)
+        return false;
+    url += 7;
+    const size_t host_length = strcspn(url, ":/");
+    if (host_length >= sizeof(host))
+        return false;
+    memcpy(host, url, host_length);
+    host[host_length] = '\0';
+    url += host_length;
+    unsigned long port = 80u;
+    if (*url == ':')
+        port = strtoul(&url[1], (char **) &url, 10);
+    if ((*url != '/') || (port == 0u) || (port > 0xFFFFu)
+        || (strlen(url) >= sizeof(message->path)))
+        return false;
+    memset(&message->location, 0, sizeof(message->location));
+    message->location.sin_family = AF_INET;
+    message->location.sin_port = htons((uint16_t) port);
+    if (inet_pton(AF_INET, host, &message->location.sin_addr) != 1)
+        return false;
+    strcpy(message->path, url);
+    return true;
+}
+
+// Parse message of a MediaRenderer device.
+// Return true on success, false if message is not relevant.
+static bool upnp_ssdp_parse(
+    const char *data, upnp_ssdp_message_t * const message)
+{
+    char value[UPNP_SSDP_VALUE_SIZE];
+    const char *type_field = "NT";
+    memset(message, 0, sizeof(upnp_ssdp_message_t));
+    if (strncmp(data, "HTTP/1.1 200", 12u) == 0)
+    {
+        message->kind = UPNP_SSDP_RESPONSE;
+        type_field = "ST";
+    }
+    else if (strncmp(data, "NOTIFY * HTTP/1.1", 17u) == 0)
+    {
+        if (!upnp_ssdp_header(data, "NTS", value, sizeof(value)))
+            return false;
+        if (strcmp(value, "ssdp:alive") == 0)
+            message->kind = UPNP_SSDP_ALIVE;
+        else if (strcmp(value, "ssdp:byebye") == 0)
+            message->kind = UPNP_SSDP_BYEBYE;
+        else
+            return false;
+    }
+    else
+        return false;
+    // Unique device name is the USN prefix, before the device type.
+    if (!upnp_ssdp_header(data, "USN", value, sizeof(value))
+        || (strncmp(value, "uuid:", 5u) != 0))
+        return false;
+    const size_t udn_length = strcspn(value, ":") + 1u
+        + strcspn(&value[5], ":");
+    if (udn_length >= sizeof(message->udn))
+        return false;
+    memcpy(message->udn, value, udn_length);
+    message->udn[udn_length] = '\0';
+    // Device leaving is reported whatever its type, it is matched by name.
+    if (message->kind == UPNP_SSDP_BYEBYE)
+        return true;
+    return upnp_ssdp_header(data, type_field, value, sizeof(value))
+        && (strncmp(value, UPNP_SSDP_DEVICE_TYPE,
+                sizeof(UPNP_SSDP_DEVICE_TYPE) - 1u) == 0)
+        && upnp_ssdp_header(data, "LOCATION", value, sizeof(value))
+        && upnp_ssdp_location(value, message);
+}
+
+bool upnp_ssdp_init(void)
+{
+    upnp_ssdp_handle_t * const handle = &upnp_ssdp_handle;
+    upnp_ssdp_deinit();
+    const int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0)
+        return false;
+    // Port is shared with other SSDP listeners of the host.
+    const int reuse = 1;
+    const unsigned char ttl = UPNP_SSDP_TTL;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    const struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = htons(UPNP_SSDP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY)
+    };
+    struct ip_mreq membership = {
+        .imr_interface.s_addr = htonl(INADDR_ANY)
+    };
+    inet_pton(AF_INET, UPNP_SSDP_ADDRESS, &membership.imr_multiaddr);
+    if ((bind(sock, (const struct sockaddr *) &address, sizeof(address)) != 0)
+        || (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership,
+                sizeof(membership)) != 0))
+    {
+        ESP_LOGW(LOGGER_TAG, "SSDP socket configuration failed");
+        close(sock);
+        return false;
+    }
+    handle->group = address;
+    handle->group.sin_addr = membership.imr_multiaddr;
+    handle->sock = sock;
+    return true;
+}
+
+void upnp_ssdp_deinit(void)
+{
+    upnp_ssdp_handle_t * const handle = &upnp_ssdp_handle;
+    if (handle->sock >= 0)
+        close(handle->sock);
+    handle->sock = -1;
+}
+
+bool upnp_ssdp_search(void)
+{
+    static const char request[] =
+        "M-SEARCH * HTTP/1.1\r\n"
+        "HOST: " UPNP_SSDP_ADDRESS ":1900\r\n"
+        "MAN: \"ssdp:discover\"\r\n"
+        "MX: 2\r\n"
+        "ST: " UPNP_SSDP_DEVICE_TYPE "1\r\n"
+        "USER-AGENT: FreeRTOS/10 UPnP/1.1 esp-upnp-remote/1.0\r\n"
+        "\r\n";
+    upnp_ssdp_handle_t * const handle = &upnp_ssdp_handle;
+    if (handle->sock < 0)
+        return false;
+    return sendto(handle->sock, request, sizeof(request) - 1u, 0,
+        (const struct sockaddr *) &handle->group, sizeof(handle->group))
+            == (ssize_t) (sizeof(request) - 1u);
+}
+
+bool upnp_ssdp_receive(
+    upnp_ssdp_message_t * const message, uint32_t timeout_ms, int wakeup)
+{
+    assert(message);
+    upnp_ssdp_handle_t * const handle = &upnp_ssdp_handle;
+    if ((handle->sock < 0) && (wakeup < 0))
+        return false;
+    const uint32_t start_ms = upnp_ssdp_time_ms();
+    uint32_t elapsed_ms = 0u;
+    while (elapsed_ms <= timeout_ms)
+    {
+        const uint32_t remaining_ms = timeout_ms - elapsed_ms;
+        struct timeval timeout = {
+            .tv_sec = remaining_ms / 1000u,
+            .tv_usec = (remaining_ms % 1000u) * 1000u
+        };
+        fd_set readable;
+        FD_ZERO(&readable);
+        if (handle->sock >= 0)
+            FD_SET(handle->sock, &readable);
+        if (wakeup >= 0)
+            FD_SET(wakeup, &readable);
+        const int fd_max = (handle->sock > wakeup) ? handle->sock : wakeup;
+        if ((select(fd_max + 1, &readable, NULL, NULL,
+                (timeout_ms == UINT32_MAX) ? NULL : &timeout) <= 0)
+            || ((wakeup >= 0) && FD_ISSET(wakeup, &readable))
+            || (handle->sock < 0))
+            return false;
+        const ssize_t nb = recv(
+            handle->sock, handle->buffer, UPNP_SSDP_BUFFER_SIZE, 0);
+        if (nb > 0)
+        {
+            handle->buffer[nb] = '\0';
+            if (upnp_ssdp_parse(handle->buffer, message))
+                return true;
+        }
+        elapsed_ms = upnp_ssdp_time_ms() - start_ms;
+    }
+    return false;
+}
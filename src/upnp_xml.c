@@ -0,0 +1,428 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "upnp_xml.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Lexer states.
+typedef enum
+{
+    UPNP_XML_STATE_TEXT = 0,        // Element content.
+    UPNP_XML_STATE_ENTITY,          // Entity reference in content.
+    UPNP_XML_STATE_MARKUP,          // Markup start ('<').
+    UPNP_XML_STATE_START_NAME,      // Start tag name.
+    UPNP_XML_STATE_ATTRIBUTES,      // Start tag attributes.
+    UPNP_XML_STATE_VALUE,           // Attribute value.
+    UPNP_XML_STATE_EMPTY,           // Empty element tag end ('/').
+    UPNP_XML_STATE_END_NAME,        // End tag.
+    UPNP_XML_STATE_BANG,            // Comment, section or declaration ('<!').
+    UPNP_XML_STATE_COMMENT,         // Comment, ended by "-->".
+    UPNP_XML_STATE_SECTION,         // CDATA section, ended by "]]>".
+    UPNP_XML_STATE_DECLARATION      // Declaration or instruction, until '>'.
+} upnp_xml_state_t;
+
+static inline bool upnp_xml_is_space(char c)
+{
+    return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n');
+}
+
+// Get index of path matched by current element, among element paths or
+// attributes paths.
+// Return index on success, negative value if no path is matched.
+static int32_t upnp_xml_match(
+    const upnp_xml_parser_t * const parser, bool attributes)
+{
+    assert(parser);
+    if ((parser->overflow > 0u) || (parser->path_length == 0u))
+        return -1;
+    for (size_t i = 0; i < parser->paths_nb; i++)
+    {
+        size_t length = strlen(parser->paths[i]);
+        if ((length == 0u)
+            || ((parser->paths[i][length - 1u] == '@') != attributes))
+            continue;
+        if (attributes)
+            length--;
+        if ((length < parser->path_length)
+            && (parser->path[parser->path_length - length - 1u] == '/')
+            && (memcmp(&parser->path[parser->path_length - length],
+                    parser->paths[i], length) == 0))
+            return (int32_t) i;
+    }
+    return -1;
+}
+
+// Start tag name is complete, its attributes are collected if matched.
+static void upnp_xml_name_end(upnp_xml_parser_t * const parser)
+{
+    assert(parser);
+    parser->attributes_match = upnp_xml_match(parser, true);
+    parser->attributes_length = 0u;
+    parser->attributes_overflow = false;
+}
+
+// Append character to attributes of matched element.
+static inline void upnp_xml_attributes_append(
+    upnp_xml_parser_t * const parser, char c)
+{
+    if (parser->attributes_match < 0)
+        return;
+    if ((parser->attributes_length == 0u) && upnp_xml_is_space(c))
+        return;
+    if (parser->attributes_length >= (UPNP_XML_TEXT_SIZE - 1u))
+        parser->attributes_overflow = true;
+    else
+        parser->attributes[parser->attributes_length++] = c;
+}
+
+// Element start tag is complete, attributes are reported if matched.
+static void upnp_xml_element_start(upnp_xml_parser_t * const parser)
+{
+    assert(parser);
+    parser->started = true;
+    if ((parser->attributes_match >= 0) && !parser->attributes_overflow)
+    {
+        while ((parser->attributes_length > 0u)
+            && upnp_xml_is_space(
+                parser->attributes[parser->attributes_length - 1u]))
+            parser->attributes_length--;
+        parser->attributes[parser->attributes_length] = '\0';
+        parser->callback(parser->context, (size_t) parser->attributes_match,
+            parser->attributes);
+    }
+    parser->attributes_match = -1;
+    if (upnp_xml_match(parser, false) < 0)
+        return;
+    // Text is collected until end of this element, for itself only.
+    parser->match_length = parser->path_length;
+    parser->text_length = 0u;
+    parser->text_overflow = false;
+}
+
+// Element ended, reported if matched.
+static void upnp_xml_element_end(upnp_xml_parser_t * const parser)
+{
+    assert(parser);
+    if (parser->overflow > 0u)
+    {
+        parser->overflow--;
+        return;
+    }
+    const int32_t match = upnp_xml_match(parser, false);
+    if (parser->match_length == parser->path_length)
+    {
+        // Trailing spaces are trimmed, leading ones are never collected.
+        while ((parser->text_length > 0u)
+            && upnp_xml_is_space(parser->text[parser->text_length - 1u]))
+            parser->text_length--;
+        parser->text[parser->text_length] = '\0';
+        parser->match_length = 0u;
+        if ((match >= 0) && !parser->text_overflow)
+            parser->callback(parser->context, (size_t) match, parser->text);
+    }
+    else if (match >= 0)
+        parser->callback(parser->context, (size_t) match, "");
+    // Drop element name from path.
+    while ((parser->path_length > 0u)
+        && (parser->path[--parser->path_length] != '/'))
+        ;
+    parser->path[parser->path_length] = '\0';
+}
+
+// Append character to text of matched element.
+static inline void upnp_xml_text_append(
+    upnp_xml_parser_t * const parser, char c)
+{
+    if ((parser->text_length == 0u) && upnp_xml_is_space(c))
+        return;
+    if (parser->text_length >= (UPNP_XML_TEXT_SIZE - 1u))
+        parser->text_overflow = true;
+    else
+        parser->text[parser->text_length++] = c;
+}
+
+// Append character to name of started element.
+static inline void upnp_xml_name_append(
+    upnp_xml_parser_t * const parser, char c)
+{
+    if (parser->overflow > 0u)
+        return;
+    // Namespace prefix is dropped, only local name is kept.
+    if (c == ':')
+    {
+        parser->path_length = parser->name_start + 1u;
+        return;
+    }
+    if (parser->path_length >= (UPNP_XML_PATH_SIZE - 1u))
+    {
+        // Element and its content are not tracked, path is kept intact.
+        parser->path_length = parser->name_start;
+        parser->path[parser->path_length] = '\0';
+        parser->overflow = 1u;
+        return;
+    }
+    parser->path[parser->path_length++] = c;
+    parser->path[parser->path_length] = '\0';
+}
+
+// Decode entity reference in text of matched element.
+// Return true on success, false if entity is unknown.
+static bool upnp_xml_entity_decode(upnp_xml_parser_t * const parser)
+{
+    static const struct
+    {
+        const char *name;
+        char c;
+    } entities[] = {
+        { "amp", '&' }, { "lt", '<' }, { "gt", '>' },
+        { "quot", '"' }, { "apos", '\'' },
+    };
+    const char * const entity = parser->entity;
+    if (entity[0] == '#')
+    {
+        // Character reference, only ASCII characters are kept.
+        const unsigned long code = (entity[1] == 'x')
+            ? strtoul(&entity[2], NULL, 16) : strtoul(&entity[1], NULL, 10);
+        upnp_xml_text_append(parser, (code < 0x80u) ? (char) code : '?');
+        return true;
+    }
+    for (size_t i = 0; i < (sizeof(entities) / sizeof(entities[0])); i++)
+    {
+        if (strcmp(entity, entities[i].name) == 0)
+        {
+            upnp_xml_text_append(parser, entities[i].c);
+            return true;
+        }
+    }
+    return false;
+}
+
+void upnp_xml_init(
+    upnp_xml_parser_t * const parser, const char * const *paths,
+    size_t paths_nb, upnp_xml_callback_t callback, void *context)
+{
+    assert(parser);
+    assert(paths || (paths_nb == 0u));
+    assert(callback);
+    memset(parser, 0, sizeof(upnp_xml_parser_t));
+    parser->paths = paths;
+    parser->paths_nb = paths_nb;
+    parser->callback = callback;
+    parser->context = context;
+    parser->attributes_match = -1;
+    parser->state = UPNP_XML_STATE_TEXT;
+}
+
+bool upnp_xml_feed(
+    upnp_xml_parser_t * const parser, const char *data, size_t length)
+{
+    assert(parser);
+    assert(data || (length == 0u));
+    const char * const end = &data[length];
+    while (data < end)
+    {
+        const char c = *data++;
+        switch (parser->state)
+        {
+            case UPNP_XML_STATE_TEXT:
+                if (c == '<')
+                    parser->state = UPNP_XML_STATE_MARKUP;
+                else if ((parser->match_length == 0u)
+                    || (parser->match_length != parser->path_length))
+                {
+                    // Content of other elements is skipped at once.
+                    const char *markup = memchr(data, '<', end - data);
+                    data = markup ? markup : end;
+                }
+                else if (c == '&')
+                {
+                    parser->entity_length = 0u;
+                    parser->state = UPNP_XML_STATE_ENTITY;
+                }
+                else
+                    upnp_xml_text_append(parser, c);
+                break;
+            case UPNP_XML_STATE_ENTITY:
+                if (c == ';')
+                {
+                    parser->entity[parser->entity_length] = '\0';
+                    if (!upnp_xml_entity_decode(parser))
+                        return false;
+                    parser->state = UPNP_XML_STATE_TEXT;
+                }
+                else if (parser->entity_length
+                    < (sizeof(parser->entity) - 1u))
+                    parser->entity[parser->entity_length++] = c;
+                else
+                    return false;
+                break;
+            case UPNP_XML_STATE_MARKUP:
+                if (c == '/')
+                    parser->state = UPNP_XML_STATE_END_NAME;
+                else if (c == '!')
+                {
+                    parser->markers = 0u;
+                    parser->state = UPNP_XML_STATE_BANG;
+                }
+                else if (c == '?')
+                    parser->state = UPNP_XML_STATE_DECLARATION;
+                else if (upnp_xml_is_space(c) || (c == '>'))
+                    return false;
+                else
+                {
+                    if (parser->overflow > 0u)
+                        parser->overflow++;
+                    else
+                    {
+                        parser->name_start = parser->path_length;
+                        upnp_xml_name_append(parser, '/');
+                    }
+                    upnp_xml_name_append(parser, c);
+                    parser->state = UPNP_XML_STATE_START_NAME;
+                }
+                break;
+            case UPNP_XML_STATE_START_NAME:
+                if ((c != '>') && (c != '/') && !upnp_xml_is_space(c))
+                {
+                    upnp_xml_name_append(parser, c);
+                    break;
+                }
+                upnp_xml_name_end(parser);
+                if (c == '>')
+                {
+                    upnp_xml_element_start(parser);
+                    parser->state = UPNP_XML_STATE_TEXT;
+                }
+                else if (c == '/')
+                    parser->state = UPNP_XML_STATE_EMPTY;
+                else
+                    parser->state = UPNP_XML_STATE_ATTRIBUTES;
+                break;
+            case UPNP_XML_STATE_ATTRIBUTES:
+                if (c == '>')
+                {
+                    upnp_xml_element_start(parser);
+                    parser->state = UPNP_XML_STATE_TEXT;
+                }
+                else if (c == '/')
+                    parser->state = UPNP_XML_STATE_EMPTY;
+                else
+                {
+                    upnp_xml_attributes_append(parser, c);
+                    if ((c == '"') || (c == '\''))
+                    {
+                        parser->quote = (uint8_t) c;
+                        parser->state = UPNP_XML_STATE_VALUE;
+                    }
+                }
+                break;
+            case UPNP_XML_STATE_VALUE:
+                upnp_xml_attributes_append(parser, c);
+                if (c == (char) parser->quote)
+                    parser->state = UPNP_XML_STATE_ATTRIBUTES;
+                break;
+            case UPNP_XML_STATE_EMPTY:
+                if (c != '>')
+                    return false;
+                upnp_xml_element_start(parser);
+                upnp_xml_element_end(parser);
+                parser->state = UPNP_XML_STATE_TEXT;
+                break;
+            case UPNP_XML_STATE_END_NAME:
+                // End tag name is not checked against start tag one.
+                if (c == '>')
+                {
+                    if ((parser->overflow == 0u) && (parser->path_length == 0u))
+                        return false;
+                    upnp_xml_element_end(parser);
+                    parser->state = UPNP_XML_STATE_TEXT;
+                }
+                break;
+            case UPNP_XML_STATE_BANG:
+                if ((c == '-') && (parser->markers == 0u))
+                    parser->markers = 1u;
+                else if ((c == '-') && (parser->markers == 1u))
+                {
+                    parser->markers = 0u;
+                    parser->state = UPNP_XML_STATE_COMMENT;
+                }
+                else if (c == '[')
+                {
+                    // CDATA section content is skipped.
+                    parser->markers = 0u;
+                    parser->state = UPNP_XML_STATE_SECTION;
+                }
+                else if (c == '>')
+                    parser->state = UPNP_XML_STATE_TEXT;
+                else
+                    parser->state = UPNP_XML_STATE_DECLARATION;
+                break;
+            case UPNP_XML_STATE_COMMENT:
+                if ((c == '>') && (parser->markers >= 2u))
+                    parser->state = UPNP_XML_STATE_TEXT;
+                else
+                    parser->markers = (c != '-') ? 0u
+                        : (parser->markers < 2u) ? parser->markers + 1u : 2u;
+                break;
+            case UPNP_XML_STATE_SECTION:
+                if ((c == '>') && (parser->markers >= 2u))
+                    parser->state = UPNP_XML_STATE_TEXT;
+                else
+                    parser->markers = (c != ']') ? 0u
+                        : (parser->markers < 2u) ? parser->markers + 1u : 2u;
+                break;
+            case UPNP_XML_STATE_DECLARATION:
+                if (c == '>')
+                    parser->state = UPNP_XML_STATE_TEXT;
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+bool upnp_xml_complete(const upnp_xml_parser_t * const parser)
+{
+    assert(parser);
+    return parser->started && (parser->path_length == 0u)
+        && (parser->overflow == 0u) && (parser->state == UPNP_XML_STATE_TEXT);
+}
+
+bool upnp_xml_attribute(
+    const char *attributes, const char *name, char *value, size_t size)
+{
+    assert(attributes);
+    assert(name);
+    assert(value);
+    const size_t name_length = strlen(name);
+    const char *attribute = attributes;
+    while (*attribute != '\0')
+    {
+        // Attribute name, then its quoted value.
+        const size_t length = strcspn(attribute, "= \t\r\n");
+        const char *quote = strpbrk(&attribute[length], "\"'");
+        if (!quote)
+            return false;
+        const char *end = strchr(&quote[1], *quote);
+        if (!end)
+            return false;
+        if ((length == name_length)
+            && (memcmp(attribute, name, name_length) == 0))
+        {
+            const size_t value_length = (size_t) (end - quote) - 1u;
+            if (value_length >= size)
+                return false;
+            memcpy(value, &quote[1], value_length);
+            value[value_length] = '\0';
+            return true;
+        }
+        attribute = &end[1];
+        attribute += strspn(attribute, " \t\r\n");
+    }
+    return false;
+}
@@ -0,0 +1,40 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "wakeup.h"
+#include "esp_vfs_eventfd.h"
+#include <sys/select.h>
+#include <sys/time.h>
+#include <stdint.h>
+#include <unistd.h>
+
+// Wakeup descriptors are event counters (eventfd), read only once readable
+// as their read waits otherwise.
+
+int wakeup_open(void)
+{
+    return eventfd(0, 0);
+}
+
+void wakeup_signal(int wakeup)
+{
+    const uint64_t value = 1u;
+    if (wakeup >= 0)
+        write(wakeup, &value, sizeof(value));
+}
+
+bool wakeup_clear(int wakeup)
+{
+    struct timeval timeout = { .tv_sec = 0, .tv_usec = 0 };
+    uint64_t value;
+    fd_set readable;
+    if (wakeup < 0)
+        return false;
+    FD_ZERO(&readable);
+    FD_SET(wakeup, &readable);
+    if (select(wakeup + 1, &readable, NULL, NULL, &timeout) <= 0)
+        return false;
+    return read(wakeup, &value, sizeof(value)) == sizeof(value);
+}
@@ -0,0 +1,374 @@
+/*
+ * MIT License
+ * Copyright (c) 2024 William Vallet
+ */
+
+#include "wifi.h"
+#include "boot.h"
+#include "led.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_wifi.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include <assert.h>
+#include <string.h>
+
+#define LOGGER_TAG "wifi"
+
+#define WIFI_EVENT_CONNECTED        (1u << 0)
+#define WIFI_NVS_NAMESPACE          "wifi"
+#define WIFI_NVS_KEY                "ap"
+#define WIFI_VERSION                1u      // Cache record layout.
+
+// Access point cache record, stored in flash.
+typedef struct
+{
+    uint32_t version;
+    uint8_t bssid[6];
+    uint8_t channel;
+} wifi_record_t;
+
+// Wi-Fi handle.
+// Access point of last connection is cached, station connects to it
+// directly on boot (IP lease is restored by DHCP client). Station falls
+// back on a full scan if it is not found.
+typedef struct
+{
+    StaticEventGroup_t event_group;
+    wifi_link_handler_t link_handler;
+    wifi_config_t config;
+    bool cached;                // Connecting to access point cached.
+    wifi_record_t record;
+} wifi_handle_t;
+
+// Power save governor handle.
+// Station leaves modem sleep on remote activity (reported by IR decoder
+// task), so renderer responses are not delayed until next DTIM beacon,
+// and goes back to it once idle window has elapsed (timer task). Governor
+// is shared under lock, mode is applied to driver once it is started.
+typedef struct
+{
+    StaticSemaphore_t lock;
+    StaticTimer_t timer;
+    bool started;               // Driver initialised, mode can be applied.
+    bool connected;
+    wifi_power_t power;
+    uint32_t power_ms;          // Time of last mode switch.
+    uint32_t activity_ms;       // Time of last remote activity.
+    uint32_t idle_ms;           // Idle window.
+    uint64_t latencies_us[WIFI_POWER_NB_MAX];   // Sum of action latencies.
+    wifi_stats_t stats;
+} wifi_power_handle_t;
+
+static wifi_handle_t wifi_handle;
+static wifi_power_handle_t wifi_power_handle;
+
+static const char * const wifi_power_str[] = {
+    [WIFI_POWER_SLEEP] = "sleep",
+    [WIFI_POWER_ACTIVE] = "active",
+};
+
+static uint32_t wifi_time_ms(void)
+{
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+// Update Wi-Fi LED from connection and power save mode.
+// Note: called with governor lock held.
+static void wifi_led_update(const wifi_power_handle_t * const handle)
+{
+    assert(handle);
+    if (!handle->connected)
+        led_wifi_set(WIFI_NOT_CONNECTED);
+    else if (handle->power == WIFI_POWER_ACTIVE)
+        led_wifi_set(WIFI_CONNECTED);
+    else
+        led_wifi_set(WIFI_CONNECTED_SLEEP);
+}
+
+// Apply power save mode to driver, if started.
+// Note: called with governor lock held.
+static void wifi_power_apply(const wifi_power_handle_t * const handle)
+{
+    assert(handle);
+    if (!handle->started)
+        return;
+    const esp_err_t err = esp_wifi_set_ps((handle->power == WIFI_POWER_ACTIVE)
+        ? WIFI_PS_NONE : WIFI_PS_MIN_MODEM);
+    if (err != ESP_OK)
+        ESP_LOGW(LOGGER_TAG, "Power save not set mode=%s err=%s",
+            wifi_power_str[handle->power], esp_err_to_name(err));
+}
+
+// Switch power save mode, time spent in previous one is accounted.
+// Note: called with governor lock held.
+static void wifi_power_switch(
+    wifi_power_handle_t * const handle, wifi_power_t power)
+{
+    assert(handle);
+    assert(power < WIFI_POWER_NB_MAX);
+    if (power == handle->power)
+        return;
+    const uint32_t now_ms = wifi_time_ms();
+    handle->stats.modes[handle->power].time_ms += now_ms - handle->power_ms;
+    handle->power_ms = now_ms;
+    handle->power = power;
+    handle->stats.switches++;
+    wifi_power_apply(handle);
+    wifi_led_update(handle);
+}
+
+// Idle window timer handler: station goes back to modem sleep once remote
+// is idle, else timer is restarted for the rest of the window.
+static void wifi_power_timer_handler(TimerHandle_t timer)
+{
+    wifi_power_handle_t * const handle =
+        (wifi_power_handle_t *) pvTimerGetTimerID(timer);
+    assert(handle);
+    xSemaphoreTake((SemaphoreHandle_t) &handle->lock, portMAX_DELAY);
+    const uint32_t idle_ms = wifi_time_ms() - handle->activity_ms;
+    if (idle_ms < handle->idle_ms)
+        xTimerChangePeriod(timer, pdMS_TO_TICKS(handle->idle_ms - idle_ms), 0);
+    else
+        wifi_power_switch(handle, WIFI_POWER_SLEEP);
+    xSemaphoreGive((SemaphoreHandle_t) &handle->lock);
+}
+
+// Set connection state, shown by Wi-Fi LED.
+static void wifi_connected_set(bool connected)
+{
+    wifi_power_handle_t * const handle = &wifi_power_handle;
+    xSemaphoreTake((SemaphoreHandle_t) &handle->lock, portMAX_DELAY);
+    handle->connected = connected;
+    wifi_led_update(handle);
+    xSemaphoreGive((SemaphoreHandle_t) &handle->lock);
+}
+
+// Load access point record from flash.
+// Return true on success, false if there is no valid record.
+static bool wifi_load(wifi_handle_t * const handle)
+{
+    assert(handle);
+    nvs_handle_t nvs;
+    size_t size = sizeof(wifi_record_t);
+    if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK)
+        return false;
+    const esp_err_t err =
+        nvs_get_blob(nvs, WIFI_NVS_KEY, &handle->record, &size);
+    nvs_close(nvs);
+    return (err == ESP_OK) && (size == sizeof(wifi_record_t))
+        && (handle->record.version == WIFI_VERSION);
+}
+
+// Store access point connected in flash, if it has changed.
+static void wifi_store(wifi_handle_t * const handle)
+{
+    assert(handle);
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK)
+        return;
+    if ((handle->record.version == WIFI_VERSION)
+        && (memcmp(handle->record.bssid, ap.bssid, sizeof(ap.bssid)) == 0)
+        && (handle->record.channel == ap.primary))
+        return;
+    handle->record.version = WIFI_VERSION;
+    memcpy(handle->record.bssid, ap.bssid, sizeof(ap.bssid));
+    handle->record.channel = ap.primary;
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(WIFI_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_blob(nvs, WIFI_NVS_KEY, &handle->record,
+            sizeof(wifi_record_t));
+        if (err == ESP_OK)
+            err = nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+    if (err != ESP_OK)
+        ESP_LOGW(LOGGER_TAG, "Access point not stored err=%s",
+            esp_err_to_name(err));
+}
+
+// Wi-Fi and IP events handler.
+static void wifi_event_handler(
+    void *context, esp_event_base_t base, int32_t id, void *data)
+{
+    assert(context);
+    wifi_handle_t * const handle = (wifi_handle_t *) context;
+    const EventGroupHandle_t event_group =
+        (EventGroupHandle_t) &handle->event_group;
+    if ((base == WIFI_EVENT) && (id == WIFI_EVENT_STA_START))
+        esp_wifi_connect();
+    else if ((base == WIFI_EVENT) && (id == WIFI_EVENT_STA_DISCONNECTED))
+    {
+        ESP_LOGW(LOGGER_TAG, "Disconnected, reconnecting");
+        xEventGroupClearBits(event_group, WIFI_EVENT_CONNECTED);
+        wifi_connected_set(false);
+        handle->link_handler(false);
+        // Access point cached may have moved, all channels are scanned.
+        if (handle->cached)
+        {
+            handle->cached = false;
+            handle->config.sta.bssid_set = false;
+            handle->config.sta.channel = 0u;
+            handle->config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+            esp_wifi_set_config(WIFI_IF_STA, &handle->config);
+        }
+        esp_wifi_connect();
+    }
+    else if ((base == IP_EVENT) && (id == IP_EVENT_STA_GOT_IP))
+    {
+        const ip_event_got_ip_t * const event = (ip_event_got_ip_t *) data;
+        ESP_LOGI(LOGGER_TAG, "Connected ip=" IPSTR, IP2STR(&event->ip_info.ip));
+        boot_mark(BOOT_LINK_UP);
+        xEventGroupSetBits(event_group, WIFI_EVENT_CONNECTED);
+        wifi_connected_set(true);
+        handle->link_handler(true);
+        wifi_store(handle);
+    }
+}
+
+void wifi_init(
+    const char *ssid, const char *password, wifi_link_handler_t link_handler)
+{
+    assert(ssid);
+    assert(password);
+    assert(link_handler);
+    memset(&wifi_handle, 0, sizeof(wifi_handle_t));
+    xEventGroupCreateStatic(&wifi_handle.event_group);
+    wifi_handle.link_handler = link_handler;
+    // Wi-Fi driver stores its calibration data in NVS, and DHCP client its
+    // last IP lease.
+    esp_err_t err = nvs_flash_init();
+    if ((err == ESP_ERR_NVS_NO_FREE_PAGES)
+        || (err == ESP_ERR_NVS_NEW_VERSION_FOUND))
+    {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(err);
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    esp_netif_create_default_wifi_sta();
+    const wifi_init_config_t init_cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&init_cfg));
+    // Power save mode set by remote activity so far.
+    xSemaphoreTake((SemaphoreHandle_t) &wifi_power_handle.lock, portMAX_DELAY);
+    wifi_power_handle.started = true;
+    wifi_power_apply(&wifi_power_handle);
+    xSemaphoreGive((SemaphoreHandle_t) &wifi_power_handle.lock);
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(
+        WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, &wifi_handle, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(
+        IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, &wifi_handle,
+        NULL));
+    // Configure station, on access point cached if any.
+    wifi_config_t * const wifi_cfg = &wifi_handle.config;
+    strncpy((char *) wifi_cfg->sta.ssid, ssid, sizeof(wifi_cfg->sta.ssid));
+    strncpy((char *) wifi_cfg->sta.password, password,
+        sizeof(wifi_cfg->sta.password));
+    wifi_handle.cached = wifi_load(&wifi_handle);
+    if (wifi_handle.cached)
+    {
+        wifi_cfg->sta.bssid_set = true;
+        memcpy(wifi_cfg->sta.bssid, wifi_handle.record.bssid,
+            sizeof(wifi_cfg->sta.bssid));
+        wifi_cfg->sta.channel = wifi_handle.record.channel;
+        wifi_cfg->sta.scan_method = WIFI_FAST_SCAN;
+        ESP_LOGI(LOGGER_TAG, "Connecting ssid=%s bssid=" MACSTR " channel=%u",
+            ssid, MAC2STR(wifi_handle.record.bssid),
+            (unsigned int) wifi_handle.record.channel);
+    }
+    else
+        ESP_LOGI(LOGGER_TAG, "Connecting ssid=%s", ssid);
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, wifi_cfg));
+    ESP_ERROR_CHECK(esp_wifi_start());
+}
+
+void wifi_power_init(uint32_t idle_ms)
+{
+    wifi_power_handle_t * const handle = &wifi_power_handle;
+    memset(handle, 0, sizeof(wifi_power_handle_t));
+    handle->idle_ms = idle_ms;
+    handle->power = WIFI_POWER_SLEEP;
+    handle->power_ms = wifi_time_ms();
+    xSemaphoreCreateMutexStatic(&handle->lock);
+    xTimerCreateStatic("Wi-Fi power", pdMS_TO_TICKS(idle_ms), pdFALSE,
+        handle, &wifi_power_timer_handler, &handle->timer);
+}
+
+void wifi_activity(void)
+{
+    wifi_power_handle_t * const handle = &wifi_power_handle;
+    xSemaphoreTake((SemaphoreHandle_t) &handle->lock, portMAX_DELAY);
+    handle->activity_ms = wifi_time_ms();
+    // Burst begins, it is held by timer until idle.
+    if (handle->power != WIFI_POWER_ACTIVE)
+    {
+        wifi_power_switch(handle, WIFI_POWER_ACTIVE);
+        xTimerChangePeriod((TimerHandle_t) &handle->timer,
+            pdMS_TO_TICKS(handle->idle_ms), 0);
+    }
+    xSemaphoreGive((SemaphoreHandle_t) &handle->lock);
+}
+
+void wifi_latency_record(uint32_t latency_us)
+{
+    wifi_power_handle_t * const handle = &wifi_power_handle;
+    xSemaphoreTake((SemaphoreHandle_t) &handle->lock, portMAX_DELAY);
+    wifi_power_stats_t * const mode = &handle->stats.modes[handle->power];
+    mode->actions++;
+    handle->latencies_us[handle->power] += latency_us;
+    if (latency_us > mode->latency_max_us)
+        mode->latency_max_us = latency_us;
+    xSemaphoreGive((SemaphoreHandle_t) &handle->lock);
+}
+
+void wifi_stats_get(wifi_stats_t * const stats)
+{
+    assert(stats);
+    wifi_power_handle_t * const handle = &wifi_power_handle;
+    xSemaphoreTake((SemaphoreHandle_t) &handle->lock, portMAX_DELAY);
+    *stats = handle->stats;
+    stats->modes[handle->power].time_ms += wifi_time_ms() - handle->power_ms;
+    for (size_t i = 0; i < WIFI_POWER_NB_MAX; i++)
+    {
+        if (stats->modes[i].actions > 0u)
+            stats->modes[i].latency_mean_us = (uint32_t)
+                (handle->latencies_us[i] / stats->modes[i].actions);
+    }
+    xSemaphoreGive((SemaphoreHandle_t) &handle->lock);
+}
+
+void wifi_power_dump(void)
+{
+    wifi_stats_t stats;
+    wifi_stats_get(&stats);
+    ESP_LOGI(LOGGER_TAG, "Power save switches=%lu idle=%lums",
+        (unsigned long) stats.switches,
+        (unsigned long) wifi_power_handle.idle_ms);
+    ESP_LOGI(LOGGER_TAG, "%-8s %10s %8s %8s %8s",
+        "mode", "time(ms)", "actions", "mean", "max");
+    for (size_t i = 0; i < WIFI_POWER_NB_MAX; i++)
+        ESP_LOGI(LOGGER_TAG, "%-8s %10lu %8lu %8lu %8lu", wifi_power_str[i],
+            (unsigned long) stats.modes[i].time_ms,
+            (unsigned long) stats.modes[i].actions,
+            (unsigned long) stats.modes[i].latency_mean_us,
+            (unsigned long) stats.modes[i].latency_max_us);
+}
+
+bool wifi_wait_connected(uint32_t timeout_ms)
+{
+    const EventBits_t bits = xEventGroupWaitBits(
+        (EventGroupHandle_t) &wifi_handle.event_group,
+        WIFI_EVENT_CONNECTED, pdFALSE, pdTRUE, pdMS_TO_TICKS(timeout_ms));
+    return (bits & WIFI_EVENT_CONNECTED) != 0u;
+}